@@ -0,0 +1,86 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include "tokenise.h"
+
+// countshards: counts a part of the corpus into a sorted shard, and merges shards.
+//
+//   countshards count <output.shard> <file-or-directory>...
+//   countshards merge [--min-freq N] <output.shard> <input.shard>...
+//   countshards info <input.shard>...
+//
+// Run `count` on every node over its own files, copy the shards together, then `merge`
+// them (merged shards can be merged again, e.g. per rack and then globally). Pass
+// --min-freq only to the final, global merge: pruning an intermediate merge loses counts.
+// The final shard is loaded with readCountShard as the input of learn_vocabulary_from_word_counts.
+
+static int usage() {
+    std::cerr << "Usage:\n"
+              << "  countshards count <output.shard> <file-or-directory>...\n"
+              << "  countshards merge [--min-freq N] <output.shard> <input.shard>...\n"
+              << "  countshards info <input.shard>..." << std::endl;
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.size() < 2) return usage();
+    const std::string& command = args[0];
+
+    try {
+        if (command == "count" && args.size() >= 3) {
+            std::vector<std::string> file_paths;
+            for (size_t i = 2; i < args.size(); ++i) {
+                if (std::filesystem::is_directory(args[i])) {
+                    for (const auto& entry : std::filesystem::directory_iterator(args[i])) {
+                        if (entry.is_regular_file()) file_paths.push_back(entry.path().string());
+                    }
+                }
+                else {
+                    file_paths.push_back(args[i]);
+                }
+            }
+            std::cout << "-> Counting " << file_paths.size() << " files into: " << args[1] << std::endl;
+        #ifdef USE_OPENCL
+            OpenCLContext ocl;
+            tokeniser TOKENISER(1, ocl);
+        #elif USE_CUDA || USE_CPU
+            tokeniser TOKENISER(1);
+        #endif
+            TOKENISER.setNumThreads();
+            TOKENISER.buildCorpusCountShard(file_paths, args[1]);
+        }
+        else if (command == "merge") {
+            size_t first = 1;
+            uint64_t min_freq = 1;
+            if (args[first] == "--min-freq" && args.size() > first + 1) {
+                min_freq = std::stoull(args[first + 1]);
+                first += 2;
+            }
+            if (args.size() < first + 2) return usage();
+            const std::vector<std::string> inputs(args.begin() + first + 1, args.end());
+            const size_t words = mergeCountShards(inputs, args[first], min_freq);
+            std::cout << "-> Merged " << inputs.size() << " shards into " << words << " words (min frequency "
+                      << min_freq << "): " << args[first] << std::endl;
+        }
+        else if (command == "info") {
+            for (size_t i = 1; i < args.size(); ++i) {
+                CountShardReader reader;
+                reader.open(args[i]);
+                const CountShardHeader& header = reader.getHeader();
+                std::cout << args[i] << ": " << header.wordCount << " words, " << header.totalCount << " occurrences, "
+                          << header.payloadSize << " bytes" << std::endl;
+            }
+        }
+        else {
+            return usage();
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "\nFATAL ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -33,6 +33,7 @@ int main()
         const std::string path2token = "D:/train/token";
         const std::string unique_tokens_output_path = "D:/train/token/_unique_initial_tokens.csv";
         const std::string stats_output_path = "D:/train/token/_final_token_stats.csv";        
+        const std::string vocab_output_path = "D:/train/token/_vocab.csv";
 
         // Create and configure the tokenizer instance
     #ifdef USE_OPENCL
@@ -62,22 +63,25 @@ int main()
         if (corpus_word_counts.empty()) 
             throw std::runtime_error("No data loaded from files. Check file content.");
         // Step C: Save the gathered unique raw tokens to a CSV file.
-        TOKENISER.saveUniqueTokensToCSV(corpus_word_counts, unique_tokens_output_path);
-        std::cout << "-> " << std::filesystem::path(unique_tokens_output_path).filename().string() << " contains " << count_lines(unique_tokens_output_path) << " rows." << std::endl;
+        const size_t unique_rows = TOKENISER.saveUniqueTokensToCSV(corpus_word_counts, unique_tokens_output_path);
+        std::cout << "-> " << std::filesystem::path(unique_tokens_output_path).filename().string() << " contains " << unique_rows << " rows." << std::endl;
 
         std::cout << "--------------------------- 2. VOCABULARY LEARNING ---------------------------" << std::endl;
         std::vector<std::string> final_vocabulary;
         // Call the new two-stage learning function.
         TOKENISER.learn_vocabulary_from_word_counts(corpus_word_counts, num_merges, final_vocabulary);
         std::cout << "-> Vocabulary Learning complete. Final vocabulary size: " << TOKENISER.getVocabularySize() << std::endl;
+        TOKENISER.saveVocabulary(vocab_output_path);
         std::cout << "---------------------- 3. STATS & EMBEDDING GEN -----------------------" << std::endl;
         // Step A: Calculate statistics based on the final BPE vocabulary
-        TOKENISER.calculateTokenStatsFromCounts(corpus_word_counts, stats_output_path);
-        std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << count_lines(stats_output_path) << " rows." << std::endl;
+        const size_t stats_rows = TOKENISER.calculateTokenStatsFromCounts(corpus_word_counts, stats_output_path);
+        std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << stats_rows << " rows." << std::endl;
 
         // Step B: Generate embeddings using original formula
-        TOKENISER.generateAndSaveEmbeddings(path2token, 1.05f);
-        std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << count_lines(stats_output_path) << " rows." << std::endl;
+        const size_t embedding_rows = TOKENISER.generateAndSaveEmbeddings(path2token, 1.05f);
+        std::cout << "-> _embeddings_only.csv contains " << embedding_rows << " rows." << std::endl;
+        // Step C: Save everything as one binary model for fast loading (loadModel)
+        TOKENISER.saveModel(path2token + "/_model.bin");
         // std::cout << "-> " << std::filesystem::path(path2token + "/_tokenEmbedding.csv").filename().string() << " contains " << count_lines(path2token + "/_final_embeddings.csv") << " rows." << std::endl;
 
         std::cout << "-------------------------- 4. INFERENCE DEMO --------------------------" << std::endl;
@@ -91,6 +95,11 @@ int main()
         }
         std::cout << "}" << std::endl;
         std::cout << "Total tokens after tokenisation: " << tokenized_sentence.size() << std::endl;
+        std::vector<int32_t> token_ids;
+        TOKENISER.encodeToIds(test_sentence, token_ids);
+        std::string decoded_sentence;
+        TOKENISER.decodeIds(token_ids, decoded_sentence);
+        std::cout << "Token ids: " << token_ids.size() << ", decoded: \"" << decoded_sentence << "\"" << std::endl;
     }
     catch (const std::exception& e) {
         std::cerr << "\nFATAL ERROR: " << e.what() << std::endl;
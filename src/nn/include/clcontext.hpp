@@ -1,102 +1,264 @@
+#ifndef CLCONTEXT_HPP
+#define CLCONTEXT_HPP 1
+
 #ifdef USE_OPENCL
 #define CL_HPP_TARGET_OPENCL_VERSION 200
 #include <CL/cl.hpp> 
 #include <vector>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <cstdint>
 
-// Helper to check for OpenCL errors
+// Helper to check for OpenCL errors; throws so that callers can recover or report the error.
 inline void check_cl(cl_int err, const char* file, int line) {
     if (err != CL_SUCCESS) {
-        fprintf(stderr, "OpenCL Error: %d at %s:%d\n", err, file, line);
-        exit(EXIT_FAILURE);
+        throw std::runtime_error("OpenCL Error: " + std::to_string(err) + " at " + file + ":" + std::to_string(line));
     }
 }
 #define CHECK_CL(err) check_cl(err, __FILE__, __LINE__)
 
 // source for token embedding
-const std::string embeddingFormulaSource = R"CLC(
-    // Basic XorShift32 PRNG for OpenCL
-    // seed must be unique per work-item
-    unsigned int xorshift32(unsigned int x) {
-        x ^= x << 13;
-        x ^= x >> 17;
-        x ^= x << 5;
-        return x;
+// Same formula, generator and Poisson table layout as embeddingformula.hpp (src/token):
+// embedding[i][j] = k(i, j) * (sin(i + 1) + cos(j - 1)) * 0.1 + 0.01, k ~ Poisson(r1).
+// The row reductions use local memory only, so the programs build as OpenCL C 1.2.
+// Sum over one work-group by a local-memory tree reduction; the work-group size must be a
+// power of 2 up to 256 (rowWorkGroupSize in kernelcl.cpp). Every work-item receives the sum.
+const std::string rowReduceSource = R"CLC(
+    float row_reduce_add(float value, __local float* scratch) {
+        const int tid = get_local_id(0);
+        scratch[tid] = value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int stride = get_local_size(0) / 2; stride > 0; stride >>= 1) {
+            if (tid < stride) scratch[tid] += scratch[tid + stride];
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+        return scratch[0];
     }
+)CLC";
+
 
-    // Function to convert a normalized [0,1] float to a custom range [r1, r2]
-    float scale_random(unsigned int* seed_ptr, float r1) {
-        // Generate a random unsigned int
-        *seed_ptr = xorshift32(*seed_ptr);
-        // Convert to float in [0, 1] range
-        float normalized_val = (float)(*seed_ptr) / (float)0xFFFFFFFFU;
-        return r1 + normalized_val * (10.0f - r1);
+const std::string embeddingFormulaSource = rowReduceSource + R"CLC(
+    // Counter-based generator (SplitMix64 of seed + (counter + 1) * golden ratio)
+    uint embedding_random(ulong seed, ulong counter) {
+        ulong x = seed + (counter + 1) * 0x9E3779B97F4A7C15UL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+        x ^= x >> 31;
+        return (uint)(x >> 32);
     }
 
-    __kernel void generate_embeddings(
+    // Poisson draw from a PoissonTable: 256 guide entries, then the 24-bit CDF thresholds
+    uint sample_poisson(__global const uint* table, uint random_bits) {
+        const uint v = random_bits >> 8;
+        uint k = table[v >> 16];
+        while (v >= table[256 + k]) ++k;
+        return k;
+    }
+
+    // Fused kernel: one work-group generates one row and writes its inverse too
+    __kernel void generate_embeddings_with_inverse(
         __global float* embeddings_out,
-        const int d_dim,
-        const float r1,
-        const unsigned int initial_seed_offset) {
+        __global float* inverses_out,
+        __global const uint* poisson_table,
+        const int d,
+        const ulong seed) {
 
-        int global_id = get_global_id(0); // 0-indexed global work-item ID
-        // int total_elements = get_global_size(0); // Not directly used in this snippet
+        __local float scratch[256];
+        const int row_idx = get_group_id(0);
+        const int tid = get_local_id(0);
+        const int local_size = get_local_size(0);
+        __global float* row = embeddings_out + (ulong)row_idx * d;
+        const float row_sin = sin((float)(row_idx + 1));
+        const ulong first_counter = (ulong)row_idx * d;
 
-        // --- MISSING LINE ADDED HERE ---
-        unsigned int seed = initial_seed_offset + global_id + 1; // Declare and initialize 'seed' for this work-item
+        float sum = 0.0f;
+        for (int j = tid; j < d; j += local_size) {
+            const float k = (float)sample_poisson(poisson_table, embedding_random(seed, first_counter + j));
+            const float value = k * (row_sin + cos((float)(j - 1))) * 0.1f + 0.01f;
+            row[j] = value;
+            sum += value * value;
+        }
 
-        // Generate random float in [r1, r2] using the local 'seed'
-        embeddings_out[global_id] = scale_random(&seed, r1, r2);
+        const float squared_magnitude = row_reduce_add(sum, scratch);
+        __global float* inverse = inverses_out + (ulong)row_idx * d;
+        for (int j = tid; j < d; j += local_size) {
+            inverse[j] = squared_magnitude > 1e-9f ? row[j] / squared_magnitude : 0.0f;
+        }
     }
 )CLC";
 
 
-const std::string vectorInverseSource = R"CLC(
+const std::string vectorInverseSource = rowReduceSource + R"CLC(
+    // One work-group per row (vector); the work-items loop over the columns, so any d works.
     __kernel void batchedVectorInverseKernel(
         __global float* output, __global const float* input, 
-        const int N, const int d, __local float* s_data)
+        const int N, const int d)
     {
-        // Identify which row (vector) this work-group is working on.
-        const int row_idx = get_group_id(1);
+        __local float scratch[256];
+        const int row_idx = get_group_id(0);
+        const int tid = get_local_id(0);
+        const int local_size = get_local_size(0);
+        __global const float* row = input + (ulong)row_idx * d;
 
-        // Identify the thread's local and global column indices.
-        const int tid_in_block = get_local_id(0);
-        const int col_idx = get_global_id(0);
+        // --- Step 1: Reduction to find the squared magnitude ---
+        float sum = 0.0f;
+        for (int j = tid; j < d; j += local_size) {
+            sum += row[j] * row[j];
+        }
+        const float squared_magnitude = row_reduce_add(sum, scratch);
 
-        // --- Step 1: Parallel Reduction to find the squared magnitude ---
-        float my_val = 0.0f;
-        if (col_idx < d) {
-            my_val = input[row_idx * d + col_idx];
+        // --- Step 2: Element-wise division ---
+        for (int j = tid; j < d; j += local_size) {
+            output[(ulong)row_idx * d + j] = squared_magnitude > 1e-9f ? row[j] / squared_magnitude : 0.0f;
         }
-        
-        s_data[tid_in_block] = my_val * my_val;
+    }
+)CLC";
 
-        // Synchronize to make sure all work-items have written to local memory.
-        barrier(CLK_LOCAL_MEM_FENCE);
 
-        // Perform the reduction in local memory.
-        for (unsigned int s = get_local_size(0) / 2; s > 0; s >>= 1) {
-            if (tid_in_block < s) {
-                s_data[tid_in_block] += s_data[tid_in_block + s];
-            }
-            barrier(CLK_LOCAL_MEM_FENCE);
+const std::string gatherEmbeddingsSource = R"CLC(
+    // One work-group per output row: copies the embedding row of ids[row], or zeros for
+    // ids outside [0, N) (unknown characters, padding).
+    __kernel void gather_embeddings(
+        __global float* output, __global const float* embeddings,
+        __global const int* ids, const int N, const int d)
+    {
+        const int row_idx = get_group_id(0);
+        const int tid = get_local_id(0);
+        const int local_size = get_local_size(0);
+        const int id = ids[row_idx];
+        __global float* row = output + (ulong)row_idx * d;
+
+        if (id >= 0 && id < N) {
+            __global const float* src = embeddings + (ulong)id * d;
+            for (int j = tid; j < d; j += local_size) row[j] = src[j];
+        }
+        else {
+            for (int j = tid; j < d; j += local_size) row[j] = 0.0f;
         }
+    }
+)CLC";
 
-        // The first work-item holds the final result.
-        const float squared_magnitude = s_data[0];
 
-        // --- Step 2: Element-wise division ---
-        if (col_idx < d) {
-            if (squared_magnitude > 1e-9f) {
-                output[row_idx * d + col_idx] = my_val / squared_magnitude;
-            } else {
-                output[row_idx * d + col_idx] = 0.0f;
-            }
+/**
+ * @brief Device buffers that stay allocated between calls, plus a pinned host staging area.
+ * `embeddings` and `deEmbeddings` hold `capacity` floats each on the device; they only grow.
+ * `pinnedHost` is a CL_MEM_ALLOC_HOST_PTR buffer of 2 x capacity floats that stays mapped at
+ * `hostPtr` (first half for embeddings, second half for deEmbeddings), so reads and writes
+ * between host and device go through page-locked memory and can be issued asynchronously.
+ * `residentEmbeddings` is the version (tokeniser::embeddingsChanged) of the matrix held in
+ * `embeddings` (0 = none), so batches of token ids are gathered without uploading it again;
+ * `ids`, `gathered` and `pinnedGathered` hold the last batch.
+ */
+class OpenCLDeviceBuffers {
+public:
+    cl::Buffer embeddings;
+    cl::Buffer deEmbeddings;
+    cl::Buffer pinnedHost;
+    float* hostPtr = nullptr;
+    size_t capacity = 0;        // floats per device buffer
+    cl::Buffer poissonTable;    // lookup table of the embedding kernel
+    size_t poissonCapacity = 0;
+    uint64_t residentEmbeddings = 0;
+    cl::Buffer ids;
+    cl::Buffer gathered;
+    cl::Buffer pinnedGathered;
+    float* gatheredHostPtr = nullptr;
+    size_t gatherCapacity = 0;      // ids per batch
+    size_t gatheredCapacity = 0;    // floats per batch
+
+    OpenCLDeviceBuffers(const cl::Context& context, const cl::CommandQueue& queue) : context(context), queue(queue) {}
+    OpenCLDeviceBuffers(const OpenCLDeviceBuffers&) = delete;
+    OpenCLDeviceBuffers& operator=(const OpenCLDeviceBuffers&) = delete;
+    ~OpenCLDeviceBuffers() { unmap(); unmapGathered(); }
+
+    /**
+     * @brief Makes sure every buffer holds at least `elements` floats (contents are not kept when growing).
+     * @throws std::runtime_error if an allocation fails.
+     */
+    void reserve(size_t elements) {
+        if (elements <= capacity) return;
+        unmap();
+        capacity = 0;
+        residentEmbeddings = 0;
+        cl_int err;
+        embeddings = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * elements, NULL, &err);
+        CHECK_CL(err);
+        deEmbeddings = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * elements, NULL, &err);
+        CHECK_CL(err);
+        pinnedHost = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, 2 * sizeof(float) * elements, NULL, &err);
+        CHECK_CL(err);
+        hostPtr = static_cast<float*>(queue.enqueueMapBuffer(pinnedHost, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                                             0, 2 * sizeof(float) * elements, NULL, NULL, &err));
+        CHECK_CL(err);
+        capacity = elements;
+    }
+
+    /**
+     * @brief Copies a lookup table (PoissonTable::data()) to the device; the buffer only grows.
+     * @throws std::runtime_error on any OpenCL error.
+     */
+    void uploadPoissonTable(const std::vector<uint32_t>& table) {
+        cl_int err;
+        if (table.size() > poissonCapacity) {
+            poissonTable = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(uint32_t) * table.size(), NULL, &err);
+            CHECK_CL(err);
+            poissonCapacity = table.size();
         }
+        err = queue.enqueueWriteBuffer(poissonTable, CL_TRUE, 0, sizeof(uint32_t) * table.size(), table.data());
+        CHECK_CL(err);
     }
-)CLC";
+
+    /**
+     * @brief Makes sure the gather buffers hold at least `count` ids and `elements` output floats.
+     * Like reserve(), the buffers only grow and their contents are not kept when growing.
+     * @throws std::runtime_error if an allocation fails.
+     */
+    void reserveGather(size_t count, size_t elements) {
+        cl_int err;
+        if (count > gatherCapacity) {
+            ids = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(cl_int) * count, NULL, &err);
+            CHECK_CL(err);
+            gatherCapacity = count;
+        }
+        if (elements > gatheredCapacity) {
+            unmapGathered();
+            gatheredCapacity = 0;
+            gathered = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * elements, NULL, &err);
+            CHECK_CL(err);
+            pinnedGathered = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(float) * elements, NULL, &err);
+            CHECK_CL(err);
+            gatheredHostPtr = static_cast<float*>(queue.enqueueMapBuffer(pinnedGathered, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                                                         0, sizeof(float) * elements, NULL, NULL, &err));
+            CHECK_CL(err);
+            gatheredCapacity = elements;
+        }
+    }
+
+    float* hostEmbeddings() { return hostPtr; }
+    float* hostDeEmbeddings() { return hostPtr + capacity; }
+
+private:
+    cl::Context context;
+    cl::CommandQueue queue;
+
+    void unmap() {
+        if (hostPtr != nullptr) {
+            queue.enqueueUnmapMemObject(pinnedHost, hostPtr);
+            queue.finish();
+            hostPtr = nullptr;
+        }
+    }
+
+    void unmapGathered() {
+        if (gatheredHostPtr != nullptr) {
+            queue.enqueueUnmapMemObject(pinnedGathered, gatheredHostPtr);
+            queue.finish();
+            gatheredHostPtr = nullptr;
+        }
+    }
+};
 
 
 // Singleton to manage the global OpenCL context, device, and queue
@@ -107,6 +269,13 @@ public:
     cl::CommandQueue queue;
     cl::Program embeddingProgram;
     cl::Program inverseProgram;
+    cl::Program gatherProgram;
+    // Kernels are created once after the programs are built and reused by every call.
+    cl::Kernel embeddingKernel;
+    cl::Kernel inverseKernel;
+    cl::Kernel gatherKernel;
+    // Device-resident embedding buffers; copies of the context share them.
+    std::shared_ptr<OpenCLDeviceBuffers> buffers;
 
     static OpenCLContext& getInstance() {
         static OpenCLContext instance;
@@ -136,21 +305,37 @@ public:
         // Compile the kernels
         embeddingProgram = cl::Program(context, embeddingFormulaSource);
         inverseProgram = cl::Program(context, vectorInverseSource);
+        gatherProgram = cl::Program(context, gatherEmbeddingsSource);
 
         cl_int err;
         err = embeddingProgram.build({device});
         if (err != CL_SUCCESS) {
             std::string log = embeddingProgram.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
             std::cerr << "OpenCL Kernel Build Error (embeddingProgram):\n" << log << std::endl;
-            exit(EXIT_FAILURE);
+            throw std::runtime_error("Failed to build the OpenCL embedding program.");
         }
 
         err = inverseProgram.build({device});
         if (err != CL_SUCCESS) {
             std::string log = inverseProgram.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
             std::cerr << "OpenCL Kernel Build Error (inverseProgram):\n" << log << std::endl;
-            exit(EXIT_FAILURE);
+            throw std::runtime_error("Failed to build the OpenCL inverse program.");
+        }
+
+        err = gatherProgram.build({device});
+        if (err != CL_SUCCESS) {
+            std::string log = gatherProgram.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+            std::cerr << "OpenCL Kernel Build Error (gatherProgram):\n" << log << std::endl;
+            throw std::runtime_error("Failed to build the OpenCL gather program.");
         }
+
+        embeddingKernel = cl::Kernel(embeddingProgram, "generate_embeddings_with_inverse", &err);
+        CHECK_CL(err);
+        inverseKernel = cl::Kernel(inverseProgram, "batchedVectorInverseKernel", &err);
+        CHECK_CL(err);
+        gatherKernel = cl::Kernel(gatherProgram, "gather_embeddings", &err);
+        CHECK_CL(err);
+        buffers = std::make_shared<OpenCLDeviceBuffers>(context, queue);
     }
 
     // Since this is a singleton, delete copy/move to prevent unintended copies
@@ -160,4 +345,6 @@ public:
     OpenCLContext& operator=(OpenCLContext&&) = default;
 };
 
-#endif
\ No newline at end of file
+#endif
+
+#endif // CLCONTEXT_HPP
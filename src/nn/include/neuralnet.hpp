@@ -2,6 +2,7 @@
 #define NEURALNET_HPP
 #include "clcontext.hpp"
 #include <vector>
+#include <span>
 #include <cmath>
 
 /*
@@ -14,10 +15,10 @@ struct layer {
 // neural network for embedding training
 class neuralNet {
 private:
-    int in;             // input dimension
-    int out;            // output dimension
-    int layers;         // number of hidden layers (excluding input and output)
-    int type;           // type of activation funtion
+    int in = 0;         // input dimension
+    int out = 0;        // output dimension
+    int layers = 0;     // number of hidden layers (excluding input and output)
+    int type = 0;       // type of activation funtion
 
     std::vector<std::vector<std::vector<float>>> weights;       // hidden weights (input + hidden layers + ouput)
     std::vector<std::vector<float>> biases;                     // biases for all weights layers
@@ -27,6 +28,18 @@ private:
     std::vector<std::vector<float>> gbiases;                    // gradients of biases (if needed)
     std::vector<std::vector<int>> layerDimensions;              // 2 rows (lenghth, breadth)
 
+    // batched input of the forward pass: batchSize x seqLen rows of `in` values
+    // (e.g. tokeniser::gatherEmbeddings), not owned
+    int batchSize = 0;
+    int seqLen = 0;
+#ifdef USE_CPU
+    std::span<const float> inputBatch;
+#elif USE_CUDA
+    const float* inputBatch = nullptr;      // device memory (tokeniser::cuGatherEmbeddingsToDevice)
+#elif USE_OPENCL
+    cl::Buffer inputBatch;                  // device buffer (tokeniser::clGatherEmbeddingsToDevice)
+#endif
+
 public:
 
 #ifdef USE_OPENCL
@@ -48,6 +61,17 @@ public:
     void getType();
 
 
+    // batched input for forprop; the data must stay valid until the forward pass has run
+#ifdef USE_CPU
+    void setInputBatch(std::span<const float> batch, int batchSize, int seqLen);
+#elif USE_CUDA
+    void setInputBatch(const float* deviceBatch, int batchSize, int seqLen);
+#elif USE_OPENCL
+    void setInputBatch(const cl::Buffer& batch, int batchSize, int seqLen);
+#endif
+    int getBatchSize() const { return batchSize; }
+    int getSeqLen() const { return seqLen; }
+
     void initialisHe();
     void initialiseXavier();
     void initialiseLeCunn();
@@ -1,3 +1,41 @@
 
 #include "include/neuralnet.hpp"
 
+#include <stdexcept>
+
+
+/**
+ * @brief Sets the input of the next forward pass to a batch of sequences.
+ * The batch holds batchSize x seqLen rows of `in` values, row b * seqLen + t being
+ * position t of sequence b (the layout of tokeniser::gatherEmbeddings for an EncodedBatch).
+ * The network keeps a view of the data; it is not copied.
+ * @throws std::runtime_error if the dimensions do not match the batch.
+ */
+#ifdef USE_CPU
+void neuralNet::setInputBatch(std::span<const float> batch, int batchSize, int seqLen) {
+    if (batchSize < 0 || seqLen < 0 || batch.size() != static_cast<size_t>(batchSize) * seqLen * in) {
+        throw std::runtime_error("Input batch size does not match batchSize x seqLen x input dimension.");
+    }
+    this->inputBatch = batch;
+    this->batchSize = batchSize;
+    this->seqLen = seqLen;
+}
+#elif USE_CUDA
+void neuralNet::setInputBatch(const float* deviceBatch, int batchSize, int seqLen) {
+    if (batchSize < 0 || seqLen < 0 || (deviceBatch == nullptr && batchSize * seqLen > 0)) {
+        throw std::runtime_error("Invalid input batch.");
+    }
+    this->inputBatch = deviceBatch;
+    this->batchSize = batchSize;
+    this->seqLen = seqLen;
+}
+#elif USE_OPENCL
+void neuralNet::setInputBatch(const cl::Buffer& batch, int batchSize, int seqLen) {
+    if (batchSize < 0 || seqLen < 0) {
+        throw std::runtime_error("Invalid input batch.");
+    }
+    this->inputBatch = batch;
+    this->batchSize = batchSize;
+    this->seqLen = seqLen;
+}
+#endif
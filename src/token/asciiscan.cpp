@@ -0,0 +1,234 @@
+// asciiscan.cpp
+#include "include/asciiscan.hpp"
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ASCIISCAN_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASCIISCAN_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ASCIISCAN_NEON 1
+#endif
+
+
+/*
+ * Range checks are done as one unsigned comparison: c is in [lo, lo + n) iff
+ * (c - lo) < n as an unsigned byte. x86 only has signed byte comparisons, so the
+ * offset is shifted by 0x80 and the comparison is done against -128 + n instead.
+ */
+#if defined(ASCIISCAN_AVX2)
+
+static inline __m256i inRange(__m256i v, char lo, char n) {
+    const __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + n)), shifted);
+}
+
+static inline void classify32(const char* p, uint32_t& alpha, uint32_t& upper, uint32_t& space) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i up = inRange(v, 'A', 26);
+    const __m256i lo = inRange(v, 'a', 26);
+    const __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange(v, '\t', 5));
+    upper = static_cast<uint32_t>(_mm256_movemask_epi8(up));
+    alpha = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(up, lo)));
+    space = static_cast<uint32_t>(_mm256_movemask_epi8(sp));
+}
+
+#elif defined(ASCIISCAN_SSE2)
+
+static inline __m128i inRange(__m128i v, char lo, char n) {
+    const __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + n)));
+}
+
+static inline void classify16(const char* p, uint32_t& alpha, uint32_t& upper, uint32_t& space) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i up = inRange(v, 'A', 26);
+    const __m128i lo = inRange(v, 'a', 26);
+    const __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange(v, '\t', 5));
+    upper = static_cast<uint32_t>(_mm_movemask_epi8(up));
+    alpha = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(up, lo)));
+    space = static_cast<uint32_t>(_mm_movemask_epi8(sp));
+}
+
+#elif defined(ASCIISCAN_NEON)
+
+// NEON has no movemask; weight each lane by its bit and add the halves horizontally.
+static inline uint32_t movemask16(uint8x16_t m) {
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t t = vandq_u8(m, vld1q_u8(weights));
+    return static_cast<uint32_t>(vaddv_u8(vget_low_u8(t))) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(t))) << 8);
+}
+
+static inline void classify16(const char* p, uint32_t& alpha, uint32_t& upper, uint32_t& space) {
+    const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+    const uint8x16_t up = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+    const uint8x16_t lo = vcltq_u8(vsubq_u8(v, vdupq_n_u8('a')), vdupq_n_u8(26));
+    const uint8x16_t sp = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vcltq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(5)));
+    upper = movemask16(up);
+    alpha = movemask16(vorrq_u8(up, lo));
+    space = movemask16(sp);
+}
+
+#endif
+
+
+// Classifies exactly 64 readable bytes.
+static inline AsciiBlockMasks classify64(const char* p) {
+    AsciiBlockMasks m{ 0, 0, 0 };
+#if defined(ASCIISCAN_AVX2)
+    for (int i = 0; i < 64; i += 32) {
+        uint32_t alpha, upper, space;
+        classify32(p + i, alpha, upper, space);
+        m.alpha |= static_cast<uint64_t>(alpha) << i;
+        m.upper |= static_cast<uint64_t>(upper) << i;
+        m.space |= static_cast<uint64_t>(space) << i;
+    }
+#elif defined(ASCIISCAN_SSE2) || defined(ASCIISCAN_NEON)
+    for (int i = 0; i < 64; i += 16) {
+        uint32_t alpha, upper, space;
+        classify16(p + i, alpha, upper, space);
+        m.alpha |= static_cast<uint64_t>(alpha) << i;
+        m.upper |= static_cast<uint64_t>(upper) << i;
+        m.space |= static_cast<uint64_t>(space) << i;
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        const unsigned char c = static_cast<unsigned char>(p[i]);
+        m.alpha |= static_cast<uint64_t>(asciiIsAlpha(c)) << i;
+        m.upper |= static_cast<uint64_t>(asciiIsUpper(c)) << i;
+        m.space |= static_cast<uint64_t>(asciiIsSpace(c)) << i;
+    }
+#endif
+    return m;
+}
+
+
+/**
+ * @brief Classifies up to 64 bytes into letter, upper-case and space masks.
+ * Short blocks are copied into a zeroed buffer first so the vector loads never read
+ * past `count`; the padding bytes classify as "other".
+ * @param bytes Start of the bytes.
+ * @param count Number of bytes, at most 64.
+ * @return Masks where bit i describes bytes[i].
+ */
+AsciiBlockMasks classifyAsciiBlock(const char* bytes, size_t count) {
+    if (count >= 64) return classify64(bytes);
+
+    alignas(64) char block[64] = {};
+    std::memcpy(block, bytes, count);
+    return classify64(block);
+}
+
+
+/**
+ * @brief Lower-cases ASCII letters (A-Z) in bulk; all other bytes are copied unchanged.
+ * @param src Source bytes.
+ * @param count Number of bytes.
+ * @param dst Destination, at least `count` bytes (may equal `src`).
+ */
+void lowercaseAscii(const char* src, size_t count, char* dst) {
+    size_t i = 0;
+#if defined(ASCIISCAN_AVX2)
+    for (; i + 32 <= count; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i up = inRange(v, 'A', 26);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi8(v, _mm256_and_si256(up, _mm256_set1_epi8(0x20))));
+    }
+#elif defined(ASCIISCAN_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i up = inRange(v, 'A', 26);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi8(v, _mm_and_si128(up, _mm_set1_epi8(0x20))));
+    }
+#elif defined(ASCIISCAN_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(src + i));
+        const uint8x16_t up = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+        vst1q_u8(reinterpret_cast<uint8_t*>(dst + i), vaddq_u8(v, vandq_u8(up, vdupq_n_u8(0x20))));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = asciiToLower(static_cast<unsigned char>(src[i]));
+    }
+}
+
+std::string lowercaseAscii(std::string_view text) {
+    std::string lowered(text.size(), '\0');
+    lowercaseAscii(text.data(), text.size(), lowered.data());
+    return lowered;
+}
+
+
+/**
+ * @brief Builds the class bitmaps for a piece of text, 64 bytes per step.
+ * @param text The text to classify; it is not retained.
+ */
+void AsciiMasks::classify(std::string_view text) {
+    length = text.size();
+    const size_t words = length / 64 + 1 + (length % 64 != 0); // one zero word of padding
+    alphaBits.assign(words, 0);
+    upperBits.assign(words, 0);
+    spaceBits.assign(words, 0);
+
+    for (size_t w = 0; w * 64 < length; ++w) {
+        const AsciiBlockMasks m = classifyAsciiBlock(text.data() + w * 64, length - w * 64);
+        alphaBits[w] = m.alpha;
+        upperBits[w] = m.upper;
+        spaceBits[w] = m.space;
+    }
+}
+
+uint64_t AsciiMasks::bitsAt(const std::vector<uint64_t>& bitmap, size_t pos) {
+    const size_t w = pos >> 6;
+    const unsigned shift = pos & 63;
+    if (w >= bitmap.size()) return 0;
+    uint64_t bits = bitmap[w] >> shift;
+    if (shift != 0 && w + 1 < bitmap.size()) bits |= bitmap[w + 1] << (64 - shift);
+    return bits;
+}
+
+size_t AsciiMasks::firstClear(const std::vector<uint64_t>& bitmap, size_t pos) const {
+    if (pos >= length) return length;
+    size_t w = pos >> 6;
+    uint64_t clear = ~bitmap[w] & (~0ULL << (pos & 63));
+    while (clear == 0) {
+        clear = ~bitmap[++w]; // the zero padding word guarantees termination
+    }
+    const size_t found = w * 64 + std::countr_zero(clear);
+    return found < length ? found : length;
+}
+
+
+/**
+ * @brief Finds the camelCase split points of the text range [begin, end).
+ * A split happens before position i when a lower-case letter is followed by an
+ * upper-case one ("camel|Case"), or when an upper-case run is followed by a capitalised
+ * word ("HTTP|Request"), exactly as in `pre_split_word`. Positions are evaluated 64 at
+ * a time from shifted copies of the masks.
+ * @param begin Start of the range.
+ * @param end End of the range (exclusive).
+ * @param splits Output: split positions in increasing order (appended).
+ */
+void AsciiMasks::camelCaseSplits(size_t begin, size_t end, std::vector<size_t>& splits) const {
+    for (size_t pos = begin + 1; pos < end; pos += 64) {
+        const size_t span = end - pos;
+        const uint64_t in_range = span >= 64 ? ~0ULL : (1ULL << span) - 1;
+        // Bit j of each mask refers to position pos + j; the next character must lie before `end`.
+        const uint64_t next_in_range = span - 1 >= 64 ? ~0ULL : (1ULL << (span - 1)) - 1;
+
+        const uint64_t upper = bitsAt(upperBits, pos);
+        const uint64_t prev_upper = bitsAt(upperBits, pos - 1);
+        const uint64_t prev_lower = bitsAt(alphaBits, pos - 1) & ~prev_upper;
+        const uint64_t next_lower = bitsAt(alphaBits, pos + 1) & ~bitsAt(upperBits, pos + 1) & next_in_range;
+
+        uint64_t split = ((prev_lower & upper) | (prev_upper & upper & next_lower)) & in_range;
+        while (split != 0) {
+            splits.push_back(pos + std::countr_zero(split));
+            split &= split - 1;
+        }
+    }
+}
@@ -0,0 +1,518 @@
+// bpe.cpp
+#include "include/bpe.hpp"
+#include "include/threadpool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <stdexcept>
+#include <string>
+
+// Below this many affected words a merge is applied on the calling thread.
+static constexpr size_t PARALLEL_MERGE_MIN_WORDS = 8192;
+// The inverted index is compacted once the postings added since the last compaction reach half
+// of all postings (each added posting roughly stands for one that went stale), and at least this many.
+static constexpr size_t COMPACT_MIN_POSTINGS = 4096;
+
+
+BpeTrainer::BpeTrainer() {
+    endOfWord = intern("</w>");
+    wordOffset.push_back(0);
+}
+
+
+/**
+ * @brief Returns the id of a symbol, adding it to the symbol table if needed.
+ * Different merges that produce the same string (e.g. "a"+"bc" and "ab"+"c")
+ * map to the same id, exactly as they would when symbols are compared as strings.
+ * @param symbol The symbol string.
+ * @return The symbol's id.
+ */
+uint32_t BpeTrainer::intern(std::string_view symbol) {
+    auto it = symbolIds.find(std::string(symbol));
+    if (it != symbolIds.end()) return it->second;
+
+    const uint32_t id = static_cast<uint32_t>(symbols.size());
+    symbols.emplace_back(symbol);
+    symbolIds.emplace(symbols.back(), id);
+    return id;
+}
+
+
+/**
+ * @brief Adds a word as a character-level sequence followed by the end-of-word marker.
+ * Words must be added in lexicographic order to reproduce the reference merge order,
+ * since inverted-index postings are visited in insertion order.
+ * @param word The word to add.
+ * @param freq The word's frequency in the corpus.
+ * @throws std::runtime_error if the words would exceed MAX_WORD_SYMBOLS symbols in total.
+ */
+void BpeTrainer::addWord(std::string_view word, int freq) {
+    if (word.length() + 1 > MAX_WORD_SYMBOLS - wordSymbols.size()) {
+        throw std::runtime_error("BPE training input exceeds " + std::to_string(MAX_WORD_SYMBOLS) + " symbols in total.");
+    }
+    for (char c : word) {
+        wordSymbols.push_back(intern(std::string_view(&c, 1)));
+    }
+    wordSymbols.push_back(endOfWord);
+
+    wordFreq.push_back(freq);
+    wordLength.push_back(static_cast<uint32_t>(word.length() + 1));
+    wordOffset.push_back(static_cast<uint32_t>(wordSymbols.size()));
+}
+
+
+/**
+ * @brief Builds the initial pair statistics, inverted index and heap (once, before merging).
+ */
+void BpeTrainer::buildIndex() {
+    pairStats.clear();
+    invertedIndex.clear();
+    totalPostings = 0;
+    staleVisits = 0;
+
+    for (uint32_t w = 0; w < wordFreq.size(); ++w) {
+        const uint32_t* word = wordSymbols.data() + wordOffset[w];
+        const uint32_t length = wordLength[w];
+        if (length < 2) continue;
+        for (uint32_t i = 0; i + 1 < length; ++i) {
+            const PairKey key = makePair(word[i], word[i + 1]);
+            pairStats[key] += wordFreq[w];
+            addPosting(key, w);
+        }
+    }
+    addedPostings = 0;
+    heapRebuild();
+    wordStamp.assign(wordFreq.size(), 0);
+    mergeCount = 0;
+    mergeHistory.clear();
+    baseSymbols = static_cast<uint32_t>(symbols.size());
+}
+
+
+// Heap order: higher frequency first, then the lexicographically smaller string pair.
+bool BpeTrainer::heapLower(const HeapEntry& a, const HeapEntry& b) const {
+    if (a.freq != b.freq) return a.freq < b.freq;
+    if (a.key == b.key) return false;
+
+    const uint32_t a_left = pairLeft(a.key), b_left = pairLeft(b.key);
+    if (a_left != b_left) return symbols[a_left] > symbols[b_left];
+    return symbols[pairRight(a.key)] > symbols[pairRight(b.key)];
+}
+
+void BpeTrainer::heapPush(PairKey key, long long freq) {
+    heap.push_back({ freq, key });
+    std::push_heap(heap.begin(), heap.end(), [this](const HeapEntry& a, const HeapEntry& b) { return heapLower(a, b); });
+}
+
+// Rebuilds the heap from the live counts, dropping every stale entry.
+void BpeTrainer::heapRebuild() {
+    heap.clear();
+    heap.reserve(pairStats.size());
+    for (const auto& p : pairStats) {
+        heap.push_back({ p.second, p.first });
+    }
+    std::make_heap(heap.begin(), heap.end(), [this](const HeapEntry& a, const HeapEntry& b) { return heapLower(a, b); });
+}
+
+// Applies a count change to a pair and records the new count in the heap.
+void BpeTrainer::updatePair(PairKey key, long long delta) {
+    auto it = pairStats.try_emplace(key, 0).first;
+    it->second += delta;
+    if (it->second <= 0) {
+        pairStats.erase(it);
+    } else {
+        heapPush(key, it->second);
+    }
+}
+
+
+// Adds a word to a pair's posting list unless it was the last word added to it.
+void BpeTrainer::addPosting(PairKey key, uint32_t word) {
+    std::vector<uint32_t>& words = invertedIndex[key];
+    if (!words.empty() && words.back() == word) return;
+    words.push_back(word);
+    ++totalPostings;
+    ++addedPostings;
+}
+
+bool BpeTrainer::wordHasPair(uint32_t word, PairKey key) const {
+    const uint32_t* symbols_of_word = wordSymbols.data() + wordOffset[word];
+    const uint32_t left = pairLeft(key), right = pairRight(key);
+    for (uint32_t k = 0; k + 1 < wordLength[word]; ++k) {
+        if (symbols_of_word[k] == left && symbols_of_word[k + 1] == right) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Sorts and deduplicates every posting list and drops the words that no longer
+ * contain the list's pair (their pair was consumed by a neighbouring merge), then drops
+ * the lists that became empty. Lists are compacted in parallel on the pool if there is one.
+ */
+void BpeTrainer::compactIndex() {
+    std::vector<std::pair<const PairKey, std::vector<uint32_t>>*> lists;
+    lists.reserve(invertedIndex.size());
+    for (auto& entry : invertedIndex) lists.push_back(&entry);
+
+    auto compact_lists = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            const PairKey key = lists[i]->first;
+            std::vector<uint32_t>& words = lists[i]->second;
+            std::sort(words.begin(), words.end());
+            words.erase(std::unique(words.begin(), words.end()), words.end());
+            words.erase(std::remove_if(words.begin(), words.end(), [&](uint32_t w) { return !wordHasPair(w, key); }), words.end());
+            if (words.capacity() > 2 * words.size() + 16) words.shrink_to_fit();
+        }
+    };
+    if (pool != nullptr && pool->size() > 1) pool->parallelFor(0, lists.size(), 256, compact_lists);
+    else compact_lists(0, lists.size());
+
+    totalPostings = 0;
+    for (auto it = invertedIndex.begin(); it != invertedIndex.end(); ) {
+        totalPostings += it->second.size();
+        it = it->second.empty() ? invertedIndex.erase(it) : std::next(it);
+    }
+    addedPostings = 0;
+}
+
+
+/**
+ * @brief Applies a merge to a set of words and records the resulting pair changes.
+ * The words are rewritten in place; pair statistics are not touched, the changes are
+ * accumulated in `delta` instead so that chunks can run concurrently.
+ * @param words Ids of the words to update (each word at most once).
+ * @param count Number of word ids.
+ * @param left Left symbol of the merged pair.
+ * @param right Right symbol of the merged pair.
+ * @param merged Symbol that replaces the pair.
+ * @param delta Output: pair-count changes and new inverted-index postings, in word order.
+ */
+void BpeTrainer::applyMerge(const uint32_t* words, size_t count, uint32_t left, uint32_t right, uint32_t merged, MergeDelta& delta) {
+    for (size_t n = 0; n < count; ++n) {
+        const uint32_t w = words[n];
+        uint32_t* symbols_of_word = wordSymbols.data() + wordOffset[w];
+        const uint32_t length = wordLength[w];
+        const long long freq = wordFreq[w];
+        if (length < 2) continue; // Skip if already merged into a single token
+
+        // Rewrite in place. Reads at k - 1 see the original symbol: position k - 1 is
+        // only overwritten before being read when no merge has happened yet, in which
+        // case it was rewritten with its own value.
+        uint32_t write = 0;
+        uint32_t k = 0;
+        while (k < length) {
+            if (k + 1 < length && symbols_of_word[k] == left && symbols_of_word[k + 1] == right) {
+                if (k > 0) {
+                    delta.counts[makePair(symbols_of_word[k - 1], left)] -= freq;
+
+                    const PairKey new_left_pair = makePair(symbols_of_word[k - 1], merged);
+                    delta.counts[new_left_pair] += freq;
+                    delta.postings.emplace_back(new_left_pair, w);
+                }
+                if (k + 2 < length) {
+                    delta.counts[makePair(right, symbols_of_word[k + 2])] -= freq;
+
+                    const PairKey new_right_pair = makePair(merged, symbols_of_word[k + 2]);
+                    delta.counts[new_right_pair] += freq;
+                    delta.postings.emplace_back(new_right_pair, w);
+                }
+                symbols_of_word[write++] = merged;
+                k += 2;
+            } else {
+                symbols_of_word[write++] = symbols_of_word[k];
+                k += 1;
+            }
+        }
+        if (write == length) delta.unchangedWords++;
+        wordLength[w] = write;
+    }
+}
+
+
+/**
+ * @brief Performs one merge of the currently most frequent pair.
+ * Only the words listed in the inverted index for the pair are visited. Large word
+ * lists are split into chunks that are rewritten in parallel, each producing a local
+ * delta; the deltas are then summed and applied to the pair statistics once, so the
+ * outcome is identical for any number of threads.
+ * @param merge Output: the merge that was performed.
+ * @return `false` if no pairs are left to merge, `true` otherwise.
+ */
+bool BpeTrainer::mergeNext(BpeMerge& merge) {
+    auto lower = [this](const HeapEntry& a, const HeapEntry& b) { return heapLower(a, b); };
+
+    // Stale entries accumulate with every count update; compact once they dominate.
+    if (heap.size() > 4 * pairStats.size() + 1024) {
+        heapRebuild();
+    }
+    // Pop stale entries until the top matches pairStats.
+    while (!heap.empty()) {
+        const HeapEntry& top = heap.front();
+        auto it = pairStats.find(top.key);
+        if (it != pairStats.end() && it->second == top.freq) break;
+        std::pop_heap(heap.begin(), heap.end(), lower);
+        heap.pop_back();
+    }
+    if (heap.empty()) return false;
+
+    const PairKey best = heap.front().key;
+    merge.freq = heap.front().freq;
+    std::pop_heap(heap.begin(), heap.end(), lower);
+    heap.pop_back();
+
+    merge.left = pairLeft(best);
+    merge.right = pairRight(best);
+    merge.merged = intern(symbols[merge.left] + symbols[merge.right]);
+    ++mergeCount;
+    mergeHistory.push_back(merge);
+
+    auto index_it = invertedIndex.find(best);
+    if (index_it == invertedIndex.end()) {
+        pairStats.erase(best);
+        return true;
+    }
+
+    // A word can be listed several times; after its first visit it no longer contains
+    // the pair, so the repeats are dropped up front and chunks never share a word.
+    std::vector<uint32_t> affected_words;
+    affected_words.reserve(index_it->second.size());
+    for (const uint32_t w : index_it->second) {
+        if (wordStamp[w] != mergeCount) {
+            wordStamp[w] = mergeCount;
+            affected_words.push_back(w);
+        }
+    }
+
+    size_t num_chunks = 1;
+    if (pool != nullptr && pool->size() > 1 && affected_words.size() >= PARALLEL_MERGE_MIN_WORDS) {
+        num_chunks = std::min<size_t>(pool->size(), affected_words.size() / (PARALLEL_MERGE_MIN_WORDS / 4));
+    }
+    std::vector<MergeDelta> deltas(num_chunks);
+    const size_t chunk_size = (affected_words.size() + num_chunks - 1) / num_chunks;
+
+    if (num_chunks == 1) {
+        applyMerge(affected_words.data(), affected_words.size(), merge.left, merge.right, merge.merged, deltas[0]);
+    } else {
+        pool->parallelFor(0, num_chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+            for (size_t c = first_chunk; c < last_chunk; ++c) {
+                const size_t start = std::min(c * chunk_size, affected_words.size());
+                const size_t end = std::min(start + chunk_size, affected_words.size());
+                applyMerge(affected_words.data() + start, end - start, merge.left, merge.right, merge.merged, deltas[c]);
+            }
+        });
+    }
+
+    // Reduce the chunk deltas, then apply each changed pair once.
+    MergeDelta& total = deltas[0];
+    for (size_t c = 1; c < num_chunks; ++c) {
+        for (const auto& d : deltas[c].counts) {
+            total.counts[d.first] += d.second;
+        }
+    }
+    for (const auto& d : total.counts) {
+        if (d.second != 0) updatePair(d.first, d.second);
+    }
+    // The list of the merged pair is dropped below; appending postings may rehash the index.
+    totalPostings -= index_it->second.size();
+    // Postings are appended in chunk order, i.e. in the same word order as a serial pass.
+    for (const auto& delta : deltas) {
+        for (const auto& posting : delta.postings) {
+            addPosting(posting.first, posting.second);
+        }
+        staleVisits += delta.unchangedWords;
+    }
+
+    invertedIndex.erase(best);
+    pairStats.erase(best);
+    if (addedPostings >= std::max(totalPostings / 2, COMPACT_MIN_POSTINGS)) {
+        compactIndex();
+    }
+    return true;
+}
+
+
+// Appends the raw bytes of a trivially copyable array.
+template<typename T>
+static void appendArray(std::string& out, const T* values, size_t count) {
+    out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+// Copies `count` values out of `data` at `pos`, advancing `pos`; false if the data is too short.
+template<typename T>
+static bool readArray(std::string_view data, size_t& pos, std::vector<T>& values, size_t count) {
+    if (count > (data.size() - pos) / sizeof(T)) return false;
+    values.resize(count);
+    if (count > 0) std::memcpy(values.data(), data.data() + pos, count * sizeof(T));
+    pos += count * sizeof(T);
+    return true;
+}
+
+
+/**
+ * @brief Appends the complete training state in native byte order.
+ * Layout: nine uint64 counts (symbols, symbol bytes, words, word symbols, pairs, index
+ * keys, index postings, merges, base symbols), then
+ *  - the symbol table as uint64 offsets into the concatenated symbol bytes,
+ *  - the word splits (wordFreq, wordOffset, wordLength, wordSymbols),
+ *  - the pair statistics as keys and counts, sorted by key,
+ *  - the inverted index as keys (sorted), uint64 offsets and word ids,
+ *  - the merge history as (left, right, merged) triples and frequencies.
+ * The pair statistics and posting lists are stored as they are rather than recomputed
+ * on load, so a restored trainer continues with exactly the merges an uninterrupted run
+ * would have made. The heap is rebuilt from the pair statistics.
+ * @param out Output: the serialized state is appended.
+ */
+void BpeTrainer::serialize(std::string& out) const {
+    std::vector<uint64_t> symbol_offsets(symbols.size() + 1, 0);
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        symbol_offsets[i + 1] = symbol_offsets[i] + symbols[i].size();
+    }
+
+    std::vector<PairKey> pair_keys;
+    pair_keys.reserve(pairStats.size());
+    for (const auto& p : pairStats) pair_keys.push_back(p.first);
+    std::sort(pair_keys.begin(), pair_keys.end());
+    std::vector<long long> pair_counts;
+    pair_counts.reserve(pair_keys.size());
+    for (const PairKey key : pair_keys) pair_counts.push_back(pairStats.at(key));
+
+    std::vector<PairKey> index_keys;
+    index_keys.reserve(invertedIndex.size());
+    for (const auto& p : invertedIndex) index_keys.push_back(p.first);
+    std::sort(index_keys.begin(), index_keys.end());
+    std::vector<uint64_t> index_offsets(index_keys.size() + 1, 0);
+    for (size_t k = 0; k < index_keys.size(); ++k) {
+        index_offsets[k + 1] = index_offsets[k] + invertedIndex.at(index_keys[k]).size();
+    }
+
+    std::vector<uint32_t> merge_ids;
+    std::vector<long long> merge_freqs;
+    merge_ids.reserve(3 * mergeHistory.size());
+    merge_freqs.reserve(mergeHistory.size());
+    for (const BpeMerge& merge : mergeHistory) {
+        merge_ids.insert(merge_ids.end(), { merge.left, merge.right, merge.merged });
+        merge_freqs.push_back(merge.freq);
+    }
+
+    const uint64_t counts[9] = { symbols.size(), symbol_offsets.back(), wordFreq.size(), wordSymbols.size(),
+                                 pair_keys.size(), index_keys.size(), index_offsets.back(), mergeHistory.size(), baseSymbols };
+    appendArray(out, counts, 9);
+    appendArray(out, symbol_offsets.data(), symbol_offsets.size());
+    for (const auto& symbol : symbols) out += symbol;
+    appendArray(out, wordFreq.data(), wordFreq.size());
+    appendArray(out, wordOffset.data(), wordOffset.size());
+    appendArray(out, wordLength.data(), wordLength.size());
+    appendArray(out, wordSymbols.data(), wordSymbols.size());
+    appendArray(out, pair_keys.data(), pair_keys.size());
+    appendArray(out, pair_counts.data(), pair_counts.size());
+    appendArray(out, index_keys.data(), index_keys.size());
+    appendArray(out, index_offsets.data(), index_offsets.size());
+    for (const PairKey key : index_keys) {
+        const std::vector<uint32_t>& postings = invertedIndex.at(key);
+        appendArray(out, postings.data(), postings.size());
+    }
+    appendArray(out, merge_ids.data(), merge_ids.size());
+    appendArray(out, merge_freqs.data(), merge_freqs.size());
+}
+
+
+/**
+ * @brief Restores a state written by `serialize`, replacing the current one.
+ * Every id, offset and length is validated, so a corrupt checkpoint cannot cause
+ * out-of-range accesses during later merges.
+ * @param data The serialized state.
+ * The thread pool set with setThreadPool is kept.
+ * @return `true` on success; on failure the trainer holds a partial state and must not be used for merging.
+ */
+bool BpeTrainer::deserialize(std::string_view data) {
+    ThreadPool* const thread_pool = pool;
+    *this = BpeTrainer();
+    pool = thread_pool;
+    symbols.clear();
+    symbolIds.clear();
+
+    size_t pos = 0;
+    std::vector<uint64_t> counts;
+    if (!readArray(data, pos, counts, 9)) return false;
+    const uint64_t num_symbols = counts[0], symbol_bytes = counts[1], num_words = counts[2], num_word_symbols = counts[3];
+    const uint64_t num_pairs = counts[4], num_index_keys = counts[5], num_postings = counts[6], num_merges = counts[7];
+    if (num_symbols == 0 || num_symbols > UINT32_MAX || num_words >= UINT32_MAX || num_word_symbols > UINT32_MAX
+        || num_merges > UINT32_MAX || counts[8] == 0 || counts[8] > num_symbols || symbol_bytes > data.size()) {
+        return false;
+    }
+
+    // symbol table
+    std::vector<uint64_t> symbol_offsets;
+    if (!readArray(data, pos, symbol_offsets, num_symbols + 1) || symbol_offsets[0] != 0
+        || symbol_offsets[num_symbols] != symbol_bytes || symbol_bytes > data.size() - pos) {
+        return false;
+    }
+    symbols.reserve(num_symbols);
+    for (size_t i = 0; i < num_symbols; ++i) {
+        if (symbol_offsets[i + 1] < symbol_offsets[i] || symbol_offsets[i + 1] > symbol_bytes) return false;
+        symbols.emplace_back(data.substr(pos + symbol_offsets[i], symbol_offsets[i + 1] - symbol_offsets[i]));
+        if (!symbolIds.emplace(symbols.back(), static_cast<uint32_t>(i)).second) return false;   // duplicate symbol
+    }
+    pos += symbol_bytes;
+    if (symbols[0] != "</w>") return false;
+    endOfWord = 0;
+    baseSymbols = static_cast<uint32_t>(counts[8]);
+
+    // words
+    bool ok = readArray(data, pos, wordFreq, num_words)
+        && readArray(data, pos, wordOffset, num_words + 1)
+        && readArray(data, pos, wordLength, num_words)
+        && readArray(data, pos, wordSymbols, num_word_symbols)
+        && wordOffset[0] == 0 && wordOffset[num_words] == num_word_symbols;
+    for (size_t w = 0; ok && w < num_words; ++w) {
+        ok = wordOffset[w] <= wordOffset[w + 1] && wordLength[w] <= wordOffset[w + 1] - wordOffset[w];
+    }
+    for (size_t i = 0; ok && i < wordSymbols.size(); ++i) {
+        ok = wordSymbols[i] < num_symbols;
+    }
+    auto valid_pair = [&](PairKey key) { return pairLeft(key) < num_symbols && pairRight(key) < num_symbols; };
+
+    // pair statistics
+    std::vector<PairKey> keys;
+    std::vector<long long> values;
+    ok = ok && readArray(data, pos, keys, num_pairs) && readArray(data, pos, values, num_pairs);
+    if (ok) pairStats.reserve(num_pairs);
+    for (size_t p = 0; ok && p < num_pairs; ++p) {
+        ok = valid_pair(keys[p]) && values[p] > 0 && pairStats.emplace(keys[p], values[p]).second;
+    }
+
+    // inverted index
+    std::vector<uint64_t> index_offsets;
+    std::vector<uint32_t> postings;
+    ok = ok && readArray(data, pos, keys, num_index_keys)
+        && readArray(data, pos, index_offsets, num_index_keys + 1)
+        && index_offsets[0] == 0 && index_offsets[num_index_keys] == num_postings
+        && readArray(data, pos, postings, num_postings);
+    if (ok) invertedIndex.reserve(num_index_keys);
+    for (size_t k = 0; ok && k < num_index_keys; ++k) {
+        ok = valid_pair(keys[k]) && index_offsets[k] <= index_offsets[k + 1] && index_offsets[k + 1] <= num_postings;
+        if (!ok) break;
+        std::vector<uint32_t> words(postings.begin() + index_offsets[k], postings.begin() + index_offsets[k + 1]);
+        for (const uint32_t w : words) ok = ok && w < num_words;
+        ok = ok && invertedIndex.emplace(keys[k], std::move(words)).second;
+    }
+
+    // merge history
+    std::vector<uint32_t> merge_ids;
+    ok = ok && readArray(data, pos, merge_ids, 3 * num_merges) && readArray(data, pos, values, num_merges)
+        && pos == data.size();
+    if (ok) mergeHistory.reserve(num_merges);
+    for (size_t m = 0; ok && m < num_merges; ++m) {
+        const BpeMerge merge{ merge_ids[3 * m], merge_ids[3 * m + 1], merge_ids[3 * m + 2], values[m] };
+        ok = merge.left < num_symbols && merge.right < num_symbols && merge.merged < num_symbols;
+        mergeHistory.push_back(merge);
+    }
+
+    if (!ok) return false;
+    mergeCount = static_cast<uint32_t>(num_merges);
+    totalPostings = num_postings;
+    addedPostings = 0;
+    wordStamp.assign(num_words, 0);
+    heapRebuild();
+    return true;
+}
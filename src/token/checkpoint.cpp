@@ -0,0 +1,218 @@
+// checkpoint.cpp
+#include "include/checkpoint.hpp"
+#include "include/bpe.hpp"
+#include "include/mappedfile.hpp"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+
+uint64_t checkpointFingerprint(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/**
+ * @brief Fingerprint of a set of input files: their paths, sizes and modification times.
+ * The order of `file_paths` does not matter. Any file that is added, removed, resized or
+ * rewritten changes the fingerprint, which invalidates word-count checkpoints taken before.
+ */
+uint64_t inputFilesFingerprint(const std::vector<std::string>& file_paths) {
+    std::vector<std::string> sorted_paths(file_paths);
+    std::sort(sorted_paths.begin(), sorted_paths.end());
+
+    uint64_t hash = CHECKPOINT_FINGERPRINT_SEED;
+    for (const auto& path : sorted_paths) {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path, ec);
+        const int64_t modified = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        hash = checkpointFingerprint(hash, path.data(), path.size() + 1);   // includes the terminator
+        hash = checkpointFingerprint(hash, &size, sizeof(size));
+        hash = checkpointFingerprint(hash, &modified, sizeof(modified));
+    }
+    return hash;
+}
+
+
+// Writes header + payload to a temporary file next to `path` (creating its directory), then renames it over `path`.
+static void writeCheckpoint(const std::string& path, CheckpointKind kind, uint64_t fingerprint, uint64_t count,
+    const std::string& payload)
+{
+    CheckpointFileHeader header{};
+    std::memcpy(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_FILE_VERSION;
+    header.byteOrderMark = CHECKPOINT_FILE_BYTE_ORDER_MARK;
+    header.kind = static_cast<uint32_t>(kind);
+    header.fingerprint = fingerprint;
+    header.count = count;
+    header.payloadSize = payload.size();
+    header.payloadChecksum = checkpointFingerprint(CHECKPOINT_FINGERPRINT_SEED, payload.data(), payload.size());
+
+    const std::string temp_path = path + ".tmp";
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    if (!directory.empty()) std::filesystem::create_directories(directory);
+    {
+        std::ofstream outFile(temp_path, std::ios::binary | std::ios::trunc);
+        if (!outFile.is_open()) {
+            throw std::runtime_error("Failed to open checkpoint file at: " + temp_path);
+        }
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outFile.write(payload.data(), payload.size());
+        if (!outFile) {
+            throw std::runtime_error("Failed to write checkpoint file: " + temp_path);
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to replace checkpoint file " + path + ": " + ec.message());
+    }
+}
+
+
+/**
+ * @brief Maps a checkpoint and validates its header and payload checksum.
+ * @return The payload, or an empty view (with a warning unless the file does not exist)
+ * if the file is missing, corrupt, of another kind or version, or of other input.
+ */
+static std::string_view readCheckpoint(const std::string& path, MappedFile& file, CheckpointKind kind, uint64_t fingerprint,
+    CheckpointFileHeader& header)
+{
+    if (!std::filesystem::exists(path)) return {};
+    auto reject = [&](const char* reason) {
+        std::cerr << "[WARNING] Ignoring checkpoint " << path << ": " << reason << "." << std::endl;
+        return std::string_view();
+    };
+    if (!file.open(path)) return reject("cannot be read");
+    const std::string_view data = file.view();
+    if (data.size() < sizeof(header)) return reject("truncated");
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic)) != 0) return reject("not a checkpoint file");
+    if (header.byteOrderMark != CHECKPOINT_FILE_BYTE_ORDER_MARK) return reject("written with a different byte order");
+    if (header.version != CHECKPOINT_FILE_VERSION) return reject("unsupported version");
+    if (header.kind != static_cast<uint32_t>(kind)) return reject("wrong checkpoint kind");
+    if (header.payloadSize != data.size() - sizeof(header)) return reject("truncated");
+    const std::string_view payload = data.substr(sizeof(header));
+    if (header.payloadChecksum != checkpointFingerprint(CHECKPOINT_FINGERPRINT_SEED, payload.data(), payload.size())) {
+        return reject("checksum mismatch");
+    }
+    if (header.fingerprint != fingerprint) return reject("it was taken from different input");
+    return payload;
+}
+
+
+/**
+ * @brief Saves corpus word counts as a binary checkpoint (layout in checkpoint.hpp).
+ * @param path Path of the checkpoint file.
+ * @param corpus_word_counts The counts to save.
+ * @param fingerprint Fingerprint of the input files (inputFilesFingerprint).
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void saveWordCountsCheckpoint(const std::string& path, const std::unordered_map<std::string, int>& corpus_word_counts,
+    uint64_t fingerprint)
+{
+    const size_t count = corpus_word_counts.size();
+    std::vector<uint64_t> offsets(count + 1, 0);
+    std::vector<int32_t> freqs;
+    freqs.reserve(count);
+    size_t i = 0;
+    for (const auto& pair : corpus_word_counts) {
+        offsets[i + 1] = offsets[i] + pair.first.size();
+        freqs.push_back(pair.second);
+        ++i;
+    }
+
+    std::string payload;
+    payload.reserve(offsets.size() * sizeof(uint64_t) + freqs.size() * sizeof(int32_t) + offsets.back());
+    payload.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    payload.append(reinterpret_cast<const char*>(freqs.data()), freqs.size() * sizeof(int32_t));
+    for (const auto& pair : corpus_word_counts) {
+        payload += pair.first;
+    }
+    writeCheckpoint(path, CheckpointKind::WordCounts, fingerprint, count, payload);
+}
+
+
+/**
+ * @brief Loads word counts saved by saveWordCountsCheckpoint.
+ * @param path Path of the checkpoint file.
+ * @param corpus_word_counts Output: replaced by the saved counts on success.
+ * @param fingerprint Fingerprint of the current input files; a checkpoint of other files is ignored.
+ * @return `true` if the counts were restored, `false` if there is no usable checkpoint.
+ */
+bool loadWordCountsCheckpoint(const std::string& path, std::unordered_map<std::string, int>& corpus_word_counts,
+    uint64_t fingerprint)
+{
+    MappedFile file;
+    CheckpointFileHeader header;
+    const std::string_view payload = readCheckpoint(path, file, CheckpointKind::WordCounts, fingerprint, header);
+    if (payload.empty()) return false;
+
+    const uint64_t count = header.count;
+    const uint64_t table_bytes = (count + 1) * sizeof(uint64_t) + count * sizeof(int32_t);
+    if (count >= payload.size() || table_bytes > payload.size()) {
+        std::cerr << "[WARNING] Ignoring checkpoint " << path << ": corrupt word table." << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> offsets(count + 1);
+    std::vector<int32_t> freqs(count);
+    std::memcpy(offsets.data(), payload.data(), offsets.size() * sizeof(uint64_t));
+    std::memcpy(freqs.data(), payload.data() + offsets.size() * sizeof(uint64_t), freqs.size() * sizeof(int32_t));
+    const std::string_view words = payload.substr(table_bytes);
+    bool ok = offsets[0] == 0 && offsets[count] == words.size();
+    for (size_t i = 0; ok && i < count; ++i) ok = offsets[i] <= offsets[i + 1];
+    if (!ok) {
+        std::cerr << "[WARNING] Ignoring checkpoint " << path << ": corrupt word table." << std::endl;
+        return false;
+    }
+
+    corpus_word_counts.clear();
+    corpus_word_counts.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        corpus_word_counts.emplace(words.substr(offsets[i], offsets[i + 1] - offsets[i]), freqs[i]);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Saves the state of a BPE trainer (splits, pair statistics, merge list) as a checkpoint.
+ * @param path Path of the checkpoint file.
+ * @param trainer The trainer to save.
+ * @param fingerprint Fingerprint of the words the trainer was built from.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void saveBpeCheckpoint(const std::string& path, const BpeTrainer& trainer, uint64_t fingerprint) {
+    std::string payload;
+    trainer.serialize(payload);
+    writeCheckpoint(path, CheckpointKind::BpeState, fingerprint, trainer.getMerges().size(), payload);
+}
+
+
+/**
+ * @brief Restores a trainer saved by saveBpeCheckpoint.
+ * @param path Path of the checkpoint file.
+ * @param trainer Output: the restored trainer (its thread pool is kept).
+ * @param fingerprint Fingerprint of the current words; a checkpoint of other words is ignored.
+ * @return `true` if the state was restored, `false` if there is no usable checkpoint
+ * (in which case `trainer` must be rebuilt before use).
+ */
+bool loadBpeCheckpoint(const std::string& path, BpeTrainer& trainer, uint64_t fingerprint) {
+    MappedFile file;
+    CheckpointFileHeader header;
+    const std::string_view payload = readCheckpoint(path, file, CheckpointKind::BpeState, fingerprint, header);
+    if (payload.empty()) return false;
+    if (!trainer.deserialize(payload) || trainer.getMerges().size() != header.count) {
+        std::cerr << "[WARNING] Ignoring checkpoint " << path << ": corrupt trainer state." << std::endl;
+        return false;
+    }
+    return true;
+}
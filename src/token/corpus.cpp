@@ -48,8 +48,9 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
     std::unordered_map<std::string, int>& corpus_word_counts)
 {
     corpus_word_counts.clear();
-    const size_t CHUNK_SIZE = 10000; // Number of lines per chunk
-    ThreadSafeQueue<std::vector<std::string>> work_queue;
+    const size_t CHUNK_BYTES = 4 << 20; // Target bytes per work unit (split on line boundaries)
+    PipelineMetrics& metrics = this->bpe_progress->metrics;
+    PipelineMetrics::Stage stage(metrics, "count_words");
 
     // Determine number of producers and consumers
     int num_producers = (this->num_threads <= 4) ? 1 : 2; // Original logic for producers
@@ -65,6 +66,11 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
         num_producers = 1;
         num_consumers = 1;
     }
+    // The queue is bounded, so producers cannot map and queue far more of the corpus than
+    // the consumers have in hand; they wait in push_batch until a consumer takes a chunk.
+    const size_t QUEUE_CHUNKS_PER_CONSUMER = 4;
+    ThreadSafeQueue<CorpusChunk> work_queue(QUEUE_CHUNKS_PER_CONSUMER * static_cast<size_t>(num_consumers));
+    PipelineMetrics::QueueWatch queue_watch(metrics, [&work_queue] { return work_queue.size(); });
 
     // Use the member bpe_progress for shared progress
     // ProgressData progress; // NO LONGER LOCAL
@@ -83,56 +89,69 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
         }
     }
     // 2. DEFINE THE CONSUMER'S JOB (Optimized with std::string_view)
-    auto consumer_task = [&work_queue, bpe_progress_ptr = this->bpe_progress.get()]() -> std::unordered_map<std::string, int> { // Capture raw pointer
-        std::unordered_map<std::string, int> local_counts;
-        std::vector<std::string> chunk;
+    // Chunks are byte ranges of a mapped file; lines are scanned in place without copying.
+    // In sharded mode each consumer splits its counts into one shard per thread (see merge_shards).
+    const bool sharded = this->aggregationMode == AggregationMode::Sharded;
+    const size_t num_shards = sharded ? static_cast<size_t>(std::max(this->num_threads, 1)) : 1;
+    // With a sketch, a word is counted exactly only from its min_count-th occurrence on (see CorpusFilter).
+    const int min_count = this->corpusFilter.minCount;
+    std::unique_ptr<CountMinSketch> sketch;
+    if (this->corpusFilter.sketchWidth > 0 && min_count > 1) {
+        sketch = std::make_unique<CountMinSketch>(this->corpusFilter.sketchWidth, this->corpusFilter.sketchDepth);
+        std::cout << "-> Counting words through a " << sketch->depth() << " x " << sketch->width() << " count-min sketch ("
+                  << sketch->memoryBytes() / (1 << 20) << " MiB); words seen fewer than " << min_count << " times are dropped." << std::endl;
+    }
+    std::atomic<int> next_consumer{ 0 };
+    auto consumer_task = [this, &work_queue, &metrics, &next_consumer, num_shards, min_count, sketch_ptr = sketch.get(), bpe_progress_ptr = this->bpe_progress.get()]() -> ShardedWordCounts { // Capture raw pointer
+        PipelineMetrics::ThreadTimer timer(metrics, "count_words", "consumer", next_consumer++);
+        ShardedWordCounts local_counts(num_shards); // keys live in the tables' own arenas; lookups take string_views
+        CorpusChunk chunk;
         while (work_queue.wait_and_pop(chunk)) {
-            for (const auto& line_str : chunk) {
-                // Increment sentence terminator count for each processed line
-                {
-                    std::lock_guard<std::mutex> lock(bpe_progress_ptr->mtx);
-                    bpe_progress_ptr->sentence_terminator_count++;
-                }
+            timer.idle();
+            unsigned long long lines_in_chunk = 0;
+            std::string_view remaining = chunk.bytes;
+            while (!remaining.empty()) {
+                // Split off the next line; a final line without '\n' still counts as a line.
+                const size_t newline = remaining.find('\n');
+                std::string_view line = remaining.substr(0, newline);
+                remaining.remove_prefix(newline == std::string_view::npos ? remaining.size() : newline + 1);
+                lines_in_chunk++;
 
-                std::string_view line(line_str);
-                for (size_t i = 0; i < line.length(); ) {
-                    unsigned char current_char = line[i];
-                    if (std::isalpha(current_char)) {
-                        size_t start = i;
-                        while (i < line.length() && std::isalpha(static_cast<unsigned char>(line[i]))) i++;
-                        
-                        std::string_view original_word_view = line.substr(start, i - start);
-                        std::vector<std::string_view> sub_words_view = pre_split_word(original_word_view);
-                        
-                        for (auto& sub_word_view : sub_words_view) {
-                            std::string lowercased_sub_word;
-                            lowercased_sub_word.reserve(sub_word_view.length());
-                            for (char c : sub_word_view) {
-                                lowercased_sub_word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-                            }
-                            local_counts[lowercased_sub_word]++;
+                // The same pre-tokenizer as splitSentence and encode: lower-cased camelCase pieces and single symbols.
+                this->preTokenize(line,
+                    [&](std::string_view word) {
+                        const uint64_t hash = WordCountTable::hashKey(word);
+                        if (sketch_ptr == nullptr || sketch_ptr->add(hash) >= static_cast<uint32_t>(min_count)) {
+                            local_counts.incrementHashed(hash, word);
                         }
-                    } 
-                    else if (!std::isspace(current_char)) {
-                        local_counts[std::string(1, static_cast<char>(current_char))]++;
-                        i++;
-                    } 
-                    else { i++; }
-                }
-                // Add the </s> token to the local_counts for each line
-                local_counts["</s>"]++; 
+                    },
+                    [&](std::string_view symbol) { local_counts.increment(symbol); });
             }
+            // Add one </s> token for each line of the chunk
+            if (lines_in_chunk > 0) local_counts.increment("</s>", static_cast<int>(lines_in_chunk));
+            // Flush the sentence count once per chunk instead of once per line.
+            bpe_progress_ptr->sentence_terminator_count.fetch_add(lines_in_chunk, std::memory_order_relaxed);
+            timer.busy("count_chunk");
         }
         return local_counts;
     };
 
     // 3. LAUNCH THREADS
-    std::cout << "-> Launching " << num_producers << " Producer(s) and " << num_consumers << " Consumer threads..." << std::endl;
+    // Producers and consumers block on each other, so each needs a thread of its own. They
+    // run on the shared pool when it has enough workers (and this is not already a pool
+    // worker); otherwise, e.g. for num_threads == 1, dedicated threads are started.
+    ThreadPool& pool = getThreadPool();
+    const bool use_pool = pool.size() >= static_cast<size_t>(num_producers + num_consumers) && !pool.isWorkerThread();
+    auto launch = [&pool, use_pool](auto task) {
+        return use_pool ? pool.submit(std::move(task)) : std::async(std::launch::async, std::move(task));
+    };
+    std::cout << "-> Launching " << num_producers << " Producer(s) and " << num_consumers << " Consumer threads"
+              << (use_pool ? " on the thread pool" : "") << "..." << std::endl;
 
-    std::vector<std::future<std::unordered_map<std::string, int>>> consumer_futures;
+    std::vector<std::future<ShardedWordCounts>> consumer_futures;
     consumer_futures.reserve(num_consumers);
     for (int i = 0; i < num_consumers; ++i) {
-        consumer_futures.push_back(std::async(std::launch::async, consumer_task));
+        consumer_futures.push_back(launch(consumer_task));
     }
 
     // --- PRODUCERS ---
@@ -163,11 +182,13 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
         }
         current_file_idx = end_idx; // Update for next producer
 
-        producer_futures.push_back(std::async(std::launch::async, [&, producer_file_subset = std::move(producer_file_subset), bpe_progress_ptr = this->bpe_progress.get()]() mutable {
+        producer_futures.push_back(launch([&, p_idx, producer_file_subset = std::move(producer_file_subset), bpe_progress_ptr = this->bpe_progress.get()]() mutable {
+            PipelineMetrics::ThreadTimer timer(metrics, "count_words", "producer", p_idx);
+            std::vector<CorpusChunk> chunks;
             for (const auto& path : producer_file_subset) {
                 std::string filename = std::filesystem::path(path).filename().string();
-                std::ifstream file(path);
-                if (!file.is_open()) {
+                auto file = std::make_shared<MappedFile>();
+                if (!file->open(path)) {
                     std::cerr << "Warning: Producer thread could not open file: " << path << std::endl;
                     {
                         // Protect progress updates with mutex
@@ -178,49 +199,25 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
                     }
                     continue;
                 }
-                
-                std::streampos last_pos = file.tellg();
-                std::string line;
-                std::vector<std::string> chunk_buffer;
-                chunk_buffer.reserve(CHUNK_SIZE);
-
-                while (std::getline(file, line)) {
-                    chunk_buffer.push_back(std::move(line));
-                    if (chunk_buffer.size() >= CHUNK_SIZE) {
-                        std::streampos current_pos = file.tellg();
-                        long long bytes_in_chunk = current_pos - last_pos;
-                        last_pos = current_pos;
 
-                        {
-                            std::lock_guard<std::mutex> lock(bpe_progress_ptr->mtx);
-                            bpe_progress_ptr->bytes_read += bytes_in_chunk;
-                        }
-                        
-                        work_queue.push(std::move(chunk_buffer));
-                        chunk_buffer.clear();
-                        chunk_buffer.reserve(CHUNK_SIZE);
-                    }
-                }
-                
-                // After the loop, account for the final partial chunk and remaining bytes
-                file.clear();
-                file.seekg(0, std::ios::end);
-                std::streampos end_pos = file.tellg();
-                long long final_bytes = end_pos - last_pos;
-
-                if (!chunk_buffer.empty()) {
-                    work_queue.push(std::move(chunk_buffer));
+                // Hand out newline-aligned ranges of the mapping. Large files are spread
+                // over many consumers; the chunks share ownership of the mapping.
+                chunks.clear();
+                for (std::string_view bytes : splitOnNewlines(file->view(), CHUNK_BYTES)) {
+                    chunks.push_back(CorpusChunk{ file, bytes });
                 }
+                bpe_progress_ptr->bytes_read.fetch_add(static_cast<long long>(file->view().size()), std::memory_order_relaxed);
+                timer.busy();
+                work_queue.push_batch(chunks);
+                timer.idle();
 
                 // ATOMIC UPDATE AND SIGNAL for progress
                 {
                     std::unique_lock<std::mutex> lock(bpe_progress_ptr->mtx);
-                    bpe_progress_ptr->bytes_read += final_bytes;
                     bpe_progress_ptr->files_completed_count++;
                     bpe_progress_ptr->last_file_completed = filename; // This will be overwritten by concurrent producers.
                     bpe_progress_ptr->cv.notify_one();
                 }
-                file.close();
             }
         }));
     }
@@ -238,15 +235,16 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
 
             double percentage = 0.0;
             if (this->bpe_progress->total_bytes > 0) {
-                percentage = static_cast<double>(this->bpe_progress->bytes_read) / this->bpe_progress->total_bytes * 100.0;
+                percentage = static_cast<double>(this->bpe_progress->bytes_read.load(std::memory_order_relaxed)) / this->bpe_progress->total_bytes * 100.0;
             }
 
             std::cout << "  -> Progress: [" << std::fixed << std::setprecision(4) << percentage << "%] "
                       << "\t| Completed " << this->bpe_progress->files_completed_count << "/" << total_files << " files. "
-                      << "\t| Sentences: " << this->bpe_progress->sentence_terminator_count // Display sentence count
+                      << "\t| Sentences: " << this->bpe_progress->sentence_terminator_count.load(std::memory_order_relaxed) // Display sentence count
                       << "\t(Finished '" << this->bpe_progress->last_file_completed << "')" << std::endl;
 
             last_reported_count = this->bpe_progress->files_completed_count;
+            metrics.notify();
         }
     }
     std::cout << "-> Producer(s) have finished reading all files. Waiting for consumers...\n";
@@ -260,18 +258,65 @@ void tokeniser::buildCorpusWordCounts(const std::vector<std::string>& file_paths
     std::cout << "-> Work queue closed. Consumers will now finish processing remaining chunks and exit.\n";
 
 
-    // 5. AGGREGATE FINAL RESULTS (Parallelized using a merge tree)
-    std::cout << "-> Aggregating results using a parallel merge tree...\n";
-    std::unordered_map<std::string, int> final_counts;
-
-    if (!consumer_futures.empty()) {
-        auto final_future = merge_maps(consumer_futures, 0, consumer_futures.size() - 1);
-        final_counts = final_future.get();
-    }
-
+    // 5. AGGREGATE FINAL RESULTS
+    PipelineMetrics::Stage aggregate_stage(metrics, "aggregate_counts");
     corpus_word_counts.clear();
-    corpus_word_counts.insert(final_counts.begin(), final_counts.end());
+    if (sharded) {
+        // Shard i of every consumer is merged by its own worker; the merged shards are disjoint.
+        std::cout << "-> Aggregating results over " << num_shards << " shards in parallel...\n";
+        std::vector<ShardedWordCounts> partials;
+        partials.reserve(consumer_futures.size());
+        for (auto& f : consumer_futures) {
+            partials.push_back(f.get());
+        }
+        merge_shards(partials, corpus_word_counts, pool);
+    }
+    else {
+        // Parallelized using a merge tree
+        std::cout << "-> Aggregating results using a parallel merge tree...\n";
+        std::vector<WordCountTable> tables;
+        tables.reserve(consumer_futures.size());
+        for (auto& f : consumer_futures) {
+            tables.push_back(std::move(f.get().shard(0)));
+        }
+        WordCountTable final_counts = merge_tables(tables, pool);
+        // Hand the counts over in the map form used by the training stages. The table's memory is
+        // released only after every word has been copied, so both are held at the peak.
+        final_counts.moveInto(corpus_word_counts);
+    }
+    if (sketch) {
+        // The occurrences absorbed by the sketch before a word was admitted (at most min_count - 1).
+        for (auto& [word, count] : corpus_word_counts) {
+            if (isWordToken(word)) count += min_count - 1;
+        }
+    }
     std::cout << "-> Aggregation complete. Total unique tokens: " << corpus_word_counts.size() << std::endl;
     // You can also print the final sentence terminator count here
-    std::cout << "-> Total </s> tokens counted: " << this->bpe_progress->sentence_terminator_count << std::endl;
-}
\ No newline at end of file
+    std::cout << "-> Total </s> tokens counted: " << this->bpe_progress->sentence_terminator_count.load() << std::endl;
+    aggregate_stage.words = corpus_word_counts.size();
+    stage.bytes = static_cast<uint64_t>(this->bpe_progress->bytes_read.load());
+    stage.lines = this->bpe_progress->sentence_terminator_count.load();
+    stage.words = corpus_word_counts.size();
+    stage.items = total_files;
+    stage.maxQueueDepth = work_queue.maxSize();
+}
+
+
+/**
+ * @brief Counts the words of this node's (or process's) files into a sorted count shard.
+ * This is the distributed form of buildCorpusWordCounts: every node counts its own part
+ * of the corpus and writes one shard; the shards are then combined with
+ * mergeCountShards (the `countshards merge` tool) and read with readCountShard as the
+ * input of learn_vocabulary_from_word_counts.
+ * @param file_paths The files to count.
+ * @param shardPath Path of the shard to write.
+ * @return Number of words written to the shard.
+ */
+size_t tokeniser::buildCorpusCountShard(const std::vector<std::string>& file_paths, const std::string& shardPath)
+{
+    std::unordered_map<std::string, int> corpus_word_counts;
+    buildCorpusWordCounts(file_paths, corpus_word_counts);
+    const size_t rows = writeCountShard(shardPath, corpus_word_counts);
+    std::cout << "-> Saved count shard with " << rows << " words to: " << shardPath << std::endl;
+    return rows;
+}
@@ -0,0 +1,264 @@
+// countshard.cpp
+#include "include/countshard.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <queue>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+// Encoded records are written out in blocks of this many bytes.
+static constexpr size_t SHARD_FLUSH_BYTES = 1 << 20;
+
+
+static void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+
+CountShardWriter::CountShardWriter(const std::string& path)
+    : path(path), out(path, std::ios::binary | std::ios::trunc)
+{
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open count shard for writing: " + path);
+    }
+    std::memcpy(header.magic, COUNT_SHARD_MAGIC, sizeof(header.magic));
+    header.version = COUNT_SHARD_VERSION;
+    header.byteOrderMark = COUNT_SHARD_BYTE_ORDER_MARK;
+    // Placeholder; the final header is written by close() once the counts are known.
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.reserve(SHARD_FLUSH_BYTES + 64);
+}
+
+CountShardWriter::~CountShardWriter() {
+    if (!closed) {
+        try { close(); } catch (...) {}
+    }
+}
+
+
+/**
+ * @brief Appends one record.
+ * @param word The word; must sort strictly after the previous one.
+ * @param freq Its frequency.
+ */
+void CountShardWriter::add(std::string_view word, uint64_t freq) {
+    if (header.wordCount > 0 && !(std::string_view(previous) < word)) {
+        throw std::runtime_error("Count shard words must be strictly increasing: " + path);
+    }
+    const size_t limit = std::min(previous.size(), word.size());
+    size_t shared = 0;
+    while (shared < limit && previous[shared] == word[shared]) ++shared;
+
+    appendVarint(buffer, shared);
+    appendVarint(buffer, word.size() - shared);
+    buffer.append(word.data() + shared, word.size() - shared);
+    appendVarint(buffer, freq);
+    previous.assign(word);
+
+    ++header.wordCount;
+    header.totalCount += freq;
+    if (buffer.size() >= SHARD_FLUSH_BYTES) flush();
+}
+
+void CountShardWriter::flush() {
+    out.write(buffer.data(), buffer.size());
+    header.payloadSize += buffer.size();
+    buffer.clear();
+    if (!out) {
+        throw std::runtime_error("Failed to write count shard: " + path);
+    }
+}
+
+// Writes the remaining records and the final header.
+void CountShardWriter::close() {
+    if (closed) return;
+    closed = true;
+    flush();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write count shard: " + path);
+    }
+}
+
+
+/**
+ * @brief Maps a shard and validates its header.
+ * @param path Path of the shard file.
+ */
+void CountShardReader::open(const std::string& path) {
+    this->path = path;
+    if (!file.open(path)) {
+        throw std::runtime_error("Could not open count shard: " + path);
+    }
+    const std::string_view data = file.view();
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error("Count shard is truncated: " + path);
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, COUNT_SHARD_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a count shard: " + path);
+    }
+    if (header.byteOrderMark != COUNT_SHARD_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Count shard was written with a different byte order: " + path);
+    }
+    if (header.version != COUNT_SHARD_VERSION) {
+        throw std::runtime_error("Unsupported count shard version " + std::to_string(header.version) + ": " + path);
+    }
+    if (header.payloadSize != data.size() - sizeof(header)) {
+        throw std::runtime_error("Count shard is truncated: " + path);
+    }
+    payload = data.substr(sizeof(header));
+    pos = 0;
+    remaining = header.wordCount;
+    current.clear();
+    currentFreq = 0;
+}
+
+uint64_t CountShardReader::readVarint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= payload.size()) break;
+        const uint8_t byte = static_cast<uint8_t>(payload[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    throw std::runtime_error("Count shard is corrupt: " + path);
+}
+
+
+/**
+ * @brief Decodes the next record.
+ * @return `false` once all records have been read.
+ */
+bool CountShardReader::next() {
+    if (remaining == 0) {
+        if (pos != payload.size()) {
+            throw std::runtime_error("Count shard has trailing data: " + path);
+        }
+        return false;
+    }
+    const uint64_t shared = readVarint();
+    const uint64_t length = readVarint();
+    const bool first = remaining == header.wordCount;
+    if (shared > current.size() || length > payload.size() - pos || (!first && length == 0)) {
+        throw std::runtime_error("Count shard is corrupt: " + path);
+    }
+    // Front coding keeps the shared prefix, so the new word sorts after the old one
+    // exactly when its first differing byte is larger.
+    const bool increasing = first || shared == current.size()
+        || static_cast<uint8_t>(payload[pos]) > static_cast<uint8_t>(current[shared]);
+    if (!increasing) {
+        throw std::runtime_error("Count shard words are not sorted: " + path);
+    }
+    current.resize(shared);
+    current.append(payload.data() + pos, length);
+    pos += length;
+    currentFreq = readVarint();
+    --remaining;
+    return true;
+}
+
+
+/**
+ * @brief Writes corpus word counts as one sorted shard.
+ * @param path Path of the shard file.
+ * @param corpus_word_counts The counts (e.g. from buildCorpusWordCounts on this node's files).
+ * @return Number of records written.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+size_t writeCountShard(const std::string& path, const std::unordered_map<std::string, int>& corpus_word_counts) {
+    std::vector<const std::pair<const std::string, int>*> entries;
+    entries.reserve(corpus_word_counts.size());
+    for (const auto& pair : corpus_word_counts) {
+        if (pair.second > 0) entries.push_back(&pair);
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    CountShardWriter writer(path);
+    for (const auto* pair : entries) {
+        writer.add(pair->first, static_cast<uint64_t>(pair->second));
+    }
+    writer.close();
+    return writer.wordCount();
+}
+
+
+/**
+ * @brief Reads a shard into the word-count map used by the training stages.
+ * Frequencies above INT_MAX (possible after merging many shards) are clamped.
+ * @param path Path of the shard file.
+ * @param corpus_word_counts Output: replaced by the shard's counts.
+ * @return Number of words read.
+ * @throws std::runtime_error if the shard is missing or corrupt.
+ */
+size_t readCountShard(const std::string& path, std::unordered_map<std::string, int>& corpus_word_counts) {
+    CountShardReader reader;
+    reader.open(path);
+    corpus_word_counts.clear();
+    corpus_word_counts.reserve(reader.getHeader().wordCount);
+    while (reader.next()) {
+        const int freq = static_cast<int>(std::min<uint64_t>(reader.freq(), INT_MAX));
+        corpus_word_counts.emplace(reader.word(), freq);
+    }
+    return corpus_word_counts.size();
+}
+
+
+/**
+ * @brief Combines sorted shards into one with a streaming k-way merge.
+ * Only one record per input is held in memory at a time, so the inputs may be far larger
+ * than RAM. Frequencies of the same word are summed across shards; words whose total is
+ * below `min_freq` are dropped. Pruning compares the totals of this merge's inputs, so it
+ * is exact only in the final merge: in an intermediate merge (e.g. per rack) it drops
+ * words that the other inputs of the global merge would have lifted above `min_freq`.
+ * Merge intermediate levels with min_freq = 1.
+ * @param input_paths Shards to merge (the result may itself be merged again).
+ * @param output_path Path of the merged shard.
+ * @param min_freq Minimum total frequency of a word to be kept.
+ * @return Number of words written.
+ * @throws std::runtime_error if an input is corrupt, the output is one of the inputs, or
+ * the output cannot be written.
+ */
+size_t mergeCountShards(const std::vector<std::string>& input_paths, const std::string& output_path, uint64_t min_freq) {
+    // Opening the output truncates it, which would destroy an input before it is read.
+    std::error_code ec;
+    for (const std::string& input : input_paths) {
+        if (std::filesystem::equivalent(input, output_path, ec)) {
+            throw std::runtime_error("Count shard merge output is also an input: " + output_path);
+        }
+    }
+    std::vector<CountShardReader> readers(input_paths.size());
+    // Min-heap of readers by their current word; ties resolve in input order.
+    auto greater = [&readers](size_t a, size_t b) {
+        const int c = readers[a].word().compare(readers[b].word());
+        return c != 0 ? c > 0 : a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < input_paths.size(); ++i) {
+        readers[i].open(input_paths[i]);
+        if (readers[i].next()) heap.push(i);
+    }
+
+    CountShardWriter writer(output_path);
+    std::string word;
+    while (!heap.empty()) {
+        word.assign(readers[heap.top()].word());
+        uint64_t total = 0;
+        while (!heap.empty() && readers[heap.top()].word() == word) {
+            const size_t i = heap.top();
+            heap.pop();
+            total += readers[i].freq();
+            if (readers[i].next()) heap.push(i);
+        }
+        if (total >= min_freq) writer.add(word, total);
+    }
+    writer.close();
+    return writer.wordCount();
+}
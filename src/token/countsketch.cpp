@@ -0,0 +1,49 @@
+// countsketch.cpp
+#include "include/countsketch.hpp"
+#include <algorithm>
+#include <limits>
+
+
+// Column of `hash` in `row`: double hashing over the two halves of a remixed hash.
+static size_t sketchColumn(uint64_t hash, size_t row, size_t width) {
+    uint64_t h = hash ^ (hash >> 29);
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    const uint64_t h1 = h & 0xFFFFFFFFull;
+    const uint64_t h2 = (h >> 32) | 1;
+    return static_cast<size_t>(((h1 + row * h2) & 0xFFFFFFFFull) * width >> 32);
+}
+
+
+/**
+ * @param width Counters per row (at least 1).
+ * @param depth Number of rows (at least 1).
+ */
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : rowWidth(std::max<size_t>(width, 1)), rowCount(std::max<size_t>(depth, 1))
+{
+    counters = std::make_unique<std::atomic<uint32_t>[]>(rowWidth * rowCount);
+}
+
+
+uint32_t CountMinSketch::add(uint64_t hash) {
+    uint32_t smallest = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < rowCount; ++row) {
+        std::atomic<uint32_t>& counter = counters[row * rowWidth + sketchColumn(hash, row, rowWidth)];
+        uint32_t value = counter.load(std::memory_order_relaxed);
+        while (value != std::numeric_limits<uint32_t>::max()
+               && !counter.compare_exchange_weak(value, value + 1, std::memory_order_relaxed)) {}
+        if (value != std::numeric_limits<uint32_t>::max()) ++value;
+        smallest = std::min(smallest, value);
+    }
+    return smallest;
+}
+
+
+uint32_t CountMinSketch::estimate(uint64_t hash) const {
+    uint32_t smallest = std::numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < rowCount; ++row) {
+        smallest = std::min(smallest, counters[row * rowWidth + sketchColumn(hash, row, rowWidth)].load(std::memory_order_relaxed));
+    }
+    return smallest;
+}
@@ -0,0 +1,262 @@
+// csvreader.cpp
+#include "include/csvreader.hpp"
+#include "include/mappedfile.hpp"
+#include "include/threadpool.hpp"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+
+static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+
+/**
+ * @brief Moves to the start of the next record, skipping what is left of the current one.
+ * @return `false` once the buffer is exhausted.
+ */
+bool CsvRecordCursor::nextRecord() {
+    std::string_view ignored;
+    while (inRecord && nextField(ignored)) {}
+    while (pos < end && (isBlank(*pos) || *pos == '\r' || *pos == '\n')) ++pos;
+    inRecord = pos < end;
+    return inRecord;
+}
+
+
+/**
+ * @brief Reads the next field of the current record.
+ * @param field Output: the (unquoted, unescaped) field text.
+ * @return `false` if the current record has no more fields.
+ */
+bool CsvRecordCursor::nextField(std::string_view& field) {
+    if (!inRecord) return false;
+    while (pos < end && isBlank(*pos)) ++pos;
+
+    if (pos < end && *pos == '"') {
+        const char* start = ++pos;
+        bool escaped = false;
+        while (pos < end) {
+            if (*pos == '"') {
+                if (pos + 1 < end && pos[1] == '"') {
+                    escaped = true;
+                    pos += 2;
+                    continue;
+                }
+                break;
+            }
+            ++pos;
+        }
+        const char* stop = pos;
+        if (pos < end) ++pos;   // closing quote
+        if (escaped) {
+            scratch.clear();
+            for (const char* p = start; p < stop; ++p) {
+                scratch.push_back(*p);
+                if (*p == '"') ++p;     // skip the second quote of a doubled pair
+            }
+            field = scratch;
+        } else {
+            field = std::string_view(start, stop - start);
+        }
+        // Anything between the closing quote and the delimiter is ignored.
+        while (pos < end && *pos != ',' && *pos != '\n') ++pos;
+    } else {
+        const char* start = pos;
+        while (pos < end && *pos != ',' && *pos != '\n') ++pos;
+        const char* stop = pos;
+        while (stop > start && (isBlank(stop[-1]) || stop[-1] == '\r')) --stop;
+        field = std::string_view(start, stop - start);
+    }
+
+    if (pos < end && *pos == ',') {
+        ++pos;
+        // A comma followed only by the line end closes the record (no empty trailing field).
+        const char* look = pos;
+        while (look < end && (isBlank(*look) || *look == '\r')) ++look;
+        if (look == end || *look == '\n') {
+            pos = look < end ? look + 1 : look;
+            inRecord = false;
+        }
+    } else {
+        if (pos < end) ++pos;   // newline
+        inRecord = false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Splits CSV data into chunks that each start at a record boundary.
+ * The data is first cut at newlines near multiples of `target_chunk_bytes`. A newline is
+ * only a record boundary if it is outside quotes, so the number of quote characters in
+ * every piece is counted (in parallel when a pool is given) and a piece that starts inside
+ * a quoted field is joined to the previous one. Doubled quotes do not change the parity.
+ * @param data The CSV bytes.
+ * @param target_chunk_bytes Approximate chunk size.
+ * @param pool Optional thread pool for counting quotes.
+ * @return Record-aligned chunks covering `data` in order.
+ */
+std::vector<std::string_view> splitCsvChunks(std::string_view data, size_t target_chunk_bytes, ThreadPool* pool) {
+    const std::vector<std::string_view> pieces = splitOnNewlines(data, target_chunk_bytes);
+    std::vector<unsigned char> odd_quotes(pieces.size(), 0);
+    auto count_quotes = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            odd_quotes[i] = static_cast<unsigned char>(std::count(pieces[i].begin(), pieces[i].end(), '"') & 1);
+        }
+    };
+    if (pool != nullptr && pieces.size() > 1) pool->parallelFor(0, pieces.size(), 1, count_quotes);
+    else count_quotes(0, pieces.size());
+
+    std::vector<std::string_view> chunks;
+    bool inside_quotes = false;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        if (inside_quotes && !chunks.empty()) {
+            chunks.back() = std::string_view(chunks.back().data(), chunks.back().size() + pieces[i].size());
+        } else {
+            chunks.push_back(pieces[i]);
+        }
+        inside_quotes ^= odd_quotes[i] != 0;
+    }
+    return chunks;
+}
+
+
+/**
+ * @brief Maps a CSV file and splits it into record-aligned chunks sized for the pool.
+ * @param filename Path of the CSV file.
+ * @param file Output: the mapping the chunks point into (keep it alive while parsing).
+ * @param chunks Output: the record-aligned chunks.
+ * @param pool Optional thread pool; without one the whole file is a single chunk.
+ * @return `false` (after printing an error) if the file cannot be opened.
+ */
+bool openCsvChunks(const std::string& filename, MappedFile& file, std::vector<std::string_view>& chunks, ThreadPool* pool) {
+    chunks.clear();
+    if (!file.open(filename)) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        std::cerr << "Check if the file exists and has proper read permissions." << std::endl;
+        return false;
+    }
+    if (pool == nullptr) {
+        if (!file.empty()) chunks.push_back(file.view());
+        return true;
+    }
+    const size_t target_bytes = std::max<size_t>(1 << 20, file.size() / (4 * (pool->size() + 1)));
+    chunks = splitCsvChunks(file.view(), target_bytes, pool);
+    return true;
+}
+
+
+/**
+ * @brief Parses a float field with std::from_chars (an optional leading '+' is accepted).
+ * Like std::stof, trailing characters after the number are ignored.
+ * @return `false` if the field does not start with a number.
+ */
+bool parseCsvFloat(std::string_view field, float& value) {
+    if (!field.empty() && field.front() == '+') field.remove_prefix(1);
+    const auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc() && result.ptr != field.data();
+}
+
+
+/**
+ * @brief Parses an integer field with std::from_chars (an optional leading '+' is accepted).
+ * @return `false` if the field does not start with a number or is out of range.
+ */
+bool parseCsvInt(std::string_view field, int& value) {
+    if (!field.empty() && field.front() == '+') field.remove_prefix(1);
+    const auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc() && result.ptr != field.data();
+}
+
+
+/**
+ * @brief Reads a numeric CSV file (such as `_embeddings_only.csv`) into one contiguous matrix.
+ * The file is memory-mapped and split into record-aligned chunks that are parsed in
+ * parallel; the chunk results are then copied into place. The column count is taken from
+ * the first row; shorter rows are padded with 0.0f and longer rows are truncated.
+ * Fields that are not numbers are read as 0.0f.
+ * @param filename Path of the CSV file.
+ * @param pool Optional thread pool (nullptr parses on the calling thread).
+ * @return The parsed matrix (empty if the file cannot be read).
+ */
+CsvFloatMatrix readCsvFloatMatrix(const std::string& filename, ThreadPool* pool) {
+    CsvFloatMatrix matrix;
+    MappedFile file;
+    std::vector<std::string_view> chunks;
+    if (!openCsvChunks(filename, file, chunks, pool)) return matrix;
+
+    // Pass 1: parse every chunk into its own flat buffer, remembering each row's width.
+    struct ParsedChunk {
+        std::vector<float> values;
+        std::vector<uint32_t> rowWidths;
+    };
+    std::vector<ParsedChunk> parsed(chunks.size());
+    std::atomic<size_t> invalid_fields{0};
+    auto parse_chunks = [&](size_t lo, size_t hi) {
+        size_t invalid = 0;
+        for (size_t c = lo; c < hi; ++c) {
+            CsvRecordCursor cursor(chunks[c]);
+            std::string_view field;
+            while (cursor.nextRecord()) {
+                const size_t before = parsed[c].values.size();
+                while (cursor.nextField(field)) {
+                    float value = 0.0f;
+                    if (!parseCsvFloat(field, value)) {
+                        if (!field.empty()) invalid++;
+                        value = 0.0f;
+                    }
+                    parsed[c].values.push_back(value);
+                }
+                parsed[c].rowWidths.push_back(static_cast<uint32_t>(parsed[c].values.size() - before));
+            }
+        }
+        invalid_fields.fetch_add(invalid, std::memory_order_relaxed);
+    };
+    if (pool != nullptr && chunks.size() > 1) pool->parallelFor(0, chunks.size(), 1, parse_chunks);
+    else parse_chunks(0, chunks.size());
+
+    // Row offsets of every chunk and the matrix width.
+    std::vector<size_t> first_row(chunks.size() + 1, 0);
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        first_row[c + 1] = first_row[c] + parsed[c].rowWidths.size();
+        if (matrix.cols == 0 && !parsed[c].rowWidths.empty()) matrix.cols = parsed[c].rowWidths.front();
+    }
+    matrix.rows = first_row.back();
+    matrix.values.assign(matrix.rows * matrix.cols, 0.0f);
+
+    // Pass 2: copy the chunk buffers into place.
+    std::atomic<size_t> ragged_rows{0};
+    auto copy_chunks = [&](size_t lo, size_t hi) {
+        size_t ragged = 0;
+        for (size_t c = lo; c < hi; ++c) {
+            const float* src = parsed[c].values.data();
+            float* dst = matrix.values.data() + first_row[c] * matrix.cols;
+            for (uint32_t width : parsed[c].rowWidths) {
+                if (width != matrix.cols) ragged++;
+                std::copy(src, src + std::min<size_t>(width, matrix.cols), dst);
+                src += width;
+                dst += matrix.cols;
+            }
+            std::vector<float>().swap(parsed[c].values);
+        }
+        ragged_rows.fetch_add(ragged, std::memory_order_relaxed);
+    };
+    if (pool != nullptr && chunks.size() > 1) pool->parallelFor(0, chunks.size(), 1, copy_chunks);
+    else copy_chunks(0, chunks.size());
+
+    if (invalid_fields.load() > 0) {
+        std::cerr << "Warning: " << invalid_fields.load() << " non-numeric fields in file " << filename
+                  << " were read as 0.0f." << std::endl;
+    }
+    if (ragged_rows.load() > 0) {
+        std::cerr << "Warning: " << ragged_rows.load() << " rows in file " << filename << " do not have "
+                  << matrix.cols << " columns; they were padded or truncated." << std::endl;
+    }
+    if (matrix.rows == 0) {
+        std::cerr << "Warning: No data found in file " << filename << std::endl;
+    } else {
+        std::cout << "Successfully read " << matrix.rows << " rows from file " << filename << std::endl;
+    }
+    return matrix;
+}
@@ -0,0 +1,89 @@
+// csvwriter.cpp
+#include "include/csvwriter.hpp"
+#include <charconv>
+
+
+void CsvBuffer::appendInt(long long value) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    text.append(digits, result.ptr);
+}
+
+
+void CsvBuffer::appendFloat(float value) {
+    char digits[32];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    text.append(digits, result.ptr);
+}
+
+
+/**
+ * @brief Appends a field enclosed in double quotes, doubling any quotes inside it.
+ * @param field The raw field text.
+ */
+void CsvBuffer::appendQuoted(std::string_view field) {
+    text.push_back('"');
+    for (char c : field) {
+        if (c == '"') text.push_back('"');
+        text.push_back(c);
+    }
+    text.push_back('"');
+}
+
+
+/**
+ * @brief Appends a field, quoting it only when needed.
+ * Same rules as `escapeAndQuoteCsvField`: empty and all-whitespace fields and fields
+ * containing a comma, quote or line break are quoted.
+ * @param field The raw field text.
+ */
+void CsvBuffer::appendField(std::string_view field) {
+    const bool needs_quoting = field.empty()
+        || field.find_first_of(",\"\n\r") != std::string_view::npos
+        || field.find_first_not_of(" \t") == std::string_view::npos;
+    if (needs_quoting) appendQuoted(field);
+    else append(field);
+}
+
+
+/**
+ * @brief Opens (truncates) the output file.
+ * @param path Path of the CSV file.
+ * @param buffer_bytes Buffered bytes before the buffer is written to the file.
+ */
+CsvWriter::CsvWriter(const std::string& path, size_t buffer_bytes)
+    : file(path, std::ios::binary | std::ios::trunc), flushBytes(std::max<size_t>(1, buffer_bytes))
+{
+    buffer.reserve(flushBytes + (flushBytes >> 4));
+}
+
+
+// Writes one formatted block to the file and counts its rows.
+void CsvWriter::writeOut(const CsvBuffer& block) {
+    if (!file.is_open()) return;
+    file.write(block.str().data(), static_cast<std::streamsize>(block.size()));
+    if (!file) failed = true;
+    rowsWritten += block.rows();
+}
+
+
+// Writes the buffered rows to the file.
+void CsvWriter::flush() {
+    if (buffer.size() == 0) return;
+    writeOut(buffer);
+    buffer.clear();
+}
+
+
+/**
+ * @brief Flushes and closes the file.
+ * @return Number of rows written.
+ */
+size_t CsvWriter::close() {
+    if (file.is_open()) {
+        flush();
+        file.close();
+        if (file.fail()) failed = true;
+    }
+    return rowsWritten;
+}
@@ -1,7 +1,6 @@
 // support functions
 #include <iostream>
 #include <fstream>
-#include <random>       // For std::mt19937 and std::uniform_real_distribution
 #include <iomanip>      // For std::fixed and std::setprecision
 #include <vector>
 #include <algorithm>    // For std::sort
@@ -9,6 +8,18 @@
 #include "include/tokenise.hpp"
 
 
+/**
+ * @brief multiplicative inverse of a vector (v / ||v||^2), written into `inverse`
+ * A (near) zero vector has an all-zero inverse, as in the GPU kernels.
+ * @param vec vector input
+ * @param inverse output of the same size as `vec`
+ */
+void vectorInverse(std::span<const float> vec, std::span<float> inverse)
+{
+    const float magnitudeOfVec = squaredNorm(vec.data(), vec.size());
+    invertRow(vec.data(), inverse.data(), magnitudeOfVec, vec.size());
+}
+
 /**
  * @brief multiplicative inverse of a vector
  * @param vec vector input
@@ -17,13 +28,7 @@
 std::vector<float> vectorInverse(const std::vector<float> &vec)
 {
     std::vector<float> inverse(vec.size());
-    float magnitudeOfVec = 0.0f;
-    for (float val : vec) {
-        magnitudeOfVec += val * val;
-    }
-    for (size_t i = 0; i < vec.size(); ++i) {
-        inverse[i] = vec[i]/magnitudeOfVec;
-    }
+    vectorInverse(std::span<const float>(vec), std::span<float>(inverse));
     return inverse;
 }
 
@@ -34,81 +39,64 @@ std::vector<float> vectorInverse(const std::vector<float> &vec)
  * currently stored in the class. It uses either the CPU, CUDA, or OpenCL
  * implementation to calculate the embeddings and their inverses. Finally,
  * it saves the token-embedding pairs to a specified CSV file.
- * @param outputPath The file path where the token-embedding CSV should be saved.
- * @param r1 The lower bound for the random seed generation.
- * @throws std::runtime_error if the output file cannot be opened.
+ * @param outputPath Folder in which `_embeddings_only.csv` is saved.
+ * @param r1 Mean of the Poisson distribution the random factors are drawn from.
+ * @param seed Seed of the counter-based generator; the same seed gives the same embeddings
+ * on every run and for any number of threads.
+ * @return Number of embedding rows written (0 if the file could not be opened).
+ * @throws std::runtime_error if the vocabulary is empty or the CUDA/OpenCL backend reports an error.
  */
-void tokeniser::generateAndSaveEmbeddings(const std::string& embeddingCSVpath, float r1) {
+size_t tokeniser::generateAndSaveEmbeddings(const std::string& embeddingCSVpath, float r1, uint64_t seed) {
     if (this->tokens.empty()) {
         throw std::runtime_error("Error: Vocabulary is not trained. Cannot generate embeddings.");
     }
     this->vocSize = this->tokens.size();
 
-    std::cout << "-> Creating a temporary, lexicographically sorted token list for saving..." << std::endl;
-    std::vector<std::string> sorted_tokens_for_saving = this->tokens;
-    // std::sort(sorted_tokens_for_saving.begin(), sorted_tokens_for_saving.end());
-    std::unordered_map<std::string, int> token_to_original_index;
-
-    for(int i = 0; i < this->vocSize; ++i) {
-        token_to_original_index[this->tokens[i]] = i;
-    }
-
     std::string csvEmbeddingOnly = embeddingCSVpath + "/_embeddings_only.csv";
     // std::string tokenEmbeddingcsv = embeddingCSVpath + "/_tokenEmbedding.csv";
     // std::string csvDeEmbeddings = embeddingCSVpath + "/_deEmbedding.csv";
-    this->embeddings.resize(this->vocSize, std::vector<float>(this->d));
-    // this->deEmbeddings.resize(this->vocSize, std::vector<float>(this->d));   // or multiple of d (m*d)
-    
+    // Row i of the matrix is the embedding of token id i (formula in embeddingformula.hpp).
     #ifdef USE_CUDA
-        // Call the CUDA kernel wrapper
-        cuEmbeddingFormula(this->embeddings, this->seeds, this->d, this->vocSize, r1);
+        // Call the CUDA kernel wrapper; one fused kernel writes each row and its inverse
+        cuEmbeddingsWithInverse(this->embeddings, this->deEmbeddings, this->d, this->vocSize, r1, seed);
+        // The rows are still in device memory, so gatherEmbeddings need not upload them
+        embeddingsChanged();
+        CudaContext::getInstance().residentEmbeddings = this->embeddingsVersion;
     #elif USE_OPENCL
-        // Call the OpenCL kernel wrapper
-        clEmbeddingFormula(this->ocl, this->embeddings, this->seeds, this->d, this->vocSize, r1);
+        // Call the OpenCL kernel wrapper; one fused kernel writes each row and its inverse
+        clEmbeddingsWithInverse(this->ocl, this->embeddings, this->deEmbeddings, this->d, this->vocSize, r1, seed);
+        embeddingsChanged();
+        this->ocl.buffers->residentEmbeddings = this->embeddingsVersion;
     #else
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        // std::uniform_real_distribution<float> dis(r1, r2);
-        std::poisson_distribution<int> dis(r1);
-        this->embeddings.resize(this->vocSize);
-        // resizinig of each row and assigning embeddings
-        for (int i = 0; i < this->vocSize; ++i) {
-            this->embeddings[i].resize(this->d);
-            for (int j = 0; j < this->d; ++j) {
-                // random number * (-1)^(i+j) * (sin(i+1) + cos(j-1))
-                this->embeddings[i][j] = dis(gen) * (std::sin(i+1) + std::cos(j-1)) * 0.1 + 0.01;
-            }
-        }
+        generateEmbeddingsWithInverse(this->embeddings, this->deEmbeddings, this->vocSize, this->d, r1, seed, &getThreadPool());
+        embeddingsChanged();
     #endif
 
     std::cout << "-> Embedding generation complete." << std::endl;
     std::cout << "-> Saving only embeddings to: " << csvEmbeddingOnly << std::endl;
     // std::cout << "-> Saving tokens and embeddings to: " << tokenEmbeddingcsv << std::endl;
-    std::ofstream outFile1(csvEmbeddingOnly);
+    CsvWriter outFile1(csvEmbeddingOnly);
     // std::ofstream outFile2(tokenEmbeddingcsv);
-    if (!outFile1.is_open()) {
+    if (!outFile1.isOpen()) {
         std::cerr << "Error: Could not open file to save embeddings: " << csvEmbeddingOnly << std::endl;
-        return;
+        return 0;
     }
     /*if (!outFile2.is_open()) {
         std::cerr << "Error: Could not open file to save tokens and embeddings: " << tokenEmbeddingcsv << std::endl;
         return;
     }*/
 
-    // Iterate over the *learned tokens* (this->tokens) to ensure consistency
-    for (size_t i = 0; i < this->vocSize; ++i) {
-        const std::string& token = this->tokens[i];
-        std::vector<float> embedding = embeddings[i];
-        // Store in mappedEmbeddings for later use (optional, but good practice)
-        // outfile2 << mappedEmbeddings->first() << ",";
-        this->mappedEmbeddings[token] = embedding;
-        // Write to CSV, handling quoting for tokens
-        std::string escaped_token = escapeAndQuoteCsvField(token);
-        // outFile2 << escaped_token; // Always use the helper function for the token
-        for (float val : embedding) { outFile1 << val << ","; } outFile1 << "\n";
-        // for (float val : embedding) { outFile2 << val << ","; } outFile2 << "\n";
+    // Iterate over the *learned tokens* (this->tokens) to ensure consistency; rows are
+    // formatted in parallel blocks and written in token order.
+    outFile1.writeRows(this->vocSize, &getThreadPool(), [this](size_t i, CsvBuffer& out) {
+        for (float val : this->embeddings.row(i)) { out.appendFloat(val); out.append(','); }
+        out.endRow();
+    });
+    const size_t rows = outFile1.close();
+    if (!outFile1.good()) {
+        std::cerr << "Error: Failed while writing embeddings: " << csvEmbeddingOnly << std::endl;
     }
-    outFile1.close();
-    std::cout << "Successfully saved " << this->tokens.size() << " embeddings to " 
+    std::cout << "Successfully saved " << rows << " embeddings to " 
               << embeddingCSVpath << " (and token mappings)" << std::endl;
+    return rows;
 }
@@ -0,0 +1,214 @@
+// embeddingformula.cpp
+#include "include/embeddingformula.hpp"
+#include "include/embeddingmatrix.hpp"
+#include "include/threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EMBEDDING_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define EMBEDDING_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define EMBEDDING_NEON 1
+#endif
+
+
+/**
+ * @brief Builds the table for Poisson(lambda); lambda <= 0 always draws 0.
+ * The probabilities are summed in double precision in log space (so large lambdas do
+ * not underflow). The tail beyond lambda + 20 sqrt(lambda) + 40 is below the 2^-24
+ * resolution of a draw and is folded into the last entry.
+ */
+PoissonTable::PoissonTable(float lambda) {
+    const uint32_t one = 1u << UNIFORM_BITS;
+    std::vector<uint32_t> thresholds;
+    if (!(lambda > 0.0f)) {
+        thresholds.push_back(one);
+    }
+    else {
+        const double mean = lambda;
+        const double log_mean = std::log(mean);
+        const size_t last_k = static_cast<size_t>(mean + 20.0 * std::sqrt(mean) + 40.0);
+        double cdf = 0.0;
+        for (size_t k = 0; ; ++k) {
+            cdf += std::exp(-mean + static_cast<double>(k) * log_mean - std::lgamma(static_cast<double>(k) + 1.0));
+            uint32_t threshold = cdf >= 1.0 ? one : static_cast<uint32_t>(cdf * one);
+            if (k >= last_k) threshold = one;
+            thresholds.push_back(threshold);
+            if (threshold == one) break;
+        }
+    }
+
+    table.resize(GUIDE_SIZE + thresholds.size());
+    uint32_t k = 0;
+    for (uint32_t b = 0; b < GUIDE_SIZE; ++b) {
+        const uint32_t bucket_start = b << (UNIFORM_BITS - GUIDE_BITS);
+        while (thresholds[k] <= bucket_start) ++k;     // ends at the last threshold (== one)
+        table[b] = k;
+    }
+    std::copy(thresholds.begin(), thresholds.end(), table.begin() + GUIDE_SIZE);
+}
+
+
+/**
+ * @brief Turns a row of Poisson draws into embedding values in place.
+ * row[j] = row[j] * (row_sin + col_cos[j]) * 0.1 + 0.01
+ * @return The squared norm of the finished row.
+ */
+float finishEmbeddingRow(float* row, const float* col_cos, float row_sin, size_t d) {
+    size_t j = 0;
+    float sum = 0.0f;
+#if defined(EMBEDDING_AVX2)
+    const __m256 s = _mm256_set1_ps(row_sin), scale = _mm256_set1_ps(0.1f), bias = _mm256_set1_ps(0.01f);
+    __m256 acc = _mm256_setzero_ps();
+    for (; j + 8 <= d; j += 8) {
+        const __m256 k = _mm256_loadu_ps(row + j);
+        const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(k, _mm256_add_ps(s, _mm256_loadu_ps(col_cos + j))), scale), bias);
+        _mm256_storeu_ps(row + j, v);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(v, v));
+    }
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, half);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(EMBEDDING_SSE2)
+    const __m128 s = _mm_set1_ps(row_sin), scale = _mm_set1_ps(0.1f), bias = _mm_set1_ps(0.01f);
+    __m128 acc = _mm_setzero_ps();
+    for (; j + 4 <= d; j += 4) {
+        const __m128 k = _mm_loadu_ps(row + j);
+        const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(k, _mm_add_ps(s, _mm_loadu_ps(col_cos + j))), scale), bias);
+        _mm_storeu_ps(row + j, v);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(EMBEDDING_NEON)
+    const float32x4_t s = vdupq_n_f32(row_sin), scale = vdupq_n_f32(0.1f), bias = vdupq_n_f32(0.01f);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; j + 4 <= d; j += 4) {
+        const float32x4_t k = vld1q_f32(row + j);
+        const float32x4_t v = vaddq_f32(vmulq_f32(vmulq_f32(k, vaddq_f32(s, vld1q_f32(col_cos + j))), scale), bias);
+        vst1q_f32(row + j, v);
+        acc = vaddq_f32(acc, vmulq_f32(v, v));
+    }
+    sum = vaddvq_f32(acc);
+#endif
+    for (; j < d; ++j) {
+        const float v = row[j] * (row_sin + col_cos[j]) * 0.1f + 0.01f;
+        row[j] = v;
+        sum += v * v;
+    }
+    return sum;
+}
+
+
+/**
+ * @brief Squared Euclidean norm of n floats.
+ */
+float squaredNorm(const float* v, size_t n) {
+    size_t j = 0;
+    float sum = 0.0f;
+#if defined(EMBEDDING_AVX2)
+    __m256 acc = _mm256_setzero_ps();
+    for (; j + 8 <= n; j += 8) {
+        const __m256 x = _mm256_loadu_ps(v + j);
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(x, x));
+    }
+    const __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, half);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(EMBEDDING_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; j + 4 <= n; j += 4) {
+        const __m128 x = _mm_loadu_ps(v + j);
+        acc = _mm_add_ps(acc, _mm_mul_ps(x, x));
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(EMBEDDING_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; j + 4 <= n; j += 4) {
+        const float32x4_t x = vld1q_f32(v + j);
+        acc = vaddq_f32(acc, vmulq_f32(x, x));
+    }
+    sum = vaddvq_f32(acc);
+#endif
+    for (; j < n; ++j) sum += v[j] * v[j];
+    return sum;
+}
+
+
+/**
+ * @brief inverse = v / squared_norm, or all zeros if squared_norm is (nearly) zero.
+ */
+void invertRow(const float* v, float* inverse, float squared_norm, size_t n) {
+    if (!(squared_norm > 1e-9f)) {
+        std::fill(inverse, inverse + n, 0.0f);
+        return;
+    }
+    size_t j = 0;
+#if defined(EMBEDDING_AVX2)
+    const __m256 q = _mm256_set1_ps(squared_norm);
+    for (; j + 8 <= n; j += 8) _mm256_storeu_ps(inverse + j, _mm256_div_ps(_mm256_loadu_ps(v + j), q));
+#elif defined(EMBEDDING_SSE2)
+    const __m128 q = _mm_set1_ps(squared_norm);
+    for (; j + 4 <= n; j += 4) _mm_storeu_ps(inverse + j, _mm_div_ps(_mm_loadu_ps(v + j), q));
+#elif defined(EMBEDDING_NEON)
+    const float32x4_t q = vdupq_n_f32(squared_norm);
+    for (; j + 4 <= n; j += 4) vst1q_f32(inverse + j, vdivq_f32(vld1q_f32(v + j), q));
+#endif
+    for (; j < n; ++j) inverse[j] = v[j] / squared_norm;
+}
+
+
+/**
+ * @brief Generates rows x d embeddings and their inverses on the CPU.
+ * Rows are generated in parallel on the pool; each row draws its Poisson values from
+ * the counter-based generator, then is finished and inverted with the SIMD row helpers.
+ * sin(i + 1) is computed once per row and cos(j - 1) once per column.
+ * @param embeddings Output, resized to rows x d.
+ * @param inverses Output, resized to rows x d.
+ * @param rows Number of rows (tokens).
+ * @param d Embedding dimension.
+ * @param r1 Mean of the Poisson distribution.
+ * @param seed Generator seed; the same seed gives the same matrices for any thread count.
+ * @param pool Optional thread pool (nullptr generates on the calling thread).
+ */
+void generateEmbeddingsWithInverse(EmbeddingMatrix& embeddings, EmbeddingMatrix& inverses, size_t rows, size_t d,
+    float r1, uint64_t seed, ThreadPool* pool)
+{
+    embeddings.resize(rows, d);
+    inverses.resize(rows, d);
+    if (rows == 0 || d == 0) return;
+
+    const PoissonTable poisson(r1);
+    std::vector<float> col_cos(d);
+    for (size_t j = 0; j < d; ++j) {
+        col_cos[j] = static_cast<float>(std::cos(static_cast<double>(j) - 1.0));
+    }
+    float* const out = embeddings.data();
+    float* const inv = inverses.data();
+
+    auto generate_rows = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            float* row = out + i * d;
+            const uint64_t first_counter = static_cast<uint64_t>(i) * d;
+            for (size_t j = 0; j < d; ++j) {
+                row[j] = static_cast<float>(poisson.sample(embeddingRandom(seed, first_counter + j)));
+            }
+            const float row_sin = static_cast<float>(std::sin(static_cast<double>(i) + 1.0));
+            const float squared_norm = finishEmbeddingRow(row, col_cos.data(), row_sin, d);
+            invertRow(row, inv + i * d, squared_norm, d);
+        }
+    };
+    const size_t grain = std::max<size_t>(1, 16384 / d);
+    if (pool != nullptr) pool->parallelFor(0, rows, grain, generate_rows);
+    else generate_rows(0, rows);
+}
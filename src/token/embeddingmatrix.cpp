@@ -0,0 +1,153 @@
+// embeddingmatrix.cpp
+#include "include/embeddingmatrix.hpp"
+#include "include/threadpool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+
+void EmbeddingMatrix::AlignedDelete::operator()(float* p) const {
+    ::operator delete[](p, std::align_val_t(ALIGNMENT));
+}
+
+
+// Allocates an aligned, zero-initialised buffer of `count` floats (null for 0).
+std::unique_ptr<float[], EmbeddingMatrix::AlignedDelete> EmbeddingMatrix::allocate(size_t count) {
+    if (count == 0) return nullptr;
+    float* p = static_cast<float*>(::operator new[](count * sizeof(float), std::align_val_t(ALIGNMENT)));
+    std::fill(p, p + count, 0.0f);
+    return std::unique_ptr<float[], AlignedDelete>(p);
+}
+
+
+/**
+ * @brief Creates a read-only view of rows that live elsewhere.
+ * @param data The first row; rows x cols floats, row-major.
+ * @param rows Number of rows.
+ * @param cols Number of columns.
+ * @param owner Keeps `data` alive for as long as the view (or a copy of it) exists.
+ */
+EmbeddingMatrix EmbeddingMatrix::view(const float* data, size_t rows, size_t cols, std::shared_ptr<const void> owner) {
+    EmbeddingMatrix matrix;
+    if (rows * cols == 0) return matrix;
+    matrix.viewData = data;
+    matrix.viewOwner = std::move(owner);
+    matrix.numRows = rows;
+    matrix.numCols = cols;
+    return matrix;
+}
+
+
+EmbeddingMatrix::EmbeddingMatrix(const EmbeddingMatrix& other)
+    : viewData(other.viewData), viewOwner(other.viewOwner), numRows(other.numRows), numCols(other.numCols)
+{
+    if (other.storage) {
+        storage = allocate(size());
+        std::memcpy(storage.get(), other.storage.get(), size() * sizeof(float));
+    }
+}
+
+EmbeddingMatrix& EmbeddingMatrix::operator=(const EmbeddingMatrix& other) {
+    if (this != &other) {
+        EmbeddingMatrix copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+EmbeddingMatrix::EmbeddingMatrix(EmbeddingMatrix&& other) noexcept
+    : storage(std::move(other.storage)),
+      viewData(std::exchange(other.viewData, nullptr)),
+      viewOwner(std::move(other.viewOwner)),
+      numRows(std::exchange(other.numRows, 0)),
+      numCols(std::exchange(other.numCols, 0))
+{}
+
+EmbeddingMatrix& EmbeddingMatrix::operator=(EmbeddingMatrix&& other) noexcept {
+    if (this != &other) {
+        storage = std::move(other.storage);
+        viewData = std::exchange(other.viewData, nullptr);
+        viewOwner = std::move(other.viewOwner);
+        numRows = std::exchange(other.numRows, 0);
+        numCols = std::exchange(other.numCols, 0);
+    }
+    return *this;
+}
+
+
+/**
+ * @brief Reshapes the matrix to rows x cols, all zeros (previous contents are dropped).
+ */
+void EmbeddingMatrix::resize(size_t rows, size_t cols) {
+    clear();
+    storage = allocate(rows * cols);
+    if (storage) {
+        numRows = rows;
+        numCols = cols;
+    }
+}
+
+
+/**
+ * @brief Replaces the contents with a copy of rows x cols row-major values.
+ */
+void EmbeddingMatrix::assign(size_t rows, size_t cols, const float* values) {
+    resize(rows, cols);
+    if (storage) std::memcpy(storage.get(), values, size() * sizeof(float));
+}
+
+
+void EmbeddingMatrix::clear() {
+    storage.reset();
+    viewData = nullptr;
+    viewOwner.reset();
+    numRows = 0;
+    numCols = 0;
+}
+
+
+// Copies the rows of a view into an owned buffer before they are modified.
+void EmbeddingMatrix::makeOwned() {
+    if (viewData == nullptr) return;
+    std::unique_ptr<float[], AlignedDelete> owned = allocate(size());
+    std::memcpy(owned.get(), viewData, size() * sizeof(float));
+    storage = std::move(owned);
+    viewData = nullptr;
+    viewOwner.reset();
+}
+
+
+bool EmbeddingMatrix::operator==(const EmbeddingMatrix& other) const {
+    return numRows == other.numRows && numCols == other.numCols
+        && std::equal(data(), data() + size(), other.data());
+}
+
+
+/**
+ * @brief Gathers the rows of `ids` into one contiguous count x cols() buffer.
+ * Each row is one memcpy (vectorised by the library); blocks of about 64 KiB of rows
+ * are claimed by the pool's workers, so a batch of a few tokens stays on the calling thread.
+ */
+void gatherRows(const EmbeddingMatrix& matrix, const int32_t* ids, size_t count, float* out, ThreadPool* pool) {
+    const size_t d = matrix.cols();
+    if (count == 0 || d == 0) return;
+    const float* const rows = matrix.data();
+    const size_t vocab = matrix.rows();
+
+    auto gather = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            float* dst = out + i * d;
+            const int32_t id = ids[i];
+            if (id >= 0 && static_cast<size_t>(id) < vocab) {
+                std::memcpy(dst, rows + static_cast<size_t>(id) * d, d * sizeof(float));
+            }
+            else {
+                std::fill(dst, dst + d, 0.0f);
+            }
+        }
+    };
+    const size_t grain = std::max<size_t>(1, 16384 / d);
+    if (pool != nullptr) pool->parallelFor(0, count, grain, gather);
+    else gather(0, count);
+}
@@ -0,0 +1,194 @@
+// encode.cpp
+#include "include/tokenise.hpp"
+#include <algorithm>
+#include <string_view>
+
+
+/**
+ * @brief Appends the token ids of a single (lower-cased) word.
+ * Same greedy longest-match over the word followed by "</w>" as `splitWord`, but the
+ * ids come straight from the prefix index, so no token strings are created.
+ * @param word The word to be tokenized.
+ * @param ids Output: the word's ids are appended (EncodedBatch::UNKNOWN_ID for unknown characters).
+ */
+void tokeniser::splitWordIds(std::string_view word, std::vector<int32_t>& ids) const {
+    if (word.empty()) return;
+
+    static constexpr std::string_view end_of_word = "</w>";
+    const size_t total_length = word.length() + end_of_word.length();
+
+    size_t pos = 0;
+    while (pos < total_length) {
+        const std::string_view head = pos < word.length() ? word.substr(pos) : std::string_view();
+        const std::string_view tail = pos < word.length() ? end_of_word : end_of_word.substr(pos - word.length());
+
+        size_t match_length = 0;
+        const int token_index = this->prefixIndex.longestPrefix(head, tail, match_length);
+        if (token_index >= 0) {
+            ids.push_back(token_index);
+            pos += match_length;
+        }
+        else {
+            ids.push_back(EncodedBatch::UNKNOWN_ID);
+            pos += 1;
+        }
+    }
+}
+
+
+/**
+ * @brief Appends the token ids of a single (lower-cased) word by replaying the merges.
+ * The word starts as its characters followed by "</w>", the symbols training started
+ * from, and the learned merges are applied lowest rank first (see MergeRankTable::apply),
+ * so a word seen in training gets exactly the segmentation BPE learned for it.
+ * @param word The word to be tokenized.
+ * @param ids Output: the word's ids are appended (EncodedBatch::UNKNOWN_ID for unknown characters).
+ */
+void tokeniser::mergeWordIds(std::string_view word, std::vector<int32_t>& ids) const {
+    if (word.empty()) return;
+
+    const size_t first = ids.size();
+    for (size_t i = 0; i < word.length(); ++i) {
+        const int token_index = this->prefixIndex.find(word.substr(i, 1));
+        ids.push_back(token_index >= 0 ? token_index : EncodedBatch::UNKNOWN_ID);
+    }
+    const int end_index = this->prefixIndex.find("</w>");
+    ids.push_back(end_index >= 0 ? end_index : EncodedBatch::UNKNOWN_ID);
+    this->mergeRanks.apply(ids, first);
+}
+
+
+/**
+ * @brief Appends the token ids of one document.
+ * Words and punctuation are found by the pre-tokenizer of the base alphabet, as in
+ * `splitSentence` and the training corpus scan. Each lower-cased word is looked up in the word cache before it is split
+ * with `splitWordIds` or `mergeWordIds`, depending on the encoder mode.
+ * @param text The document.
+ * @param ids Output: the document's ids are appended.
+ */
+void tokeniser::encodeDocument(std::string_view text, std::vector<int32_t>& ids) const {
+    WordIdCache* cache = this->wordCache.get();
+
+    preTokenize(text,
+        [&](std::string_view word) {
+            if (cache == nullptr || !cache->lookup(word, ids)) {
+                const size_t first = ids.size();
+                if (this->encoderMode == EncoderMode::MergeRank) mergeWordIds(word, ids);
+                else splitWordIds(word, ids);
+                if (cache != nullptr) cache->insert(word, ids.data() + first, ids.size() - first);
+            }
+        },
+        [&](std::string_view symbol) {
+            // Punctuation or another symbol, kept as a single token
+            const int token_index = this->prefixIndex.find(symbol);
+            ids.push_back(token_index >= 0 ? token_index : EncodedBatch::UNKNOWN_ID);
+        });
+}
+
+
+/**
+ * @brief Encodes a batch of documents into one flat id buffer using the thread pool.
+ * Documents are split into chunks that the pool's workers encode independently; the
+ * chunk buffers are then copied into place in parallel. The output is identical for
+ * any number of threads; without setNumThreads the pool has one worker (see
+ * getThreadPool), so tokenisers from loadModel or the path constructor encode safely.
+ * @param documents The documents to encode (views must stay valid during the call).
+ * @param batch Output: ids and per-document offsets (previous contents are replaced).
+ */
+void tokeniser::encode(const std::vector<std::string_view>& documents, EncodedBatch& batch) const {
+    batch.ids.clear();
+    batch.offsets.assign(documents.size() + 1, 0);
+    if (documents.empty()) return;
+    if (documents.size() == 1) {
+        // Nothing to split: encode on the calling thread without touching the pool.
+        encodeDocument(documents[0], batch.ids);
+        batch.offsets[1] = batch.ids.size();
+        return;
+    }
+
+    ThreadPool& pool = getThreadPool();
+    const size_t grain = std::max<size_t>(1, documents.size() / (8 * (pool.size() + 1)));
+    const size_t num_chunks = (documents.size() + grain - 1) / grain;
+
+    // Pass 1: every chunk encodes into its own buffer and records document lengths in offsets[d + 1].
+    std::vector<std::vector<int32_t>> chunk_ids(num_chunks);
+    pool.parallelFor(0, num_chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t c = first_chunk; c < last_chunk; ++c) {
+            const size_t last_doc = std::min(documents.size(), (c + 1) * grain);
+            for (size_t d = c * grain; d < last_doc; ++d) {
+                const size_t before = chunk_ids[c].size();
+                encodeDocument(documents[d], chunk_ids[c]);
+                batch.offsets[d + 1] = chunk_ids[c].size() - before;
+            }
+        }
+    });
+
+    // Prefix sum over the lengths gives the offsets; chunk c starts at the offset of its first document.
+    for (size_t d = 0; d < documents.size(); ++d) {
+        batch.offsets[d + 1] += batch.offsets[d];
+    }
+    batch.ids.resize(batch.offsets.back());
+
+    // Pass 2: copy the chunk buffers into place.
+    pool.parallelFor(0, num_chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        for (size_t c = first_chunk; c < last_chunk; ++c) {
+            std::copy(chunk_ids[c].begin(), chunk_ids[c].end(), batch.ids.begin() + batch.offsets[c * grain]);
+            std::vector<int32_t>().swap(chunk_ids[c]);
+        }
+    });
+}
+
+/**
+ * @brief Convenience overload of `encode` for owned strings.
+ * @param documents The documents to encode.
+ * @return The ids and per-document offsets.
+ */
+EncodedBatch tokeniser::encode(const std::vector<std::string>& documents) const {
+    std::vector<std::string_view> views(documents.begin(), documents.end());
+    EncodedBatch batch;
+    encode(views, batch);
+    return batch;
+}
+
+
+/**
+ * @brief Encodes a single text into token ids on the calling thread.
+ * @param text The text to encode.
+ * @param ids Output: the text's ids (previous contents are replaced).
+ */
+void tokeniser::encodeToIds(std::string_view text, std::vector<int32_t>& ids) const {
+    ids.clear();
+    encodeDocument(text, ids);
+}
+
+
+/**
+ * @brief Turns token ids back into text, appending straight from the vocabulary strings.
+ * A trailing "</w>" becomes a space and "</s>" a newline; other tokens that do not start
+ * with a letter (punctuation) are followed by a space, letter pieces are concatenated.
+ * Unknown and out-of-range ids are skipped. Casing is not restored.
+ * @param ids The token ids.
+ * @param count Number of ids.
+ * @param text Output: the decoded text is appended.
+ */
+void tokeniser::decodeIds(const int32_t* ids, size_t count, std::string& text) const {
+    static constexpr std::string_view end_of_word = "</w>";
+    static constexpr std::string_view end_of_sentence = "</s>";
+
+    for (size_t i = 0; i < count; ++i) {
+        if (ids[i] < 0 || static_cast<size_t>(ids[i]) >= this->tokens.size()) continue;
+        const std::string_view token = this->tokens[ids[i]];
+
+        if (token == end_of_sentence) {
+            text += '\n';
+        }
+        else if (token.size() >= end_of_word.size() && token.substr(token.size() - end_of_word.size()) == end_of_word) {
+            text.append(token.data(), token.size() - end_of_word.size());
+            text += ' ';
+        }
+        else {
+            text.append(token.data(), token.size());
+            if (!token.empty() && !isWordToken(token)) text += ' ';
+        }
+    }
+}
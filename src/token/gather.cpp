@@ -0,0 +1,100 @@
+// gather.cpp
+#include "include/tokenise.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+
+/**
+ * @brief Gives the embedding matrix a new, process-wide unique version.
+ * The CUDA and OpenCL contexts remember the version of the matrix they hold, so a
+ * gather uploads the embeddings only when they changed since the last upload (or
+ * another tokeniser's matrix replaced them). Copies of a tokeniser keep the version
+ * of their (equal) matrix.
+ */
+void tokeniser::embeddingsChanged() {
+    static std::atomic<uint64_t> nextVersion{ 1 };
+    this->embeddingsVersion = nextVersion.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+// Number of ids of the longest document.
+size_t EncodedBatch::maxDocumentLength() const {
+    size_t longest = 0;
+    for (size_t i = 0; i < documentCount(); ++i) longest = std::max(longest, documentLength(i));
+    return longest;
+}
+
+
+/**
+ * @brief Lays the documents out as a documentCount() x seqLen grid of ids.
+ * Row b holds the first seqLen ids of document b; shorter documents are filled with `pad`.
+ * @param seqLen Ids per row (0 = the longest document).
+ * @param grid Output, resized to documentCount() x seqLen.
+ * @param pad Id of the padding positions (UNKNOWN_ID gathers as a row of zeros).
+ */
+void EncodedBatch::padded(size_t seqLen, std::vector<int32_t>& grid, int32_t pad) const {
+    if (seqLen == 0) seqLen = maxDocumentLength();
+    const size_t documents = documentCount();
+    grid.assign(documents * seqLen, pad);
+    for (size_t b = 0; b < documents; ++b) {
+        const size_t length = std::min(seqLen, documentLength(b));
+        std::copy_n(ids.begin() + offsets[b], length, grid.begin() + b * seqLen);
+    }
+}
+
+
+/**
+ * @brief Embeddings of a flat buffer of token ids: row i of `out` is the embedding of ids[i].
+ * On the CPU the rows are copied in parallel on the thread pool (num_threads workers, one
+ * unless setNumThreads was called). The CUDA and OpenCL backends gather on the device
+ * from the resident embedding matrix (uploaded once, see embeddingsChanged) and copy only
+ * the result back; use cuGatherEmbeddingsToDevice or clGatherEmbeddingsToDevice to keep it
+ * on the device (e.g. as neuralNet input).
+ * Ids outside the vocabulary (EncodedBatch::UNKNOWN_ID, padding) give rows of zeros.
+ * @param ids Token ids, e.g. EncodedBatch::ids.
+ * @param count Number of ids.
+ * @param out count x d floats.
+ * @throws std::runtime_error if the embeddings are not generated or loaded, or the
+ * CUDA/OpenCL backend reports an error.
+ */
+void tokeniser::gatherEmbeddings(const int32_t* ids, size_t count, float* out) const {
+    if (this->embeddings.empty()) {
+        throw std::runtime_error("Error: Embeddings are not generated or loaded. Cannot gather embeddings.");
+    }
+    if (count == 0) return;
+    #ifdef USE_CUDA
+        cuGatherEmbeddings(ids, count, out);
+    #elif USE_OPENCL
+        clGatherEmbeddings(this->ocl, ids, count, out);
+    #else
+        // A batch that fits in one block is copied on the calling thread without the pool.
+        const bool parallel = count * this->embeddings.cols() > 16384;
+        gatherRows(this->embeddings, ids, count, out, parallel ? &getThreadPool() : nullptr);
+    #endif
+}
+
+
+void tokeniser::gatherEmbeddings(const std::vector<int32_t>& ids, std::vector<float>& out) const {
+    out.resize(ids.size() * this->embeddings.cols());
+    gatherEmbeddings(ids.data(), ids.size(), out.data());
+}
+
+
+/**
+ * @brief Embeddings of a batch as a [documents x seqLen x d] tensor.
+ * Row b * seqLen + t of the result is the embedding of token t of document b. Documents
+ * longer than seqLen are truncated; the positions after the end of a shorter document
+ * are rows of zeros (see EncodedBatch::padded).
+ * @param batch Output of encode().
+ * @param seqLen Tokens per document (0 = the longest document of the batch).
+ * @return (documentCount() * seqLen) x d matrix.
+ * @throws std::runtime_error as gatherEmbeddings(ids, count, out).
+ */
+EmbeddingMatrix tokeniser::gatherEmbeddings(const EncodedBatch& batch, size_t seqLen) const {
+    std::vector<int32_t> grid;
+    batch.padded(seqLen, grid);
+    EmbeddingMatrix tensor(grid.size(), this->embeddings.cols());
+    if (!grid.empty()) gatherEmbeddings(grid.data(), grid.size(), tensor.data());
+    return tensor;
+}
@@ -15,13 +15,15 @@
 #include <future>
 #include <string_view>
 #include <cctype>
+#include <optional>
 
 
 /**
  * @brief (INVERTED INDEX OPTIMIZATION) Learns a BPE vocabulary with extreme speed.
  * This version uses an inverted index to track which words are affected by a merge.
- * It includes corrected initialization logic and robust debugging logs to verify
- * each stage of the process.
+ * The merge loop itself runs on the integer-id BpeTrainer (bpe.cpp): symbols are
+ * interned ids, pairs are packed 64-bit keys and word splits are one flat array,
+ * so strings are only materialised when the final vocabulary is assembled.
  * @param corpus_word_counts A map of unique words and their frequencies.
  * @param num_merges The number of merge operations to perform.
  * @param final_vocab Output vector to store the learned vocabulary tokens.
@@ -30,51 +32,81 @@ void tokeniser::groupCommonTokens(const std::unordered_map<std::string, int>& co
     std::vector<std::string>& final_vocab) 
 {
     // 1. INITIAL SETUP
+    // One metrics stage per step: setup, the merge loop, finalization.
+    PipelineMetrics& metrics = this->bpe_progress->metrics;
+    std::optional<PipelineMetrics::Stage> stage(std::in_place, metrics, "bpe_setup");
     std::set<std::string> vocab;
-    std::map<std::string, int> bpe_word_counts;
-    std::map<std::string, std::vector<std::string>> splits;
-
-    // A robust check for what constitutes a "word" to be split by BPE.
-    auto is_word_for_bpe = [](const std::string& s) {
-        return !s.empty() && std::isalpha(static_cast<unsigned char>(s[0])) && s.length() > 1;
-    };
+    // Pointers into corpus_word_counts; sorted so word ids follow lexicographic order.
+    std::vector<const std::pair<const std::string, int>*> bpe_words;
 
     // --- Step 1a: Separate raw tokens into BPE candidates and atomic tokens ---
+    // Candidates rejected by the corpus filter are not split; only their characters are kept.
+    const CorpusFilter& filter = this->corpusFilter;
+    bool filtered_chars[256] = {};
+    size_t filtered_words = 0;
     std::cout << "[DEBUG] Total unique raw tokens received: " << corpus_word_counts.size() << std::endl;
     for (const auto& pair : corpus_word_counts) {
-        if (is_word_for_bpe(pair.first)) {
-            bpe_word_counts[pair.first] = pair.second;
+        if (isMergeWordToken(pair.first)) {
+            if (pair.second >= filter.minCount && (filter.maxWordLength == 0 || pair.first.length() <= filter.maxWordLength)) {
+                bpe_words.push_back(&pair);
+            }
+            else {
+                for (const char c : pair.first) filtered_chars[static_cast<unsigned char>(c)] = true;
+                filtered_words++;
+            }
         } else {
             // This includes punctuation, symbols, and single-letter words.
             vocab.insert(pair.first);
         }
     }
-    std::cout << "[DEBUG] Number of words selected for BPE processing: \t\t" << bpe_word_counts.size() << std::endl;
+    if (filter.topK > 0 && bpe_words.size() > filter.topK) {
+        // Keep the K most frequent words (ties broken alphabetically, so the choice is deterministic).
+        auto more_frequent = [](const auto* a, const auto* b) {
+            return a->second != b->second ? a->second > b->second : a->first < b->first;
+        };
+        std::nth_element(bpe_words.begin(), bpe_words.begin() + filter.topK, bpe_words.end(), more_frequent);
+        for (auto it = bpe_words.begin() + filter.topK; it != bpe_words.end(); ++it) {
+            for (const char c : (*it)->first) filtered_chars[static_cast<unsigned char>(c)] = true;
+        }
+        filtered_words += bpe_words.size() - filter.topK;
+        bpe_words.resize(filter.topK);
+    }
+    for (int c = 0; c < 256; ++c) {
+        // The byte-level alphabet holds every non-space byte, seen in the corpus or not.
+        const bool base_byte = this->baseAlphabet == BaseAlphabet::Bytes && !asciiIsSpace(static_cast<unsigned char>(c));
+        if (filtered_chars[c] || base_byte) vocab.insert(std::string(1, static_cast<char>(c)));
+    }
+    std::sort(bpe_words.begin(), bpe_words.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+    if (filtered_words > 0) {
+        std::cout << "[DEBUG] Words left out of BPE by the corpus filter: \t\t" << filtered_words << std::endl;
+    }
+    std::cout << "[DEBUG] Number of words selected for BPE processing: \t\t" << bpe_words.size() << std::endl;
     std::cout << "[DEBUG] Number of initial atomic tokens (punctuation, etc.): \t" << vocab.size() << std::endl;
     std::cout << "[DEBUG] Number of Mergers to be made: \t\t\t\t" << num_merges << std::endl;
 
-    if (bpe_word_counts.empty()) {
+    if (bpe_words.empty()) {
         std::cerr << "[WARNING] No words were long enough for BPE splitting. The vocabulary will consist of only initial tokens." << std::endl;
         final_vocab.assign(vocab.begin(), vocab.end());
         this->tokens = final_vocab;
+        this->merges.clear();
         this->vocSize = this->tokens.size();
+        buildPrefixIndex();
+        buildMergeRanks();
         return; // Exit gracefully
     }
 
     // --- Step 1b: Create initial character-level splits and populate base vocabulary ---
-    for (const auto& pair : bpe_word_counts) {
-        const std::string& word = pair.first;
-        std::vector<std::string> chars;
-        for (char c : word) {
-            std::string s(1, c);
-            chars.push_back(s);
-            vocab.insert(s); // Add every single character to the initial vocab
-        }
-        chars.push_back("</w>"); // Add the essential end-of-word token
-        splits[word] = std::move(chars);
+    // Every single character becomes a symbol of the trainer; "</w>" is interned up front.
+    BpeTrainer trainer;
+    trainer.setThreadPool(&getThreadPool());
+    for (const auto* pair : bpe_words) {
+        trainer.addWord(pair->first, pair->second);
+    }
+    for (const auto& symbol : trainer.getSymbols()) {
+        vocab.insert(symbol);   // Add every single character and "</w>" to the initial vocab
     }
-    vocab.insert("</w>");       // Ensure end-of-word token in the vocab
     vocab.insert("</s>");       // Ensure end-of-sentence token in the vocab
+    const size_t initial_symbol_count = trainer.getSymbols().size();
     {
         for(auto& token : vocab) {
             std::cout << token << " ";
@@ -83,99 +115,114 @@ void tokeniser::groupCommonTokens(const std::unordered_map<std::string, int>& co
     std::cout << std::endl;
 
     // 2. BUILD INITIAL STATS AND INVERTED INDEX (ONCE!)
-    std::cout << "Building initial statistics and inverted index..." << std::endl;
-    std::map<std::pair<std::string, std::string>, int> pair_stats;
-    std::map<std::pair<std::string, std::string>, std::vector<std::string>> inverted_index;
-
-    for (const auto& p : splits) {
-        const std::string& word = p.first;
-        const auto& symbols = p.second;
-        if (symbols.size() < 2) continue;
-        for (size_t i = 0; i < symbols.size() - 1; ++i) {
-            const auto current_pair = std::make_pair(symbols[i], symbols[i + 1]);
-            pair_stats[current_pair] += bpe_word_counts.at(word);
-            inverted_index[current_pair].push_back(word);
+    // With checkpoints enabled, a saved state of the same words replaces this step and
+    // merging continues after its last merge.
+    const bool checkpointing = !this->checkpointDirectory.empty();
+    const std::string checkpoint_path = this->checkpointDirectory + "/" + BPE_CHECKPOINT;
+    uint64_t words_fingerprint = CHECKPOINT_FINGERPRINT_SEED;
+    for (const auto* pair : bpe_words) {
+        const int32_t freq = pair->second;
+        words_fingerprint = checkpointFingerprint(words_fingerprint, pair->first.data(), pair->first.size() + 1);
+        words_fingerprint = checkpointFingerprint(words_fingerprint, &freq, sizeof(freq));
+    }
+    bool resumed = false;
+    if (checkpointing) {
+        BpeTrainer restored;
+        restored.setThreadPool(&getThreadPool());
+        if (loadBpeCheckpoint(checkpoint_path, restored, words_fingerprint)) {
+            if (restored.getMerges().size() > static_cast<size_t>(std::max(num_merges, 0))) {
+                std::cerr << "[WARNING] Checkpoint " << checkpoint_path << " has " << restored.getMerges().size()
+                          << " merges, more than the " << num_merges << " requested. Training from scratch." << std::endl;
+            }
+            else {
+                trainer = std::move(restored);
+                resumed = true;
+                std::cout << "[INFO] Resumed BPE training from checkpoint " << checkpoint_path << " after "
+                          << trainer.getMerges().size() << " merges." << std::endl;
+            }
         }
     }
+    if (!resumed) {
+        std::cout << "Building initial statistics and inverted index..." << std::endl;
+        trainer.buildIndex();
+    }
 
-    std::cout << "[DEBUG] Size of initial pair_stats map: " << pair_stats.size() << ". Initialization complete. Starting merges." << std::endl;
+    std::cout << "[DEBUG] Size of initial pair_stats map: " << trainer.pairCount() << ". Initialization complete. Starting merges." << std::endl;
+    stage->words = bpe_words.size();
+    stage->items = trainer.pairCount();
 
     // 3. HIGH-SPEED MERGE LOOP
     std::cout << "Merge Count:" << std::endl;
-    for (int i = 0; i < num_merges; ++i) {
-        if (pair_stats.empty()) {
+    const size_t merges_at_start = trainer.getMerges().size();
+    stage.emplace(metrics, "bpe_merges");
+    ProgressData& progress = *this->bpe_progress;
+    progress.total_merges = num_merges;
+    progress.merges_completed = static_cast<int>(merges_at_start);
+    progress.merges_per_second = 0.0;
+    progress.start_time = std::chrono::steady_clock::now();
+    auto update_merge_rate = [&progress, merges_at_start]() {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - progress.start_time).count();
+        const int merged = progress.merges_completed.load(std::memory_order_relaxed) - static_cast<int>(merges_at_start);
+        progress.merges_per_second.store(seconds > 0.0 ? merged / seconds : 0.0, std::memory_order_relaxed);
+    };
+    for (int i = static_cast<int>(merges_at_start); i < num_merges; ++i) {
+        BpeMerge merge;
+        if (!trainer.mergeNext(merge)) {
             std::cout << "[INFO] No more pairs to merge. Stopping at merge " << i + 1 << "." << std::endl;
             break;
         }
-        auto best_pair_it = std::max_element(pair_stats.begin(), pair_stats.end(),
-            [](const auto& a, const auto& b) { return a.second < b.second; });
-        const auto best_pair = best_pair_it->first;
-        const int best_pair_freq = best_pair_it->second;
-
-        const std::string new_token = best_pair.first + best_pair.second;
-        vocab.insert(new_token);
-
-        if (inverted_index.find(best_pair) == inverted_index.end()) {
-            pair_stats.erase(best_pair_it);
-            continue;
+        progress.merges_completed.store(i + 1, std::memory_order_relaxed);
+        if ((i + 1) % PipelineMetrics::NOTIFY_MERGE_INTERVAL == 0) {
+            update_merge_rate();
+            metrics.notify();
         }
-        const auto& affected_words = inverted_index.at(best_pair);
-
-        // This loop is now very fast as it only iterates over a small number of words
-        for (const auto& word : affected_words) {
-            auto& symbols = splits.at(word);
-            int freq = bpe_word_counts.at(word);
-            if (symbols.size() < 2) continue; // Skip if already merged into a single token
-
-            std::vector<std::string> new_symbols;
-            new_symbols.reserve(symbols.size());
-
-            size_t k = 0;
-            while (k < symbols.size()) {
-                if (k < symbols.size() - 1 && symbols[k] == best_pair.first && symbols[k + 1] == best_pair.second) {
-                    if (k > 0) {
-                        auto old_left_pair = std::make_pair(symbols[k - 1], best_pair.first);
-                        pair_stats[old_left_pair] -= freq;
-                        if (pair_stats[old_left_pair] <= 0) pair_stats.erase(old_left_pair);
-                        
-                        auto new_left_pair = std::make_pair(symbols[k - 1], new_token);
-                        pair_stats[new_left_pair] += freq;
-                        inverted_index[new_left_pair].push_back(word);
-                    }
-                    if (k < symbols.size() - 2) {
-                        auto old_right_pair = std::make_pair(best_pair.second, symbols[k + 2]);
-                        pair_stats[old_right_pair] -= freq;
-                        if (pair_stats[old_right_pair] <= 0) pair_stats.erase(old_right_pair);
-
-                        auto new_right_pair = std::make_pair(new_token, symbols[k + 2]);
-                        pair_stats[new_right_pair] += freq;
-                        inverted_index[new_right_pair].push_back(word);
-                    }
-                    new_symbols.push_back(new_token);
-                    k += 2;
-                } else {
-                    new_symbols.push_back(symbols[k]);
-                    k += 1;
-                }
-            }
-            symbols = std::move(new_symbols);
-        }
-
-        inverted_index.erase(best_pair);
-        pair_stats.erase(best_pair);
 
         if ((i + 1) % 1000 == 0 || i == num_merges - 1) {
-            std::cout << "Merge " << i + 1 << "/" << num_merges << ": Merged '" << best_pair.first 
-                      << "' and '" << best_pair.second << "' (Frequency: " << best_pair_freq << ")" << std::endl;
+            std::cout << "Merge " << i + 1 << "/" << num_merges << ": Merged '" << trainer.symbol(merge.left)
+                      << "' and '" << trainer.symbol(merge.right) << "' (Frequency: " << merge.freq << ")" << std::endl;
         }
+        if (checkpointing && this->checkpointInterval > 0 && (i + 1) % this->checkpointInterval == 0 && i + 1 < num_merges) {
+            saveBpeCheckpoint(checkpoint_path, trainer, words_fingerprint);
+        }
+    }
+    // The final state is always saved, so a later run can skip BPE or add more merges.
+    if (checkpointing && (!resumed || trainer.getMerges().size() != merges_at_start)) {
+        saveBpeCheckpoint(checkpoint_path, trainer, words_fingerprint);
+        std::cout << "-> Saved BPE checkpoint after " << trainer.getMerges().size() << " merges: " << checkpoint_path << std::endl;
     }
+    const std::vector<BpeMerge>& learned_merges = trainer.getMerges();
+    update_merge_rate();
+    stage->words = bpe_words.size();
+    stage->items = learned_merges.size() - merges_at_start;
+    stage->counters = { { "index_postings_left", trainer.postingCount() }, { "stale_word_visits", trainer.staleVisitCount() } };
+    stage.emplace(metrics, "bpe_finalize");
 
     // 4. FINALIZE VOCABULARY
-    // final_vocab.push_back("</s>");     // add sentence terminator token "</s>"
+    // Canonical id order: the base vocabulary (atomic tokens, characters, "</w>", "</s>") in
+    // lexicographic order, then every merged token in the order it was learned. Merged tokens
+    // are the symbols interned after the initial characters, so they already come in merge order.
+    // splitWord matches through the prefix index, so no length sort is needed.
     final_vocab.assign(vocab.begin(), vocab.end());
-    std::sort(final_vocab.begin(), final_vocab.end(), [](const auto& a, const auto& b){ return a.length() > b.length(); });
+    const auto& symbols = trainer.getSymbols();
+    for (size_t s = initial_symbol_count; s < symbols.size(); ++s) {
+        if (vocab.insert(symbols[s]).second) {
+            final_vocab.push_back(symbols[s]);
+        }
+    }
 
     this->tokens = final_vocab;
     this->vocSize = this->tokens.size();
+    buildPrefixIndex();
+
+    // Record the merges (rank = position) in terms of the canonical ids.
+    this->merges.clear();
+    this->merges.reserve(learned_merges.size());
+    for (const auto& merge : learned_merges) {
+        this->merges.push_back({ tokenToId(trainer.symbol(merge.left)),
+                                 tokenToId(trainer.symbol(merge.right)),
+                                 tokenToId(trainer.symbol(merge.merged)) });
+    }
+    buildMergeRanks();
+    stage->items = this->tokens.size();
     std::cout << "BPE training complete. Final vocabulary size: " << this->vocSize << std::endl;
 }
@@ -0,0 +1,69 @@
+#ifndef ASCIISCAN_HPP
+#define ASCIISCAN_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Locale-independent ASCII character classes. These match std::isalpha, std::isupper,
+ * std::islower, std::isspace and std::tolower in the default "C" locale, so every byte
+ * >= 0x80 is neither a letter nor a space.
+ */
+constexpr bool asciiIsUpper(unsigned char c) { return static_cast<unsigned char>(c - 'A') < 26; }
+constexpr bool asciiIsLower(unsigned char c) { return static_cast<unsigned char>(c - 'a') < 26; }
+constexpr bool asciiIsAlpha(unsigned char c) { return static_cast<unsigned char>((c | 0x20) - 'a') < 26; }
+constexpr bool asciiIsSpace(unsigned char c) { return c == ' ' || static_cast<unsigned char>(c - '\t') < 5; }
+constexpr char asciiToLower(unsigned char c) { return static_cast<char>(asciiIsUpper(c) ? c + 32 : c); }
+
+/**
+ * @brief Class masks for (up to) 64 consecutive bytes; bit i describes byte i.
+ */
+struct AsciiBlockMasks {
+    uint64_t alpha;     // A-Z, a-z
+    uint64_t upper;     // A-Z
+    uint64_t space;     // ' ', '\t', '\n', '\v', '\f', '\r'
+};
+
+AsciiBlockMasks classifyAsciiBlock(const char* bytes, size_t count);
+void lowercaseAscii(const char* src, size_t count, char* dst);
+std::string lowercaseAscii(std::string_view text);
+
+
+/**
+ * @brief Bitmaps of the character classes of one piece of text.
+ * The text is classified once, 64 bytes per step (AVX2, SSE2 or NEON where available,
+ * scalar otherwise); word boundaries and camelCase split points are then found with
+ * bit operations on the masks instead of per-byte classification calls.
+ * The bitmaps are padded with a zero word, so bits past the end read as "other".
+ * Reusing one instance across lines keeps its buffers allocated.
+ */
+class AsciiMasks {
+private:
+    std::vector<uint64_t> alphaBits;
+    std::vector<uint64_t> upperBits;
+    std::vector<uint64_t> spaceBits;
+    size_t length = 0;
+
+    // 64 bits of a bitmap starting at bit `pos`.
+    static uint64_t bitsAt(const std::vector<uint64_t>& bitmap, size_t pos);
+    // First position >= pos whose bit is clear.
+    size_t firstClear(const std::vector<uint64_t>& bitmap, size_t pos) const;
+
+public:
+    void classify(std::string_view text);
+
+    size_t size() const { return length; }
+    bool isAlpha(size_t i) const { return (alphaBits[i >> 6] >> (i & 63)) & 1; }
+    bool isUpper(size_t i) const { return (upperBits[i >> 6] >> (i & 63)) & 1; }
+    bool isSpace(size_t i) const { return (spaceBits[i >> 6] >> (i & 63)) & 1; }
+
+    size_t alphaRunEnd(size_t pos) const { return firstClear(alphaBits, pos); }
+    size_t skipSpaces(size_t pos) const { return firstClear(spaceBits, pos); }
+
+    void camelCaseSplits(size_t begin, size_t end, std::vector<size_t>& splits) const;
+};
+
+#endif // ASCIISCAN_HPP
@@ -0,0 +1,141 @@
+#ifndef BPE_HPP
+#define BPE_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class ThreadPool;
+
+// Mixes a packed symbol pair so that unordered containers spread sequential ids well.
+struct PairKeyHash {
+    std::size_t operator()(uint64_t key) const {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<std::size_t>(key);
+    }
+};
+
+
+/**
+ * @brief One merge performed by the BPE trainer.
+ */
+struct BpeMerge {
+    uint32_t left;      // id of the left symbol
+    uint32_t right;     // id of the right symbol
+    uint32_t merged;    // id of the resulting symbol
+    long long freq;     // pair frequency at the time of the merge
+};
+
+
+/**
+ * @brief Integer-id BPE training engine.
+ * Every symbol is interned once into a uint32_t id and adjacent pairs are packed into
+ * a uint64_t key, so the merge loop hashes and compares integers only. Each word's
+ * symbols live in one flat array; a word occupies [wordOffset[w], wordOffset[w] + wordLength[w])
+ * and shrinks in place as merges are applied. Strings exist only in the symbol table
+ * and are materialised by the caller once training is finished.
+ * Each merge is applied to the affected words in parallel chunks; every chunk produces
+ * a local pair-count delta that is reduced into the global statistics afterwards, so
+ * the result does not depend on the number of threads.
+ * Best-pair selection uses a lazy-deletion max-heap. Ties are broken towards the
+ * lexicographically smaller (left, right) string pair, which keeps the merge order
+ * identical to a scan over an ordered string map.
+ * The inverted index lists word ids per pair. A word is not appended again right after
+ * itself, and once the postings added since the last compaction reach half of the index
+ * every list is sorted, deduplicated and stripped of words that no longer contain its pair. A list
+ * only has to include every word that contains the pair, so compaction never changes
+ * the merges that are made.
+ */
+class BpeTrainer {
+public:
+    using PairKey = uint64_t;
+
+    // Word offsets are 32-bit: addWord throws once all words together exceed this many symbols.
+    static constexpr size_t MAX_WORD_SYMBOLS = 0xFFFFFFFFull;
+
+    static PairKey makePair(uint32_t left, uint32_t right) { return (static_cast<uint64_t>(left) << 32) | right; }
+    static uint32_t pairLeft(PairKey key) { return static_cast<uint32_t>(key >> 32); }
+    static uint32_t pairRight(PairKey key) { return static_cast<uint32_t>(key); }
+
+    BpeTrainer();
+
+    uint32_t intern(std::string_view symbol);
+    const std::string& symbol(uint32_t id) const { return symbols[id]; }
+    const std::vector<std::string>& getSymbols() const { return symbols; }
+    size_t symbolCount() const { return symbols.size(); }
+    size_t wordCount() const { return wordFreq.size(); }
+    size_t pairCount() const { return pairStats.size(); }
+    // Postings held by the inverted index, and words visited by merges they no longer applied to.
+    size_t postingCount() const { return totalPostings; }
+    size_t staleVisitCount() const { return staleVisits; }
+    uint32_t endOfWordId() const { return endOfWord; }
+    // Symbols that existed before the first merge (single characters and "</w>").
+    size_t baseSymbolCount() const { return baseSymbols; }
+    // Every merge performed so far, in order (restored with the rest of the state by deserialize).
+    const std::vector<BpeMerge>& getMerges() const { return mergeHistory; }
+
+    // Pool used to apply large merges in parallel; without one, merges run on the calling thread.
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+
+    void addWord(std::string_view word, int freq);
+    void buildIndex();
+    bool mergeNext(BpeMerge& merge);
+
+    // Checkpoints: the complete training state, so that merging can continue later.
+    void serialize(std::string& out) const;
+    bool deserialize(std::string_view data);
+
+private:
+    struct HeapEntry {
+        long long freq;
+        PairKey key;
+    };
+
+    // Pair-count changes and new postings produced while applying one merge to a set of words.
+    struct MergeDelta {
+        std::unordered_map<PairKey, long long, PairKeyHash> counts;
+        std::vector<std::pair<PairKey, uint32_t>> postings;
+        size_t unchangedWords = 0;
+    };
+
+    ThreadPool* pool = nullptr;
+
+    // symbol table
+    std::vector<std::string> symbols;                                       // id -> symbol
+    std::unordered_map<std::string, uint32_t> symbolIds;                    // symbol -> id
+    uint32_t endOfWord;                                                     // id of "</w>"
+
+    // words, stored as one flat array of symbol ids
+    std::vector<int> wordFreq;                                              // frequency of each word
+    std::vector<uint32_t> wordOffset;                                       // start of each word in wordSymbols (< MAX_WORD_SYMBOLS)
+    std::vector<uint32_t> wordLength;                                       // current number of symbols per word
+    std::vector<uint32_t> wordSymbols;                                      // all symbols of all words
+
+    // pair statistics
+    std::unordered_map<PairKey, long long, PairKeyHash> pairStats;          // pair -> total frequency
+    std::unordered_map<PairKey, std::vector<uint32_t>, PairKeyHash> invertedIndex; // pair -> words containing it
+    size_t totalPostings = 0;                                               // entries of all posting lists
+    size_t addedPostings = 0;                                               // postings added since the last compaction
+    size_t staleVisits = 0;                                                 // visited words without the merged pair
+    std::vector<HeapEntry> heap;                                            // lazy-deletion max-heap
+    std::vector<uint32_t> wordStamp;                                        // last merge that visited each word
+    uint32_t mergeCount = 0;                                                // merges performed so far
+    std::vector<BpeMerge> mergeHistory;                                     // merges performed so far, in order
+    uint32_t baseSymbols = 0;                                               // symbol count when the index was built
+
+    bool heapLower(const HeapEntry& a, const HeapEntry& b) const;
+    void heapPush(PairKey key, long long freq);
+    void heapRebuild();
+    void updatePair(PairKey key, long long delta);
+    void addPosting(PairKey key, uint32_t word);
+    bool wordHasPair(uint32_t word, PairKey key) const;
+    void compactIndex();
+    void applyMerge(const uint32_t* words, size_t count, uint32_t left, uint32_t right, uint32_t merged, MergeDelta& delta);
+};
+
+#endif // BPE_HPP
@@ -0,0 +1,55 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP 1
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+class BpeTrainer;
+
+/**
+ * @brief On-disk layout of the training checkpoints written by `tokeniser::train`.
+ * Each file is a CheckpointFileHeader followed by its payload, in native byte order:
+ *  - Word counts (WORD_COUNTS_CHECKPOINT): uint64_t offsets[count + 1] into the word bytes,
+ *    int32 frequencies[count], then the concatenated word bytes.
+ *  - BPE state (BPE_CHECKPOINT): the trainer state (`BpeTrainer::serialize`) after `count` merges.
+ * The fingerprint ties a checkpoint to its input (the corpus files for word counts, the BPE
+ * words and frequencies for BPE state), so a checkpoint of other data is never resumed.
+ * Files are written to a temporary name and renamed, so an interrupted write leaves the
+ * previous checkpoint in place.
+ */
+enum class CheckpointKind : uint32_t { WordCounts = 1, BpeState = 2 };
+
+struct CheckpointFileHeader {
+    char magic[8];              // CHECKPOINT_FILE_MAGIC
+    uint32_t version;           // CHECKPOINT_FILE_VERSION
+    uint32_t byteOrderMark;     // CHECKPOINT_FILE_BYTE_ORDER_MARK as written by the producer
+    uint32_t kind;              // CheckpointKind
+    uint32_t reserved;
+    uint64_t fingerprint;       // input the checkpoint belongs to
+    uint64_t count;             // words (WordCounts) or merges performed (BpeState)
+    uint64_t payloadSize;       // bytes following the header
+    uint64_t payloadChecksum;   // checkpointFingerprint of the payload
+};
+
+inline constexpr char CHECKPOINT_FILE_MAGIC[8] = { 'T', 'O', 'K', 'C', 'K', 'P', 'T', '1' };
+inline constexpr uint32_t CHECKPOINT_FILE_VERSION = 1;
+inline constexpr uint32_t CHECKPOINT_FILE_BYTE_ORDER_MARK = 0x01020304u;
+inline constexpr char WORD_COUNTS_CHECKPOINT[] = "_word_counts.bin";
+inline constexpr char BPE_CHECKPOINT[] = "_bpe_state.bin";
+
+static_assert(sizeof(CheckpointFileHeader) == 56, "CheckpointFileHeader layout must not change within a version");
+
+// FNV-1a over `size` bytes, continuing from `hash` (start with CHECKPOINT_FINGERPRINT_SEED).
+inline constexpr uint64_t CHECKPOINT_FINGERPRINT_SEED = 0xcbf29ce484222325ULL;
+uint64_t checkpointFingerprint(uint64_t hash, const void* data, size_t size);
+uint64_t inputFilesFingerprint(const std::vector<std::string>& file_paths);
+
+void saveWordCountsCheckpoint(const std::string& path, const std::unordered_map<std::string, int>& corpus_word_counts, uint64_t fingerprint);
+bool loadWordCountsCheckpoint(const std::string& path, std::unordered_map<std::string, int>& corpus_word_counts, uint64_t fingerprint);
+void saveBpeCheckpoint(const std::string& path, const BpeTrainer& trainer, uint64_t fingerprint);
+bool loadBpeCheckpoint(const std::string& path, BpeTrainer& trainer, uint64_t fingerprint);
+
+#endif // CHECKPOINT_HPP
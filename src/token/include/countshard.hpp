@@ -0,0 +1,109 @@
+#ifndef COUNTSHARD_HPP
+#define COUNTSHARD_HPP 1
+
+#include "mappedfile.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief On-disk layout of a partial word-count shard.
+ * A shard holds (word, frequency) records sorted by word bytes, so any number of shards
+ * can be combined in one streaming k-way merge (mergeCountShards) without loading them.
+ * The file is a CountShardHeader followed by wordCount records, each
+ *     varint shared   bytes shared with the previous word (front coding)
+ *     varint length   bytes that follow
+ *     suffix bytes
+ *     varint freq
+ * Varints are LEB128 (7 bits per byte, low bits first). Words are strictly increasing.
+ * Header values are stored in native byte order; the byte order mark rejects shards
+ * written on a machine with the other endianness.
+ */
+struct CountShardHeader {
+    char magic[8];              // COUNT_SHARD_MAGIC
+    uint32_t version;           // COUNT_SHARD_VERSION
+    uint32_t byteOrderMark;     // COUNT_SHARD_BYTE_ORDER_MARK as written by the producer
+    uint64_t wordCount;         // number of records
+    uint64_t totalCount;        // sum of all frequencies
+    uint64_t payloadSize;       // bytes following the header
+};
+
+inline constexpr char COUNT_SHARD_MAGIC[8] = { 'T', 'O', 'K', 'S', 'H', 'A', 'R', 'D' };
+inline constexpr uint32_t COUNT_SHARD_VERSION = 1;
+inline constexpr uint32_t COUNT_SHARD_BYTE_ORDER_MARK = 0x01020304u;
+
+static_assert(sizeof(CountShardHeader) == 40, "CountShardHeader layout must not change within a version");
+
+
+/**
+ * @brief Streams sorted records into a shard file.
+ * Records are encoded into a buffer that is flushed in large blocks; `close` writes
+ * the final header. Words must be added in strictly increasing byte order.
+ * @throws std::runtime_error on I/O errors or out-of-order words.
+ */
+class CountShardWriter {
+public:
+    explicit CountShardWriter(const std::string& path);
+    ~CountShardWriter();
+
+    CountShardWriter(const CountShardWriter&) = delete;
+    CountShardWriter& operator=(const CountShardWriter&) = delete;
+
+    void add(std::string_view word, uint64_t freq);
+    void close();
+    uint64_t wordCount() const { return header.wordCount; }
+
+private:
+    std::string path;
+    std::ofstream out;
+    std::string buffer;
+    std::string previous;
+    CountShardHeader header{};
+    bool closed = false;
+
+    void flush();
+};
+
+
+/**
+ * @brief Sequential reader over a memory-mapped shard.
+ * Usage: `open`, then `while (reader.next()) use(reader.word(), reader.freq());`.
+ * Every record is bounds-checked and the word order is verified while reading.
+ * Non-copyable; the reader must not be moved after `open` (word() views its own buffer).
+ * @throws std::runtime_error if the file is missing or corrupt.
+ */
+class CountShardReader {
+public:
+    CountShardReader() = default;
+    CountShardReader(const CountShardReader&) = delete;
+    CountShardReader& operator=(const CountShardReader&) = delete;
+
+    void open(const std::string& path);
+    bool next();
+    std::string_view word() const { return current; }
+    uint64_t freq() const { return currentFreq; }
+    const CountShardHeader& getHeader() const { return header; }
+
+private:
+    std::string path;
+    MappedFile file;
+    std::string_view payload;
+    size_t pos = 0;
+    uint64_t remaining = 0;
+    std::string current;
+    uint64_t currentFreq = 0;
+    CountShardHeader header{};
+
+    uint64_t readVarint();
+};
+
+
+size_t writeCountShard(const std::string& path, const std::unordered_map<std::string, int>& corpus_word_counts);
+size_t readCountShard(const std::string& path, std::unordered_map<std::string, int>& corpus_word_counts);
+size_t mergeCountShards(const std::vector<std::string>& input_paths, const std::string& output_path, uint64_t min_freq = 1);
+
+#endif // COUNTSHARD_HPP
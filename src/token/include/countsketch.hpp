@@ -0,0 +1,38 @@
+#ifndef COUNTSKETCH_HPP
+#define COUNTSKETCH_HPP 1
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Fixed-size, thread-safe count-min sketch over 64-bit word hashes.
+ * `depth` rows of `width` 32-bit counters; a word increments one counter per row and
+ * its estimate is the smallest of them. The estimate never undercounts, and overcounts
+ * by at most 2N/width with probability 1 - 2^-depth (N = total of all adds). Counters
+ * are relaxed atomics, so all consumers can share one sketch, and they saturate instead
+ * of wrapping. Memory is depth * width * 4 bytes whatever the number of distinct words.
+ */
+class CountMinSketch {
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> counters;
+    size_t rowWidth = 0;
+    size_t rowCount = 0;
+
+public:
+    CountMinSketch(size_t width, size_t depth);
+
+    CountMinSketch(const CountMinSketch&) = delete;
+    CountMinSketch& operator=(const CountMinSketch&) = delete;
+
+    size_t width() const { return rowWidth; }
+    size_t depth() const { return rowCount; }
+    size_t memoryBytes() const { return rowWidth * rowCount * sizeof(uint32_t); }
+
+    // Adds one occurrence of the word with this hash and returns its new estimate.
+    uint32_t add(uint64_t hash);
+    uint32_t estimate(uint64_t hash) const;
+};
+
+#endif // COUNTSKETCH_HPP
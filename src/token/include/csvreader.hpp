@@ -0,0 +1,54 @@
+#ifndef CSVREADER_HPP
+#define CSVREADER_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+class ThreadPool;
+class MappedFile;
+
+/**
+ * @brief Zero-copy cursor over the records of a CSV buffer.
+ * Understands the quoting written by `escapeAndQuoteCsvField` / CsvWriter: quoted
+ * fields may contain commas, line breaks and doubled quotes. Whitespace around
+ * unquoted fields is trimmed, blank lines are skipped, and an empty field after a
+ * trailing comma is not reported (rows such as "0.1,0.2," have two fields).
+ * Field views point into the buffer, except for quoted fields containing doubled
+ * quotes, whose unescaped text lives in the cursor and is valid until the next call.
+ */
+class CsvRecordCursor {
+private:
+    const char* pos;
+    const char* end;
+    bool inRecord = false;
+    std::string scratch;
+
+public:
+    explicit CsvRecordCursor(std::string_view data) : pos(data.data()), end(data.data() + data.size()) {}
+
+    bool nextRecord();
+    bool nextField(std::string_view& field);
+};
+
+/**
+ * @brief A CSV file of numbers parsed into one contiguous row-major buffer.
+ * Row r occupies values[r * cols] .. values[r * cols + cols - 1].
+ */
+struct CsvFloatMatrix {
+    std::vector<float> values;
+    size_t rows = 0;
+    size_t cols = 0;
+
+    const float* row(size_t r) const { return values.data() + r * cols; }
+};
+
+std::vector<std::string_view> splitCsvChunks(std::string_view data, size_t target_chunk_bytes, ThreadPool* pool = nullptr);
+bool openCsvChunks(const std::string& filename, MappedFile& file, std::vector<std::string_view>& chunks, ThreadPool* pool = nullptr);
+bool parseCsvFloat(std::string_view field, float& value);
+bool parseCsvInt(std::string_view field, int& value);
+
+CsvFloatMatrix readCsvFloatMatrix(const std::string& filename, ThreadPool* pool = nullptr);
+
+#endif // CSVREADER_HPP
@@ -0,0 +1,127 @@
+#ifndef CSVWRITER_HPP
+#define CSVWRITER_HPP 1
+
+#include "threadpool.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @brief Growable text buffer with the field formatters used by the CSV writers.
+ * Numbers are formatted with std::to_chars (no locale, no stream state); floats use
+ * the shortest representation that reads back to the same value.
+ */
+class CsvBuffer {
+private:
+    std::string text;
+    size_t rowCount = 0;
+
+public:
+    void append(std::string_view s) { text.append(s.data(), s.size()); }
+    void append(char c) { text.push_back(c); }
+    void appendInt(long long value);
+    void appendFloat(float value);
+    void appendQuoted(std::string_view field);
+    void appendField(std::string_view field);
+    void endRow() { text.push_back('\n'); ++rowCount; }
+
+    const std::string& str() const { return text; }
+    size_t size() const { return text.size(); }
+    size_t rows() const { return rowCount; }
+    void reserve(size_t bytes) { text.reserve(bytes); }
+    void clear() { text.clear(); rowCount = 0; }
+};
+
+
+/**
+ * @brief Buffered CSV file writer.
+ * Rows are formatted into a large in-memory buffer that is written to the file in one
+ * call whenever it fills up, instead of one stream insertion per field. `writeRows`
+ * formats blocks of rows on a thread pool and writes the blocks in row order, so the
+ * file is identical for any number of threads. The writer counts the rows it wrote,
+ * so callers do not need to read the file back.
+ */
+class CsvWriter {
+private:
+    std::ofstream file;
+    CsvBuffer buffer;
+    size_t flushBytes;
+    size_t rowsWritten = 0;
+    bool failed = false;
+
+    void writeOut(const CsvBuffer& block);
+
+public:
+    static constexpr size_t DEFAULT_BUFFER_BYTES = 4 << 20;
+    static constexpr size_t ROWS_PER_BLOCK = 1024;      // rows formatted per task in writeRows
+
+    explicit CsvWriter(const std::string& path, size_t buffer_bytes = DEFAULT_BUFFER_BYTES);
+    ~CsvWriter() { close(); }
+
+    CsvWriter(const CsvWriter&) = delete;
+    CsvWriter& operator=(const CsvWriter&) = delete;
+
+    bool isOpen() const { return file.is_open(); }
+    bool good() const { return !failed; }
+    size_t rows() const { return rowsWritten + buffer.rows(); }
+
+    void field(std::string_view value) { buffer.appendField(value); }
+    void quoted(std::string_view value) { buffer.appendQuoted(value); }
+    void value(long long number) { buffer.appendInt(number); }
+    void value(float number) { buffer.appendFloat(number); }
+    void raw(std::string_view text) { buffer.append(text); }
+    void raw(char c) { buffer.append(c); }
+    void endRow() {
+        buffer.endRow();
+        if (buffer.size() >= flushBytes) flush();
+    }
+
+    void flush();
+    size_t close();
+
+    /**
+     * @brief Formats rows [0, count) with `formatRow(row, CsvBuffer&)` and appends them in order.
+     * `formatRow` must write exactly one complete row (ending with `endRow()`) and must be
+     * safe to call concurrently for different rows. A window of blocks is formatted in
+     * parallel and written before the next window starts, which bounds the memory used.
+     * @param count Number of rows.
+     * @param pool Thread pool used for formatting; nullptr formats on the calling thread.
+     * @param formatRow The row formatter.
+     */
+    template <typename FormatRow>
+    void writeRows(size_t count, ThreadPool* pool, FormatRow&& formatRow) {
+        if (pool == nullptr || pool->size() <= 1 || count <= ROWS_PER_BLOCK) {
+            for (size_t row = 0; row < count; ++row) {
+                formatRow(row, buffer);
+                if (buffer.size() >= flushBytes) flush();
+            }
+            return;
+        }
+
+        flush();
+        const size_t num_blocks = (count + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+        const size_t window = 4 * (pool->size() + 1);
+        std::vector<CsvBuffer> blocks(std::min(window, num_blocks));
+        for (size_t first_block = 0; first_block < num_blocks; first_block += window) {
+            const size_t last_block = std::min(num_blocks, first_block + window);
+            pool->parallelFor(first_block, last_block, 1, [&](size_t lo, size_t hi) {
+                for (size_t b = lo; b < hi; ++b) {
+                    CsvBuffer& block = blocks[b - first_block];
+                    block.clear();
+                    const size_t last_row = std::min(count, (b + 1) * ROWS_PER_BLOCK);
+                    for (size_t row = b * ROWS_PER_BLOCK; row < last_row; ++row) {
+                        formatRow(row, block);
+                    }
+                }
+            });
+            for (size_t b = first_block; b < last_block; ++b) {
+                writeOut(blocks[b - first_block]);
+            }
+        }
+    }
+};
+
+#endif // CSVWRITER_HPP
@@ -0,0 +1,76 @@
+#ifndef CUDACONTEXT_HPP
+#define CUDACONTEXT_HPP 1
+
+#ifdef USE_CUDA
+
+#include <cuda_runtime.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Helper for CUDA error checking; throws so that callers can recover or report the error.
+#define CHECK_CUDA(call) do {   \
+    cudaError_t err_ = (call);  \
+    if (err_ != cudaSuccess) {  \
+        throw std::runtime_error(std::string("CUDA Error: ") + cudaGetErrorString(err_) +   \
+                                 " at " + __FILE__ + ":" + std::to_string(__LINE__));       \
+    }                           \
+} while (0)
+
+/**
+ * @brief Process-wide CUDA state used by the embedding kernels.
+ * Holds one stream, device buffers for the embeddings and their inverses, and
+ * page-locked (pinned) host staging buffers of the same size. The buffers only grow,
+ * so repeated calls do not allocate; copies are issued asynchronously on the stream.
+ * The embeddings stay resident between calls, so batches of token ids are gathered
+ * on the device without copying the matrix again.
+ * Like OpenCLContext, it is a singleton (see getInstance()).
+ */
+class CudaContext {
+public:
+    // Copies through pinned memory are split into this many pieces (one event each), so the
+    // host copy of one piece overlaps the transfer of the next.
+    static constexpr size_t TRANSFER_CHUNKS = 8;
+
+    cudaStream_t stream = nullptr;
+    float* deviceEmbeddings = nullptr;
+    float* deviceDeEmbeddings = nullptr;
+    float* hostEmbeddings = nullptr;        // pinned staging for deviceEmbeddings
+    float* hostDeEmbeddings = nullptr;      // pinned staging for deviceDeEmbeddings
+    size_t capacity = 0;                    // floats per buffer
+    cudaEvent_t transferDone[2][TRANSFER_CHUNKS] = {};     // [0] embeddings, [1] deEmbeddings
+    // The last upload through hostEmbeddings, which may still be reading it: its size in
+    // floats (0 = none) and one event per piece.
+    size_t pendingUpload = 0;
+    cudaEvent_t uploadDone[TRANSFER_CHUNKS] = {};
+    uint32_t* devicePoissonTable = nullptr;                 // PoissonTable::data() of the last call
+    size_t poissonCapacity = 0;
+    // Embedding gather: the version (tokeniser::embeddingsChanged) of the matrix held in
+    // deviceEmbeddings (0 = none), and the id/output buffers of the last batch.
+    uint64_t residentEmbeddings = 0;
+    int32_t* deviceIds = nullptr;
+    float* deviceGathered = nullptr;
+    float* hostGathered = nullptr;          // pinned staging for deviceGathered
+    size_t gatherCapacity = 0;              // ids per batch
+    size_t gatheredCapacity = 0;            // floats per batch
+
+    static CudaContext& getInstance();
+
+    void reserve(size_t elements);
+    void uploadPoissonTable(const std::vector<uint32_t>& table);
+    void reserveGather(size_t ids, size_t elements);
+
+    CudaContext(const CudaContext&) = delete;
+    CudaContext& operator=(const CudaContext&) = delete;
+    ~CudaContext();
+
+private:
+    CudaContext();
+    void release() noexcept;
+};
+
+#endif // USE_CUDA
+
+#endif // CUDACONTEXT_HPP
@@ -0,0 +1,85 @@
+#ifndef EMBEDDINGFORMULA_HPP
+#define EMBEDDINGFORMULA_HPP 1
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__CUDACC__)
+#define EMBEDDING_HOST_DEVICE __host__ __device__
+#else
+#define EMBEDDING_HOST_DEVICE
+#endif
+
+class EmbeddingMatrix;
+class ThreadPool;
+
+/*
+ * The embedding formula shared by every backend:
+ *
+ *     embedding[i][j] = k(i, j) * (sin(i + 1) + cos(j - 1)) * 0.1 + 0.01
+ *     inverse[i][j]   = embedding[i][j] / ||embedding[i]||^2      (0 if the norm is ~0)
+ *
+ * where k(i, j) ~ Poisson(r1) is drawn from the counter-based generator below with
+ * counter i * d + j. Every element depends only on (seed, i, j), so the result does not
+ * depend on the number of threads or on the order in which rows are generated.
+ */
+
+// Default seed of generateAndSaveEmbeddings; the same seed always gives the same embeddings.
+constexpr uint64_t DEFAULT_EMBEDDING_SEED = 0x5EED5EED5EED5EEDull;
+
+/**
+ * @brief Counter-based random number: 32 random bits for (seed, counter).
+ * This is the SplitMix64 output for state seed + (counter + 1) * golden ratio, so
+ * any element can be generated independently of all the others.
+ */
+EMBEDDING_HOST_DEVICE inline uint32_t embeddingRandom(uint64_t seed, uint64_t counter) {
+    uint64_t x = seed + (counter + 1) * 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return static_cast<uint32_t>(x >> 32);
+}
+
+/**
+ * @brief Inverse-CDF table for drawing Poisson(lambda) values from 32 random bits.
+ * Layout of data() (also used as is by the CUDA and OpenCL kernels):
+ *  - [0, GUIDE_SIZE):        guide[b] = smallest k whose threshold is above b << (UNIFORM_BITS - GUIDE_BITS)
+ *  - [GUIDE_SIZE, ...):      threshold[k] = floor(P(X <= k) * 2^UNIFORM_BITS); the last one is 2^UNIFORM_BITS
+ * A draw uses the top UNIFORM_BITS bits v of the random value and returns the first k with
+ * v < threshold[k]; the guide makes that about one comparison on average.
+ */
+class PoissonTable {
+public:
+    static constexpr uint32_t UNIFORM_BITS = 24;
+    static constexpr uint32_t GUIDE_BITS = 8;
+    static constexpr uint32_t GUIDE_SIZE = 1u << GUIDE_BITS;
+
+    explicit PoissonTable(float lambda);
+
+    const std::vector<uint32_t>& data() const { return table; }
+    uint32_t sample(uint32_t random_bits) const;
+
+    // Draw from a table laid out as data(); shared with the CUDA kernels.
+    EMBEDDING_HOST_DEVICE static inline uint32_t sample(const uint32_t* table, uint32_t random_bits) {
+        const uint32_t v = random_bits >> (32 - UNIFORM_BITS);
+        uint32_t k = table[v >> (UNIFORM_BITS - GUIDE_BITS)];
+        while (v >= table[GUIDE_SIZE + k]) ++k;
+        return k;
+    }
+
+private:
+    std::vector<uint32_t> table;
+};
+
+inline uint32_t PoissonTable::sample(uint32_t random_bits) const { return sample(table.data(), random_bits); }
+
+// Row helpers (SIMD where available).
+float finishEmbeddingRow(float* row, const float* col_cos, float row_sin, size_t d);
+float squaredNorm(const float* v, size_t n);
+void invertRow(const float* v, float* inverse, float squared_norm, size_t n);
+
+void generateEmbeddingsWithInverse(EmbeddingMatrix& embeddings, EmbeddingMatrix& inverses, size_t rows, size_t d,
+    float r1, uint64_t seed, ThreadPool* pool = nullptr);
+
+#endif // EMBEDDINGFORMULA_HPP
@@ -0,0 +1,76 @@
+#ifndef EMBEDDINGMATRIX_HPP
+#define EMBEDDINGMATRIX_HPP 1
+
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+class ThreadPool;
+
+/**
+ * @brief Dense vocSize x d float matrix stored row-major in one contiguous buffer.
+ * Row i (the embedding of token id i) occupies data()[i * cols()] .. data()[i * cols() + cols() - 1].
+ * The buffer is aligned to ALIGNMENT bytes, so it can be handed to SIMD code and to
+ * the CUDA/OpenCL copies as is. A matrix can also be a read-only view of memory owned
+ * by someone else (e.g. the float section of a memory-mapped model file); the first
+ * mutable access copies a view into its own buffer.
+ * Copies are deep (views share their owner); moves are cheap.
+ */
+class EmbeddingMatrix {
+private:
+    struct AlignedDelete {
+        void operator()(float* p) const;
+    };
+
+    std::unique_ptr<float[], AlignedDelete> storage;    // owned buffer (null for views and empty matrices)
+    const float* viewData = nullptr;                    // external rows when this is a view
+    std::shared_ptr<const void> viewOwner;              // keeps the external rows alive
+    size_t numRows = 0;
+    size_t numCols = 0;
+
+    static std::unique_ptr<float[], AlignedDelete> allocate(size_t count);
+    void makeOwned();
+
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    EmbeddingMatrix() = default;
+    EmbeddingMatrix(size_t rows, size_t cols) { resize(rows, cols); }
+    static EmbeddingMatrix view(const float* data, size_t rows, size_t cols, std::shared_ptr<const void> owner);
+
+    EmbeddingMatrix(const EmbeddingMatrix& other);
+    EmbeddingMatrix& operator=(const EmbeddingMatrix& other);
+    EmbeddingMatrix(EmbeddingMatrix&& other) noexcept;
+    EmbeddingMatrix& operator=(EmbeddingMatrix&& other) noexcept;
+    ~EmbeddingMatrix() = default;
+
+    void resize(size_t rows, size_t cols);
+    void assign(size_t rows, size_t cols, const float* values);
+    void clear();
+
+    size_t rows() const { return numRows; }
+    size_t cols() const { return numCols; }
+    size_t size() const { return numRows * numCols; }
+    bool empty() const { return size() == 0; }
+    bool isView() const { return viewData != nullptr; }
+
+    const float* data() const { return viewData != nullptr ? viewData : storage.get(); }
+    float* data() { makeOwned(); return storage.get(); }
+
+    std::span<const float> row(size_t i) const { return { data() + i * numCols, numCols }; }
+    std::span<float> row(size_t i) { return { data() + i * numCols, numCols }; }
+    float operator()(size_t r, size_t c) const { return data()[r * numCols + c]; }
+    float& operator()(size_t r, size_t c) { return data()[r * numCols + c]; }
+
+    bool operator==(const EmbeddingMatrix& other) const;
+};
+
+/**
+ * @brief Copies row ids[i] of `matrix` to out[i * cols()] for every i < count.
+ * Ids outside [0, rows()) (EncodedBatch::UNKNOWN_ID, padding) give rows of zeros.
+ * Rows are copied in parallel blocks on the pool (nullptr copies on the calling thread).
+ */
+void gatherRows(const EmbeddingMatrix& matrix, const int32_t* ids, size_t count, float* out, ThreadPool* pool = nullptr);
+
+#endif // EMBEDDINGMATRIX_HPP
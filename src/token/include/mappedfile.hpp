@@ -0,0 +1,62 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+/**
+ * @brief Read-only view of a whole file.
+ * The file is memory-mapped where the platform allows it (POSIX mmap or Win32 file
+ * mapping), so readers work directly on the page cache without copying. If mapping
+ * fails the contents are read once into a single heap buffer instead, which keeps the
+ * interface identical for callers.
+ * Non-copyable; movable.
+ */
+class MappedFile {
+private:
+    const char* begin = nullptr;
+    size_t length = 0;
+    bool mapped = false;                    // true if `begin` points into a mapping
+    std::unique_ptr<char[]> buffer;         // fallback storage when mapping is unavailable
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    void release();
+
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    ~MappedFile() { release(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path);
+    void close() { release(); }
+
+    const char* data() const { return begin; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    bool isMapped() const { return mapped; }
+    std::string_view view() const { return std::string_view(begin, length); }
+};
+
+/**
+ * @brief A unit of corpus work: a newline-aligned byte range inside a mapped file.
+ * The shared pointer keeps the mapping alive until the last chunk of the file is processed.
+ */
+struct CorpusChunk {
+    std::shared_ptr<const MappedFile> file;
+    std::string_view bytes;
+};
+
+std::vector<std::string_view> splitOnNewlines(std::string_view data, size_t target_chunk_bytes);
+
+#endif // MAPPEDFILE_HPP
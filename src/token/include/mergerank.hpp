@@ -0,0 +1,72 @@
+#ifndef MERGERANK_HPP
+#define MERGERANK_HPP 1
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct TokenMerge;
+
+/**
+ * @brief Compact (left id, right id) -> (rank, merged id) table of the learned merges.
+ * The table is an open-addressing hash over 16-byte slots keyed by both ids packed in
+ * 64 bits, so a lookup is one hash and (almost always) one cache line. `apply` encodes
+ * a word the way training did: the adjacent pair with the lowest rank is merged first,
+ * leftmost first among equal ranks, until no adjacent pair has a merge.
+ */
+class MergeRankTable {
+private:
+    static constexpr uint64_t EMPTY_KEY = ~0ull;    // (-1, -1): ids of merges are never negative
+
+    struct Slot {
+        uint64_t key = EMPTY_KEY;
+        uint32_t rank = 0;
+        int32_t merged = -1;
+    };
+
+    std::vector<Slot> slots;    // size is a power of two (or 0)
+    size_t mergeCount = 0;
+
+    static uint64_t pairKey(int32_t left, int32_t right) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) | static_cast<uint32_t>(right);
+    }
+    static size_t slotHash(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDull;
+        key ^= key >> 33;
+        return static_cast<size_t>(key);
+    }
+
+public:
+    static constexpr uint32_t NO_RANK = ~0u;
+
+    MergeRankTable() = default;
+    explicit MergeRankTable(const std::vector<TokenMerge>& merges) { build(merges); }
+
+    void build(const std::vector<TokenMerge>& merges);
+    void clear();
+    bool empty() const { return mergeCount == 0; }
+    size_t size() const { return mergeCount; }
+
+    /**
+     * @brief Rank of merging `left` and `right` (NO_RANK if they never merge).
+     * @param merged Output: the merged token's id when the pair has a rank.
+     */
+    uint32_t rank(int32_t left, int32_t right, int32_t& merged) const {
+        if (slots.empty() || left < 0 || right < 0) return NO_RANK;     // unknown symbols never merge
+        const uint64_t key = pairKey(left, right);
+        const size_t mask = slots.size() - 1;
+        for (size_t i = slotHash(key) & mask; ; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.key == key) {
+                merged = slot.merged;
+                return slot.rank;
+            }
+            if (slot.key == EMPTY_KEY) return NO_RANK;
+        }
+    }
+
+    void apply(std::vector<int32_t>& symbols, size_t first = 0) const;
+};
+
+#endif // MERGERANK_HPP
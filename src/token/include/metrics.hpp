@@ -0,0 +1,205 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP 1
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Wall time and work of one finished pipeline stage (see PipelineMetrics::Stage).
+ * The work counters are whatever the stage processes; `items` is its own unit
+ * (merges for "bpe_merges", rows for the CSV stages, token ids for "encode_shard").
+ * `counters` holds further named counters of a stage (e.g. the inverted index of
+ * "bpe_merges").
+ */
+struct StageMetrics {
+    std::string name;
+    double startSeconds = 0.0;      // since the metrics were reset
+    double seconds = 0.0;           // wall time
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint64_t words = 0;
+    uint64_t items = 0;
+    size_t maxQueueDepth = 0;       // high-water mark of the stage's work queue (0 = no queue)
+    uint64_t peakRssBytes = 0;      // peak resident set size of the process when the stage ended
+    std::vector<std::pair<std::string, uint64_t>> counters;
+
+    double bytesPerSecond() const { return seconds > 0.0 ? bytes / seconds : 0.0; }
+    double itemsPerSecond() const { return seconds > 0.0 ? items / seconds : 0.0; }
+};
+
+/**
+ * @brief Busy and idle time of one worker thread of a stage.
+ * Idle is the time spent blocked on the stage's queues (waiting for work or for room),
+ * busy is everything else between the thread's start and end.
+ */
+struct ThreadMetrics {
+    std::string stage;
+    std::string role;               // "producer", "consumer", ...
+    int index = 0;                  // index among the threads of the same role
+    double startSeconds = 0.0;
+    double busySeconds = 0.0;
+    double idleSeconds = 0.0;
+};
+
+/**
+ * @brief Point-in-time copy of the pipeline metrics and the live progress counters.
+ */
+struct MetricsSnapshot {
+    std::vector<StageMetrics> stages;       // finished stages, in the order they ended
+    std::vector<ThreadMetrics> threads;     // finished worker threads
+    std::vector<std::string> runningStages; // outermost first
+    double elapsedSeconds = 0.0;            // since the metrics were reset
+    long long totalBytes = 0;               // input bytes of the current corpus pass
+    long long bytesRead = 0;
+    unsigned long long sentences = 0;
+    int mergesCompleted = 0;
+    int totalMerges = 0;
+    double mergesPerSecond = 0.0;           // of the running (or last) merge loop
+    size_t queueDepth = 0;                  // items in the watched work queue right now
+    uint64_t peakRssBytes = 0;
+};
+
+/**
+ * @brief Thread-safe collector of per-stage and per-thread timings of the pipeline.
+ * Stages are timed with the RAII `Stage`, worker threads with `ThreadTimer`; both are
+ * recorded when they go out of scope. `snapshot()` copies the recorded metrics together
+ * with the live counters of the owning ProgressData (bytes read, merges, queue depth),
+ * and the optional callback receives a snapshot whenever a stage ends and at regular
+ * points of the long stages (every file of the corpus pass, every
+ * NOTIFY_MERGE_INTERVAL merges). Recording takes one short lock per stage or thread.
+ * With tracing on, worker threads also record one event per work item; `writeChromeTrace`
+ * writes stages, threads and those events in the Chrome trace event format
+ * (chrome://tracing, Perfetto).
+ */
+class PipelineMetrics {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void(const MetricsSnapshot&)>;
+
+    static constexpr int NOTIFY_MERGE_INTERVAL = 100;
+
+    /**
+     * @brief Times one stage from construction to destruction.
+     * Fill in the work counters before it goes out of scope.
+     */
+    class Stage {
+    public:
+        Stage(PipelineMetrics& metrics, std::string name);
+        ~Stage();
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+
+        uint64_t bytes = 0;
+        uint64_t lines = 0;
+        uint64_t words = 0;
+        uint64_t items = 0;
+        size_t maxQueueDepth = 0;
+        std::vector<std::pair<std::string, uint64_t>> counters;     // name, value
+
+    private:
+        PipelineMetrics& owner;
+        std::string name;
+        Clock::time_point start;
+        int thread;
+    };
+
+    /**
+     * @brief Splits one worker thread's lifetime into busy and idle time.
+     * Call `idle()` after a blocking wait and `busy()` after a piece of work: the time
+     * since the previous call is counted accordingly.
+     */
+    class ThreadTimer {
+    public:
+        ThreadTimer(PipelineMetrics& metrics, std::string stage, std::string role, int index);
+        ~ThreadTimer();
+        ThreadTimer(const ThreadTimer&) = delete;
+        ThreadTimer& operator=(const ThreadTimer&) = delete;
+
+        void idle();
+        void busy(const char* event = nullptr);     // event: traced name of the work item
+
+    private:
+        PipelineMetrics& owner;
+        ThreadMetrics record;
+        Clock::time_point start, last;
+        int thread;
+        bool tracing;
+    };
+
+    /**
+     * @brief Reports the depth of a work queue in snapshots while it is in scope.
+     */
+    class QueueWatch {
+    public:
+        QueueWatch(PipelineMetrics& metrics, std::function<size_t()> depth);
+        ~QueueWatch();
+        QueueWatch(const QueueWatch&) = delete;
+        QueueWatch& operator=(const QueueWatch&) = delete;
+
+    private:
+        PipelineMetrics& owner;
+    };
+
+    PipelineMetrics();
+    PipelineMetrics(const PipelineMetrics&) = delete;
+    PipelineMetrics& operator=(const PipelineMetrics&) = delete;
+
+    // Forgets everything recorded so far and restarts the clock.
+    void reset();
+    void setCallback(Callback callback);
+    void setTracing(bool enabled) { tracingEnabled.store(enabled, std::memory_order_relaxed); }
+    bool tracing() const { return tracingEnabled.load(std::memory_order_relaxed); }
+    // Fills in the live counters of a snapshot; set once by the owner (ProgressData).
+    void setCounterSource(std::function<void(MetricsSnapshot&)> source);
+
+    MetricsSnapshot snapshot() const;
+    // Passes a snapshot to the callback, if one is set.
+    void notify() const;
+    double secondsSince(Clock::time_point t) const;
+
+    std::string toJson() const;
+    bool writeJson(const std::string& path) const;
+    bool writeChromeTrace(const std::string& path) const;
+
+private:
+    struct TraceEvent {
+        std::string name;
+        std::string category;
+        double startSeconds;
+        double seconds;
+        int thread;
+    };
+
+    mutable std::mutex mtx;
+    Clock::time_point epoch;
+    std::vector<StageMetrics> stages;
+    std::vector<ThreadMetrics> threads;
+    std::vector<std::string> running;                       // open stages, outermost first
+    std::vector<TraceEvent> events;
+    std::vector<std::thread::id> traceThreads;              // index + 1 = trace thread id
+    std::vector<std::string> traceThreadNames;
+    std::function<size_t()> queueDepth;
+    std::function<void(MetricsSnapshot&)> counterSource;
+    Callback callback;
+    std::atomic<bool> hasCallback{ false };
+    std::atomic<bool> tracingEnabled{ false };
+
+    int traceThread();      // requires mtx
+    void beginStage(const std::string& name, int& thread);
+    void finishStage(StageMetrics stage, int thread);
+    void finishThread(const ThreadMetrics& thread, int traceId);
+    void addEvent(TraceEvent event);
+};
+
+// Peak resident set size of this process in bytes (0 where it cannot be queried).
+uint64_t peakResidentBytes();
+
+#endif // METRICS_HPP
@@ -0,0 +1,44 @@
+#ifndef MODELFILE_HPP
+#define MODELFILE_HPP 1
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief On-disk layout of the binary tokenizer model (`tokeniser::saveModel` / `loadModel`).
+ * The file starts with a ModelFileHeader followed by the sections listed in its table.
+ * Every section starts at a multiple of MODEL_SECTION_ALIGNMENT, so a memory-mapped
+ * file can be read in place. All values are stored in native byte order; the byte
+ * order mark rejects files written on a machine with the other endianness.
+ *  - Vocabulary:  uint64_t offsets[vocabSize + 1] into the token bytes that follow.
+ *  - Merges:      mergeCount TokenMerge records (int32 left, right, merged) in rank order.
+ *  - PrefixIndex: the compiled TokenTrie arrays (`TokenTrie::serialize`).
+ *  - Embeddings:  vocabSize x embeddingDim float32 values, row-major (empty if none).
+ */
+enum class ModelSection : uint32_t { Vocabulary = 0, Merges, PrefixIndex, Embeddings, Count };
+
+struct ModelFileSection {
+    uint64_t offset;    // from the start of the file
+    uint64_t size;      // in bytes
+};
+
+struct ModelFileHeader {
+    char magic[8];              // MODEL_FILE_MAGIC
+    uint32_t version;           // MODEL_FILE_VERSION
+    uint32_t byteOrderMark;     // MODEL_FILE_BYTE_ORDER_MARK as written by the producer
+    uint32_t embeddingDim;
+    uint32_t vocabSize;
+    uint32_t mergeCount;
+    uint32_t flags;             // MODEL_FLAG_* bits (0 in files of older builds)
+    ModelFileSection sections[static_cast<size_t>(ModelSection::Count)];
+};
+
+inline constexpr char MODEL_FILE_MAGIC[8] = { 'T', 'O', 'K', 'M', 'O', 'D', 'E', 'L' };
+inline constexpr uint32_t MODEL_FILE_VERSION = 1;
+inline constexpr uint32_t MODEL_FILE_BYTE_ORDER_MARK = 0x01020304u;
+inline constexpr size_t MODEL_SECTION_ALIGNMENT = 64;
+inline constexpr uint32_t MODEL_FLAG_BYTE_ALPHABET = 1u;    // trained with BaseAlphabet::Bytes
+
+static_assert(sizeof(ModelFileHeader) == 96, "ModelFileHeader layout must not change within a version");
+
+#endif // MODELFILE_HPP
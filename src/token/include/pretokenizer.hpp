@@ -0,0 +1,207 @@
+#ifndef PRETOKENIZER_HPP
+#define PRETOKENIZER_HPP 1
+
+#include "asciiscan.hpp"
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Class of one byte under a pre-tokenizer rule policy.
+ * Lower, Upper and Caseless bytes are letters; only Lower and Upper take part in the
+ * camelCase rule. Space bytes separate pre-tokens; every Other byte is a pre-token of its own.
+ */
+enum class ByteClass : uint8_t { Other, Space, Lower, Upper, Caseless };
+
+/**
+ * @brief The default pre-tokenizer rules, shared by training and inference.
+ * Words are runs of ASCII letters. They are split at camelCase boundaries
+ * ("camel|Case", "HTTP|Request") and lower-cased. Every other non-space byte, including
+ * each byte >= 0x80, is a token of its own. Words shorter than minMergeLength
+ * (single letters) are atomic tokens of the base vocabulary and are not split by BPE.
+ *
+ * A rule policy provides these members, all constexpr:
+ *   classOf(c)       ByteClass of byte c (evaluated at compile time into a 256-entry table)
+ *   splitCamelCase   split words at camelCase boundaries
+ *   foldCase         lower-case ASCII letters of words
+ *   minMergeLength   shortest word that BPE training splits
+ *   asciiMasks       classOf matches AsciiMasks (A-Z and a-z letters, C-locale spaces), so
+ *                    the SIMD mask scan can replace the table scan
+ */
+struct AsciiWordRules {
+    static constexpr ByteClass classOf(unsigned char c) {
+        return asciiIsUpper(c) ? ByteClass::Upper
+             : asciiIsLower(c) ? ByteClass::Lower
+             : asciiIsSpace(c) ? ByteClass::Space
+             : ByteClass::Other;
+    }
+    static constexpr bool splitCamelCase = true;
+    static constexpr bool foldCase = true;
+    static constexpr size_t minMergeLength = 2;
+    static constexpr bool asciiMasks = true;
+};
+
+/**
+ * @brief Rules of the byte-level alphabet (BaseAlphabet::Bytes).
+ * Bytes >= 0x80 are Caseless letters, so a word is a run of ASCII letters and UTF-8
+ * sequences: "naïve", "Straße" or "日本語" stays one word instead of falling apart into
+ * one atomic token per non-ASCII byte. The camelCase rule only splits between ASCII
+ * letters, so a split never falls inside or next to a UTF-8 sequence ("ÉCOLE" and
+ * "STRAßE" stay one word); case folding lower-cases the ASCII letters only.
+ */
+struct Utf8WordRules {
+    static constexpr ByteClass classOf(unsigned char c) {
+        return c >= 0x80 ? ByteClass::Caseless : AsciiWordRules::classOf(c);
+    }
+    static constexpr bool splitCamelCase = true;
+    static constexpr bool foldCase = true;
+    static constexpr size_t minMergeLength = 2;
+    static constexpr bool asciiMasks = false;
+};
+
+
+/**
+ * @brief Splits text into pre-tokens (words and single symbols) under a rule policy.
+ * The policy is a template parameter, so its rules compile into the scanner. Class
+ * lookups come from a constexpr table, and the branches of disabled rules are removed.
+ * Policies with `asciiMasks` classify the text 64 bytes at a time instead. Words are
+ * emitted already split and case-folded.
+ * An instance keeps its buffers between calls; use one per thread (it is not thread-safe).
+ */
+template<typename Rules>
+class PreTokenizer {
+private:
+    static constexpr std::array<ByteClass, 256> makeClassTable() {
+        std::array<ByteClass, 256> table{};
+        for (int c = 0; c < 256; ++c) table[c] = Rules::classOf(static_cast<unsigned char>(c));
+        return table;
+    }
+    static constexpr std::array<ByteClass, 256> classes = makeClassTable();
+
+    static constexpr bool isLetter(ByteClass c) { return c != ByteClass::Other && c != ByteClass::Space; }
+    static constexpr ByteClass byteClass(char c) { return classes[static_cast<unsigned char>(c)]; }
+
+    AsciiMasks masks;
+    std::vector<size_t> splits;
+    std::string folded;
+
+    template<typename OnWord>
+    void emitWord(const char* word, size_t length, OnWord& on_word) {
+        if constexpr (Rules::foldCase) {
+            folded.resize(length);
+            lowercaseAscii(word, length, folded.data());
+            on_word(std::string_view(folded));
+        }
+        else {
+            on_word(std::string_view(word, length));
+        }
+    }
+
+    // Split points of the letter run [begin, end) by the camelCase rule, from the class table.
+    void tableCamelCaseSplits(std::string_view text, size_t begin, size_t end) {
+        for (size_t j = begin + 1; j < end; ++j) {
+            if (isCamelCaseSplit(text, j, end)) splits.push_back(j);
+        }
+    }
+
+public:
+    using RulesType = Rules;
+
+    /**
+     * @brief Whether the camelCase rule splits the letter run ending at `end` before byte j.
+     * Byte j must be Upper and follow a Lower byte ("camel|Case"), or follow an Upper byte
+     * and precede a Lower one ("HTTP|Request"). Caseless bytes never satisfy either side.
+     */
+    static constexpr bool isCamelCaseSplit(std::string_view text, size_t j, size_t end) {
+        if (byteClass(text[j]) != ByteClass::Upper) return false;
+        const ByteClass prev = byteClass(text[j - 1]);
+        const ByteClass next = j + 1 < end ? byteClass(text[j + 1]) : ByteClass::Other;
+        return prev == ByteClass::Lower || (prev == ByteClass::Upper && next == ByteClass::Lower);
+    }
+
+    // Number of camelCase split points of a word (a letter run).
+    static constexpr size_t camelCaseSplitCount(std::string_view word) {
+        size_t count = 0;
+        for (size_t j = 1; j < word.length(); ++j) count += isCamelCaseSplit(word, j, word.length());
+        return count;
+    }
+
+    // A pre-token that is a word, i.e. is split into subwords (as opposed to a symbol).
+    static bool isWord(std::string_view token) { return !token.empty() && isLetter(byteClass(token[0])); }
+    // A word that BPE training splits; shorter words stay atomic tokens.
+    static bool isMergeWord(std::string_view token) { return isWord(token) && token.length() >= Rules::minMergeLength; }
+
+    /**
+     * @brief Scans `text` and reports its pre-tokens in order.
+     * @param on_word Called with every word piece (case-folded per the rules); the view is
+     *        only valid during the call.
+     * @param on_symbol Called with every other non-space byte, as a one-byte view of `text`.
+     */
+    template<typename OnWord, typename OnSymbol>
+    void scan(std::string_view text, OnWord&& on_word, OnSymbol&& on_symbol) {
+        if constexpr (Rules::asciiMasks) {
+            masks.classify(text);
+            size_t i = masks.skipSpaces(0);
+            while (i < text.length()) {
+                if (masks.isAlpha(i)) {
+                    const size_t word_end = masks.alphaRunEnd(i);
+                    splits.clear();
+                    if constexpr (Rules::splitCamelCase) masks.camelCaseSplits(i, word_end, splits);
+                    splits.push_back(word_end);
+                    size_t start = i;
+                    for (const size_t split : splits) {
+                        emitWord(text.data() + start, split - start, on_word);
+                        start = split;
+                    }
+                    i = word_end;
+                }
+                else {
+                    on_symbol(text.substr(i, 1));
+                    i++;
+                }
+                i = masks.skipSpaces(i);
+            }
+        }
+        else {
+            size_t i = 0;
+            while (i < text.length()) {
+                const ByteClass c = byteClass(text[i]);
+                if (c == ByteClass::Space) {
+                    i++;
+                }
+                else if (!isLetter(c)) {
+                    on_symbol(text.substr(i, 1));
+                    i++;
+                }
+                else {
+                    size_t word_end = i + 1;
+                    while (word_end < text.length() && isLetter(byteClass(text[word_end]))) word_end++;
+                    splits.clear();
+                    if constexpr (Rules::splitCamelCase) tableCamelCaseSplits(text, i, word_end);
+                    splits.push_back(word_end);
+                    size_t start = i;
+                    for (const size_t split : splits) {
+                        emitWord(text.data() + start, split - start, on_word);
+                        start = split;
+                    }
+                    i = word_end;
+                }
+            }
+        }
+    }
+};
+
+// The pre-tokenizer of buildCorpusWordCounts, groupCommonTokens, splitSentence and encode.
+using DefaultPreTokenizer = PreTokenizer<AsciiWordRules>;
+// Their pre-tokenizer with the byte-level alphabet.
+using Utf8PreTokenizer = PreTokenizer<Utf8WordRules>;
+
+// Uppercase words with non-ASCII letters stay one piece; ASCII camelCase still splits.
+static_assert(Utf8PreTokenizer::camelCaseSplitCount("\xC3\x89" "COLE") == 0, "ÉCOLE must stay one word");
+static_assert(Utf8PreTokenizer::camelCaseSplitCount("STRA" "\xC3\x9F" "E") == 0, "STRAßE must stay one word");
+static_assert(Utf8PreTokenizer::camelCaseSplitCount("HTTPRequest") == 1, "HTTP|Request must still split");
+
+#endif // PRETOKENIZER_HPP
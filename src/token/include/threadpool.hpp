@@ -0,0 +1,179 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP 1
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <exception>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+
+/**
+ * @brief Persistent work-stealing thread pool shared by all tokeniser stages.
+ * Every worker owns a task deque: it pops its own tasks from the back (most recent
+ * first, cache friendly) and, when that is empty, steals from the front of the other
+ * workers' deques. Tasks submitted from outside the pool are spread round-robin.
+ * `parallelFor` and `parallelReduce` split a range into grain-sized chunks that are
+ * claimed dynamically by the workers and the calling thread, so uneven chunks balance
+ * out. A thread that waits for a parallel loop runs queued tasks in the meantime,
+ * which makes nested parallel loops safe.
+ * Tasks that block on each other (e.g. producer/consumer pipelines) must not exceed
+ * the number of workers, since a blocked task keeps its worker.
+ */
+class ThreadPool {
+private:
+    using Task = std::function<void()>;
+
+    struct WorkerQueue {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    std::atomic<long long> queuedTasks{0};
+    std::atomic<size_t> nextQueue{0};
+    bool stopping = false;                  // guarded by sleepMutex
+
+    void enqueue(Task task);
+    bool popTask(size_t self, Task& task);
+    void workerLoop(size_t index);
+
+public:
+    explicit ThreadPool(size_t num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+    bool isWorkerThread() const;
+    bool runPendingTask();
+
+    /**
+     * @brief Queues a callable and returns a future for its result.
+     * @param fn Callable taking no arguments.
+     */
+    template <typename Fn>
+    auto submit(Fn&& fn) -> std::future<std::invoke_result_t<std::decay_t<Fn>>> {
+        using Result = std::invoke_result_t<std::decay_t<Fn>>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+        std::future<Result> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    /**
+     * @brief Waits for a future; on a worker thread, runs other queued tasks while waiting.
+     */
+    template <typename T>
+    T wait(std::future<T>& future) {
+        if (isWorkerThread()) {
+            while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!runPendingTask()) std::this_thread::yield();
+            }
+        }
+        return future.get();
+    }
+
+    /**
+     * @brief Runs `body(chunk_begin, chunk_end)` over [begin, end) split into chunks of `grain`.
+     * Chunks are claimed dynamically by up to size() workers plus the calling thread.
+     * Blocks until all chunks are done; the first exception thrown by `body` is rethrown.
+     * @param begin Start of the range.
+     * @param end End of the range (exclusive).
+     * @param grain Number of indices per chunk (0 picks about 4 chunks per thread).
+     * @param body Callable invoked as body(size_t, size_t), possibly concurrently.
+     */
+    template <typename Body>
+    void parallelFor(size_t begin, size_t end, size_t grain, Body&& body) {
+        if (end <= begin) return;
+        const size_t count = end - begin;
+        if (grain == 0) grain = std::max<size_t>(1, count / (4 * (size() + 1)));
+        const size_t num_chunks = (count + grain - 1) / grain;
+        if (num_chunks == 1 || size() == 0) {
+            body(begin, end);
+            return;
+        }
+
+        // Shared with the helper tasks, which may start after the loop has finished.
+        struct LoopState {
+            std::atomic<size_t> nextChunk{0};
+            std::atomic<size_t> doneChunks{0};
+            std::mutex errorMutex;
+            std::exception_ptr error;
+        };
+        auto state = std::make_shared<LoopState>();
+        auto* body_ptr = &body;
+
+        auto run_chunks = [state, body_ptr, begin, end, grain, num_chunks]() {
+            size_t chunk;
+            while ((chunk = state->nextChunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks) {
+                const size_t lo = begin + chunk * grain;
+                const size_t hi = std::min(lo + grain, end);
+                try {
+                    (*body_ptr)(lo, hi);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->errorMutex);
+                    if (!state->error) state->error = std::current_exception();
+                }
+                state->doneChunks.fetch_add(1, std::memory_order_acq_rel);
+            }
+        };
+
+        const size_t helpers = std::min(size(), num_chunks - 1);
+        for (size_t h = 0; h < helpers; ++h) enqueue(run_chunks);
+        run_chunks();
+
+        // Every chunk is claimed; wait for the ones still running, helping meanwhile.
+        while (state->doneChunks.load(std::memory_order_acquire) < num_chunks) {
+            if (!runPendingTask()) std::this_thread::yield();
+        }
+        if (state->error) std::rethrow_exception(state->error);
+    }
+
+    /**
+     * @brief Maps each chunk of [begin, end) to a partial result and reduces them in chunk order.
+     * The reduction is done on the calling thread in a fixed order, so the result does not
+     * depend on scheduling.
+     * @param begin Start of the range.
+     * @param end End of the range (exclusive).
+     * @param grain Number of indices per chunk (0 picks about 4 chunks per thread).
+     * @param identity Result for an empty range and starting value of the reduction.
+     * @param map Callable map(size_t chunk_begin, size_t chunk_end) -> T.
+     * @param reduce Callable reduce(T accumulated, T partial) -> T.
+     */
+    template <typename T, typename Map, typename Reduce>
+    T parallelReduce(size_t begin, size_t end, size_t grain, T identity, Map&& map, Reduce&& reduce) {
+        if (end <= begin) return identity;
+        const size_t count = end - begin;
+        if (grain == 0) grain = std::max<size_t>(1, count / (4 * (size() + 1)));
+        const size_t num_chunks = (count + grain - 1) / grain;
+
+        std::vector<std::optional<T>> partials(num_chunks);
+        parallelFor(0, num_chunks, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                const size_t chunk_begin = begin + c * grain;
+                partials[c].emplace(map(chunk_begin, std::min(chunk_begin + grain, end)));
+            }
+        });
+
+        T result = std::move(identity);
+        for (auto& partial : partials) {
+            result = reduce(std::move(result), std::move(*partial));
+        }
+        return result;
+    }
+};
+
+#endif // THREADPOOL_HPP
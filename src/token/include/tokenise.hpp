@@ -2,6 +2,26 @@
 #define TOKENISE_HPP 1
 
 #include <neuralNet.hpp>
+#include "trie.hpp"
+#include "bpe.hpp"
+#include "mappedfile.hpp"
+#include "asciiscan.hpp"
+#include "pretokenizer.hpp"
+#include "wordcount.hpp"
+#include "countsketch.hpp"
+#include "threadpool.hpp"
+#include "wordcache.hpp"
+#include "mergerank.hpp"
+#include "modelfile.hpp"
+#include "csvwriter.hpp"
+#include "csvreader.hpp"
+#include "embeddingmatrix.hpp"
+#include "embeddingformula.hpp"
+#include "cudacontext.hpp"
+#include "checkpoint.hpp"
+#include "countshard.hpp"
+#include "tokenshard.hpp"
+#include "metrics.hpp"
 #include <string>
 #include <vector>
 #include <set>
@@ -11,6 +31,8 @@
 #include <queue>                 // For std::queue
 #include <mutex>                 // For std::mutex, std::lock_guard
 #include <condition_variable>    // For std::condition_variable
+#include <atomic>
+#include <chrono>
 #include <regex>
 #include <algorithm>
 #include <future>
@@ -28,22 +50,61 @@ struct PairHash {
 };
 
 
+/**
+ * @brief One learned BPE merge in terms of canonical token ids.
+ * A merge's rank is its position in `tokeniser::getMerges()` (0 = learned first).
+ */
+struct TokenMerge {
+    int32_t left;       // id of the left token
+    int32_t right;      // id of the right token
+    int32_t merged;     // id of the resulting token
+};
+
+
+/**
+ * @brief Token ids of a batch of documents, stored back to back in one flat buffer.
+ * The ids of document i are ids[offsets[i]] .. ids[offsets[i + 1] - 1]; offsets has
+ * one entry more than there are documents. Ids index the vocabulary (`getTokens()`,
+ * `idToToken()`) and are the canonical ids saved in `_vocab.csv`; characters that are
+ * not in the vocabulary are encoded as UNKNOWN_ID.
+ */
+struct EncodedBatch {
+    static constexpr int32_t UNKNOWN_ID = -1;
+
+    std::vector<int32_t> ids;
+    std::vector<uint64_t> offsets;
+
+    size_t documentCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t documentLength(size_t i) const { return static_cast<size_t>(offsets[i + 1] - offsets[i]); }
+    size_t maxDocumentLength() const;
+    void padded(size_t seqLen, std::vector<int32_t>& grid, int32_t pad = UNKNOWN_ID) const;
+};
+
+
 /**
  * @brief A struct to hold shared progress data for logging.
- * Protected by a mutex.
+ * The hot counters updated by worker threads are atomics, each on its own cache line
+ * so producers and consumers do not contend; workers batch their increments and
+ * flush them once per chunk. The mutex and condition variable only guard the coarse
+ * per-file fields used by the reporting loop on the main thread. `metrics` records the
+ * per-stage and per-thread timings; its snapshots include the counters here.
  * Explicitly delete copy/move operations because of std::mutex.
  */
 struct ProgressData {
+    static constexpr size_t CACHE_LINE = 64;
+
     std::mutex mtx; // This makes ProgressData non-copyable and non-movable
     std::condition_variable cv;
-    long long total_bytes = 0;
-    long long bytes_read = 0;
-    size_t files_completed_count = 0;
-    std::string last_file_completed;
-    int merges_completed = 0;
-    int total_merges = 0;
-    unsigned long long sentence_terminator_count = 0;
+    std::atomic<long long> total_bytes{0};
+    alignas(CACHE_LINE) std::atomic<long long> bytes_read{0};                       // updated by producers
+    alignas(CACHE_LINE) std::atomic<unsigned long long> sentence_terminator_count{0}; // updated by consumers
+    alignas(CACHE_LINE) size_t files_completed_count = 0;                           // guarded by mtx
+    std::string last_file_completed;                                                // guarded by mtx
+    std::atomic<int> merges_completed{0};                                           // updated by the merge loop
+    std::atomic<int> total_merges{0};
+    std::atomic<double> merges_per_second{0.0};
     std::chrono::steady_clock::time_point start_time;
+    PipelineMetrics metrics;                                                        // per-stage timings (see metrics.hpp)
 
     // Explicitly delete copy constructor and assignment operator
     ProgressData(const ProgressData&) = delete;
@@ -53,11 +114,69 @@ struct ProgressData {
     ProgressData(ProgressData&&) = delete;
     ProgressData& operator=(ProgressData&&) = delete;
 
-    // Default constructor is fine for creating a new instance
-    ProgressData() = default;
+    // The metrics snapshots read the live counters above
+    ProgressData() {
+        metrics.setCounterSource([this](MetricsSnapshot& snapshot) {
+            snapshot.totalBytes = total_bytes.load(std::memory_order_relaxed);
+            snapshot.bytesRead = bytes_read.load(std::memory_order_relaxed);
+            snapshot.sentences = sentence_terminator_count.load(std::memory_order_relaxed);
+            snapshot.mergesCompleted = merges_completed.load(std::memory_order_relaxed);
+            snapshot.totalMerges = total_merges.load(std::memory_order_relaxed);
+            snapshot.mergesPerSecond = merges_per_second.load(std::memory_order_relaxed);
+        });
+    }
 };
 
 
+/**
+ * @brief How the per-consumer word counts are combined in buildCorpusWordCounts.
+ * MergeTree: every consumer keeps one table and the tables are merged pairwise up a tree.
+ * Sharded: every consumer partitions its counts by hash into one shard per thread and
+ * shard i of all consumers is merged by worker i, all shards in parallel (default).
+ */
+enum class AggregationMode { MergeTree, Sharded };
+
+/**
+ * @brief Limits on the corpus words BPE trains on (see tokeniser::setCorpusFilter).
+ * Rare and overlong words (URLs, hashes, OCR noise) are most of the distinct words of a
+ * large corpus but add little to the merges, while each one costs a character split
+ * and inverted-index entries. Filtered words are still counted; they are just not split
+ * by BPE (their characters stay in the vocabulary). The defaults filter nothing.
+ * With sketchWidth > 0 and minCount > 1, buildCorpusWordCounts also bounds its own
+ * memory: words enter the count tables only once a shared count-min sketch has seen
+ * them minCount times, and the minCount - 1 occurrences seen before that are added back
+ * afterwards, so word counts are then estimates: usually exact, a little high for words
+ * that share sketch counters, and rarely one or two low when consumers race on a word's
+ * first occurrences.
+ */
+struct CorpusFilter {
+    int minCount = 1;               // words seen fewer times are not split by BPE
+    size_t topK = 0;                // only the K most frequent words are split (0 = all)
+    size_t maxWordLength = 0;       // longer words are not split (0 = no limit)
+    size_t sketchWidth = 0;         // counters per row of the counting sketch (0 = exact counting)
+    size_t sketchDepth = 4;         // rows of the counting sketch
+};
+
+/**
+ * @brief How words are split into token ids by encode, encodeDocument and splitWord.
+ * Greedy: longest vocabulary match from the left, through the prefix index (default).
+ * MergeRank: the learned merges are replayed lowest rank first, which reproduces the
+ * segmentation training produced for the word (needs the merges, see getMerges()).
+ */
+enum class EncoderMode { Greedy, MergeRank };
+
+/**
+ * @brief The symbols every word is built from (see tokeniser::setBaseAlphabet).
+ * Ascii: words are runs of ASCII letters and every other byte is an atomic token of its
+ * own (DefaultPreTokenizer); this is the default.
+ * Bytes: bytes >= 0x80 are word characters too (Utf8PreTokenizer), so non-English
+ * words are counted and merged whole instead of as millions of 1-byte atomic tokens.
+ * The base vocabulary is then all 250 non-space byte values, whether or not they occur
+ * in the corpus, so any input encodes without unknown ids and the base alphabet never
+ * grows beyond 256 symbols.
+ */
+enum class BaseAlphabet { Ascii, Bytes };
+
 /**
  * Class to tokenise dataset into subwords and embeddings. The embeddings are of
  * d dimension with all the values of type float.
@@ -69,19 +188,52 @@ private:
     unsigned long long sentence_terminator_count;
 
     std::string path2data;                          // path to dataset
-    std::vector<std::string> tokens;                // all possible tokens
+    std::vector<std::string> tokens;                // all possible tokens (index = canonical token id)
+    std::vector<TokenMerge> merges;                 // learned merges in rank order
     std::vector<float> seeds;                       // seeds for all tokens (seeds.csv)
-    std::vector<std::vector<float>> embeddings;     // vector for each token of dimension d
-    std::vector<std::vector<float>> deEmbeddings;   // inverse of each token of dimension d
-    // map of tokens and their embeddings (embeddings.csv)
-    std::unordered_map<std::string, std::vector<float>> mappedEmbeddings;
+    EmbeddingMatrix embeddings;                     // vocSize x d, row i = embedding of token id i
+    EmbeddingMatrix deEmbeddings;                   // inverse of each token of dimension d
     std::unordered_map<std::string, int> corpusWordCount;   // NEW (or similar if it's not a member)
     std::unordered_map<std::string, int> statOfTokens;      // hold tokens and their stats (unique_tokens.csv)
+    TokenTrie prefixIndex;                          // compiled prefix index over tokens (rebuilt whenever tokens change)
+    mutable std::shared_ptr<ThreadPool> pool;       // worker pool shared by all stages (sized from num_threads; shared by copies)
+    std::shared_ptr<WordIdCache> wordCache;         // word -> ids cache for encode (replaced whenever tokens change)
+    size_t encodeCacheCapacity = WordIdCache::DEFAULT_CAPACITY;
+    std::string checkpointDirectory;                // where train() keeps its checkpoints (empty = off)
+    int checkpointInterval = 0;                     // merges between BPE checkpoints (0 = only at the end)
+    MergeRankTable mergeRanks;                      // pair -> rank of `merges` (rebuilt whenever merges change)
+    EncoderMode encoderMode = EncoderMode::Greedy;
+    CorpusFilter corpusFilter;                      // pre-filters of the BPE words (default: none)
+    BaseAlphabet baseAlphabet = BaseAlphabet::Ascii;
+    uint64_t embeddingsVersion = 0;                 // identifies the contents of `embeddings` (device residency, see gather.cpp)
+
+    // Gives `embeddings` a new version; call after every change to the matrix.
+    void embeddingsChanged();
+
+    // Runs the pre-tokenizer of the base alphabet over `text` (see PreTokenizer::scan).
+    template<typename OnWord, typename OnSymbol>
+    void preTokenize(std::string_view text, OnWord&& on_word, OnSymbol&& on_symbol) const {
+        if (this->baseAlphabet == BaseAlphabet::Bytes) {
+            thread_local Utf8PreTokenizer pretokenizer;
+            pretokenizer.scan(text, on_word, on_symbol);
+        }
+        else {
+            thread_local DefaultPreTokenizer pretokenizer;
+            pretokenizer.scan(text, on_word, on_symbol);
+        }
+    }
+    bool isWordToken(std::string_view token) const {
+        return this->baseAlphabet == BaseAlphabet::Bytes ? Utf8PreTokenizer::isWord(token) : DefaultPreTokenizer::isWord(token);
+    }
+    bool isMergeWordToken(std::string_view token) const {
+        return this->baseAlphabet == BaseAlphabet::Bytes ? Utf8PreTokenizer::isMergeWord(token) : DefaultPreTokenizer::isMergeWord(token);
+    }
 
 public:
 
-    int num_threads;                        // number of threads
+    int num_threads = 1;                    // number of threads (see setNumThreads)
     int totalCorpusWordCount;               // corpus word count
+    AggregationMode aggregationMode = AggregationMode::Sharded;     // how consumer counts are combined
     std::unique_ptr<ProgressData> bpe_progress;
 
 #ifdef USE_OPENCL
@@ -106,14 +258,26 @@ public:
           vocSize(other.vocSize),
           path2data(other.path2data),
           tokens(other.tokens),
+          merges(other.merges),
           seeds(other.seeds),
           embeddings(other.embeddings),
           deEmbeddings(other.deEmbeddings),
-          mappedEmbeddings(other.mappedEmbeddings),
           corpusWordCount(other.corpusWordCount),
           statOfTokens(other.statOfTokens),
+          prefixIndex(other.prefixIndex),
+          pool(other.pool),
+          wordCache(other.wordCache),
+          encodeCacheCapacity(other.encodeCacheCapacity),
+          checkpointDirectory(other.checkpointDirectory),
+          checkpointInterval(other.checkpointInterval),
+          mergeRanks(other.mergeRanks),
+          encoderMode(other.encoderMode),
+          corpusFilter(other.corpusFilter),
+          baseAlphabet(other.baseAlphabet),
+          embeddingsVersion(other.embeddingsVersion),
           num_threads(other.num_threads),
           totalCorpusWordCount(other.totalCorpusWordCount),
+          aggregationMode(other.aggregationMode),
           bpe_progress(std::make_unique<ProgressData>()) // Create a NEW, independent ProgressData object
 #ifdef USE_OPENCL
           , ocl(other.ocl)
@@ -126,14 +290,26 @@ public:
           vocSize(other.vocSize),
           path2data(std::move(other.path2data)),
           tokens(std::move(other.tokens)),
+          merges(std::move(other.merges)),
           seeds(std::move(other.seeds)),
           embeddings(std::move(other.embeddings)),
           deEmbeddings(std::move(other.deEmbeddings)),
-          mappedEmbeddings(std::move(other.mappedEmbeddings)),
           corpusWordCount(std::move(other.corpusWordCount)),
           statOfTokens(std::move(other.statOfTokens)),
+          prefixIndex(std::move(other.prefixIndex)),
+          pool(std::move(other.pool)),
+          wordCache(std::move(other.wordCache)),
+          encodeCacheCapacity(other.encodeCacheCapacity),
+          checkpointDirectory(std::move(other.checkpointDirectory)),
+          checkpointInterval(other.checkpointInterval),
+          mergeRanks(std::move(other.mergeRanks)),
+          encoderMode(other.encoderMode),
+          corpusFilter(other.corpusFilter),
+          baseAlphabet(other.baseAlphabet),
+          embeddingsVersion(other.embeddingsVersion),
           num_threads(other.num_threads),
           totalCorpusWordCount(other.totalCorpusWordCount),
+          aggregationMode(other.aggregationMode),
           bpe_progress(std::move(other.bpe_progress)) // std::unique_ptr handles the move
 #ifdef USE_OPENCL
           , ocl(std::move(other.ocl))
@@ -150,14 +326,26 @@ public:
         vocSize = other.vocSize;
         path2data = other.path2data;
         tokens = other.tokens;
+        merges = other.merges;
         seeds = other.seeds;
         embeddings = other.embeddings;
         deEmbeddings = other.deEmbeddings;
-        mappedEmbeddings = other.mappedEmbeddings;
         corpusWordCount = other.corpusWordCount;
         statOfTokens = other.statOfTokens;
+        prefixIndex = other.prefixIndex;
+        pool = other.pool;
+        wordCache = other.wordCache;
+        encodeCacheCapacity = other.encodeCacheCapacity;
+        checkpointDirectory = other.checkpointDirectory;
+        checkpointInterval = other.checkpointInterval;
+        mergeRanks = other.mergeRanks;
+        encoderMode = other.encoderMode;
+        corpusFilter = other.corpusFilter;
+        baseAlphabet = other.baseAlphabet;
+        embeddingsVersion = other.embeddingsVersion;
         num_threads = other.num_threads;
         totalCorpusWordCount = other.totalCorpusWordCount;
+        aggregationMode = other.aggregationMode;
         bpe_progress = std::make_unique<ProgressData>(); // Create a new ProgressData object
 
         #ifdef USE_OPENCL
@@ -176,14 +364,26 @@ public:
         vocSize = other.vocSize;
         path2data = std::move(other.path2data);
         tokens = std::move(other.tokens);
+        merges = std::move(other.merges);
         seeds = std::move(other.seeds);
         embeddings = std::move(other.embeddings);
         deEmbeddings = std::move(other.deEmbeddings);
-        mappedEmbeddings = std::move(other.mappedEmbeddings);
         corpusWordCount = std::move(other.corpusWordCount);
         statOfTokens = std::move(other.statOfTokens);
+        prefixIndex = std::move(other.prefixIndex);
+        pool = std::move(other.pool);
+        wordCache = std::move(other.wordCache);
+        encodeCacheCapacity = other.encodeCacheCapacity;
+        checkpointDirectory = std::move(other.checkpointDirectory);
+        checkpointInterval = other.checkpointInterval;
+        mergeRanks = std::move(other.mergeRanks);
+        encoderMode = other.encoderMode;
+        corpusFilter = other.corpusFilter;
+        baseAlphabet = other.baseAlphabet;
+        embeddingsVersion = other.embeddingsVersion;
         num_threads = other.num_threads;
         totalCorpusWordCount = other.totalCorpusWordCount;
+        aggregationMode = other.aggregationMode;
 
         // Move the unique_ptr
         bpe_progress = std::move(other.bpe_progress);
@@ -204,37 +404,79 @@ public:
     void setEmbeddingDimension(int d);
     void setVocabularySize(int vocSize);
     void setNumThreads();
-    void setEmbedding(const std::string& token, std::vector<float> embedding);
+    void setNumThreads(int threads);
+    void setEmbedding(const std::string& token, std::span<const float> embedding);
     void readFromFiles(const std::string& path2ClassDataFolder);
+    void saveModel(const std::string& path) const;
+    void loadModel(const std::string& path);
+    void buildPrefixIndex();
+    void setEncodeCacheCapacity(size_t words);
+    void setCheckpointing(const std::string& directory, int mergeInterval);
+    void setEncoderMode(EncoderMode mode);
+    void setCorpusFilter(const CorpusFilter& filter);
+    void setBaseAlphabet(BaseAlphabet alphabet);
+    void buildMergeRanks();
 
     // Getters for read-only access to internal state
     int getEmbeddingDimension() const { return d; }
     int getVocabularySize() const { return vocSize; }
     const std::unordered_map<std::string, int>& getTokenStats() const { return statOfTokens; }
     const std::vector<std::string>& getTokens() const { return tokens; }
-    const std::unordered_map<std::string, std::vector<float>>& getMappedEmbeddings() const { return mappedEmbeddings; }
+    const std::vector<TokenMerge>& getMerges() const { return merges; }
+    EncoderMode getEncoderMode() const { return encoderMode; }
+    const CorpusFilter& getCorpusFilter() const { return corpusFilter; }
+    BaseAlphabet getBaseAlphabet() const { return baseAlphabet; }
+    const std::string& idToToken(int32_t id) const { return tokens[id]; }
+    int32_t tokenToId(std::string_view token) const;
+    const TokenTrie& getPrefixIndex() const { return prefixIndex; }
+    ThreadPool& getThreadPool() const;
+    PipelineMetrics& getMetrics() const { return bpe_progress->metrics; }     // timings of the last run (see metrics.hpp)
+    MetricsSnapshot getMetricsSnapshot() const { return bpe_progress->metrics.snapshot(); }
     const std::vector<float>& getSeeds() const { return seeds; }
-    const std::vector<std::vector<float>>& getEmbeddings() const { return embeddings; }
-    const std::vector<std::vector<float>>& getDeEmbeddings() const { return deEmbeddings; }
-    std::vector<float> getEmbeddingForToken(int index) const { return embeddings[index]; };
-    std::vector<float> getEmbeddingForToken(const std::string& token) const;
+    const EmbeddingMatrix& getEmbeddings() const { return embeddings; }
+    const EmbeddingMatrix& getDeEmbeddings() const { return deEmbeddings; }
+    std::span<const float> getEmbeddingForToken(int index) const { return embeddings.row(index); };
+    std::span<const float> getEmbeddingForToken(std::string_view token) const;
+    void gatherEmbeddings(const int32_t* ids, size_t count, float* out) const;
+    void gatherEmbeddings(const std::vector<int32_t>& ids, std::vector<float>& out) const;
+    EmbeddingMatrix gatherEmbeddings(const EncodedBatch& batch, size_t seqLen = 0) const;
 
     void splitWord(const std::string& word, std::vector<std::string>& subwords) const;
     void splitSentence(const std::string& sentence, std::vector<std::string>& all_subwords) const;
+    void splitWordIds(std::string_view word, std::vector<int32_t>& ids) const;
+    void mergeWordIds(std::string_view word, std::vector<int32_t>& ids) const;
+    void encodeDocument(std::string_view text, std::vector<int32_t>& ids) const;
+    void encode(const std::vector<std::string_view>& documents, EncodedBatch& batch) const;
+    EncodedBatch encode(const std::vector<std::string>& documents) const;
+    void encodeToIds(std::string_view text, std::vector<int32_t>& ids) const;
+    size_t encodeFilesToShard(const std::vector<std::string>& file_paths, const std::string& shardPath, size_t idBytes = 0) const;
+    void decodeIds(const int32_t* ids, size_t count, std::string& text) const;
+    void decodeIds(const std::vector<int32_t>& ids, std::string& text) const { decodeIds(ids.data(), ids.size(), text); }
     void buildCorpusWordCounts(const std::vector<std::string>& file_paths, std::unordered_map<std::string, int>& corpus_word_counts);
+    size_t buildCorpusCountShard(const std::vector<std::string>& file_paths, const std::string& shardPath);
     void groupCommonTokens(const std::unordered_map<std::string, int>& corpus_word_counts, int num_merges, std::vector<std::string>& final_vocab);
     void learn_vocabulary_from_word_counts(const std::unordered_map<std::string, int>& corpus_word_counts, int num_merges, std::vector<std::string>& final_vocab);
-    void saveUniqueTokensToCSV(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath);
-    void calculateTokenStatsFromCounts(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath);
+    size_t saveVocabulary(const std::string& outputPath) const;
+    bool readVocabulary(const std::string& filename);
+    size_t saveMerges(const std::string& outputPath) const;
+    bool readMerges(const std::string& filename);
+    size_t saveUniqueTokensToCSV(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath);
+    size_t calculateTokenStatsFromCounts(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath);
     void calculateTokenStats(const std::vector<std::string>& pre_tokens, const std::string& outputPath);
-    void generateAndSaveEmbeddings(const std::string& outputPath, float r1);
+    size_t generateAndSaveEmbeddings(const std::string& outputPath, float r1, uint64_t seed = DEFAULT_EMBEDDING_SEED);
 
     #ifdef USE_CUDA
-        void cuEmbeddingFormula(std::vector<std::vector<float>>& embedding, const std::vector<float>& seeds, int& d, int& vocSize, float r1);
-        void cuVectorInverse(std::vector<std::vector<float>>& deEmbedding, const std::vector<std::vector<float>>& embedding, int& d, int& vocSize);
+        void cuEmbeddingFormula(EmbeddingMatrix& embedding, int& d, int& vocSize, float r1, uint64_t seed);
+        void cuVectorInverse(EmbeddingMatrix& deEmbedding, const EmbeddingMatrix& embedding, int& d, int& vocSize);
+        void cuEmbeddingsWithInverse(EmbeddingMatrix& embedding, EmbeddingMatrix& deEmbedding, int& d, int& vocSize, float r1, uint64_t seed);
+        const float* cuGatherEmbeddingsToDevice(const int32_t* ids, size_t count) const;
+        void cuGatherEmbeddings(const int32_t* ids, size_t count, float* out) const;
     #elif USE_OPENCL
-        void clEmbeddingFormula(OpenCLContext& ocl_context, std::vector<std::vector<float>>& embedding, const std::vector<float>& seeds_ignored, int& d_dim, int& vocSize_val, float r1, float r2);
-        void clVectorInverse(OpenCLContext& ocl, std::vector<std::vector<float>>& deEmbedding, const std::vector<std::vector<float>>& embedding, int& d, int& vocSize);
+        void clEmbeddingFormula(OpenCLContext& ocl_context, EmbeddingMatrix& embedding, int& d_dim, int& vocSize_val, float r1, uint64_t seed);
+        void clVectorInverse(OpenCLContext& ocl, EmbeddingMatrix& deEmbedding, const EmbeddingMatrix& embedding, int& d, int& vocSize);
+        void clEmbeddingsWithInverse(OpenCLContext& ocl_context, EmbeddingMatrix& embedding, EmbeddingMatrix& deEmbedding, int& d, int& vocSize, float r1, uint64_t seed);
+        const cl::Buffer& clGatherEmbeddingsToDevice(const OpenCLContext& ocl_context, const int32_t* ids, size_t count) const;
+        void clGatherEmbeddings(const OpenCLContext& ocl_context, const int32_t* ids, size_t count, float* out) const;
     #endif
 
     // training function
@@ -246,6 +488,10 @@ public:
 
 /**
  * @brief A thread-safe queue designed for producer-consumer patterns.
+ * A queue constructed with a capacity is bounded: `push` blocks while it is full, so a
+ * fast producer is held back until consumers catch up (backpressure); `try_push` fails
+ * instead of blocking. `push_batch` and `pop_batch` move many items per lock acquisition
+ * and wake-up.
  * @tparam T The type of elements to store in the queue.
  */
 template<typename T>
@@ -254,6 +500,9 @@ private:
     std::queue<T> queue_;
     mutable std::mutex mutex_;
     std::condition_variable cv_;
+    std::condition_variable not_full_cv_;
+    size_t capacity_ = 0;       // 0 = unbounded
+    size_t max_size_ = 0;       // high-water mark of queue_.size()
     bool done_ = false;
 
 public:
@@ -264,13 +513,19 @@ public:
     ThreadSafeQueue& operator=(ThreadSafeQueue&&) = delete;
 
     ThreadSafeQueue() = default; // Default constructor is fine
+    explicit ThreadSafeQueue(size_t capacity) : capacity_(capacity) {}
 
     /**
      * @brief Pushes a new item onto the queue and notifies a waiting consumer.
+     * On a bounded queue, waits until there is room (or the queue is closed).
      */
     void push(T item) {
-        std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (capacity_ > 0) {
+            not_full_cv_.wait(lock, [this] { return queue_.size() < capacity_ || done_; });
+        }
         queue_.push(std::move(item));
+        max_size_ = std::max(max_size_, queue_.size());
         cv_.notify_one();
     }
 
@@ -289,9 +544,99 @@ public:
 
         item = std::move(queue_.front());
             queue_.pop();
+        if (capacity_ > 0) not_full_cv_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Pushes an item only if a bounded queue has room, without waiting.
+     * @return `false` (and `item` is left alone) if the queue is full or closed.
+     */
+    bool try_push(T&& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done_ || (capacity_ > 0 && queue_.size() >= capacity_)) return false;
+        queue_.push(std::move(item));
+        max_size_ = std::max(max_size_, queue_.size());
+        cv_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Pops an item if one is queued, without waiting.
+     * @return `false` if the queue is empty.
+     */
+    bool try_pop(T& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) return false;
+        item = std::move(queue_.front());
+        queue_.pop();
+        if (capacity_ > 0) not_full_cv_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Pushes all `items` in order and clears the vector.
+     * On a bounded queue, as many items as fit are pushed under one lock, then it waits
+     * for room for the rest; consumers are woken once per group instead of per item.
+     */
+    void push_batch(std::vector<T>& items) {
+        size_t next = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (next < items.size()) {
+            if (capacity_ > 0) {
+                not_full_cv_.wait(lock, [this] { return queue_.size() < capacity_ || done_; });
+            }
+            const size_t room = (capacity_ > 0 && !done_) ? capacity_ - queue_.size() : items.size() - next;
+            const size_t end = next + std::min(room, items.size() - next);
+            const size_t pushed = end - next;
+            for (; next < end; ++next) queue_.push(std::move(items[next]));
+            max_size_ = std::max(max_size_, queue_.size());
+            if (pushed == 1) cv_.notify_one();
+            else cv_.notify_all();
+        }
+        items.clear();
+    }
+
+    /**
+     * @brief Waits for at least one item, then pops up to `max_items` of them.
+     * @param items Replaced by the popped items, in queue order.
+     * @return `false` if the queue is closed and empty, `true` otherwise.
+     */
+    bool pop_batch(std::vector<T>& items, size_t max_items) {
+        items.clear();
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return !queue_.empty() || done_; });
+        if (queue_.empty() && done_) {
+            return false;
+        }
+
+        const size_t count = std::min(std::max<size_t>(max_items, 1), queue_.size());
+        items.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            items.push_back(std::move(queue_.front()));
+            queue_.pop();
+        }
+        if (capacity_ > 0) {
+            if (count == 1) not_full_cv_.notify_one();
+            else not_full_cv_.notify_all();
+        }
         return true;
     }
 
+    size_t capacity() const { return capacity_; }
+
+    // Number of queued items right now.
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    // Largest number of items the queue has held at once.
+    size_t maxSize() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return max_size_;
+    }
+
     /**
      * @brief Signals to all consumers that production is complete.
      */
@@ -299,16 +644,21 @@ public:
         std::lock_guard<std::mutex> lock(mutex_);
         done_ = true;
         cv_.notify_all(); // Wake up all waiting threads so they can exit.
+        not_full_cv_.notify_all();
     }
 };
 
 
 std::vector<std::string_view> pre_split_word(std::string_view word);
 std::unordered_map<std::pair<std::string, std::string>, int, PairHash> get_pair_stats(const std::unordered_map<std::string, int>& word_counts, const std::unordered_map<std::string, std::vector<std::string>>& splits);
-void merge_pair(const std::pair<std::string, std::string>& best_pair, std::unordered_map<std::string, std::vector<std::string>>& splits, int num_threads);
+void merge_pair(const std::pair<std::string, std::string>& best_pair, std::unordered_map<std::string, std::vector<std::string>>& splits, ThreadPool& pool);
 std::unordered_map<std::string, int> mergeTwoMaps(std::unordered_map<std::string, int> map1, std::unordered_map<std::string, int> map2);
-std::future<std::unordered_map<std::string, int>> merge_maps(std::vector<std::future<std::unordered_map<std::string, int>>>& futures,size_t start_idx, size_t end_idx);
+std::unordered_map<std::string, int> merge_maps(std::vector<std::unordered_map<std::string, int>>& maps, ThreadPool& pool);
+WordCountTable mergeTwoTables(WordCountTable table1, WordCountTable table2);
+WordCountTable merge_tables(std::vector<WordCountTable>& tables, ThreadPool& pool);
+void merge_shards(std::vector<ShardedWordCounts>& partials, std::unordered_map<std::string, int>& result, ThreadPool& pool);
 std::vector<float> vectorInverse(const std::vector<float>& vec);
+void vectorInverse(std::span<const float> vec, std::span<float> inverse);
 std::vector<std::string> pre_tokenize_word_by_corpus_freq(const std::string& word, const std::unordered_map<std::string, int>& corpus_word_counts);
 
 long long count_lines(const std::string& filename);
@@ -318,9 +668,9 @@ std::string escapeAndQuoteCsvField(const std::string& field);
 bool isHeaderLine(const std::string& line);
 std::vector<std::string> readSingleColumnCsv(const std::string& filename);
 std::vector<std::string> readSpecificColumnFromCsv(const std::string& filename, int targetColumnIndex);
-std::vector<std::vector<float>> readCsvTo2DVector(const std::string& filename);
-std::unordered_map<std::string, int> readUnorderedMap(const std::string& filename);
-std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const std::string& filename);
+std::vector<std::vector<float>> readCsvTo2DVector(const std::string& filename, ThreadPool* pool = nullptr);
+std::unordered_map<std::string, int> readUnorderedMap(const std::string& filename, ThreadPool* pool = nullptr);
+std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const std::string& filename, ThreadPool* pool = nullptr);
 
 #ifdef USE_CUDA
 
@@ -328,11 +678,13 @@ std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const s
 #include <cuda_runtime.h>
 #include <device_launch_parameters.h>
 
-// kernel for embedding calculation
-__global__ void embeddingFormulaBatchKernel(float* all_embeddings, const float* all_seeds,
-            const int N, const int d);
+// fused kernel: embedding rows and their inverses
+__global__ void generateEmbeddingsWithInverseKernel(float* embeddings_out, float* inverses_out,
+            const uint32_t* poisson_table, int N, int d, unsigned long long seed);
 // kernel for vector inverse calculation
 __global__ void batchedVectorInverseKernel(float* output, const float* input, int N, int d);
+// kernel for gathering the embedding rows of a batch of token ids
+__global__ void gatherEmbeddingsKernel(float* output, const float* embeddings, const int32_t* ids, int count, int N, int d);
 #endif
 
 #endif // TOKENISE_HPP
\ No newline at end of file
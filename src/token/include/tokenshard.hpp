@@ -0,0 +1,41 @@
+#ifndef TOKENSHARD_HPP
+#define TOKENSHARD_HPP 1
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+struct EncodedBatch;
+
+/**
+ * @brief On-disk layout of a token-id shard (`tokeniser::encodeFilesToShard`).
+ * A shard is two files, each starting with a TokenShardHeader:
+ *  - `<path>`:      tokenCount ids of idBytes each (uint16 or uint32), in input order.
+ *                   Unknown characters are stored as the all-ones value of the width.
+ *  - `<path>.idx`:  documentCount + 1 uint64 offsets into the ids; document i (line i of
+ *                   the input files, in the order given) is ids[offsets[i]] .. ids[offsets[i + 1] - 1].
+ * Both headers carry the same counts. Values are stored in native byte order; the byte
+ * order mark rejects files written on a machine with the other endianness.
+ */
+struct TokenShardHeader {
+    char magic[8];              // TOKEN_SHARD_MAGIC or TOKEN_INDEX_MAGIC
+    uint32_t version;           // TOKEN_SHARD_VERSION
+    uint32_t byteOrderMark;     // TOKEN_SHARD_BYTE_ORDER_MARK as written by the producer
+    uint32_t idBytes;           // 2 or 4
+    uint32_t reserved;
+    uint64_t tokenCount;
+    uint64_t documentCount;
+    uint64_t vocabSize;         // vocabulary the ids refer to
+};
+
+inline constexpr char TOKEN_SHARD_MAGIC[8] = { 'T', 'O', 'K', 'I', 'D', 'S', '0', '1' };
+inline constexpr char TOKEN_INDEX_MAGIC[8] = { 'T', 'O', 'K', 'I', 'D', 'X', '0', '1' };
+inline constexpr uint32_t TOKEN_SHARD_VERSION = 1;
+inline constexpr uint32_t TOKEN_SHARD_BYTE_ORDER_MARK = 0x01020304u;
+inline constexpr char TOKEN_INDEX_SUFFIX[] = ".idx";
+
+static_assert(sizeof(TokenShardHeader) == 48, "TokenShardHeader layout must not change within a version");
+
+void readTokenShard(const std::string& path, EncodedBatch& batch);
+
+#endif // TOKENSHARD_HPP
@@ -0,0 +1,48 @@
+#ifndef TRIE_HPP
+#define TRIE_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Immutable byte-level prefix index over the learned vocabulary.
+ * The trie is compiled once into flat arrays (CSR layout): the outgoing edges of
+ * node n live in [firstEdge[n], firstEdge[n + 1]) of edgeLabel/edgeTarget and are
+ * sorted by label. Children of the root are additionally kept in a direct 256-entry
+ * table since nearly every lookup starts there.
+ * All queries are const and never allocate, so one instance can be shared read-only
+ * by any number of worker threads.
+ */
+class TokenTrie {
+private:
+    static constexpr uint32_t NO_NODE = 0xFFFFFFFFu;
+
+    std::array<uint32_t, 256> rootChild{};      // direct child table of the root node
+    std::vector<uint32_t> firstEdge;            // per node: index of its first edge (size = nodes + 1)
+    std::vector<unsigned char> edgeLabel;       // per edge: byte on the edge
+    std::vector<uint32_t> edgeTarget;           // per edge: child node
+    std::vector<int32_t> tokenIndex;            // per node: index into the vocabulary, -1 if not terminal
+
+    uint32_t child(uint32_t node, unsigned char label) const;
+
+public:
+    TokenTrie() { rootChild.fill(NO_NODE); }
+    explicit TokenTrie(const std::vector<std::string>& vocabulary) { build(vocabulary); }
+
+    void build(const std::vector<std::string>& vocabulary);
+    void clear();
+    bool empty() const { return tokenIndex.empty(); }
+    size_t nodeCount() const { return tokenIndex.size(); }
+
+    int longestPrefix(std::string_view head, std::string_view tail, size_t& length) const;
+    int longestPrefix(std::string_view text, size_t& length) const { return longestPrefix(text, {}, length); }
+    int find(std::string_view token) const;
+
+    void serialize(std::string& out) const;
+    bool deserialize(std::string_view data, size_t vocabulary_size);
+};
+
+#endif // TRIE_HPP
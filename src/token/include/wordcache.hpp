@@ -0,0 +1,55 @@
+#ifndef WORDCACHE_HPP
+#define WORDCACHE_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Bounded, thread-safe cache from (lower-cased) words to their token-id sequences.
+ * Word frequencies are Zipfian, so a small cache answers most lookups during encoding.
+ * The cache is split into independently locked shards by word hash. Each shard keeps
+ * two generations: lookups that hit the older generation move the entry into the
+ * current one, and when the current generation is full it becomes the older one and
+ * the previous older generation is dropped. Frequently used words therefore survive
+ * while memory stays bounded by twice the capacity, without per-hit LRU bookkeeping.
+ */
+class WordIdCache {
+private:
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    using Map = std::unordered_map<std::string, std::vector<int32_t>, StringHash, std::equal_to<>>;
+
+    struct Shard {
+        std::mutex mtx;
+        Map current;
+        Map older;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shardCapacity;
+
+    Shard& shardFor(std::string_view word) const;
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;    // words kept per generation
+    static constexpr size_t MAX_WORD_BYTES = 64;            // longer words are not cached
+
+    explicit WordIdCache(size_t capacity_words = DEFAULT_CAPACITY, size_t num_shards = 64);
+
+    size_t capacity() const { return shardCapacity * shards.size(); }
+
+    bool lookup(std::string_view word, std::vector<int32_t>& ids);
+    void insert(std::string_view word, const int32_t* ids, size_t count);
+    void clear();
+};
+
+#endif // WORDCACHE_HPP
@@ -0,0 +1,118 @@
+#ifndef WORDCOUNT_HPP
+#define WORDCOUNT_HPP 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Flat open-addressing hash table from words to counts.
+ * Keys are copied once into an arena owned by the table (large blocks, no per-key
+ * allocation) and looked up directly by `std::string_view`, so counting a word never
+ * builds a temporary `std::string`. Slots hold the full hash, which makes probing and
+ * rehashing cheap and lets `mergeFrom` insert another table without rehashing its keys.
+ * Linear probing over a power-of-two slot array, load factor at most 0.7.
+ * Not thread-safe; intended to be owned by one worker at a time. Movable, not copyable.
+ */
+class WordCountTable {
+private:
+    struct Slot {
+        uint64_t hash;
+        const char* key;        // into the arena; nullptr marks an empty slot
+        uint32_t length;
+        int count;
+    };
+
+    static constexpr size_t ARENA_BLOCK_BYTES = 1 << 20;
+
+    std::vector<Slot> slots;
+    size_t used = 0;
+    size_t mask = 0;
+
+    std::vector<std::unique_ptr<char[]>> arenaBlocks;
+    char* arenaCursor = nullptr;
+    size_t arenaRemaining = 0;
+    size_t arenaBytes = 0;
+
+    const char* storeKey(std::string_view key);
+    Slot& findSlot(uint64_t hash, std::string_view key);
+    void grow(size_t min_slots);
+    void add(uint64_t hash, std::string_view key, int delta);
+
+public:
+    WordCountTable() = default;
+    explicit WordCountTable(size_t expected_words) { reserve(expected_words); }
+
+    WordCountTable(const WordCountTable&) = delete;
+    WordCountTable& operator=(const WordCountTable&) = delete;
+    WordCountTable(WordCountTable&& other) noexcept;
+    WordCountTable& operator=(WordCountTable&& other) noexcept;
+
+    void reserve(size_t expected_words);
+    void clear();
+
+    size_t size() const { return used; }
+    bool empty() const { return used == 0; }
+    size_t memoryBytes() const { return slots.size() * sizeof(Slot) + arenaBytes; }
+
+    static uint64_t hashKey(std::string_view key);
+
+    // Adds `delta` to the count of `word`, inserting it with count 0 first if needed.
+    void increment(std::string_view word, int delta = 1) { add(hashKey(word), word, delta); }
+    // Same as increment, for callers that already hashed the word with hashKey.
+    void incrementHashed(uint64_t hash, std::string_view word, int delta = 1) { add(hash, word, delta); }
+    int count(std::string_view word) const;
+
+    void mergeFrom(WordCountTable&& other);
+    void moveInto(std::unordered_map<std::string, int>& out);
+
+    /**
+     * @brief Calls `fn(std::string_view word, int count)` for every entry, in slot order.
+     */
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const Slot& s : slots) {
+            if (s.key != nullptr) fn(std::string_view(s.key, s.length), s.count);
+        }
+    }
+};
+
+
+/**
+ * @brief Word counts partitioned by hash into a fixed number of independent tables.
+ * Every word always lands in the same shard for a given shard count, so the shards of
+ * several workers can be combined shard by shard: shard i of all workers is merged by
+ * one thread, all shards in parallel, and the merged shards are disjoint.
+ */
+class ShardedWordCounts {
+private:
+    std::vector<WordCountTable> shards;
+
+public:
+    explicit ShardedWordCounts(size_t num_shards = 1) : shards(num_shards > 0 ? num_shards : 1) {}
+
+    // Shard of a word hash. Uses the high bits, which the tables' slot index does not.
+    static size_t shardOf(uint64_t hash, size_t num_shards) {
+        return static_cast<size_t>(((hash >> 32) * num_shards) >> 32);
+    }
+
+    void increment(std::string_view word, int delta = 1) {
+        const uint64_t hash = WordCountTable::hashKey(word);
+        shards[shardOf(hash, shards.size())].incrementHashed(hash, word, delta);
+    }
+
+    // Same as increment, for callers that already hashed the word with WordCountTable::hashKey.
+    void incrementHashed(uint64_t hash, std::string_view word, int delta = 1) {
+        shards[shardOf(hash, shards.size())].incrementHashed(hash, word, delta);
+    }
+
+    size_t shardCount() const { return shards.size(); }
+    WordCountTable& shard(size_t i) { return shards[i]; }
+    const WordCountTable& shard(size_t i) const { return shards[i]; }
+};
+
+#endif // WORDCOUNT_HPP
@@ -6,56 +6,81 @@
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 #include "include/tokenise.hpp"
 
-// Helper for CUDA Error Checking
-#define CHECK_CUDA(call) do {   \
-    cudaError_t err = call;     \
-    if (err != cudaSuccess) {   \
-        fprintf(stderr, "CUDA Error: %s at %s:%d\n", cudaGetErrorString(err), __FILE__, __LINE__);  \
-        exit(EXIT_FAILURE);     \
-    }                           \
-} while (0)
+/**
+ * @brief Sum of `value` over the whole block; every thread receives the result.
+ * Each warp reduces with shuffles, then the first warp reduces the per-warp sums.
+ * blockDim.x must be a multiple of 32 (at most 1024).
+ */
+__device__ float blockReduceSum(float value) {
+    __shared__ float warp_sums[32];
+    const unsigned int lane = threadIdx.x & 31;
+    const unsigned int warp = threadIdx.x >> 5;
 
-// Basic XorShift32 PRNG for CUDA
-// Each thread uses its unique thread index to get a distinct seed
-__device__ unsigned int xorshift32_cuda(unsigned int x) {
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    return x;
-}
+    for (int offset = 16; offset > 0; offset >>= 1) {
+        value += __shfl_down_sync(0xffffffffu, value, offset);
+    }
+    if (lane == 0) warp_sums[warp] = value;
+    __syncthreads();
 
-// Function to convert a normalized [0,1] float to a custom range [r1, r2]
-__device__ float scale_random_cuda(unsigned int* seed_ptr, float r1) {
-    *seed_ptr = xorshift32_cuda(*seed_ptr);
-    float normalized_val = (float)(*seed_ptr) / (float)UINT_MAX;
-    return r1 + normalized_val * (10.0f - r1);
+    if (warp == 0) {
+        value = lane < (blockDim.x >> 5) ? warp_sums[lane] : 0.0f;
+        for (int offset = 16; offset > 0; offset >>= 1) {
+            value += __shfl_down_sync(0xffffffffu, value, offset);
+        }
+        if (lane == 0) warp_sums[0] = value;
+    }
+    __syncthreads();
+    return warp_sums[0];
 }
 
-// CUDA Kernel to generate embeddings
-__global__ void generate_embeddings_kernel(
-    float* embeddings_out,
-    int d_dim,
-    float r1,
-    float r2,
-    unsigned int initial_seed_offset,
-    int total_elements) {
-
-    int idx = blockIdx.x * blockDim.x + threadIdx.x; // Global thread ID
-
-    if (idx < total_elements) {
-        // Use global_id + an offset for a unique seed per thread
-        unsigned int seed = initial_seed_offset + idx + 1; // +1 to avoid seed 0
+/**
+ * @brief Fused kernel: generates one embedding row per block and writes its inverse too.
+ * The formula and the counter-based generator are the ones in embeddingformula.hpp, so the
+ * rows match the CPU backend for the same seed (up to float rounding of sin/cos and of the
+ * order of the norm sum).
+ * @param embeddings_out The output embeddings (N x d), flattened.
+ * @param inverses_out The output inverses (N x d), flattened.
+ * @param poisson_table PoissonTable::data() for the requested mean.
+ * @param N The number of rows (tokens).
+ * @param d The dimension of each row.
+ * @param seed The generator seed.
+ */
+__global__ void generateEmbeddingsWithInverseKernel(float* embeddings_out, float* inverses_out,
+    const uint32_t* poisson_table, int N, int d, unsigned long long seed)
+{
+    const int row_idx = blockIdx.x;
+    if (row_idx >= N) return;   // uniform for the whole block
+
+    float* row = embeddings_out + (size_t)row_idx * d;
+    const float row_sin = sinf((float)(row_idx + 1));
+    const uint64_t first_counter = (uint64_t)row_idx * d;
+
+    // Step 1: generate the row, keeping each thread's part of the squared norm.
+    float sum = 0.0f;
+    for (int j = threadIdx.x; j < d; j += blockDim.x) {
+        const float k = (float)PoissonTable::sample(poisson_table, embeddingRandom(seed, first_counter + j));
+        const float value = k * (row_sin + cosf((float)(j - 1))) * 0.1f + 0.01f;
+        row[j] = value;
+        sum += value * value;
+    }
 
-        // Generate random float in [r1, r2]
-        embeddings_out[idx] = scale_random_cuda(&seed, r1);
+    // Step 2: reduce with warp shuffles, then divide (each thread re-reads its own values).
+    const float squared_magnitude = blockReduceSum(sum);
+    float* inverse = inverses_out + (size_t)row_idx * d;
+    for (int j = threadIdx.x; j < d; j += blockDim.x) {
+        inverse[j] = squared_magnitude > 1e-9f ? row[j] / squared_magnitude : 0.0f;
     }
 }
 
 /**
  * @brief Computes the inverse (v / ||v||^2) for a batch of vectors in parallel.
- * Each CUDA block is responsible for processing one vector (one row of the matrix).
+ * Each CUDA block is responsible for processing one vector (one row of the matrix),
+ * looping over its columns, so any dimension d is supported.
  * @param output The output matrix (N x d), flattened.
  * @param input The input matrix (N x d), flattened.
  * @param N The number of vectors (rows).
@@ -63,163 +88,371 @@ __global__ void generate_embeddings_kernel(
  */
 __global__ void batchedVectorInverseKernel(float* output, const float* input, int N, int d) 
 {
-    // Use dynamic shared memory, sized by the kernel launch.
-    // This will hold the values for the reduction.
-    extern __shared__ float s_data[];
-
-    // Identify which row (vector) this block is working on.
-    const int row_idx = blockIdx.y;
+    const int row_idx = blockIdx.x;
+    if (row_idx >= N) return;
+    const float* row = input + (size_t)row_idx * d;
 
-    // Identify the thread's index within the block and its global column index.
-    const int tid_in_block = threadIdx.x;
-    const int col_idx = blockIdx.x * blockDim.x + tid_in_block;
+    float sum = 0.0f;
+    for (int j = threadIdx.x; j < d; j += blockDim.x) {
+        sum += row[j] * row[j];
+    }
+    const float squared_magnitude = blockReduceSum(sum);
 
-    // --- Step 1: Parallel Reduction to find the squared magnitude ---
+    // Handle zero-magnitude vector case (output is all zeros).
+    for (int j = threadIdx.x; j < d; j += blockDim.x) {
+        output[(size_t)row_idx * d + j] = squared_magnitude > 1e-9f ? row[j] / squared_magnitude : 0.0f;
+    }
+}
 
-    float my_val = 0.0f;
-    // Load the thread's value from the input matrix if it's within bounds.
-    if (col_idx < d) {
-        my_val = input[row_idx * d + col_idx];
+/**
+ * @brief Gathers the embedding rows of a batch of token ids into one contiguous buffer.
+ * Each CUDA block copies one row (one id), looping over its columns; ids outside [0, N)
+ * (unknown characters, padding) give rows of zeros.
+ * @param output The gathered rows (count x d), flattened.
+ * @param embeddings The device-resident embedding matrix (N x d), flattened.
+ * @param ids The token ids (count).
+ * @param count The number of ids (rows of the output).
+ * @param N The number of rows of the embedding matrix.
+ * @param d The dimension of each row.
+ */
+__global__ void gatherEmbeddingsKernel(float* output, const float* embeddings, const int32_t* ids, int count, int N, int d)
+{
+    const int i = blockIdx.x;
+    if (i >= count) return;
+    const int32_t id = ids[i];
+    float* row = output + (size_t)i * d;
+
+    if (id >= 0 && id < N) {
+        const float* src = embeddings + (size_t)id * d;
+        for (int j = threadIdx.x; j < d; j += blockDim.x) row[j] = src[j];
+    }
+    else {
+        for (int j = threadIdx.x; j < d; j += blockDim.x) row[j] = 0.0f;
     }
-    
-    // Store the square of the value in shared memory for reduction.
-    s_data[tid_in_block] = my_val * my_val;
+}
 
-    // Synchronize to make sure all threads have written their squared value to shared memory.
-    __syncthreads();
+// =================================================================================
+// HOST-SIDE WRAPPER FUNCTIONS
+// =================================================================================
+
+
+// ---------------------------------------------------------------------------------
+// Persistent context: one stream, device buffers and pinned staging buffers.
+// ---------------------------------------------------------------------------------
+
+CudaContext& CudaContext::getInstance() {
+    static CudaContext instance;
+    return instance;
+}
 
-    // Perform the reduction in shared memory.
-    // Each thread adds its right-half neighbor's value to its own.
-    for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
-        if (tid_in_block < s) {
-            s_data[tid_in_block] += s_data[tid_in_block + s];
+CudaContext::CudaContext() {
+    CHECK_CUDA(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+    for (auto& events : transferDone) {
+        for (cudaEvent_t& event : events) {
+            CHECK_CUDA(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
         }
-        __syncthreads(); // Synchronize at each step of the reduction tree.
     }
+    for (cudaEvent_t& event : uploadDone) {
+        CHECK_CUDA(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    }
+}
+
+CudaContext::~CudaContext() {
+    release();
+    cudaFree(devicePoissonTable);
+    cudaFree(deviceIds);
+    cudaFree(deviceGathered);
+    cudaFreeHost(hostGathered);
+    // Errors are ignored: the singleton is destroyed at exit, possibly after the runtime shut down.
+    for (auto& events : transferDone) {
+        for (cudaEvent_t event : events) cudaEventDestroy(event);
+    }
+    for (cudaEvent_t event : uploadDone) cudaEventDestroy(event);
+    if (stream != nullptr) cudaStreamDestroy(stream);
+}
+
+void CudaContext::release() noexcept {
+    cudaFree(deviceEmbeddings);
+    cudaFree(deviceDeEmbeddings);
+    cudaFreeHost(hostEmbeddings);
+    cudaFreeHost(hostDeEmbeddings);
+    deviceEmbeddings = deviceDeEmbeddings = hostEmbeddings = hostDeEmbeddings = nullptr;
+    capacity = 0;
+    residentEmbeddings = 0;
+    pendingUpload = 0;
+}
 
-    // After the loop, the first element of shared memory (s_data[0]) holds the
-    // final squared magnitude for the entire row.
-    const float squared_magnitude = s_data[0];
+/**
+ * @brief Makes sure every buffer holds at least `elements` floats (contents are not kept when growing).
+ * @throws std::runtime_error if an allocation fails.
+ */
+void CudaContext::reserve(size_t elements) {
+    if (elements <= capacity) return;
+    CHECK_CUDA(cudaStreamSynchronize(stream));
+    release();
+    const size_t bytes = elements * sizeof(float);
+    CHECK_CUDA(cudaMalloc(&deviceEmbeddings, bytes));
+    CHECK_CUDA(cudaMalloc(&deviceDeEmbeddings, bytes));
+    CHECK_CUDA(cudaMallocHost(&hostEmbeddings, bytes));
+    CHECK_CUDA(cudaMallocHost(&hostDeEmbeddings, bytes));
+    capacity = elements;
+}
 
-    // --- Step 2: Element-wise division ---
 
-    // Ensure the thread is within bounds and the magnitude is non-zero to avoid division by zero.
-    if (col_idx < d && squared_magnitude > 1e-9f) {
-        output[row_idx * d + col_idx] = my_val / squared_magnitude;
-    } else if (col_idx < d) {
-        // Handle zero-magnitude vector case (output is all zeros).
-        output[row_idx * d + col_idx] = 0.0f;
+/**
+ * @brief Copies a PoissonTable to the device (the buffer only grows).
+ * @throws std::runtime_error on any CUDA error.
+ */
+void CudaContext::uploadPoissonTable(const std::vector<uint32_t>& table) {
+    if (table.size() > poissonCapacity) {
+        CHECK_CUDA(cudaStreamSynchronize(stream));
+        cudaFree(devicePoissonTable);
+        devicePoissonTable = nullptr;
+        poissonCapacity = 0;
+        CHECK_CUDA(cudaMalloc(&devicePoissonTable, table.size() * sizeof(uint32_t)));
+        poissonCapacity = table.size();
     }
+    // From pageable memory this returns once the table has been staged, so `table` may go away.
+    CHECK_CUDA(cudaMemcpyAsync(devicePoissonTable, table.data(), table.size() * sizeof(uint32_t), cudaMemcpyHostToDevice, stream));
 }
 
-// =================================================================================
-// HOST-SIDE WRAPPER FUNCTIONS
-// =================================================================================
+
+/**
+ * @brief Makes sure the gather buffers hold at least `ids` ids and `elements` output floats.
+ * Like reserve(), the buffers only grow and their contents are not kept when growing.
+ * @throws std::runtime_error if an allocation fails.
+ */
+void CudaContext::reserveGather(size_t ids, size_t elements) {
+    if (ids <= gatherCapacity && elements <= gatheredCapacity) return;
+    CHECK_CUDA(cudaStreamSynchronize(stream));
+    if (ids > gatherCapacity) {
+        cudaFree(deviceIds);
+        deviceIds = nullptr;
+        gatherCapacity = 0;
+        CHECK_CUDA(cudaMalloc(&deviceIds, ids * sizeof(int32_t)));
+        gatherCapacity = ids;
+    }
+    if (elements > gatheredCapacity) {
+        cudaFree(deviceGathered);
+        cudaFreeHost(hostGathered);
+        deviceGathered = hostGathered = nullptr;
+        gatheredCapacity = 0;
+        CHECK_CUDA(cudaMalloc(&deviceGathered, elements * sizeof(float)));
+        CHECK_CUDA(cudaMallocHost(&hostGathered, elements * sizeof(float)));
+        gatheredCapacity = elements;
+    }
+}
 
 
-// Host-side wrapper function
-void tokeniser::cuEmbeddingFormula(std::vector<std::vector<float>>& embedding, const std::vector<float>& seeds_ignored, 
-    int& d_dim, int& vocSize_val, float r1) 
-{
-    // Resize embedding vector to hold the results
-    embedding.resize(vocSize_val, std::vector<float>(d_dim));
+static size_t transferChunk(size_t elements) {
+    return (elements + CudaContext::TRANSFER_CHUNKS - 1) / CudaContext::TRANSFER_CHUNKS;
+}
 
-    size_t total_elements = (size_t)vocSize_val * d_dim;
-    if (total_elements == 0) return;
+// Queues device-to-host copies into the pinned staging buffer, recording one event per piece.
+static void enqueueDownload(CudaContext& ctx, const float* device_src, float* staging, size_t elements, cudaEvent_t* events) {
+    const size_t chunk = transferChunk(elements);
+    size_t k = 0;
+    for (size_t begin = 0; begin < elements; begin += chunk) {
+        const size_t count = std::min(chunk, elements - begin);
+        CHECK_CUDA(cudaMemcpyAsync(staging + begin, device_src + begin, count * sizeof(float), cudaMemcpyDeviceToHost, ctx.stream));
+        CHECK_CUDA(cudaEventRecord(events[k++], ctx.stream));
+    }
+}
 
-    float* d_embeddings = nullptr; // Device pointer for embeddings
+// Waits for every piece queued by enqueueDownload and copies it into `dst` as soon as it lands,
+// so the host copy of one piece overlaps the transfer of the next.
+static void finishDownload(const float* staging, float* dst, size_t elements, cudaEvent_t* events) {
+    const size_t chunk = transferChunk(elements);
+    size_t k = 0;
+    for (size_t begin = 0; begin < elements; begin += chunk) {
+        const size_t count = std::min(chunk, elements - begin);
+        CHECK_CUDA(cudaEventSynchronize(events[k++]));
+        std::memcpy(dst + begin, staging + begin, count * sizeof(float));
+    }
+}
 
-    // Allocate device memory
-    CUDA_CHECK(cudaMalloc(&d_embeddings, total_elements * sizeof(float)));
+// Waits until the pending upload (see enqueueUpload) has read staging[0, end), so that
+// range may be overwritten. Pieces are copied in stream order, so waiting for the piece
+// holding the last element of the range is enough.
+static void waitForUploadStaging(CudaContext& ctx, size_t end) {
+    if (ctx.pendingUpload == 0 || end == 0) return;
+    const size_t last = (std::min(end, ctx.pendingUpload) - 1) / transferChunk(ctx.pendingUpload);
+    CHECK_CUDA(cudaEventSynchronize(ctx.uploadDone[last]));
+}
 
-    // Configure kernel launch parameters
-    int threads_per_block = 256;
-    int blocks_per_grid = (total_elements + threads_per_block - 1) / threads_per_block;
+// Stages `src` in ctx.hostEmbeddings piece by piece and queues asynchronous host-to-device
+// copies, recording one event per piece. Kernels launched later on the same stream see the
+// uploaded data. A piece is staged only once the previous upload no longer reads its range.
+static void enqueueUpload(CudaContext& ctx, float* device_dst, const float* src, size_t elements) {
+    float* staging = ctx.hostEmbeddings;
+    const size_t chunk = transferChunk(elements);
+    size_t k = 0;
+    for (size_t begin = 0; begin < elements; begin += chunk) {
+        const size_t count = std::min(chunk, elements - begin);
+        waitForUploadStaging(ctx, begin + count);
+        std::memcpy(staging + begin, src + begin, count * sizeof(float));
+        CHECK_CUDA(cudaMemcpyAsync(device_dst + begin, staging + begin, count * sizeof(float), cudaMemcpyHostToDevice, ctx.stream));
+        CHECK_CUDA(cudaEventRecord(ctx.uploadDone[k++], ctx.stream));
+    }
+    ctx.pendingUpload = elements;
+}
 
-    // Use a time-based seed offset for better randomness across runs
-    unsigned int initial_seed_offset = static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+// Threads per block for a row of d values: a multiple of the warp size, at most 256.
+static int rowBlockSize(int d) {
+    return std::min(256, std::max(32, (d + 31) / 32 * 32));
+}
 
-    // Launch kernel
-    generate_embeddings_kernel<<<blocks_per_grid, threads_per_block>>>(
-        d_embeddings,
+// Launches the fused kernel: device embeddings and device deEmbeddings, one block per row.
+static void launchGenerate(CudaContext& ctx, int d_dim, int vocSize_val, float r1, uint64_t seed) {
+    ctx.uploadPoissonTable(PoissonTable(r1).data());
+    ctx.residentEmbeddings = 0;     // the caller marks the generated rows resident
+    generateEmbeddingsWithInverseKernel<<<vocSize_val, rowBlockSize(d_dim), 0, ctx.stream>>>(
+        ctx.deviceEmbeddings,
+        ctx.deviceDeEmbeddings,
+        ctx.devicePoissonTable,
+        vocSize_val,
         d_dim,
-        r1,
-        initial_seed_offset,
-        total_elements
+        seed
     );
-    CUDA_CHECK(cudaGetLastError()); // Check for errors during kernel launch
+    CHECK_CUDA(cudaGetLastError()); // Check for errors during kernel launch
+}
 
-    // Copy results back to host
-    std::vector<float> flat_embeddings(total_elements);
-    CUDA_CHECK(cudaMemcpy(flat_embeddings.data(), d_embeddings, total_elements * sizeof(float), cudaMemcpyDeviceToHost));
+// Launches the inverse kernel: device embeddings -> device deEmbeddings.
+static void launchInverse(CudaContext& ctx, int d, int vocSize) {
+    batchedVectorInverseKernel<<<vocSize, rowBlockSize(d), 0, ctx.stream>>>(
+        ctx.deviceDeEmbeddings, ctx.deviceEmbeddings, vocSize, d);
+    CHECK_CUDA(cudaGetLastError());
+}
 
-    // Copy flat_embeddings to the 2D embedding vector
-    for (int i = 0; i < vocSize_val; ++i) {
-        for (int j = 0; j < d_dim; ++j) {
-            embedding[i][j] = flat_embeddings[i * d_dim + j];
-        }
-    }
 
-    // Free device memory
-    CUDA_CHECK(cudaFree(d_embeddings));
+/**
+ * @brief Generates the embeddings on the GPU and copies them into `embedding`.
+ * The fused kernel also leaves the inverses in device memory; they are not copied back.
+ * The device buffers and pinned staging memory are reused across calls.
+ * @throws std::runtime_error on any CUDA error.
+ */
+void tokeniser::cuEmbeddingFormula(EmbeddingMatrix& embedding, int& d_dim, int& vocSize_val, float r1, uint64_t seed)
+{
+    // Resize the embedding matrix to hold the results
+    embedding.resize(vocSize_val, d_dim);
+
+    size_t total_elements = (size_t)vocSize_val * d_dim;
+    if (total_elements == 0) return;
+
+    CudaContext& ctx = CudaContext::getInstance();
+    ctx.reserve(total_elements);
+    launchGenerate(ctx, d_dim, vocSize_val, r1, seed);
+
+    // Copy results back through pinned memory into the (row-major) embedding matrix
+    enqueueDownload(ctx, ctx.deviceEmbeddings, ctx.hostEmbeddings, total_elements, ctx.transferDone[0]);
+    finishDownload(ctx.hostEmbeddings, embedding.data(), total_elements, ctx.transferDone[0]);
 }
 
 
 /**
  * @brief Host wrapper to calculate batched vector inverses on the GPU.
- * @param deEmbedding [out] 2D vector to store the results. Will be resized.
- * @param embedding [in] 2D vector of input vectors.
+ * @param deEmbedding [out] Matrix to store the results. Will be resized.
+ * @param embedding [in] Matrix of input vectors, one per row.
  * @param d [in] The dimension of each vector.
  * @param vocSize [in] The number of vectors.
+ * @throws std::runtime_error on any CUDA error or if the dimensions do not match.
  */
-void tokeniser::cuVectorInverse(std::vector<std::vector<float>>& deEmbedding,
-    const std::vector<std::vector<float>>& embedding, int& d, int& vocSize)
+void tokeniser::cuVectorInverse(EmbeddingMatrix& deEmbedding,
+    const EmbeddingMatrix& embedding, int& d, int& vocSize)
 {
     if (vocSize == 0 || d == 0) return;
-    if (embedding.size() != vocSize || embedding[0].size() != d) {
+    if (embedding.rows() != vocSize || embedding.cols() != d) {
         throw std::runtime_error("Input embedding dimensions do not match vocSize and d.");
     }
+    deEmbedding.resize(vocSize, d);
+    const size_t total_elements = (size_t)vocSize * d;
+
+    CudaContext& ctx = CudaContext::getInstance();
+    ctx.reserve(total_elements);
+    enqueueUpload(ctx, ctx.deviceEmbeddings, embedding.data(), total_elements);
+    ctx.residentEmbeddings = 0;
+    launchInverse(ctx, d, vocSize);
+    enqueueDownload(ctx, ctx.deviceDeEmbeddings, ctx.hostDeEmbeddings, total_elements, ctx.transferDone[1]);
+    finishDownload(ctx.hostDeEmbeddings, deEmbedding.data(), total_elements, ctx.transferDone[1]);
+}
 
-    // 1. Resize output and flatten the 2D input vector for the GPU
-    deEmbedding.assign(vocSize, std::vector<float>(d));
-    std::vector<float> h_flat_input(vocSize * d);
-    std::vector<float> h_flat_output(vocSize * d);
-    for (int i = 0; i < vocSize; ++i) {
-        for (int j = 0; j < d; ++j) {
-            h_flat_input[i * d + j] = embedding[i][j];
-        }
-    }
 
-    // 2. Allocate device memory
-    float *d_input, *d_output;
-    size_t total_size = (size_t)vocSize * d * sizeof(float);
-    CHECK_CUDA(cudaMalloc(&d_input, total_size));
-    CHECK_CUDA(cudaMalloc(&d_output, total_size));
+/**
+ * @brief Generates the embeddings and their inverses in one device round trip.
+ * One fused kernel writes every row and its inverse; both matrices are then copied
+ * back on the same stream.
+ * @throws std::runtime_error on any CUDA error.
+ */
+void tokeniser::cuEmbeddingsWithInverse(EmbeddingMatrix& embedding, EmbeddingMatrix& deEmbedding,
+    int& d, int& vocSize, float r1, uint64_t seed)
+{
+    embedding.resize(vocSize, d);
+    deEmbedding.resize(vocSize, d);
+    const size_t total_elements = (size_t)vocSize * d;
+    if (total_elements == 0) return;
 
-    // 3. Copy flattened input data to device
-    CHECK_CUDA(cudaMemcpy(d_input, h_flat_input.data(), total_size, cudaMemcpyHostToDevice));
+    CudaContext& ctx = CudaContext::getInstance();
+    ctx.reserve(total_elements);
+    launchGenerate(ctx, d, vocSize, r1, seed);
+    enqueueDownload(ctx, ctx.deviceEmbeddings, ctx.hostEmbeddings, total_elements, ctx.transferDone[0]);
+    enqueueDownload(ctx, ctx.deviceDeEmbeddings, ctx.hostDeEmbeddings, total_elements, ctx.transferDone[1]);
+    finishDownload(ctx.hostEmbeddings, embedding.data(), total_elements, ctx.transferDone[0]);
+    finishDownload(ctx.hostDeEmbeddings, deEmbedding.data(), total_elements, ctx.transferDone[1]);
+}
 
-    // 4. Configure and launch kernel
-    const int block_size = 256; // Must be power of 2 for this reduction
-    dim3 grid_dim((d + block_size - 1) / block_size, vocSize, 1);
-    dim3 block_dim(block_size, 1, 1);
-    size_t shared_mem_size = block_dim.x * sizeof(float);
-    batchedVectorInverseKernel<<<grid_dim, block_dim, shared_mem_size>>>(d_output, d_input, vocSize, d);
-    CHECK_CUDA(cudaGetLastError());
 
-    // 5. Copy flat results back to host
-    CHECK_CUDA(cudaMemcpy(h_flat_output.data(), d_output, total_size, cudaMemcpyDeviceToHost));
 
-    // 6. "Un-flatten" the results into the 2D output vector
-    for (int i = 0; i < vocSize; ++i) {
-        for (int j = 0; j < d; ++j) {
-            deEmbedding[i][j] = h_flat_output[i * d + j];
-        }
+/**
+ * @brief Gathers the embedding rows of `ids` on the GPU and leaves them in device memory.
+ * The embedding matrix is uploaded once and stays resident until it changes (or another
+ * upload replaces it), so a batch only transfers its ids. Work is queued on the context's
+ * stream; the result (count x d floats) is valid until the next gather.
+ * @param ids Token ids; ids outside the vocabulary give rows of zeros.
+ * @param count Number of ids.
+ * @return Device pointer to the gathered rows (null if count is 0).
+ * @throws std::runtime_error if there are no embeddings or on any CUDA error.
+ */
+const float* tokeniser::cuGatherEmbeddingsToDevice(const int32_t* ids, size_t count) const
+{
+    if (this->embeddings.empty()) {
+        throw std::runtime_error("Error: Embeddings are not generated or loaded. Cannot gather embeddings.");
+    }
+    if (count > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Error: Too many token ids for one gather.");
+    }
+    if (count == 0) return nullptr;
+    const int d_dim = static_cast<int>(this->embeddings.cols());
+    const int rows = static_cast<int>(this->embeddings.rows());
+
+    CudaContext& ctx = CudaContext::getInstance();
+    if (ctx.residentEmbeddings == 0 || ctx.residentEmbeddings != this->embeddingsVersion) {
+        ctx.reserve(this->embeddings.size());
+        enqueueUpload(ctx, ctx.deviceEmbeddings, this->embeddings.data(), this->embeddings.size());
+        ctx.residentEmbeddings = this->embeddingsVersion;
     }
+    ctx.reserveGather(count, count * d_dim);
+    // From pageable memory this returns once the ids have been staged, so `ids` may go away.
+    CHECK_CUDA(cudaMemcpyAsync(ctx.deviceIds, ids, count * sizeof(int32_t), cudaMemcpyHostToDevice, ctx.stream));
+    gatherEmbeddingsKernel<<<static_cast<unsigned int>(count), rowBlockSize(d_dim), 0, ctx.stream>>>(
+        ctx.deviceGathered, ctx.deviceEmbeddings, ctx.deviceIds, static_cast<int>(count), rows, d_dim);
+    CHECK_CUDA(cudaGetLastError());
+    return ctx.deviceGathered;
+}
+
 
-    // 7. Free device memory
-    CHECK_CUDA(cudaFree(d_input));
-    CHECK_CUDA(cudaFree(d_output));
+/**
+ * @brief Gathers the embedding rows of `ids` on the GPU and copies them into `out`.
+ * @param out count x d floats, row i = embedding of ids[i].
+ * @throws std::runtime_error if there are no embeddings or on any CUDA error.
+ */
+void tokeniser::cuGatherEmbeddings(const int32_t* ids, size_t count, float* out) const
+{
+    const float* gathered = cuGatherEmbeddingsToDevice(ids, count);
+    if (gathered == nullptr) return;
+    CudaContext& ctx = CudaContext::getInstance();
+    const size_t total_elements = count * this->embeddings.cols();
+    enqueueDownload(ctx, gathered, ctx.hostGathered, total_elements, ctx.transferDone[0]);
+    finishDownload(ctx.hostGathered, out, total_elements, ctx.transferDone[0]);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,135 +1,257 @@
 #ifdef USE_OPENCL
 #include "include/tokenise.hpp"
-#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 
-// host side function for embeddings
-void tokeniser::clEmbeddingFormula(OpenCLContext& ocl_context, std::vector<std::vector<float>>& embedding, const std::vector<float>& seeds_ignored, int& d_dim, 
-    int& vocSize_val, float r1) 
+// Host <-> device copies are split into this many pieces, so that copying one piece between
+// the pinned staging area and the matrix overlaps the transfer of the next one.
+static constexpr size_t TRANSFER_CHUNKS = 8;
+
+static size_t transferChunk(size_t elements) {
+    return (elements + TRANSFER_CHUNKS - 1) / TRANSFER_CHUNKS;
+}
+
+static void checkContext(const OpenCLContext& ocl_context) {
+    if (!ocl_context.context() || !ocl_context.queue() || !ocl_context.buffers) { // Use () for cl.hpp accessors
+        throw std::runtime_error("OpenCL context or command queue not initialized via singleton.");
+    }
+}
+
+
+// Queues asynchronous reads of a device buffer into the pinned staging area, one event per piece.
+static void enqueueDownload(cl::CommandQueue& queue, const cl::Buffer& src, float* pinned, size_t elements,
+    std::vector<cl::Event>& done)
 {
-    if (!ocl_context.context() || !ocl_context.queue()) { // Use () for cl.hpp accessors
-        std::cerr << "OpenCL context or command queue not initialized via singleton." << std::endl;
-        return;
+    const size_t chunk = transferChunk(elements);
+    for (size_t begin = 0; begin < elements; begin += chunk) {
+        const size_t count = std::min(chunk, elements - begin);
+        done.emplace_back();
+        CHECK_CL(queue.enqueueReadBuffer(src, CL_FALSE, begin * sizeof(float), count * sizeof(float),
+                                         pinned + begin, NULL, &done.back()));
     }
+}
+
+// Waits for the reads queued by enqueueDownload and copies each piece into `dst` as it lands.
+static void finishDownload(std::vector<cl::Event>& done, const float* pinned, float* dst, size_t elements) {
+    const size_t chunk = transferChunk(elements);
+    size_t begin = 0;
+    for (cl::Event& event : done) {
+        CHECK_CL(event.wait());
+        const size_t count = std::min(chunk, elements - begin);
+        std::memcpy(dst + begin, pinned + begin, count * sizeof(float));
+        begin += count;
+    }
+    done.clear();
+}
+
+// Stages `src` in pinned memory piece by piece and queues asynchronous writes to the device.
+// The in-order queue runs later kernels only after these writes have completed.
+static void enqueueUpload(cl::CommandQueue& queue, cl::Buffer& dst, float* pinned, const float* src, size_t elements) {
+    const size_t chunk = transferChunk(elements);
+    for (size_t begin = 0; begin < elements; begin += chunk) {
+        const size_t count = std::min(chunk, elements - begin);
+        std::memcpy(pinned + begin, src + begin, count * sizeof(float));
+        CHECK_CL(queue.enqueueWriteBuffer(dst, CL_FALSE, begin * sizeof(float), count * sizeof(float), pinned + begin));
+    }
+}
+
+
+// Work-items per work-group for a row of d values: a power of 2 up to 256 (rows loop over columns).
+static size_t rowWorkGroupSize(int d_dim) {
+    size_t local_work_size_x = 1;
+    while (local_work_size_x < static_cast<size_t>(d_dim) && local_work_size_x < 256) local_work_size_x <<= 1;
+    return local_work_size_x;
+}
+
+
+// Queues the fused kernel: one work-group per row writes the device embeddings and deEmbeddings.
+static void enqueueGenerate(OpenCLContext& ocl_context, int d_dim, int vocSize_val, float r1, uint64_t seed) {
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+    buffers.uploadPoissonTable(PoissonTable(r1).data());
+    buffers.residentEmbeddings = 0;     // the caller marks the generated rows resident
+
+    cl::Kernel& kernel = ocl_context.embeddingKernel;
+    kernel.setArg(0, buffers.embeddings);
+    kernel.setArg(1, buffers.deEmbeddings);
+    kernel.setArg(2, buffers.poissonTable);
+    kernel.setArg(3, d_dim);
+    kernel.setArg(4, static_cast<cl_ulong>(seed));
+
+    const size_t local_work_size_x = rowWorkGroupSize(d_dim);
+    cl::NDRange global_work_size(local_work_size_x * vocSize_val);
+    cl::NDRange local_work_size(local_work_size_x);
+    CHECK_CL(ocl_context.queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_work_size, local_work_size));
+}
+
+
+// Queues the inverse kernel: device embeddings -> device deEmbeddings.
+static void enqueueInverse(OpenCLContext& ocl_context, int d_dim, int vocSize_val) {
+    cl::Kernel& kernel = ocl_context.inverseKernel;
+    kernel.setArg(0, ocl_context.buffers->deEmbeddings);
+    kernel.setArg(1, ocl_context.buffers->embeddings);
+    kernel.setArg(2, vocSize_val); // N is number of rows
+    kernel.setArg(3, d_dim);       // d is dimension of each vector
+
+    // One work-group per row (vector)
+    const size_t local_work_size_x = rowWorkGroupSize(d_dim);
+    cl::NDRange global_work_size(local_work_size_x * vocSize_val);
+    cl::NDRange local_work_size(local_work_size_x);
+    CHECK_CL(ocl_context.queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_work_size, local_work_size));
+}
+
 
-    // Resize embedding vector to hold the results
-    embedding.resize(vocSize_val, std::vector<float>(d_dim));
+/**
+ * @brief Generates the embeddings on the device and reads them into `embedding`.
+ * The fused kernel also leaves the inverses in device memory; they are not read back.
+ * The device buffers, pinned staging memory and kernel are reused across calls.
+ * @throws std::runtime_error on any OpenCL error.
+ */
+void tokeniser::clEmbeddingFormula(OpenCLContext& ocl_context, EmbeddingMatrix& embedding, int& d_dim,
+    int& vocSize_val, float r1, uint64_t seed)
+{
+    checkContext(ocl_context);
+    // Resize the embedding matrix to hold the results
+    embedding.resize(vocSize_val, d_dim);
     // Calculate total number of elements
     size_t total_elements = (size_t)vocSize_val * d_dim;
     if (total_elements == 0) return;
-    cl_int err;
-
-    // Create a flat array for host memory, then copy back to 2D vector
-    std::vector<float> flat_embeddings(total_elements);
-    // Create device buffer
-    cl::Buffer embeddings_buffer(ocl_context.context, CL_MEM_WRITE_ONLY, sizeof(float) * total_elements, NULL, &err);
-    CHECK_CL(err);
-    // Create kernel object
-    cl::Kernel kernel(ocl_context.embeddingProgram, "generate_embeddings", &err);
-    CHECK_CL(err);
-
-    // Set Kernel Arguments
-    kernel.setArg(0, embeddings_buffer);
-    kernel.setArg(1, d_dim);
-    kernel.setArg(2, r1);
-    unsigned int initial_seed_offset = static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
-    kernel.setArg(4, initial_seed_offset);
-
-    // Execute Kernel
-    cl::NDRange global_work_size(total_elements);
-    cl::NDRange local_work_size = cl::NullRange; // Let OpenCL decide optimal local size
-
-    err = ocl_context.queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_work_size, local_work_size);
-    CHECK_CL(err);
-    // Read Results Back
-    err = ocl_context.queue.enqueueReadBuffer(embeddings_buffer, CL_TRUE, 0,
-                                              sizeof(float) * total_elements, flat_embeddings.data());
-    CHECK_CL(err);
-
-    // Copy flat_embeddings to the 2D embedding vector
-    for (int i = 0; i < vocSize_val; ++i) {
-        for (int j = 0; j < d_dim; ++j) {
-            embedding[i][j] = flat_embeddings[i * d_dim + j];
-        }
-    }
-    // No explicit release needed for cl.hpp objects as they manage resources via RAII
+
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+    buffers.reserve(total_elements);
+    enqueueGenerate(ocl_context, d_dim, vocSize_val, r1, seed);
+
+    // Read results back asynchronously through pinned memory
+    std::vector<cl::Event> done;
+    enqueueDownload(ocl_context.queue, buffers.embeddings, buffers.hostEmbeddings(), total_elements, done);
+    CHECK_CL(ocl_context.queue.flush());
+    finishDownload(done, buffers.hostEmbeddings(), embedding.data(), total_elements);
 }
 
-// The clVectorInverse function would follow a similar pattern, using inverseProgram
-void tokeniser::clVectorInverse(OpenCLContext& ocl_context, std::vector<std::vector<float>>& deEmbedding, \
-    const std::vector<std::vector<float>>& embedding, int& d_dim, int& vocSize_val) 
+
+/**
+ * @brief Computes the inverse of every row of `embedding` on the device.
+ * @throws std::runtime_error on any OpenCL error.
+ */
+void tokeniser::clVectorInverse(OpenCLContext& ocl_context, EmbeddingMatrix& deEmbedding, \
+    const EmbeddingMatrix& embedding, int& d_dim, int& vocSize_val)
 {
-    if (!ocl_context.context() || !ocl_context.queue()) {
-        std::cerr << "OpenCL context or command queue not initialized via singleton." << std::endl;
-        return;
+    checkContext(ocl_context);
+    size_t total_elements = (size_t)vocSize_val * d_dim;
+    if (embedding.rows() != static_cast<size_t>(vocSize_val) || embedding.cols() != static_cast<size_t>(d_dim)) {
+        throw std::runtime_error("Input embedding dimensions do not match vocSize and d.");
     }
+    deEmbedding.resize(vocSize_val, d_dim);
+    if (total_elements == 0) return;
 
-    deEmbedding.resize(vocSize_val, std::vector<float>(d_dim));
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+    buffers.reserve(total_elements);
+    enqueueUpload(ocl_context.queue, buffers.embeddings, buffers.hostEmbeddings(), embedding.data(), total_elements);
+    buffers.residentEmbeddings = 0;
+    enqueueInverse(ocl_context, d_dim, vocSize_val);
+
+    std::vector<cl::Event> done;
+    enqueueDownload(ocl_context.queue, buffers.deEmbeddings, buffers.hostDeEmbeddings(), total_elements, done);
+    CHECK_CL(ocl_context.queue.flush());
+    finishDownload(done, buffers.hostDeEmbeddings(), deEmbedding.data(), total_elements);
+}
+
+
+/**
+ * @brief Generates the embeddings and their inverses in one device round trip.
+ * One fused kernel writes every row and its inverse; both matrices are then read back
+ * together.
+ * @throws std::runtime_error on any OpenCL error.
+ */
+void tokeniser::clEmbeddingsWithInverse(OpenCLContext& ocl_context, EmbeddingMatrix& embedding, EmbeddingMatrix& deEmbedding,
+    int& d_dim, int& vocSize_val, float r1, uint64_t seed)
+{
+    checkContext(ocl_context);
+    embedding.resize(vocSize_val, d_dim);
+    deEmbedding.resize(vocSize_val, d_dim);
     size_t total_elements = (size_t)vocSize_val * d_dim;
     if (total_elements == 0) return;
 
-    cl_int err;
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+    buffers.reserve(total_elements);
+    enqueueGenerate(ocl_context, d_dim, vocSize_val, r1, seed);
 
-    // Flatten input embedding data for transfer
-    std::vector<float> flat_embedding_input(total_elements);
-    for (int i = 0; i < vocSize_val; ++i) {
-        for (int j = 0; j < d_dim; ++j) {
-            flat_embedding_input[i * d_dim + j] = embedding[i][j];
-        }
+    std::vector<cl::Event> embeddings_done, inverses_done;
+    enqueueDownload(ocl_context.queue, buffers.embeddings, buffers.hostEmbeddings(), total_elements, embeddings_done);
+    enqueueDownload(ocl_context.queue, buffers.deEmbeddings, buffers.hostDeEmbeddings(), total_elements, inverses_done);
+    CHECK_CL(ocl_context.queue.flush());
+    finishDownload(embeddings_done, buffers.hostEmbeddings(), embedding.data(), total_elements);
+    finishDownload(inverses_done, buffers.hostDeEmbeddings(), deEmbedding.data(), total_elements);
+}
+
+
+/**
+ * @brief Gathers the embedding rows of `ids` on the device and leaves them in device memory.
+ * The embedding matrix is uploaded once and stays resident until it changes (or another
+ * upload replaces it), so a batch only transfers its ids. Work is queued on the context's
+ * in-order queue; the result (count x d floats) is valid until the next gather.
+ * @param ids Token ids; ids outside the vocabulary give rows of zeros.
+ * @param count Number of ids (at least 1).
+ * @return The device buffer holding the gathered rows.
+ * @throws std::runtime_error if there are no embeddings or on any OpenCL error.
+ */
+const cl::Buffer& tokeniser::clGatherEmbeddingsToDevice(const OpenCLContext& ocl_context, const int32_t* ids, size_t count) const
+{
+    checkContext(ocl_context);
+    if (this->embeddings.empty()) {
+        throw std::runtime_error("Error: Embeddings are not generated or loaded. Cannot gather embeddings.");
     }
+    if (count == 0 || count > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Error: Number of token ids for one gather is out of range.");
+    }
+    const int d_dim = static_cast<int>(this->embeddings.cols());
+    const int rows = static_cast<int>(this->embeddings.rows());
+    // cl:: objects are reference counted handles: the copies share the context's queue and kernel.
+    cl::CommandQueue queue = ocl_context.queue;
+    cl::Kernel kernel = ocl_context.gatherKernel;
 
-    cl::Buffer input_buffer(ocl_context.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                            sizeof(float) * total_elements, flat_embedding_input.data(), &err);
-    CHECK_CL(err);
-
-    cl::Buffer output_buffer(ocl_context.context, CL_MEM_WRITE_ONLY,
-                             sizeof(float) * total_elements, NULL, &err);
-    CHECK_CL(err);
-
-    cl::Kernel kernel(ocl_context.inverseProgram, "batchedVectorInverseKernel", &err);
-    CHECK_CL(err);
-
-    // Determine local work size for reduction kernel
-    // The kernel is designed with a single work-group per row (vector) in mind.
-    // The local work size should be at least 'd_dim' or a power of 2 greater than 'd_dim'
-    // for the reduction, up to CL_DEVICE_MAX_WORK_GROUP_SIZE.
-    // For simplicity, let's pick a common value or max_work_group_size if d_dim is small.
-    // You might want to query device capabilities for optimal local_work_size.
-    size_t local_work_size_x = 256; // Example. Adjust for your hardware/kernel design
-    if (d_dim < local_work_size_x) {
-        // Round up to the next power of 2 if not already one
-        local_work_size_x = 1;
-        while (local_work_size_x < d_dim) local_work_size_x <<= 1;
-        if (local_work_size_x > 256) local_work_size_x = 256; // Cap to common max
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+    if (buffers.residentEmbeddings == 0 || buffers.residentEmbeddings != this->embeddingsVersion) {
+        buffers.reserve(this->embeddings.size());
+        enqueueUpload(queue, buffers.embeddings, buffers.hostEmbeddings(), this->embeddings.data(), this->embeddings.size());
+        buffers.residentEmbeddings = this->embeddingsVersion;
     }
+    buffers.reserveGather(count, count * d_dim);
+    // Blocking write: `ids` may go away as soon as this returns.
+    CHECK_CL(queue.enqueueWriteBuffer(buffers.ids, CL_TRUE, 0, count * sizeof(int32_t), ids));
 
+    kernel.setArg(0, buffers.gathered);
+    kernel.setArg(1, buffers.embeddings);
+    kernel.setArg(2, buffers.ids);
+    kernel.setArg(3, rows);
+    kernel.setArg(4, d_dim);
 
-    kernel.setArg(0, output_buffer);
-    kernel.setArg(1, input_buffer);
-    kernel.setArg(2, vocSize_val); // N is number of rows
-    kernel.setArg(3, d_dim);       // d is dimension of each vector
-    kernel.setArg(4, sizeof(float) * local_work_size_x, NULL); // Local memory for s_data
-
-    // Global work size: Each row/vector needs a work-group operating on 'd_dim' elements
-    // The kernel uses get_group_id(1) for rows, so global_work_size should map to that.
-    // Global X: local_work_size_x * number of groups in X (which is 1 per row for the col dim)
-    // Global Y: vocSize_val (number of rows)
-    cl::NDRange global_size_2d(local_work_size_x, vocSize_val); // Corrected global size for 2D kernel
-    cl::NDRange local_size_2d(local_work_size_x, 1); // Local size: X for columns, 1 for rows (each row a group)
-
-    err = ocl_context.queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_size_2d, local_size_2d);
-    CHECK_CL(err);
-
-    std::vector<float> flat_deEmbedding_output(total_elements);
-    err = ocl_context.queue.enqueueReadBuffer(output_buffer, CL_TRUE, 0,
-                                              sizeof(float) * total_elements, flat_deEmbedding_output.data());
-    CHECK_CL(err);
-
-    // Copy flat_deEmbedding_output to the 2D deEmbedding vector
-    for (int i = 0; i < vocSize_val; ++i) {
-        for (int j = 0; j < d_dim; ++j) {
-            deEmbedding[i][j] = flat_deEmbedding_output[i * d_dim + j];
-        }
-    }
+    // One work-group per output row
+    const size_t local_work_size_x = rowWorkGroupSize(d_dim);
+    cl::NDRange global_work_size(local_work_size_x * count);
+    cl::NDRange local_work_size(local_work_size_x);
+    CHECK_CL(queue.enqueueNDRangeKernel(kernel, cl::NullRange, global_work_size, local_work_size));
+    return buffers.gathered;
+}
+
+
+/**
+ * @brief Gathers the embedding rows of `ids` on the device and reads them into `out`.
+ * @param out count x d floats, row i = embedding of ids[i].
+ * @throws std::runtime_error if there are no embeddings or on any OpenCL error.
+ */
+void tokeniser::clGatherEmbeddings(const OpenCLContext& ocl_context, const int32_t* ids, size_t count, float* out) const
+{
+    if (count == 0) return;
+    const cl::Buffer& gathered = clGatherEmbeddingsToDevice(ocl_context, ids, count);
+    const size_t total_elements = count * this->embeddings.cols();
+    OpenCLDeviceBuffers& buffers = *ocl_context.buffers;
+
+    cl::CommandQueue queue = ocl_context.queue;
+    std::vector<cl::Event> done;
+    enqueueDownload(queue, gathered, buffers.gatheredHostPtr, total_elements, done);
+    CHECK_CL(queue.flush());
+    finishDownload(done, buffers.gatheredHostPtr, out, total_elements);
 }
 
 
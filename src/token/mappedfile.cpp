@@ -0,0 +1,151 @@
+// mappedfile.cpp
+#include "include/mappedfile.hpp"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    begin = std::exchange(other.begin, nullptr);
+    length = std::exchange(other.length, 0);
+    mapped = std::exchange(other.mapped, false);
+    buffer = std::move(other.buffer);
+#ifdef _WIN32
+    fileHandle = std::exchange(other.fileHandle, nullptr);
+    mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+    return *this;
+}
+
+
+// Unmaps or frees the current contents.
+void MappedFile::release() {
+    if (mapped && begin != nullptr) {
+#ifdef _WIN32
+        UnmapViewOfFile(begin);
+#else
+        munmap(const_cast<char*>(begin), length);
+#endif
+    }
+#ifdef _WIN32
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != nullptr && fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#endif
+    buffer.reset();
+    begin = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+
+/**
+ * @brief Opens a file for reading, mapping it into memory if possible.
+ * Empty files are opened successfully with a null, zero-length view.
+ * @param path Path of the file.
+ * @return `false` if the file could not be opened or read, `true` otherwise.
+ */
+bool MappedFile::open(const std::string& path) {
+    release();
+
+    std::error_code ec;
+    const auto file_size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    if (file_size == 0) return true;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (view != nullptr) {
+                fileHandle = file;
+                mappingHandle = mapping;
+                begin = static_cast<const char*>(view);
+                length = static_cast<size_t>(file_size);
+                mapped = true;
+                return true;
+            }
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+    }
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        void* view = mmap(nullptr, static_cast<size_t>(file_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps its own reference to the file.
+        if (view != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(view, static_cast<size_t>(file_size), MADV_SEQUENTIAL);
+#endif
+            begin = static_cast<const char*>(view);
+            length = static_cast<size_t>(file_size);
+            mapped = true;
+            return true;
+        }
+    }
+#endif
+
+    // Fallback: read the whole file into one buffer.
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    buffer = std::make_unique<char[]>(static_cast<size_t>(file_size));
+    if (!file.read(buffer.get(), static_cast<std::streamsize>(file_size))) {
+        buffer.reset();
+        return false;
+    }
+    begin = buffer.get();
+    length = static_cast<size_t>(file_size);
+    return true;
+}
+
+
+/**
+ * @brief Splits a byte range into chunks of roughly `target_chunk_bytes` that end on line boundaries.
+ * Every chunk except possibly the last ends directly after a '\n', so no line is split
+ * between two chunks. Lines longer than the target end up in a chunk of their own.
+ * @param data The bytes to split.
+ * @param target_chunk_bytes Desired chunk size in bytes.
+ * @return The chunks in order; they cover `data` exactly.
+ */
+std::vector<std::string_view> splitOnNewlines(std::string_view data, size_t target_chunk_bytes) {
+    std::vector<std::string_view> chunks;
+    if (target_chunk_bytes == 0) target_chunk_bytes = 1;
+
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = start + target_chunk_bytes;
+        if (end >= data.size()) {
+            end = data.size();
+        } else {
+            const void* newline = std::memchr(data.data() + end, '\n', data.size() - end);
+            end = newline ? static_cast<size_t>(static_cast<const char*>(newline) - data.data()) + 1 : data.size();
+        }
+        chunks.push_back(data.substr(start, end - start));
+        start = end;
+    }
+    return chunks;
+}
@@ -1,6 +1,5 @@
 #include "include/tokenise.hpp"
 #include <vector>
-#include <future>
 
 
 // Helper to merge two unordered_maps. This is efficient as it moves map2's contents.
@@ -17,38 +16,111 @@ std::unordered_map<std::string, int> mergeTwoMaps(std::unordered_map<std::string
     return map1;
 }
 
-// Recursive function for parallel map merging (merge tree)
-std::future<std::unordered_map<std::string, int>> merge_maps(
-    std::vector<std::future<std::unordered_map<std::string, int>>>& futures,
-    size_t start_idx, size_t end_idx) {
+/**
+ * @brief Merges maps level by level on the thread pool (merge tree).
+ * At each level adjacent maps are merged pairwise, all pairs of the level in parallel,
+ * until one map is left. Maps are only ever moved between levels.
+ * @param maps The maps to merge; consumed.
+ * @param pool Pool that runs the pairwise merges.
+ * @return The merged map.
+ */
+std::unordered_map<std::string, int> merge_maps(std::vector<std::unordered_map<std::string, int>>& maps, ThreadPool& pool) {
+    if (maps.empty()) return {};
+    while (maps.size() > 1) {
+        const size_t pairs = maps.size() / 2;
+        pool.parallelFor(0, pairs, 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; ++p) {
+                maps[2 * p] = mergeTwoMaps(std::move(maps[2 * p]), std::move(maps[2 * p + 1]));
+            }
+        });
+        // Keep the merged maps (even slots), plus the unpaired last one.
+        for (size_t i = 1; i < (maps.size() + 1) / 2; ++i) {
+            maps[i] = std::move(maps[2 * i]);
+        }
+        maps.resize((maps.size() + 1) / 2);
+    }
+    return std::move(maps[0]);
+}
+
 
-    if (start_idx == end_idx) {
-        // Base case: a single map, just return its future
-        return std::move(futures[start_idx]);
+// Helper to merge two word-count tables: the smaller one is folded into the larger one,
+// which only copies keys that are new to the larger table and then frees the smaller one.
+WordCountTable mergeTwoTables(WordCountTable table1, WordCountTable table2)
+{
+    if (table1.size() < table2.size()) {
+        std::swap(table1, table2);
     }
-    if (start_idx + 1 == end_idx) {
-        // Base case: two maps, merge them directly
-        return std::async(std::launch::async, [
-            m1 = futures[start_idx].get(), // Get and move map from first future
-            m2 = futures[end_idx].get()    // Get and move map from second future
-        ]() mutable {
-            return mergeTwoMaps(std::move(m1), std::move(m2));
+    table1.mergeFrom(std::move(table2));
+    return table1;
+}
+
+/**
+ * @brief Merges word-count tables level by level on the thread pool, like merge_maps.
+ * @param tables The tables to merge; consumed.
+ * @param pool Pool that runs the pairwise merges.
+ * @return The merged table.
+ */
+WordCountTable merge_tables(std::vector<WordCountTable>& tables, ThreadPool& pool) {
+    if (tables.empty()) return WordCountTable();
+    while (tables.size() > 1) {
+        const size_t pairs = tables.size() / 2;
+        pool.parallelFor(0, pairs, 1, [&](size_t first, size_t last) {
+            for (size_t p = first; p < last; ++p) {
+                tables[2 * p] = mergeTwoTables(std::move(tables[2 * p]), std::move(tables[2 * p + 1]));
+            }
         });
+        for (size_t i = 1; i < (tables.size() + 1) / 2; ++i) {
+            tables[i] = std::move(tables[2 * i]);
+        }
+        tables.resize((tables.size() + 1) / 2);
     }
+    return std::move(tables[0]);
+}
 
-    size_t mid_idx = start_idx + (end_idx - start_idx) / 2;
-
-    // Recursively merge left and right halves
-    auto left_future = merge_maps(futures, start_idx, mid_idx);
-    auto right_future = merge_maps(futures, mid_idx + 1, end_idx);
 
-    // Merge the results of the two parallel merges
-    return std::async(std::launch::async, [
-        m1 = left_future.get(), // Get and move map from left sub-tree
-        m2 = right_future.get() // Get and move map from right sub-tree
-    ]() mutable {
-        return mergeTwoMaps(std::move(m1), std::move(m2));
+/**
+ * @brief Combines the sharded partial counts of all workers into one map.
+ * Every word hashes to the same shard in every partial, so shard i of all partials can
+ * be merged independently of the other shards: one task per shard folds shard i of
+ * every partial into a table (largest first) and converts it into its own map. All
+ * shards are processed in parallel and the results are disjoint, so the final step
+ * only splices map nodes into `result` instead of merging two large maps.
+ * @param partials Per-worker partial counts, all with the same shard count; their shards are consumed.
+ * @param result Output map; counts are added to existing entries.
+ */
+void merge_shards(std::vector<ShardedWordCounts>& partials, std::unordered_map<std::string, int>& result, ThreadPool& pool)
+{
+    if (partials.empty()) return;
+    const size_t num_shards = partials[0].shardCount();
+
+    std::vector<std::unordered_map<std::string, int>> shard_maps(num_shards);
+    pool.parallelFor(0, num_shards, 1, [&](size_t first, size_t last) {
+        for (size_t s = first; s < last; ++s) {
+            // Start from the largest shard so the fold copies as few keys as possible.
+            size_t largest = 0;
+            for (size_t p = 1; p < partials.size(); ++p) {
+                if (partials[p].shard(s).size() > partials[largest].shard(s).size()) largest = p;
+            }
+            WordCountTable merged = std::move(partials[largest].shard(s));
+            for (size_t p = 0; p < partials.size(); ++p) {
+                if (p != largest) merged.mergeFrom(std::move(partials[p].shard(s)));
+            }
+            merged.moveInto(shard_maps[s]);
+        }
     });
+
+    size_t total = result.size();
+    for (const auto& shard_map : shard_maps) {
+        total += shard_map.size();
+    }
+    result.reserve(total);
+    for (auto& shard_map : shard_maps) {
+        result.merge(shard_map); // moves the nodes, no reallocation of keys
+        for (const auto& pair : shard_map) { // keys that were already present in `result`
+            result[pair.first] += pair.second;
+        }
+        shard_map = {};
+    }
 }
 
 
@@ -57,99 +129,62 @@ std::future<std::unordered_map<std::string, int>> merge_maps(
 // A naive approach: re-split words containing the best_pair.
 void merge_pair(const std::pair<std::string, std::string>& best_pair,
                          std::unordered_map<std::string, std::vector<std::string>>& splits,
-                         int num_threads)
+                         ThreadPool& pool)
 {
     // Step 1: Identify words to update.
-    // Instead of collecting strings, collect iterators or keys.
-    // For efficiency, a real BPE implementation often uses an inverted index
-    // (token -> list of words containing token) to quickly find words.
-    // Since we don't have that, we iterate, but we can optimize the update.
-    
-    // We'll collect the keys of the words that need updating.
-    std::vector<std::string> keys_to_update;
-    keys_to_update.reserve(splits.size()); // Reserve to avoid reallocations
-
-    for (const auto& entry : splits) {
-        // Only add words that actually contain the pair.
-        // This check can be optimized: search for first token, then check next.
-        for (size_t i = 0; i + 1 < entry.second.size(); ++i) {
-            if (entry.second[i] == best_pair.first && entry.second[i+1] == best_pair.second) {
-                keys_to_update.push_back(entry.first);
-                break; // Found the pair, no need to check further in this word's split
+    // The buckets of `splits` are scanned in parallel ranges; each range collects pointers
+    // to the splits that contain the pair, so no keys are copied.
+    using Split = std::vector<std::string>;
+    std::vector<Split*> splits_to_update = pool.parallelReduce(
+        size_t(0), splits.bucket_count(), size_t(0), std::vector<Split*>(),
+        [&](size_t first_bucket, size_t last_bucket) {
+            std::vector<Split*> found;
+            for (size_t b = first_bucket; b < last_bucket; ++b) {
+                for (auto it = splits.begin(b); it != splits.end(b); ++it) {
+                    Split& split = it->second;
+                    for (size_t i = 0; i + 1 < split.size(); ++i) {
+                        if (split[i] == best_pair.first && split[i + 1] == best_pair.second) {
+                            found.push_back(&split);
+                            break; // Found the pair, no need to check further in this word's split
+                        }
+                    }
+                }
             }
-        }
-    }
+            return found;
+        },
+        [](std::vector<Split*> all, std::vector<Split*> part) {
+            all.insert(all.end(), part.begin(), part.end());
+            return all;
+        });
 
     // If no words contain the pair, nothing to do
-    if (keys_to_update.empty()) {
+    if (splits_to_update.empty()) {
         return;
     }
 
-    // Step 2: Parallelize the update, returning local changes.
-    std::vector<std::future<std::unordered_map<std::string, std::vector<std::string>>>> futures;
-    futures.reserve(num_threads);
-
-    // Calculate effective number of threads if there are fewer words than threads
-    int effective_num_threads = std::min<int>(num_threads, (int)keys_to_update.size());
-    if (effective_num_threads == 0) return; // Should not happen if keys_to_update is not empty
-
-    size_t chunk_size = keys_to_update.size() / effective_num_threads;
-    
-    for (int t = 0; t < effective_num_threads; ++t) {
-        size_t start_idx = chunk_size * t;
-        size_t end_idx = (t == effective_num_threads - 1) ? keys_to_update.size() : start_idx + chunk_size;
-
-        futures.push_back(std::async(std::launch::async, [&, start_idx, end_idx]() {
-            // Each thread works on a *copy* of the relevant parts of `splits`
-            // and builds its own local updates.
-            std::unordered_map<std::string, std::vector<std::string>> local_updated_splits;
-
-            for (size_t i = start_idx; i < end_idx; ++i) {
-                const std::string& word_key = keys_to_update[i];
-                // Get the current subwords for this word. This read *must* be safe.
-                // Assuming `splits` is thread-safe for reads while threads are spawned.
-                // If `splits` can change during this phase, it needs read-write lock or similar.
-                // For BPE, `splits` is generally stable until the next merge.
-                
-                // OPTIMIZATION: Get existing subwords without locking global `splits` map.
-                // This implies `splits` itself is read-only at this stage, or protected by R/W lock.
-                // For simplicity, we'll assume `splits` is thread-safe for concurrent reads (or copied).
-                // A better design would be to pass a const reference to splits into the lambda
-                // or pre-copy the relevant parts for each thread.
-                // Given the original code's locking pattern, we'll fetch the *original* split.
-                const std::vector<std::string>& current_subwords = splits.at(word_key); // Use .at() for bounds checking
-
-                std::vector<std::string> new_subwords;
-                new_subwords.reserve(current_subwords.size()); // Optimize allocation
-
-                for (size_t j = 0; j < current_subwords.size(); ) {
-                    if (j + 1 < current_subwords.size() &&
-                        current_subwords[j] == best_pair.first &&
-                        current_subwords[j+1] == best_pair.second) {
-                        new_subwords.push_back(best_pair.first + best_pair.second);
-                        j += 2; // Skip the two merged tokens
-                    } else {
-                        new_subwords.push_back(current_subwords[j]);
-                        j += 1;
-                    }
+    // Step 2: Rewrite the affected splits in parallel.
+    // Every element is visited by exactly one task and the map itself is not modified
+    // (no insertions, no rehash), so the splits can be updated in place.
+    const std::string merged_token = best_pair.first + best_pair.second;
+    pool.parallelFor(0, splits_to_update.size(), 0, [&](size_t first, size_t last) {
+        for (size_t n = first; n < last; ++n) {
+            Split& current_subwords = *splits_to_update[n];
+
+            Split new_subwords;
+            new_subwords.reserve(current_subwords.size()); // Optimize allocation
+
+            for (size_t j = 0; j < current_subwords.size(); ) {
+                if (j + 1 < current_subwords.size() &&
+                    current_subwords[j] == best_pair.first &&
+                    current_subwords[j+1] == best_pair.second) {
+                    new_subwords.push_back(merged_token);
+                    j += 2; // Skip the two merged tokens
+                } else {
+                    new_subwords.push_back(std::move(current_subwords[j]));
+                    j += 1;
                 }
-                // Store the updated subwords in this thread's local map
-                local_updated_splits[word_key] = std::move(new_subwords);
             }
-            return local_updated_splits;
-        }));
-    }
-
-    // Step 3: Aggregate results from all threads.
-    // This phase should be sequential or use a merge tree (if many threads)
-    // to apply the collected local changes to the global `splits` map.
-    // Since `splits` modification is an `std::unordered_map` assignment,
-    // it's best done sequentially from the main thread.
-    for (auto& f : futures) {
-        std::unordered_map<std::string, std::vector<std::string>> local_map = f.get(); // Get the thread's results
-        for (auto& entry : local_map) {
-            // Update the global `splits` map. This is safe as it's sequential.
-            splits[entry.first] = std::move(entry.second);
+            current_subwords = std::move(new_subwords);
         }
-    }
+    });
 }
@@ -0,0 +1,111 @@
+// mergerank.cpp
+#include "include/mergerank.hpp"
+#include "include/tokenise.hpp"
+#include <algorithm>
+#include <functional>
+
+
+/**
+ * @brief Builds the table from merges in rank order (rank = position).
+ * A pair that is learned again later (its merged token can be re-created by another merge)
+ * keeps its first, lowest rank, since that is the one applied first during training.
+ * Slots are kept at most half full.
+ */
+void MergeRankTable::build(const std::vector<TokenMerge>& merges) {
+    clear();
+    if (merges.empty()) return;
+
+    size_t capacity = 16;
+    while (capacity < 2 * merges.size()) capacity <<= 1;
+    slots.assign(capacity, Slot{});
+
+    const size_t mask = capacity - 1;
+    for (size_t r = 0; r < merges.size(); ++r) {
+        const uint64_t key = pairKey(merges[r].left, merges[r].right);
+        for (size_t i = slotHash(key) & mask; ; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.key == key) break;     // already ranked lower
+            if (slot.key == EMPTY_KEY) {
+                slot.key = key;
+                slot.rank = static_cast<uint32_t>(r);
+                slot.merged = merges[r].merged;
+                mergeCount++;
+                break;
+            }
+        }
+    }
+}
+
+
+void MergeRankTable::clear() {
+    slots.clear();
+    mergeCount = 0;
+}
+
+
+/**
+ * @brief Merges the symbols of one word in place, lowest rank first.
+ * The symbols form a doubly linked list over their positions and every adjacent pair
+ * with a rank sits in a min-heap keyed by (rank, position). Popping a pair merges the
+ * right symbol into the left one and pushes the two new neighbour pairs; entries whose
+ * pair has changed since they were pushed are recognised by their rank and skipped.
+ * That is O(n log n) for n symbols, instead of rescanning the word after every merge.
+ * Unknown symbols (negative ids) never merge.
+ * @param symbols The word's symbol ids from position `first` on; replaced by the merged ids.
+ * @param first Position of the word's first symbol (earlier entries are left alone).
+ */
+void MergeRankTable::apply(std::vector<int32_t>& symbols, size_t first) const {
+    const size_t n = symbols.size() > first ? symbols.size() - first : 0;
+    if (n < 2 || slots.empty()) return;
+
+    thread_local std::vector<uint32_t> next, prev;
+    thread_local std::vector<uint64_t> heap;
+    int32_t* const word = symbols.data() + first;
+    const uint32_t end = static_cast<uint32_t>(n);
+    next.resize(n);
+    prev.resize(n);
+    heap.clear();
+
+    auto push_pair = [&](uint32_t pos) {
+        int32_t merged = 0;
+        const uint32_t r = rank(word[pos], word[next[pos]], merged);
+        if (r != NO_RANK) {
+            heap.push_back((static_cast<uint64_t>(r) << 32) | pos);
+            std::push_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+        }
+    };
+
+    for (uint32_t i = 0; i < end; ++i) {
+        next[i] = i + 1;
+        prev[i] = i - 1;    // wraps to ~0u for the first symbol
+    }
+    for (uint32_t i = 0; i + 1 < end; ++i) push_pair(i);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+        const uint64_t entry = heap.back();
+        heap.pop_back();
+        const uint32_t pos = static_cast<uint32_t>(entry);
+        const uint32_t expected_rank = static_cast<uint32_t>(entry >> 32);
+
+        // Merged-away positions are unlinked (next = end is never a valid left symbol).
+        const uint32_t right = next[pos];
+        if (right >= end) continue;
+        int32_t merged = 0;
+        if (rank(word[pos], word[right], merged) != expected_rank) continue;     // pair changed
+
+        word[pos] = merged;
+        next[pos] = next[right];
+        if (next[pos] < end) prev[next[pos]] = pos;
+        next[right] = end;
+        word[right] = EncodedBatch::UNKNOWN_ID;
+
+        if (prev[pos] < end) push_pair(prev[pos]);
+        if (next[pos] < end) push_pair(pos);
+    }
+
+    // Compact the surviving symbols (the first one always survives).
+    size_t out = first;
+    for (uint32_t i = 0; i < end; i = next[i]) symbols[out++] = word[i];
+    symbols.resize(out);
+}
@@ -0,0 +1,353 @@
+// metrics.cpp
+#include "include/metrics.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+uint64_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<uint64_t>(counters.PeakWorkingSetSize);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);          // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;   // kilobytes
+#endif
+#endif
+}
+
+
+// Escapes a string for a JSON string literal.
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (const char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+
+static bool writeTextFile(const std::string& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+    out.close();
+    if (!out) {
+        std::cerr << "Error: Could not write metrics file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Stage, ThreadTimer, QueueWatch
+
+PipelineMetrics::Stage::Stage(PipelineMetrics& metrics, std::string name)
+    : owner(metrics), name(std::move(name)), start(Clock::now()), thread(0)
+{
+    owner.beginStage(this->name, thread);
+}
+
+
+PipelineMetrics::Stage::~Stage() {
+    StageMetrics stage;
+    stage.name = std::move(name);
+    stage.startSeconds = owner.secondsSince(start);
+    stage.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stage.bytes = bytes;
+    stage.lines = lines;
+    stage.words = words;
+    stage.items = items;
+    stage.maxQueueDepth = maxQueueDepth;
+    stage.peakRssBytes = peakResidentBytes();
+    stage.counters = std::move(counters);
+    owner.finishStage(std::move(stage), thread);
+}
+
+
+PipelineMetrics::ThreadTimer::ThreadTimer(PipelineMetrics& metrics, std::string stage, std::string role, int index)
+    : owner(metrics), start(Clock::now()), last(start), tracing(metrics.tracing())
+{
+    record.stage = std::move(stage);
+    record.role = std::move(role);
+    record.index = index;
+    record.startSeconds = owner.secondsSince(start);
+    std::lock_guard<std::mutex> lock(owner.mtx);
+    thread = owner.traceThread();
+}
+
+
+PipelineMetrics::ThreadTimer::~ThreadTimer() {
+    idle();     // from the last piece of work to the end: waiting for the queue to close
+    owner.finishThread(record, thread);
+}
+
+
+void PipelineMetrics::ThreadTimer::idle() {
+    const Clock::time_point now = Clock::now();
+    record.idleSeconds += std::chrono::duration<double>(now - last).count();
+    last = now;
+}
+
+
+void PipelineMetrics::ThreadTimer::busy(const char* event) {
+    const Clock::time_point now = Clock::now();
+    const double seconds = std::chrono::duration<double>(now - last).count();
+    record.busySeconds += seconds;
+    if (tracing && event != nullptr) {
+        owner.addEvent({ event, "work", owner.secondsSince(last), seconds, thread });
+    }
+    last = now;
+}
+
+
+PipelineMetrics::QueueWatch::QueueWatch(PipelineMetrics& metrics, std::function<size_t()> depth)
+    : owner(metrics)
+{
+    std::lock_guard<std::mutex> lock(owner.mtx);
+    owner.queueDepth = std::move(depth);
+}
+
+
+PipelineMetrics::QueueWatch::~QueueWatch() {
+    std::lock_guard<std::mutex> lock(owner.mtx);
+    owner.queueDepth = nullptr;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// PipelineMetrics
+
+PipelineMetrics::PipelineMetrics() : epoch(Clock::now()) {}
+
+
+void PipelineMetrics::reset() {
+    std::lock_guard<std::mutex> lock(mtx);
+    epoch = Clock::now();
+    stages.clear();
+    threads.clear();
+    events.clear();
+}
+
+
+void PipelineMetrics::setCallback(Callback callback) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->callback = std::move(callback);
+    hasCallback.store(static_cast<bool>(this->callback), std::memory_order_relaxed);
+}
+
+
+void PipelineMetrics::setCounterSource(std::function<void(MetricsSnapshot&)> source) {
+    std::lock_guard<std::mutex> lock(mtx);
+    counterSource = std::move(source);
+}
+
+
+double PipelineMetrics::secondsSince(Clock::time_point t) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return std::chrono::duration<double>(t - epoch).count();
+}
+
+
+// Small sequential id of the calling thread for the trace (1, 2, ...).
+int PipelineMetrics::traceThread() {
+    const std::thread::id id = std::this_thread::get_id();
+    const auto it = std::find(traceThreads.begin(), traceThreads.end(), id);
+    if (it != traceThreads.end()) return static_cast<int>(it - traceThreads.begin()) + 1;
+    traceThreads.push_back(id);
+    traceThreadNames.emplace_back(traceThreads.size() == 1 ? "main" : "");
+    return static_cast<int>(traceThreads.size());
+}
+
+
+void PipelineMetrics::beginStage(const std::string& name, int& thread) {
+    std::lock_guard<std::mutex> lock(mtx);
+    running.push_back(name);
+    thread = traceThread();
+}
+
+
+void PipelineMetrics::finishStage(StageMetrics stage, int thread) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto it = std::find(running.rbegin(), running.rend(), stage.name);
+        if (it != running.rend()) running.erase(std::next(it).base());
+        events.push_back({ stage.name, "stage", stage.startSeconds, stage.seconds, thread });
+        stages.push_back(std::move(stage));
+    }
+    notify();
+}
+
+
+void PipelineMetrics::finishThread(const ThreadMetrics& thread, int traceId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const std::string name = thread.role + " " + std::to_string(thread.index);
+    traceThreadNames[traceId - 1] = name;
+    events.push_back({ thread.stage + " " + name, "thread", thread.startSeconds,
+                       thread.busySeconds + thread.idleSeconds, traceId });
+    threads.push_back(thread);
+}
+
+
+void PipelineMetrics::addEvent(TraceEvent event) {
+    std::lock_guard<std::mutex> lock(mtx);
+    events.push_back(std::move(event));
+}
+
+
+MetricsSnapshot PipelineMetrics::snapshot() const {
+    MetricsSnapshot snapshot;
+    std::function<void(MetricsSnapshot&)> source;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        snapshot.stages = stages;
+        snapshot.threads = threads;
+        snapshot.runningStages = running;
+        snapshot.elapsedSeconds = std::chrono::duration<double>(Clock::now() - epoch).count();
+        snapshot.queueDepth = queueDepth ? queueDepth() : 0;
+        source = counterSource;
+    }
+    if (source) source(snapshot);
+    snapshot.peakRssBytes = peakResidentBytes();
+    return snapshot;
+}
+
+
+void PipelineMetrics::notify() const {
+    if (!hasCallback.load(std::memory_order_relaxed)) return;
+    Callback cb;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        cb = callback;
+    }
+    if (cb) cb(snapshot());
+}
+
+
+/**
+ * @brief The current snapshot as one JSON object.
+ * Stages list their wall time, work counters and rates (and a "counters" object when the
+ * stage has named counters); threads their busy and idle time and the busy fraction.
+ */
+std::string PipelineMetrics::toJson() const {
+    const MetricsSnapshot s = snapshot();
+    std::ostringstream json;
+    json << std::setprecision(6);
+    json << "{\n  \"elapsed_seconds\": " << s.elapsedSeconds
+         << ",\n  \"peak_rss_bytes\": " << s.peakRssBytes
+         << ",\n  \"total_bytes\": " << s.totalBytes
+         << ",\n  \"bytes_read\": " << s.bytesRead
+         << ",\n  \"sentences\": " << s.sentences
+         << ",\n  \"merges_completed\": " << s.mergesCompleted
+         << ",\n  \"total_merges\": " << s.totalMerges
+         << ",\n  \"merges_per_second\": " << s.mergesPerSecond
+         << ",\n  \"stages\": [\n";
+    for (size_t i = 0; i < s.stages.size(); ++i) {
+        const StageMetrics& stage = s.stages[i];
+        json << "    { \"name\": " << jsonString(stage.name)
+             << ", \"start_seconds\": " << stage.startSeconds
+             << ", \"seconds\": " << stage.seconds
+             << ", \"bytes\": " << stage.bytes
+             << ", \"lines\": " << stage.lines
+             << ", \"words\": " << stage.words
+             << ", \"items\": " << stage.items
+             << ", \"bytes_per_second\": " << stage.bytesPerSecond()
+             << ", \"items_per_second\": " << stage.itemsPerSecond()
+             << ", \"max_queue_depth\": " << stage.maxQueueDepth
+             << ", \"peak_rss_bytes\": " << stage.peakRssBytes;
+        if (!stage.counters.empty()) {
+            json << ", \"counters\": { ";
+            for (size_t c = 0; c < stage.counters.size(); ++c) {
+                json << (c > 0 ? ", " : "") << jsonString(stage.counters[c].first) << ": " << stage.counters[c].second;
+            }
+            json << " }";
+        }
+        json << " }" << (i + 1 < s.stages.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n  \"threads\": [\n";
+    for (size_t i = 0; i < s.threads.size(); ++i) {
+        const ThreadMetrics& thread = s.threads[i];
+        const double total = thread.busySeconds + thread.idleSeconds;
+        json << "    { \"stage\": " << jsonString(thread.stage)
+             << ", \"role\": " << jsonString(thread.role)
+             << ", \"index\": " << thread.index
+             << ", \"busy_seconds\": " << thread.busySeconds
+             << ", \"idle_seconds\": " << thread.idleSeconds
+             << ", \"busy_fraction\": " << (total > 0.0 ? thread.busySeconds / total : 0.0) << " }"
+             << (i + 1 < s.threads.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    return json.str();
+}
+
+
+bool PipelineMetrics::writeJson(const std::string& path) const {
+    return writeTextFile(path, toJson());
+}
+
+
+/**
+ * @brief Writes the recorded stages, threads and (with tracing) work items as a Chrome
+ * trace: complete ("X") events in microseconds, one track per thread, named by role.
+ */
+bool PipelineMetrics::writeChromeTrace(const std::string& path) const {
+    std::vector<TraceEvent> trace;
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        trace = events;
+        names = traceThreadNames;
+    }
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3);
+    json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (size_t t = 0; t < names.size(); ++t) {
+        if (names[t].empty()) continue;
+        json << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t + 1
+             << ",\"args\":{\"name\":" << jsonString(names[t]) << "}}";
+        first = false;
+    }
+    for (const TraceEvent& event : trace) {
+        json << (first ? "" : ",\n") << "{\"name\":" << jsonString(event.name) << ",\"cat\":\"" << event.category
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << event.startSeconds * 1e6 << ",\"dur\":" << event.seconds * 1e6 << "}";
+        first = false;
+    }
+    json << "\n]}\n";
+    return writeTextFile(path, json.str());
+}
@@ -0,0 +1,205 @@
+// modelfile.cpp
+#include "include/tokenise.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+
+// Appends the raw bytes of a trivially copyable array.
+template<typename T>
+static void appendBytes(std::string& out, const T* values, size_t count) {
+    out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+static uint64_t alignSection(uint64_t offset) {
+    return (offset + MODEL_SECTION_ALIGNMENT - 1) / MODEL_SECTION_ALIGNMENT * MODEL_SECTION_ALIGNMENT;
+}
+
+
+/**
+ * @brief Saves the vocabulary, merges, prefix index and embeddings as one binary model file.
+ * The layout is described in modelfile.hpp. Token ids, merge ranks and embedding rows are
+ * written in canonical id order, so `loadModel` restores them without sorting or rebuilding.
+ * @param path Path of the model file to write.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void tokeniser::saveModel(const std::string& path) const {
+    const size_t num_sections = static_cast<size_t>(ModelSection::Count);
+    std::string sections[num_sections];
+
+    // Vocabulary: offsets into the concatenated token bytes.
+    std::string& vocab = sections[static_cast<size_t>(ModelSection::Vocabulary)];
+    std::vector<uint64_t> offsets(this->tokens.size() + 1, 0);
+    for (size_t i = 0; i < this->tokens.size(); ++i) {
+        offsets[i + 1] = offsets[i] + this->tokens[i].size();
+    }
+    appendBytes(vocab, offsets.data(), offsets.size());
+    for (const auto& token : this->tokens) {
+        vocab += token;
+    }
+
+    appendBytes(sections[static_cast<size_t>(ModelSection::Merges)], this->merges.data(), this->merges.size());
+    this->prefixIndex.serialize(sections[static_cast<size_t>(ModelSection::PrefixIndex)]);
+
+    // Embeddings are stored only if there is one row of d floats per token.
+    const bool has_embeddings = this->d > 0 && !this->embeddings.empty() && this->embeddings.rows() == this->tokens.size();
+    if (has_embeddings) {
+        if (this->embeddings.cols() != static_cast<size_t>(this->d)) {
+            throw std::runtime_error("Cannot save model: embedding rows do not match the embedding dimension.");
+        }
+        // The matrix is row-major by token id, which is exactly the section layout.
+        appendBytes(sections[static_cast<size_t>(ModelSection::Embeddings)], this->embeddings.data(), this->embeddings.size());
+    }
+
+    ModelFileHeader header{};
+    std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_FILE_VERSION;
+    header.byteOrderMark = MODEL_FILE_BYTE_ORDER_MARK;
+    header.embeddingDim = has_embeddings ? static_cast<uint32_t>(this->d) : 0;
+    header.vocabSize = static_cast<uint32_t>(this->tokens.size());
+    header.mergeCount = static_cast<uint32_t>(this->merges.size());
+    header.flags = this->baseAlphabet == BaseAlphabet::Bytes ? MODEL_FLAG_BYTE_ALPHABET : 0;
+    uint64_t offset = alignSection(sizeof(ModelFileHeader));
+    for (size_t s = 0; s < num_sections; ++s) {
+        header.sections[s] = { offset, sections[s].size() };
+        offset = alignSection(offset + sections[s].size());
+    }
+
+    std::ofstream outFile(path, std::ios::binary | std::ios::trunc);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Could not open file to save model: " << path << std::endl;
+        throw std::runtime_error("Failed to open file at: " + path);
+    }
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    static const char padding[MODEL_SECTION_ALIGNMENT] = {};
+    for (size_t s = 0; s < num_sections; ++s) {
+        outFile.write(padding, header.sections[s].offset - written);
+        outFile.write(sections[s].data(), sections[s].size());
+        written = header.sections[s].offset + sections[s].size();
+    }
+    if (!outFile) {
+        throw std::runtime_error("Failed to write model file: " + path);
+    }
+    std::cout << "-> Saved binary model (" << header.vocabSize << " tokens, " << header.mergeCount << " merges, d = "
+              << header.embeddingDim << ") to: " << path << std::endl;
+}
+
+
+/**
+ * @brief Loads a model written by `saveModel`.
+ * The file is memory-mapped and every section is validated before use. Tokens, merges and
+ * the prefix-index arrays are copied out with plain memcpy (no parsing, sorting or trie
+ * construction). The float32 embedding matrix is not copied at all: the loaded matrix is a
+ * view of the mapping, which stays open for as long as the view (or a copy of it) exists,
+ * so processes loading the same model share its pages.
+ * @param path Path of the model file.
+ * @throws std::runtime_error if the file is missing, truncated or of another version.
+ */
+void tokeniser::loadModel(const std::string& path) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) {
+        throw std::runtime_error("Could not open model file: " + path);
+    }
+    const std::string_view data = file->view();
+
+    ModelFileHeader header;
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error("Model file is truncated: " + path);
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a tokenizer model file: " + path);
+    }
+    if (header.byteOrderMark != MODEL_FILE_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Model file was written with a different byte order: " + path);
+    }
+    if (header.version != MODEL_FILE_VERSION) {
+        throw std::runtime_error("Unsupported model file version " + std::to_string(header.version) + ": " + path);
+    }
+
+    auto section = [&](ModelSection id) {
+        const ModelFileSection& s = header.sections[static_cast<size_t>(id)];
+        if (s.offset > data.size() || s.size > data.size() - s.offset) {
+            throw std::runtime_error("Model file section is out of range: " + path);
+        }
+        return data.substr(s.offset, s.size);
+    };
+    const size_t vocab_size = header.vocabSize;
+    const size_t dim = header.embeddingDim;
+
+    // Vocabulary
+    const std::string_view vocab = section(ModelSection::Vocabulary);
+    const size_t offsets_bytes = (vocab_size + 1) * sizeof(uint64_t);
+    if (vocab.size() < offsets_bytes) {
+        throw std::runtime_error("Model file vocabulary is truncated: " + path);
+    }
+    std::vector<uint64_t> offsets(vocab_size + 1);
+    std::memcpy(offsets.data(), vocab.data(), offsets_bytes);
+    const std::string_view token_bytes = vocab.substr(offsets_bytes);
+    if (offsets[0] != 0 || offsets[vocab_size] != token_bytes.size()) {
+        throw std::runtime_error("Model file vocabulary is corrupt: " + path);
+    }
+    for (size_t i = 0; i < vocab_size; ++i) {
+        if (offsets[i + 1] < offsets[i]) {
+            throw std::runtime_error("Model file vocabulary is corrupt: " + path);
+        }
+    }
+    std::vector<std::string> loaded_tokens(vocab_size);
+    for (size_t i = 0; i < vocab_size; ++i) {
+        loaded_tokens[i].assign(token_bytes.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    // Merges
+    const std::string_view merge_bytes = section(ModelSection::Merges);
+    if (merge_bytes.size() != header.mergeCount * sizeof(TokenMerge)) {
+        throw std::runtime_error("Model file merge table is corrupt: " + path);
+    }
+    std::vector<TokenMerge> loaded_merges(header.mergeCount);
+    if (!loaded_merges.empty()) std::memcpy(loaded_merges.data(), merge_bytes.data(), merge_bytes.size());
+    for (const auto& merge : loaded_merges) {
+        for (int32_t id : { merge.left, merge.right, merge.merged }) {
+            if (id < 0 || static_cast<size_t>(id) >= vocab_size) {
+                throw std::runtime_error("Model file merge table refers to an unknown token: " + path);
+            }
+        }
+    }
+
+    // Prefix index
+    TokenTrie loaded_index;
+    if (!loaded_index.deserialize(section(ModelSection::PrefixIndex), vocab_size)) {
+        throw std::runtime_error("Model file prefix index is corrupt: " + path);
+    }
+
+    // Embeddings
+    const std::string_view matrix = section(ModelSection::Embeddings);
+    if (matrix.size() != vocab_size * dim * sizeof(float)) {
+        throw std::runtime_error("Model file embedding matrix does not match the vocabulary: " + path);
+    }
+    EmbeddingMatrix loaded_embeddings;
+    if (dim > 0 && vocab_size > 0) {
+        if (reinterpret_cast<uintptr_t>(matrix.data()) % alignof(float) == 0) {
+            loaded_embeddings = EmbeddingMatrix::view(reinterpret_cast<const float*>(matrix.data()), vocab_size, dim, file);
+        }
+        else {
+            // Only a hand-edited file can misplace the section; fall back to a copy.
+            std::vector<float> values(vocab_size * dim);
+            std::memcpy(values.data(), matrix.data(), matrix.size());
+            loaded_embeddings.assign(vocab_size, dim, values.data());
+        }
+    }
+
+    // Everything is valid: replace the current model.
+    this->tokens = std::move(loaded_tokens);
+    this->merges = std::move(loaded_merges);
+    this->prefixIndex = std::move(loaded_index);
+    this->embeddings = std::move(loaded_embeddings);
+    this->deEmbeddings.clear();
+    embeddingsChanged();
+    this->vocSize = static_cast<int>(vocab_size);
+    if (dim > 0) this->d = static_cast<int>(dim);
+    this->baseAlphabet = (header.flags & MODEL_FLAG_BYTE_ALPHABET) ? BaseAlphabet::Bytes : BaseAlphabet::Ascii;
+    buildMergeRanks();      // also empties the encode cache, whose ids refer to the old vocabulary
+    std::cout << "-> Loaded binary model (" << vocab_size << " tokens, " << this->merges.size() << " merges, d = "
+              << dim << ") from: " << path << std::endl;
+}
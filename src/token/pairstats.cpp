@@ -11,8 +11,9 @@
  *        is orders of magnitude faster than iterating over all tokens in the corpus.
  * @param corpus_word_counts Map of unique words and their frequencies.
  * @param outputPath Path to save the statistics CSV file.
+ * @return Number of rows written (0 if nothing was saved).
  */
-void tokeniser::calculateTokenStatsFromCounts(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath) {
+size_t tokeniser::calculateTokenStatsFromCounts(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath) {
     this->statOfTokens.clear();
 
     // ******************************************************************************
@@ -23,74 +24,54 @@ void tokeniser::calculateTokenStatsFromCounts(const std::unordered_map<std::stri
     }
     // ******************************************************************************
 
-    auto is_word_for_bpe = [](const std::string& s) -> bool {
-        return !s.empty() && std::isalpha(static_cast<unsigned char>(s[0]));
-    };
-
     std::cout << "Calculating final token statistics from " << corpus_word_counts.size() << " unique raw tokens..." << std::endl;
 
-    const int num_threads = this->num_threads > 0 ? this->num_threads : 1;
-    std::vector<std::future<std::unordered_map<std::string, int>>> futures;
-
-    // Divide work among threads
-    // Create iterators for the map to define chunks.
-    // Iterators for std::map are not random access, so std::advance is used carefully.
-    auto it = corpus_word_counts.begin();
-    size_t total_items = corpus_word_counts.size();
-    size_t chunk_size = (total_items + num_threads - 1) / num_threads; // Ceiling division
-
-    for (int t = 0; t < num_threads; ++t) {
-        auto chunk_start = it;
-        // Advance iterator, ensuring we don't go past the end.
-        std::advance(it, std::min<int>(chunk_size, (size_t)std::distance(it, corpus_word_counts.end())));
-        auto chunk_end = it;
-
-        if (chunk_start == chunk_end) {
-            // No more work for this thread. This happens if total_items < num_threads
-            continue;
-        }
-
-        // Launch an asynchronous task for each chunk
-        futures.push_back(std::async(std::launch::async,
-            [=, this]() -> std::unordered_map<std::string, int> { // Capture 'this' pointer for splitWord
-            std::unordered_map<std::string, int> local_stats;
-
-            for (auto current_it = chunk_start; current_it != chunk_end; ++current_it) {
-                const std::string& pre_token = current_it->first;
-                const int count = current_it->second;
-
-                if (is_word_for_bpe(pre_token)) {
-                    std::vector<std::string> subwords;
-                    // Ensure this->splitWord is const-correct and thread-safe (read-only access to this->tokens)
-                    this->splitWord(pre_token, subwords);
-                    for (const auto& subword : subwords) {
-                        local_stats[subword] += count;
+    // Divide work into bucket ranges of the map: every range can be reached in O(1)
+    // (unlike std::advance over its iterators) and the ranges are claimed dynamically
+    // by the pool's workers, so uneven buckets balance out.
+    ThreadPool& pool = getThreadPool();
+    const size_t bucket_count = corpus_word_counts.bucket_count();
+    const size_t grain = std::max<size_t>(1, bucket_count / (4 * (pool.size() + 1)));
+    const size_t num_chunks = (bucket_count + grain - 1) / grain;
+    std::vector<std::unordered_map<std::string, int>> chunk_stats(num_chunks);
+
+    pool.parallelFor(0, num_chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+        std::vector<std::string> subwords;
+        for (size_t c = first_chunk; c < last_chunk; ++c) {
+            std::unordered_map<std::string, int>& local_stats = chunk_stats[c];
+            const size_t last_bucket = std::min(bucket_count, (c + 1) * grain);
+
+            for (size_t b = c * grain; b < last_bucket; ++b) {
+                for (auto current_it = corpus_word_counts.begin(b); current_it != corpus_word_counts.end(b); ++current_it) {
+                    const std::string& pre_token = current_it->first;
+                    const int count = current_it->second;
+
+                    if (isWordToken(pre_token)) {
+                        // Ensure this->splitWord is const-correct and thread-safe (read-only access to this->tokens)
+                        this->splitWord(pre_token, subwords);
+                        for (const auto& subword : subwords) {
+                            local_stats[subword] += count;
+                        }
+                    } else {
+                        // It's a non-alphabetic token (punctuation, numbers, etc.)
+                        // These should have been added to the base vocabulary in groupCommonTokens,
+                        // and their counts from corpus_word_counts should be applied directly.
+                        local_stats[pre_token] += count;
                     }
-                } else {
-                    // It's a non-alphabetic token (punctuation, numbers, etc.)
-                    // These should have been added to the base vocabulary in groupCommonTokens,
-                    // and their counts from corpus_word_counts should be applied directly.
-                    local_stats[pre_token] += count;
                 }
             }
-            return local_stats;
-        }));
-    }
+        }
+    });
 
     // Aggregate results from all threads into the main statOfEmbeddings (unordered_map)
-    std::cout << "Aggregating parallel statistics: ";
-    int merge_count = 0;
-    for (auto& f : futures) {
-        merge_count++;
-        std::cout << merge_count << " ";
-        auto local_map = f.get(); // Retrieve the unordered_map from the future
+    std::cout << "Aggregating parallel statistics from " << num_chunks << " chunks..." << std::endl;
+    for (auto& local_map : chunk_stats) {
         for (const auto& pair : local_map) {
             // Merge into global unordered_map. Since statOfTokens is pre-populated,
             // this will either add to an existing count or update a 0 to a non-zero count.
             this->statOfTokens[pair.first] += pair.second;
         }
     }
-    std::cout << std::endl;
     std::cout << "Calculation complete. Found " << this->statOfTokens.size() << " final BPE tokens." << std::endl;
 
     // ******************************************************************************
@@ -114,60 +95,39 @@ void tokeniser::calculateTokenStatsFromCounts(const std::unordered_map<std::stri
     }
     // ******************************************************************************
 
-    if (!outputPath.empty()) {
-        std::cout << "-> Sorting and saving token statistics to: " << outputPath << std::endl;
-
-        // 1. Copy the unordered_map contents to a vector of pairs for sorting.
-        std::vector<std::pair<std::string, int>> sorted_stats(
-            this->statOfTokens.begin(),
-            this->statOfTokens.end()
-        );
+    if (outputPath.empty()) {
+        std::cout << "\nOutput path is empty. Skipped saving statistics file." << std::endl;
+        return 0;
+    }
+    std::cout << "-> Sorting and saving token statistics to: " << outputPath << std::endl;
 
-        // 2. Sort the vector.
-        std::sort(sorted_stats.begin(), sorted_stats.end(),
-            [](const auto& a, const auto& b) {
-                return a.first < b.first; // Explicitly sort by token string (the key)
-            }
-        );
+    // 1. Sort pointers to the entries by token string (the key) instead of copying the map.
+    std::vector<const std::pair<const std::string, int>*> sorted_stats;
+    sorted_stats.reserve(this->statOfTokens.size());
+    for (const auto& pair : this->statOfTokens) {
+        sorted_stats.push_back(&pair);
+    }
+    std::sort(sorted_stats.begin(), sorted_stats.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
 
-        // 3. Write the sorted vector to the file.
-        std::ofstream outFile(outputPath);
-        if (!outFile.is_open()) {
-            std::cerr << "Warning: Could not open file to save token stats: " << outputPath << std::endl;
-            return;
-        }
-        
-        // outFile << "token,repetitions\n";
-        for (const auto& pair : sorted_stats) {
-            const std::string& token = pair.first;
-            // Handle tokens that might contain commas or quotes (CSV escaping)
-            std::string escaped_token;
-            bool needs_quotes = false;
-            for (char c : token) {
-                if (c == '"') {
-                    escaped_token += "\"\""; // Double quotes
-                    needs_quotes = true;
-                }
-                else if (c == ',') {
-                    needs_quotes = true;
-                    escaped_token += c;
-                }
-                else {
-                    escaped_token += c;
-                }
-            }
-            if (needs_quotes) {
-                outFile << "\"" << escaped_token << "\"," << pair.second << "\n";
-            } else {
-                outFile << escaped_token << "," << pair.second << "\n";
-            }
-        }
-        outFile.close();
-        std::cout << "-> Successfully saved sorted statistics file." << std::endl;
+    // 2. Write the sorted rows through the buffered writer.
+    CsvWriter writer(outputPath);
+    if (!writer.isOpen()) {
+        std::cerr << "Warning: Could not open file to save token stats: " << outputPath << std::endl;
+        return 0;
     }
-    else {
-        std::cout << "\nOutput path is empty. Skipped saving statistics file." << std::endl;
+    writer.writeRows(sorted_stats.size(), &getThreadPool(), [&](size_t row, CsvBuffer& out) {
+        out.appendField(sorted_stats[row]->first);      // CSV escaping for tokens with commas or quotes
+        out.append(',');
+        out.appendInt(sorted_stats[row]->second);
+        out.endRow();
+    });
+    const size_t rows = writer.close();
+    if (!writer.good()) {
+        std::cerr << "Warning: Failed while writing token stats: " << outputPath << std::endl;
+        return 0;
     }
+    std::cout << "-> Successfully saved sorted statistics file." << std::endl;
+    return rows;
 }
 
 
@@ -176,18 +136,18 @@ void tokeniser::calculateTokenStatsFromCounts(const std::unordered_map<std::stri
  * The keys from the provided map are used as the tokens.
  * @param corpus_word_counts The map containing all unique tokens as keys.
  * @param outputPath The path where the CSV file will be saved.
+ * @return Number of rows written.
  */
-void tokeniser::saveUniqueTokensToCSV(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath) {
+size_t tokeniser::saveUniqueTokensToCSV(const std::unordered_map<std::string, int>& corpus_word_counts, const std::string& outputPath) {
     if (outputPath.empty()) {
         std::cout << "-> Output path is empty. Skipping saving unique tokens CSV." << std::endl;
-        return;
+        return 0;
     }
 
     std::cout << "-> Saving " << corpus_word_counts.size() << " unique tokens to: " << outputPath << std::endl;
 
-    // Use std::ofstream for modern, safe file handling
-    std::ofstream outFile(outputPath);
-    if (!outFile.is_open()) {
+    CsvWriter writer(outputPath);
+    if (!writer.isOpen()) {
         // Use std::cerr for error messages
         std::cerr << "Error: Could not open file to save unique tokens: " << outputPath << std::endl;
         // It's better to throw an exception if saving is critical, or just return if it's optional.
@@ -197,22 +157,21 @@ void tokeniser::saveUniqueTokensToCSV(const std::unordered_map<std::string, int>
     // Write the CSV header
     // outFile << "token\n";
 
-    // Iterate through the map and write each key (the token) to the file
+    // Every key (the token) is written quoted, so tokens with commas or quotes survive.
+    std::vector<const std::string*> unique_tokens;
+    unique_tokens.reserve(corpus_word_counts.size());
     for (const auto& pair : corpus_word_counts) {
-        const std::string& token = pair.first;
-        // Handle tokens that might contain commas or quotes by enclosing them in double quotes.
-        // First, escape any existing double quotes within the token itself.
-        std::string escaped_token;
-        for (char c : token) {
-            if (c == '"') {
-                escaped_token += "\"\""; // CSV standard for escaping a quote is to double it
-            } else {
-                escaped_token += c;
-            }
-        }
-        outFile << "\"" << escaped_token << "\"\n";
+        unique_tokens.push_back(&pair.first);
+    }
+    writer.writeRows(unique_tokens.size(), &getThreadPool(), [&](size_t row, CsvBuffer& out) {
+        out.appendQuoted(*unique_tokens[row]);
+        out.endRow();
+    });
+
+    const size_t rows = writer.close();
+    if (!writer.good()) {
+        throw std::runtime_error("Failed to write file at: " + outputPath);
     }
-
-    outFile.close();
     std::cout << "-> Successfully saved unique tokens file." << std::endl;
-}
\ No newline at end of file
+    return rows;
+}
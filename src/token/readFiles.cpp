@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include <algorithm>
 #include <cctype>
+#include <atomic>
 #include "include/tokenise.hpp"
 
 
@@ -56,92 +57,13 @@ std::string readCsvField(std::stringstream& ss) {
 
 
 // Function to read an entire CSV file into a 2D vector of floats
-std::vector<std::vector<float>> readCsvTo2DVector(const std::string& filename) {
-    std::vector<std::vector<float>> csvData;
-    std::ifstream file(filename);
-
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        std::cerr << "Check if the file exists and has proper read permissions." << std::endl;
-        return csvData;
-    }
-
-    std::string line;
-    int lineNumber = 0;
-
-    while (std::getline(file, line)) {
-        lineNumber++;
-        if (line.empty()) {
-            continue; // Skip truly empty lines
-        }
-        // Apply global trim to the entire line
-        line = trim(line);
-        if (line.empty()) {
-            continue; // Skip lines that become empty after trimming
-        }
-
-        std::vector<float> row;
-        std::stringstream ss(line);
-
-        // Loop to read fields using the robust readCsvField
-        // Check for success of readCsvField and if there are actual characters processed
-        bool has_more_fields_on_line = true;
-        while (has_more_fields_on_line) {
-            std::string raw_field = readCsvField(ss);
-            // After reading the field, if ss is at EOF and the field is empty, it means we hit end of line (possibly after a trailing comma).
-            // This is a subtle point: readCsvField will consume a trailing comma. If no chars are left after that, it's EOF.
-            // If the last actual field was empty (e.g., "1,2,"), raw_field for the last empty one will be empty.
-            if (raw_field.empty() && ss.eof()) {
-                has_more_fields_on_line = false; // No more actual fields.
-            }
-
-            // Apply trim and removeQuotes to the raw field string before conversion
-            std::string cleaned_field_str = removeQuotes(trim(raw_field));
-
-            float value = 0.0f;
-            // Attempt to convert the string to float
-            try {
-                // If the cleaned_field_str is empty, stof will throw invalid_argument, which is desired.
-                value = std::stof(cleaned_field_str);
-            } catch (const std::invalid_argument& e) {
-                // Conversion failed (e.g., empty string, "abc" to float)
-                // This means the field was empty or non-numeric. Treat as 0.0f.
-                if (!cleaned_field_str.empty()) { // Only warn if it wasn't just an empty field
-                    std::cerr << "Warning: Failed to convert field '" << cleaned_field_str
-                              << "' to float at line " << lineNumber
-                              << " in file " << filename << ". Defaulting to 0.0f." << std::endl;
-                }
-                value = 0.0f;
-            } catch (const std::out_of_range& e) {
-                std::cerr << "Warning: Float out of range '" << cleaned_field_str
-                          << "' at line " << lineNumber
-                          << " in file " << filename << ". Defaulting to 0.0f." << std::endl;
-                value = 0.0f;
-            }
-            row.push_back(value);
-
-            // Check if there are more fields to read in the current line.
-            // If ss.peek() returns EOF or fails, or if it's not a comma, we are at the end of fields for this line.
-            if (ss.peek() == EOF && !ss.good()) {
-                has_more_fields_on_line = false;
-            }
-        } // End of while(has_more_fields_on_line)
-
-        // Add row only if it's not empty (e.g., not just an empty line that resulted in no fields)
-        if (!row.empty() || line.find(',') != std::string::npos) { // Add row even if empty but it indicates fields (e.g. "a,,c")
-            csvData.push_back(row);
-        }
-    }
-
-    file.close();
-    if (csvData.empty()) {
-        std::cerr << "Warning: No data found in file " << filename << std::endl;
-    }
-    else {
-        std::cout << "Successfully read " << csvData.size()
-                  << " rows from file " << filename << std::endl;
+// (built on readCsvFloatMatrix; prefer that for large files, it keeps one contiguous buffer)
+std::vector<std::vector<float>> readCsvTo2DVector(const std::string& filename, ThreadPool* pool) {
+    const CsvFloatMatrix matrix = readCsvFloatMatrix(filename, pool);
+    std::vector<std::vector<float>> csvData(matrix.rows);
+    for (size_t r = 0; r < matrix.rows; ++r) {
+        csvData[r].assign(matrix.row(r), matrix.row(r) + matrix.cols);
     }
-
     return csvData;
 }
 
@@ -276,74 +198,53 @@ std::vector<std::string> readSpecificColumnFromCsv(const std::string& filename,
 }
 
 
-// Function to read a CSV with "word,count" format into an unordered_map<string, int>
-std::unordered_map<std::string, int> readUnorderedMap(const std::string& filename) {
+// Function to read a CSV with "word,count" format into an unordered_map<string, int>.
+// Record-aligned chunks of the mapped file are parsed in parallel and inserted in file
+// order, so a later duplicate still replaces an earlier one.
+std::unordered_map<std::string, int> readUnorderedMap(const std::string& filename, ThreadPool* pool) {
     std::unordered_map<std::string, int> corpusWordCount;
-    std::ifstream file(filename);
-
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        std::cerr << "Check if the file exists and has proper read permissions." << std::endl;
+    MappedFile file;
+    std::vector<std::string_view> chunks;
+    if (!openCsvChunks(filename, file, chunks, pool)) {
         return corpusWordCount;
     }
 
-    std::string line;
-    int lineNumber = 0;
-    int successfullyParsed = 0;
-    bool headerSkipped = false; // Keep this for potential future use or if some files truly have headers
-
-    while (std::getline(file, line)) {
-        lineNumber++;
-
-        if (line.empty()) {
-            continue;
-        }
-
-        line = trim(line);
-        if (line.empty()) {
-            continue;
-        }
-
-        // Removed header skip logic here, as per previous discussion it was commented out in user's code.
-        // If your files legitimately have headers, uncomment this AND ensure it correctly identifies them.
-        /*if (!headerSkipped && isHeaderLine(line)) {
-            headerSkipped = true;
-            std::cout << "Skipping header line: " << line << std::endl;
-            continue;
-        }*/
-
-        std::stringstream ss(line);
-        
-        // Read the token field using the robust helper
-        std::string raw_token_field = readCsvField(ss);
-        std::string token = removeQuotes(trim(raw_token_field));
-
-        // Read the count field using the robust helper
-        std::string raw_count_field = readCsvField(ss);
-        std::string count_str_cleaned = removeQuotes(trim(raw_count_field));
-
-        // Attempt to convert to integer
-        try {
-            // std::stoi is quite robust for numeric strings, including leading/trailing spaces
-            // and signs. It stops at the first non-numeric character.
-            int count = std::stoi(count_str_cleaned);
-            corpusWordCount[token] = count; // Allow empty string as a key if it comes from data
-            successfullyParsed++;
-        } catch (const std::invalid_argument& e) {
-            if (!count_str_cleaned.empty() && count_str_cleaned.find_first_not_of(" \t\r\n") != std::string::npos) { // Only warn if it wasn't just empty/whitespace
-                std::cerr << "Warning: Invalid integer format for count '"
-                          << raw_count_field << "' (cleaned to '" << count_str_cleaned << "') in line " << lineNumber
-                          << " of file " << filename << ": " << e.what() << ". Skipping entry." << std::endl;
+    // Keys are built on the workers; the sequential part only moves them into the map.
+    std::vector<std::vector<std::pair<std::string, int>>> parsed(chunks.size());
+    std::atomic<size_t> invalid_rows{0};
+    auto parse_chunks = [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            CsvRecordCursor cursor(chunks[c]);
+            std::string_view token, count_field;
+            while (cursor.nextRecord()) {
+                if (!cursor.nextField(token)) continue;
+                std::string key(token);     // the view may point into the cursor's scratch buffer
+                int count = 0;
+                if (!cursor.nextField(count_field) || !parseCsvInt(count_field, count)) {
+                    invalid_rows.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                parsed[c].emplace_back(std::move(key), count);
             }
-        } catch (const std::out_of_range& e) {
-            std::cerr << "Warning: Count out of range '"
-                      << raw_count_field << "' (cleaned to '" << count_str_cleaned << "') in line " << lineNumber
-                      << " of file " << filename << ": " << e.what() << ". Skipping entry." << std::endl;
         }
+    };
+    if (pool != nullptr && chunks.size() > 1) pool->parallelFor(0, chunks.size(), 1, parse_chunks);
+    else parse_chunks(0, chunks.size());
+
+    size_t successfullyParsed = 0;
+    for (const auto& rows : parsed) successfullyParsed += rows.size();
+    corpusWordCount.reserve(successfullyParsed);
+    for (auto& rows : parsed) {
+        for (auto& [token, count] : rows) {
+            corpusWordCount.insert_or_assign(std::move(token), count);   // Allow empty string as a key if it comes from data
+        }
+        std::vector<std::pair<std::string, int>>().swap(rows);
     }
 
-    file.close();
-
+    if (invalid_rows.load() > 0) {
+        std::cerr << "Warning: Skipped " << invalid_rows.load() << " rows without a valid integer count in file "
+                  << filename << "." << std::endl;
+    }
     if (corpusWordCount.empty()) {
         std::cerr << "Warning: No valid word-count pairs found in file " << filename << std::endl;
     } else {
@@ -355,118 +256,65 @@ std::unordered_map<std::string, int> readUnorderedMap(const std::string& filenam
 }
 
 
-// Function to read a CSV with "word,float1,float2,..." format into an unordered_map<string, vector<float>>
-std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const std::string& filename) {
+// Function to read a CSV with "word,float1,float2,..." format into an unordered_map<string, vector<float>>.
+// Chunks are parsed in parallel like readUnorderedMap; empty intermediate fields are read as
+// 0.0f, and a line with a field that is not a number is skipped.
+std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const std::string& filename, ThreadPool* pool) {
     std::unordered_map<std::string, std::vector<float>> mappedEmbeddings;
-    std::ifstream file(filename);
-
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        std::cerr << "Check if the file exists and has proper read permissions." << std::endl;
+    MappedFile file;
+    std::vector<std::string_view> chunks;
+    if (!openCsvChunks(filename, file, chunks, pool)) {
         return mappedEmbeddings;
     }
 
-    std::string line;
-    int lineNumber = 0;
-    int successfullyParsed = 0;
-    // int expectedEmbeddingSize = -1; // Not strictly needed here, 'd' is set in Tokenizer after loading
-
-    while (std::getline(file, line)) {
-        lineNumber++;
-
-        if (line.empty()) {
-            continue;
-        }
-
-        line = trim(line);
-
-        if (line.empty()) {
-            continue;
-        }
-
-        std::stringstream ss(line);
-        std::string raw_token_field = readCsvField(ss);
-        std::string word_str = removeQuotes(trim(raw_token_field));
-
-
-        if (word_str.empty()) {
-            if (lineNumber <= 10) { // Limit warnings
-                std::cerr << "Warning: Empty token string in line " << lineNumber
-                          << " of file " << filename << ". Skipping embedding for this line." << std::endl;
-            }
-            continue;
-        }
-        
-        std::vector<float> embeddings_vector;
-        bool parseError = false;
-        
-        // Extract the rest of the floats, handling potential consecutive commas (empty segments).
-        bool has_more_fields_on_line = true;
-        while (has_more_fields_on_line) {
-            std::string raw_segment = readCsvField(ss);
-
-            if (raw_segment.empty() && ss.eof()) { // Check for empty field at end of line
-                 has_more_fields_on_line = false;
-                 // If the last field was truly empty and there was a comma before it, we still want to add a 0.0f.
-                 // Otherwise, if it was the end of the line, break.
-                 if (line.back() == ',') { // Check if the original line ended with a comma
-                     embeddings_vector.push_back(0.0f); // Treat trailing empty field as 0.0f
-                 }
-                 break;
-            }
-            if (raw_segment.empty() && ss.peek() == ',') { // Empty field followed by a comma (,,)
-                embeddings_vector.push_back(0.0f); // Treat empty intermediate field as 0.0f
-                ss.get(); // Consume the comma
-                continue; // Continue to next field
-            }
-            
-            std::string segment = trim(removeQuotes(raw_segment));
-
-            try {
-                float value = std::stof(segment);
-                embeddings_vector.push_back(value);
-            } catch (const std::invalid_argument& e) {
-                if (!segment.empty()) { // Only warn if it wasn't just an empty field
-                    if (lineNumber <= 5) {
-                        std::cerr << "Warning: Invalid float format '" << raw_segment
-                                  << "' (cleaned to '" << segment << "') for word '" << word_str << "' in line " << lineNumber
-                                  << " of file " << filename << ": " << e.what() << ". Skipping line." << std::endl;
+    std::vector<std::vector<std::pair<std::string, std::vector<float>>>> parsed(chunks.size());
+    std::atomic<size_t> skipped_rows{0};
+    auto parse_chunks = [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            CsvRecordCursor cursor(chunks[c]);
+            std::string_view field;
+            while (cursor.nextRecord()) {
+                if (!cursor.nextField(field) || field.empty()) {
+                    skipped_rows.fetch_add(1, std::memory_order_relaxed);     // empty token string
+                    continue;
+                }
+                std::string word(field);
+                std::vector<float> embeddings_vector;
+                bool parseError = false;
+                while (cursor.nextField(field)) {
+                    float value = 0.0f;
+                    if (!field.empty() && !parseCsvFloat(field, value)) {
+                        parseError = true;
+                        break;
                     }
+                    embeddings_vector.push_back(value);
                 }
-                parseError = true;
-                break;
-            } catch (const std::out_of_range& e) {
-                if (lineNumber <= 5) {
-                    std::cerr << "Warning: Float out of range '" << raw_segment
-                              << "' (cleaned to '" << segment << "') for word '" << word_str << "' in line " << lineNumber
-                              << " of file " << filename << ": " << e.what() << ". Skipping line." << std::endl;
+                // Only keep lines that parsed cleanly and have at least some embeddings
+                if (parseError || embeddings_vector.empty()) {
+                    skipped_rows.fetch_add(1, std::memory_order_relaxed);
+                    continue;
                 }
-                parseError = true;
-                break;
-            }
-            // Check if there are more fields to read (after consuming current field and its comma)
-            if (ss.peek() == EOF && !ss.good()) {
-                has_more_fields_on_line = false;
+                parsed[c].emplace_back(std::move(word), std::move(embeddings_vector));
             }
-        } // End of while(has_more_fields_on_line)
-
-        if (parseError) {
-            continue;
         }
-
-        // Only add to map if we got at least some embeddings
-        if (!embeddings_vector.empty()) {
-            mappedEmbeddings[word_str] = embeddings_vector;
-            successfullyParsed++;
-        } else {
-            if (lineNumber <= 10) {
-                std::cerr << "Warning: No embeddings found for token '" << word_str << "' in line " << lineNumber << ". Skipping." << std::endl;
-            }
+    };
+    if (pool != nullptr && chunks.size() > 1) pool->parallelFor(0, chunks.size(), 1, parse_chunks);
+    else parse_chunks(0, chunks.size());
+
+    size_t successfullyParsed = 0;
+    for (const auto& rows : parsed) successfullyParsed += rows.size();
+    mappedEmbeddings.reserve(successfullyParsed);
+    for (auto& rows : parsed) {
+        for (auto& [word, embedding] : rows) {
+            mappedEmbeddings.insert_or_assign(std::move(word), std::move(embedding));
         }
+        std::vector<std::pair<std::string, std::vector<float>>>().swap(rows);
     }
 
-    file.close();
-
+    if (skipped_rows.load() > 0) {
+        std::cerr << "Warning: Skipped " << skipped_rows.load() << " lines with an empty token or invalid floats in file "
+                  << filename << "." << std::endl;
+    }
     if (mappedEmbeddings.empty()) {
         std::cerr << "Warning: No valid word-embedding pairs found in file " << filename << std::endl;
     } else {
@@ -478,8 +326,109 @@ std::unordered_map<std::string, std::vector<float>> readMappedEmbeddings(const s
 }
 
 
+/**
+ * @brief Reads the "id,token" vocabulary written by `saveVocabulary` into `tokens`.
+ * Every id from 0 to n-1 must appear exactly once, so the canonical ids of the
+ * trained model are restored unchanged.
+ * @param filename Path of the vocabulary CSV file.
+ * @return `true` if the vocabulary was loaded; `false` (with `tokens` untouched) otherwise.
+ */
+bool tokeniser::readVocabulary(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<std::string> vocab;
+    std::vector<bool> seen;
+    size_t record = 0;
+    CsvRecordCursor cursor(file.view());
+    std::string_view id_field, token;
+    while (cursor.nextRecord()) {
+        record++;
+        if (!cursor.nextField(id_field)) continue;
+        if (record == 1 && id_field == "id") continue;      // header
+        if (!cursor.nextField(token)) token = std::string_view();
+
+        int id = -1;
+        // Every record takes at least two bytes, so an id beyond the file size cannot be valid.
+        if (!parseCsvInt(id_field, id) || id < 0 || static_cast<size_t>(id) >= file.size()) {
+            std::cerr << "Error: Invalid id '" << id_field << "' in record " << record << " of " << filename << std::endl;
+            return false;
+        }
+        if (static_cast<size_t>(id) >= vocab.size()) {
+            vocab.resize(id + 1);
+            seen.resize(id + 1, false);
+        }
+        if (seen[id]) {
+            std::cerr << "Error: Duplicate id " << id << " in record " << record << " of " << filename << std::endl;
+            return false;
+        }
+        vocab[id] = std::string(token);
+        seen[id] = true;
+    }
+
+    for (size_t id = 0; id < seen.size(); ++id) {
+        if (!seen[id]) {
+            std::cerr << "Error: Id " << id << " is missing from " << filename << std::endl;
+            return false;
+        }
+    }
+
+    this->tokens = std::move(vocab);
+    std::cout << "Successfully read " << this->tokens.size() << " vocabulary entries from file " << filename << std::endl;
+    return true;
+}
+
+
+/**
+ * @brief Reads the "rank,left,right,merged" merges written by `saveMerges` into `merges`.
+ * Ranks must run from 0 to n-1 in order and every id must be in the current vocabulary,
+ * so the vocabulary has to be read first. The merge-rank table is rebuilt on success.
+ * @param filename Path of the merges CSV file.
+ * @return `true` if the merges were loaded; `false` (with `merges` untouched) otherwise.
+ */
+bool tokeniser::readMerges(const std::string& filename) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<TokenMerge> loaded;
+    size_t record = 0;
+    CsvRecordCursor cursor(file.view());
+    std::string_view field;
+    while (cursor.nextRecord()) {
+        record++;
+        if (!cursor.nextField(field)) continue;
+        if (record == 1 && field == "rank") continue;       // header
+
+        int values[4] = { -1, -1, -1, -1 };
+        bool valid = parseCsvInt(field, values[0]) && values[0] == static_cast<int>(loaded.size());
+        for (int k = 1; k < 4 && valid; ++k) {
+            valid = cursor.nextField(field) && parseCsvInt(field, values[k])
+                 && values[k] >= 0 && static_cast<size_t>(values[k]) < this->tokens.size();
+        }
+        if (!valid) {
+            std::cerr << "Error: Invalid merge in record " << record << " of " << filename << std::endl;
+            return false;
+        }
+        loaded.push_back({ values[1], values[2], values[3] });
+    }
+
+    this->merges = std::move(loaded);
+    buildMergeRanks();
+    std::cout << "Successfully read " << this->merges.size() << " merges from file " << filename << std::endl;
+    return true;
+}
+
+
 // Your tokeniser::readFromFiles method remains largely the same,
 // as it calls the updated readUnorderedMap and readMappedEmbeddings functions.
+// The CSV files are parsed on the thread pool. The path constructor runs this before the
+// caller can call setNumThreads, so it loads with the default pool of one worker.
 void tokeniser::readFromFiles(const std::string& path2ClassDataFolder) {
     // 1. Load the token counts (which contain the vocabulary keys)
     // Assuming statOfTokens.csv is where your trained token counts are saved by calculateTokenStatsFromCounts.
@@ -490,68 +439,63 @@ void tokeniser::readFromFiles(const std::string& path2ClassDataFolder) {
         std::cerr << "Error: Token statistics file not found at " << token_stats_file << std::endl;
         throw std::runtime_error("Required token statistics file missing. Ensure training created '_final_token_stats.csv' in the specified path.");
     }
-    this->statOfTokens = readUnorderedMap(token_stats_file);
-/*
-
-    // 2. Load the mapped embeddings (token -> vector<float>)
-    std::string tokenembeddings_file = path2ClassDataFolder + "/_tokenEmbedding.csv";
-    if (!std::filesystem::exists(tokenembeddings_file)) {
-        std::cerr << "Error: Token embeddings file not found at " << tokenembeddings_file << std::endl;
-        throw std::runtime_error("Required token embeddings file missing. Ensure training created '_tokenEmbedding.csv' in the specified path.");
-    }
-    this->mappedEmbeddings = readMappedEmbeddings(tokenembeddings_file);
+    this->statOfTokens = readUnorderedMap(token_stats_file, &getThreadPool());
 
-*/
     // --- CRITICAL STEP: Populate 'this->tokens' from the loaded vocabulary AND then 'this->embeddings' ---
     this->tokens.clear(); // Ensure it's empty before populating
     this->embeddings.clear(); // Clear existing embeddings
-    this->embeddings.reserve(this->statOfTokens.size()); // Pre-allocate space
-
-    // Sort the tokens from statOfTokens to ensure a consistent order for `this->tokens`
-    // (and thus for the `embeddings` vector if you populate it in the same order).
-    // This is crucial for `splitWord`'s longest-match logic.
-    std::vector<std::string> sorted_tokens_from_stats;
-    for (const auto& pair : this->statOfTokens) {
-        sorted_tokens_from_stats.push_back(pair.first);
-    }
-    std::sort(sorted_tokens_from_stats.begin(), sorted_tokens_from_stats.end(),
-        [](const std::string& a, const std::string& b) {
-            if (a.length() != b.length()) {
-                return a.length() > b.length(); // Longer tokens first
-            }
-            return a < b; // Alphabetical for tie-breaking
+    this->deEmbeddings.clear();
+    embeddingsChanged();
+
+    // Token ids come from `_vocab.csv` when it exists, so they match the ids used in training
+    // (and the row order of the saved embeddings).
+    const std::string vocab_file = path2ClassDataFolder + "/_vocab.csv";
+    const bool loaded_vocabulary = std::filesystem::exists(vocab_file) && readVocabulary(vocab_file);
+    if (!loaded_vocabulary) {
+        // Older models have no vocabulary file: derive a deterministic order from statOfTokens
+        // (longer tokens first, alphabetical for tie-breaking).
+        std::cerr << "Warning: No usable vocabulary file at " << vocab_file
+                  << ". Token ids are derived from the token statistics instead." << std::endl;
+        std::vector<std::string> sorted_tokens_from_stats;
+        for (const auto& pair : this->statOfTokens) {
+            sorted_tokens_from_stats.push_back(pair.first);
         }
-    );
-    this->tokens = sorted_tokens_from_stats; // Populate `this->tokens` with the sorted list
-
-    // Now populate 'this->embeddings' and 'this->deEmbeddings' based on `this->tokens` and `this->mappedEmbeddings`
-    this->d = 0; // Initialize embedding dimension
-    if (!this->mappedEmbeddings.empty()) {
-        this->d = this->mappedEmbeddings.begin()->second.size(); // Set 'd' based on the first loaded embedding
+        std::sort(sorted_tokens_from_stats.begin(), sorted_tokens_from_stats.end(),
+            [](const std::string& a, const std::string& b) {
+                if (a.length() != b.length()) {
+                    return a.length() > b.length(); // Longer tokens first
+                }
+                return a < b; // Alphabetical for tie-breaking
+            }
+        );
+        this->tokens = sorted_tokens_from_stats; // Populate `this->tokens` with the sorted list
+    }
+    buildPrefixIndex();
+
+    // The merges (for EncoderMode::MergeRank) are only meaningful with the saved ids.
+    this->merges.clear();
+    buildMergeRanks();
+    const std::string merges_file = path2ClassDataFolder + "/_merges.csv";
+    if (loaded_vocabulary && std::filesystem::exists(merges_file)) {
+        readMerges(merges_file);
     }
-/*
 
-    for (const auto& token_str : this->tokens) {
-        auto it = this->mappedEmbeddings.find(token_str);
-        if (it != this->mappedEmbeddings.end()) {
-            this->embeddings.push_back(it->second);
+    // 2. Load the embeddings: row i of `_embeddings_only.csv` belongs to token id i.
+    this->d = 0; // Initialize embedding dimension
+    const std::string embeddings_file = path2ClassDataFolder + "/_embeddings_only.csv";
+    if (std::filesystem::exists(embeddings_file)) {
+        const CsvFloatMatrix loaded = readCsvFloatMatrix(embeddings_file, &getThreadPool());
+        if (loaded.rows == this->tokens.size() && loaded.cols > 0) {
+            this->embeddings.assign(loaded.rows, loaded.cols, loaded.values.data());
+            embeddingsChanged();
+            this->d = static_cast<int>(loaded.cols); // Set 'd' based on the loaded embeddings
         }
-        else {
-            // This warning will trigger if a token in _final_token_stats.csv is not in _tokenEmbedding.csv
-            // The original warning for '"' means your BPE process likely produced a token that was not embedded.
-            std::cerr << "Warning: Token '" << token_str << "' from '_final_token_stats.csv' missing embedding in '_tokenEmbedding.csv'. Adding zero vector." << std::endl;
-            this->embeddings.push_back(std::vector<float>(this->d, 0.0f)); // Provide a zero vector as a fallback
+        else if (loaded.rows > 0) {
+            std::cerr << "Warning: " << embeddings_file << " has " << loaded.rows << " rows but the vocabulary has "
+                      << this->tokens.size() << " tokens. Embeddings were not loaded." << std::endl;
         }
     }
 
-    // Similarly for deEmbeddings if applicable
-    this->deEmbeddings.clear();
-    this->deEmbeddings.reserve(this->embeddings.size()); // Reserve space
-    for (const auto& embedding_vec : this->embeddings) {
-        this->deEmbeddings.push_back(vectorInverse(embedding_vec));
-    }
-
-*/
     // Update vocabulary size based on loaded data
     this->vocSize = this->tokens.size();
 
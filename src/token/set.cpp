@@ -3,6 +3,10 @@
 #include <algorithm>
 #include <iterator>
 #include <thread>
+#include <mutex>
+
+// Serialises creation of the tokenisers' thread pools.
+static std::mutex pool_mutex;
 
 /**
  * @brief set dimension of embedding
@@ -22,38 +26,127 @@ void tokeniser::setVocabularySize(int vocSize) {
     this->vocSize = vocSize;
 }
 
+/**
+ * @brief Rebuilds the prefix index used by splitWord from the current tokens.
+ * Must be called whenever `tokens` is replaced; the index stores positions
+ * into `tokens`, so it is only valid for the vector it was built from.
+ */
+void tokeniser::buildPrefixIndex() {
+    this->prefixIndex.build(this->tokens);
+    // Cached id sequences refer to the old tokens; start a fresh cache (copies keep theirs).
+    this->wordCache = this->encodeCacheCapacity > 0 ? std::make_shared<WordIdCache>(this->encodeCacheCapacity) : nullptr;
+}
+
+/**
+ * @brief Sets how many words the encode cache keeps and empties it.
+ * @param words Capacity in words (per generation); 0 disables the cache.
+ */
+void tokeniser::setEncodeCacheCapacity(size_t words) {
+    this->encodeCacheCapacity = words;
+    this->wordCache = words > 0 ? std::make_shared<WordIdCache>(words) : nullptr;
+}
+
+/**
+ * @brief Enables training checkpoints (see checkpoint.hpp).
+ * `train` then saves the corpus word counts and the BPE state in `directory`, and resumes
+ * from them when they exist: counting is skipped and merging continues after the last
+ * saved merge. Training again with more merges continues an already finished vocabulary.
+ * @param directory Directory of the checkpoint files (created if needed); empty disables checkpoints.
+ * @param mergeInterval Merges between BPE checkpoints; 0 saves the BPE state only when merging ends.
+ */
+void tokeniser::setCheckpointing(const std::string& directory, int mergeInterval) {
+    this->checkpointDirectory = directory;
+    this->checkpointInterval = mergeInterval > 0 ? mergeInterval : 0;
+}
+
+/**
+ * @brief Sets the pre-filters applied to the corpus words before BPE (see CorpusFilter).
+ * A minCount below 1 is treated as 1 and a sketch depth of 0 as 1.
+ */
+void tokeniser::setCorpusFilter(const CorpusFilter& filter) {
+    this->corpusFilter = filter;
+    this->corpusFilter.minCount = std::max(filter.minCount, 1);
+    this->corpusFilter.sketchDepth = std::max<size_t>(filter.sketchDepth, 1);
+}
+
+/**
+ * @brief Selects the base alphabet used to count, train and encode (see BaseAlphabet) and
+ * empties the encode cache. Set it before training; a model keeps the alphabet it was
+ * trained with in `_model.bin` (loadModel restores it), while readFromFiles uses the
+ * alphabet set here.
+ */
+void tokeniser::setBaseAlphabet(BaseAlphabet alphabet) {
+    this->baseAlphabet = alphabet;
+    setEncodeCacheCapacity(this->encodeCacheCapacity);
+}
+
+/**
+ * @brief Selects how words are split into token ids (see EncoderMode) and empties the
+ * encode cache, whose entries were produced by the previous mode.
+ * MergeRank without learned merges leaves every word as single characters and "</w>".
+ */
+void tokeniser::setEncoderMode(EncoderMode mode) {
+    this->encoderMode = mode;
+    setEncodeCacheCapacity(this->encodeCacheCapacity);
+}
+
+/**
+ * @brief Rebuilds the pair -> rank table used by the MergeRank encoder from `merges`.
+ * Must be called whenever `merges` is replaced; the encode cache is emptied as well.
+ */
+void tokeniser::buildMergeRanks() {
+    this->mergeRanks.build(this->merges);
+    setEncodeCacheCapacity(this->encodeCacheCapacity);
+}
+
 void tokeniser::setNumThreads()
 {
-    num_threads = std::thread::hardware_concurrency();
+    setNumThreads(static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+/**
+ * @brief Sets the number of worker threads and (re)creates the shared thread pool.
+ * @param threads Number of threads; values below 1 are treated as 1.
+ */
+void tokeniser::setNumThreads(int threads)
+{
+    num_threads = threads > 0 ? threads : 1;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!pool || pool->size() != static_cast<size_t>(num_threads)) {
+        pool = std::make_shared<ThreadPool>(num_threads);
+    }
+}
+
+/**
+ * @brief Returns the thread pool used by every parallel stage.
+ * The pool is created on first use and recreated if `num_threads` was changed directly,
+ * so that it always has `num_threads` workers (at least one; a tokeniser that never called
+ * setNumThreads uses one). Copies of a tokeniser share the pool.
+ */
+ThreadPool& tokeniser::getThreadPool() const
+{
+    const size_t wanted = static_cast<size_t>(std::max(num_threads, 1));
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!pool || pool->size() != wanted) {
+        pool = std::make_shared<ThreadPool>(wanted);
+    }
+    return *pool;
 }
 
 
 /**
  * @brief Sets the embedding for a given token.
- * This function searches for the specified token within the `tokens` vector.
- * If found, it updates the corresponding embedding in the `embeddings` vector
- * and also updates the `mappedEmbeddings` map to keep it in sync.
+ * The token's id is its row in the `embeddings` matrix, so the row is overwritten in place.
  * @param token The string token whose embedding is to be set.
- * @param embedding The vector representing the embedding for the token.
+ * @param embedding The new embedding; must have `d` values, otherwise nothing is changed.
  */
-void tokeniser::setEmbedding(const std::string& token, std::vector<float> embedding) {
-    // Using the map for lookup is much more efficient (O(log N)) than a linear scan.
-    auto map_it = mappedEmbeddings.find(token);
-    if (map_it != mappedEmbeddings.end()) {
-        // The token exists in the map. Now find it in the vector to update the parallel `embeddings` vector.
-        // This highlights the fragility of the parallel vector design.
-        // A linear search is still required here to find the index for the `embeddings` vector.
-        auto it = std::find(tokens.begin(), tokens.end(), token);
-
-        if (it != tokens.end()) {
-            auto index = std::distance(tokens.begin(), it);
-
-            // Update the map first with a copy of the embedding.
-            map_it->second = embedding;
-            // Then move the embedding into the vector to avoid a second copy.
-            embeddings[index] = std::move(embedding);
-        }
+void tokeniser::setEmbedding(const std::string& token, std::span<const float> embedding) {
+    const int32_t id = tokenToId(token);
+    if (id < 0 || static_cast<size_t>(id) >= embeddings.rows() || embedding.size() != embeddings.cols()) {
+        return;
     }
+    std::copy(embedding.begin(), embedding.end(), embeddings.row(id).begin());
+    embeddingsChanged();
     // Note: This function doesn't handle adding a *new* token, only updating an existing one.
 }
 
@@ -61,13 +154,13 @@ void tokeniser::setEmbedding(const std::string& token, std::vector<float> embedd
 /**
  * @brief Gets the embedding for a given token.
  * @param token The token to look up.
- * @return The embedding vector for the token. Returns an empty vector if not found.
+ * @return A view of the token's row in the embedding matrix (empty if not found).
+ * The view is valid until the embeddings are regenerated or reloaded.
  */
-std::vector<float> tokeniser::getEmbeddingForToken(const std::string& token) const {
-    auto it = std::find(tokens.begin(), tokens.end(), token);
-    if (it != tokens.end()) {
-        auto index = std::distance(tokens.begin(), it);
-        return embeddings[index];
+std::span<const float> tokeniser::getEmbeddingForToken(std::string_view token) const {
+    const int32_t id = tokenToId(token);
+    if (id >= 0 && static_cast<size_t>(id) < embeddings.rows()) {
+        return embeddings.row(id);
     }
-    return {}; // Return empty vector if not found
-}
\ No newline at end of file
+    return {}; // Return empty span if not found
+}
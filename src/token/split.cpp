@@ -3,7 +3,6 @@
 #include <future>
 #include <fstream>
 #include <sstream>
-#include <regex>
 #include <map>
 #include <algorithm>
 #include <iostream>
@@ -17,9 +16,9 @@
 
 /**
  * @brief Pre-tokenizes a single word based on common patterns like camelCase or PascalCase.
- * This version uses a fast, manual character-by-character scan instead of std::regex,
- * which significantly improves performance in multithreaded contexts by avoiding
- * repeated regex compilation and execution overhead.
+ * The word is classified into letter/upper-case bitmaps 64 bytes at a time and the
+ * split points are derived from the masks (see `AsciiMasks::camelCaseSplits`), which
+ * avoids both std::regex and per-character, locale-dependent classification calls.
  * It splits words at transitions from lowercase to uppercase letters, and also handles acronyms
  * like in "MyHTTPRequest" -> "My", "HTTP", "Request".
  * Note: This heuristic will not split already-lowercased concatenated words like
@@ -32,28 +31,18 @@ std::vector<std::string_view> pre_split_word(std::string_view word) {
         return {};
     }
 
+    thread_local AsciiMasks masks;
+    thread_local std::vector<size_t> splits;
+    masks.classify(word);
+    splits.clear();
+    masks.camelCaseSplits(0, word.length(), splits);
+
     std::vector<std::string_view> subtokens;
+    subtokens.reserve(splits.size() + 1);
     size_t start = 0;
-
-    for (size_t i = 1; i < word.length(); ++i) {
-        bool split = false;
-        const unsigned char prev_char = word[i-1];
-        const unsigned char curr_char = word[i];
-
-        // Condition 1: Lower to Upper (e.g., "camel|Case")
-        if (std::islower(prev_char) && std::isupper(curr_char)) {
-            split = true;
-        }
-        // Condition 2: Acronym to Word (e.g., "HTTP|Request")
-        // This detects a transition from an uppercase sequence to a new capitalized word.
-        else if (i + 1 < word.length() && std::isupper(prev_char) && std::isupper(curr_char) && std::islower(static_cast<unsigned char>(word[i+1]))) {
-            split = true;
-        }
-
-        if (split) {
-            subtokens.emplace_back(word.substr(start, i - start));
-            start = i;
-        }
+    for (const size_t split : splits) {
+        subtokens.emplace_back(word.substr(start, split - start));
+        start = split;
     }
 
     // Add the last or only token.
@@ -65,7 +54,11 @@ std::vector<std::string_view> pre_split_word(std::string_view word) {
 /**
  * @brief Splits a single word into a sequence of subword tokens using the learned vocabulary.
  * This function implements the tokenization of a single word by greedily matching the
- * longest possible tokens from the vocabulary.
+ * longest possible tokens from the vocabulary. Matching goes through the compiled
+ * prefix index, so each step costs O(token length) instead of a scan over the whole
+ * vocabulary, and the end-of-word marker is matched as a virtual suffix without
+ * building a concatenated copy of the word. In EncoderMode::MergeRank the pieces are
+ * the tokens of `mergeWordIds` instead.
  * @param word The word to be tokenized.
  * @param subwords Output vector to store the resulting subword tokens.
  */
@@ -74,25 +67,46 @@ void tokeniser::splitWord(const std::string& word, std::vector<std::string>& sub
     if (word.empty()) return;
 
     // Add end-of-word token to handle word boundaries correctly
-    std::string current_word = word + "</w>";
-    
-    while (!current_word.empty()) {
-        bool found_match = false;
-        // Greedily find the longest token in our vocabulary that is a prefix of the current word.
-        // This requires the vocabulary `this->tokens` to be sorted by length, descending.
-        for (const auto& token : this->tokens) {
-            if (current_word.rfind(token, 0) == 0) { // check if string starts with token
-                subwords.push_back(token);
-                current_word = current_word.substr(token.length());
-                found_match = true;
-                break;
+    static constexpr std::string_view end_of_word = "</w>";
+    const std::string_view word_view(word);
+    const size_t total_length = word_view.length() + end_of_word.length();
+
+    if (this->encoderMode == EncoderMode::MergeRank) {
+        // Unknown characters stay single symbols, so the ids walk the word piece by piece.
+        thread_local std::vector<int32_t> ids;
+        ids.clear();
+        mergeWordIds(word_view, ids);
+        size_t pos = 0;
+        for (const int32_t id : ids) {
+            if (id >= 0) {
+                subwords.push_back(this->tokens[id]);
+                pos += this->tokens[id].size();
+            }
+            else {
+                subwords.emplace_back(1, pos < word_view.length() ? word_view[pos] : end_of_word[pos - word_view.length()]);
+                pos += 1;
             }
         }
-        if (!found_match) {
+        return;
+    }
+
+    size_t pos = 0;
+    while (pos < total_length) {
+        // The remaining input is word_view[pos..] followed by the (rest of the) marker.
+        const std::string_view head = pos < word_view.length() ? word_view.substr(pos) : std::string_view();
+        const std::string_view tail = pos < word_view.length() ? end_of_word : end_of_word.substr(pos - word_view.length());
+
+        size_t match_length = 0;
+        const int token_index = this->prefixIndex.longestPrefix(head, tail, match_length);
+        if (token_index >= 0) {
+            subwords.push_back(this->tokens[token_index]);
+            pos += match_length;
+        }
+        else {
             // Fallback for unknown characters. This should not happen if the initial
             // vocabulary includes all single characters from the training corpus.
-            subwords.push_back(current_word.substr(0, 1));
-            current_word = current_word.substr(1);
+            subwords.emplace_back(1, head.empty() ? tail[0] : head[0]);
+            pos += 1;
         }
     }
 }
@@ -100,35 +114,27 @@ void tokeniser::splitWord(const std::string& word, std::vector<std::string>& sub
 
 /**
  * @brief Tokenizes a full sentence into a sequence of subword tokens.
- * This function splits a sentence into words and punctuation, then tokenizes
- * each word using the `splitWord` method.
+ * The sentence is pre-tokenized exactly as the training corpus was (the pre-tokenizer of
+ * the base alphabet: lower-cased camelCase pieces of letter runs, and single
+ * punctuation/symbol characters, skipping whitespace), then each word is tokenized with `splitWord`.
  * @param sentence The input sentence string.
  * @param all_subwords Output vector to store the final sequence of tokens.
  */
 void tokeniser::splitSentence(const std::string& sentence, std::vector<std::string>& all_subwords) const {
     all_subwords.clear();
 
-    // Regex to split sentence by words and punctuation.
-    // It captures sequences of letters OR single non-letter, non-space characters.
-    std::regex re(R"([a-zA-Z]+|[^a-zA-Z\s])");
-    auto words_begin = std::sregex_iterator(sentence.begin(), sentence.end(), re);
-    auto words_end = std::sregex_iterator();
+    std::string lower_token_str;
+    std::vector<std::string> word_subwords;
 
-    for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-        std::string token_str = (*i).str();
-        
-        // If it's a word (starts with a letter), split it using our learned vocabulary
-        if (std::isalpha(token_str[0])) {
-            std::string lower_token_str = token_str;
-            std::transform(lower_token_str.begin(), lower_token_str.end(), lower_token_str.begin(), ::tolower);
-            
-            std::vector<std::string> word_subwords;
+    preTokenize(sentence,
+        [&](std::string_view word) {
+            // A word: split it using our learned vocabulary
+            lower_token_str.assign(word);
             splitWord(lower_token_str, word_subwords);
-            all_subwords.insert(all_subwords.end(), word_subwords.begin(), word_subwords.end());
-        } 
-        else {
+            all_subwords.insert(all_subwords.end(), std::make_move_iterator(word_subwords.begin()), std::make_move_iterator(word_subwords.end()));
+        },
+        [&](std::string_view symbol) {
             // It's punctuation or another symbol, keep it as a single token
-            all_subwords.push_back(token_str);
-        }
-    }
-}
\ No newline at end of file
+            all_subwords.emplace_back(symbol);
+        });
+}
@@ -0,0 +1,116 @@
+// threadpool.cpp
+#include "include/threadpool.hpp"
+
+// Identifies the pool and deque of the current worker thread (nullptr outside any pool).
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+
+/**
+ * @brief Starts the worker threads.
+ * @param num_threads Number of workers; at least one is started.
+ */
+ThreadPool::ThreadPool(size_t num_threads) {
+    if (num_threads == 0) num_threads = 1;
+    queues.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    workers.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+// Runs every task that is still queued, then joins the workers.
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCv.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+
+bool ThreadPool::isWorkerThread() const {
+    return current_pool == this;
+}
+
+
+// Pushes a task onto the caller's own deque (worker threads) or the next deque round-robin.
+void ThreadPool::enqueue(Task task) {
+    const size_t target = isWorkerThread()
+        ? current_worker
+        : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mtx);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedTasks.fetch_add(1, std::memory_order_relaxed);
+    }
+    sleepCv.notify_one();
+}
+
+
+// Takes a task from deque `self` (newest first), otherwise steals the oldest task of another deque.
+bool ThreadPool::popTask(size_t self, Task& task) {
+    {
+        WorkerQueue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); ++k) {
+        WorkerQueue& victim = *queues[(self + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Runs one queued task on the calling thread, if there is one.
+ * Used by threads that wait for parallel work so that they help instead of idling.
+ * @return `true` if a task was run.
+ */
+bool ThreadPool::runPendingTask() {
+    if (queuedTasks.load(std::memory_order_relaxed) <= 0) return false;
+    Task task;
+    const size_t self = isWorkerThread() ? current_worker : 0;
+    if (!popTask(self, task)) return false;
+    task();
+    return true;
+}
+
+
+void ThreadPool::workerLoop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+
+    Task task;
+    while (true) {
+        if (popTask(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCv.wait(lock, [this]() { return stopping || queuedTasks.load(std::memory_order_relaxed) > 0; });
+        if (stopping && queuedTasks.load(std::memory_order_relaxed) <= 0) return;
+    }
+}
@@ -31,6 +31,12 @@ tokeniser::tokeniser(const std::string& path2data, OpenCLContext& context) noexc
         this->vocSize = 0;
         this->d = 0;
     }
+    catch (...) {
+        // The constructor is noexcept: nothing may escape it.
+        std::cerr << "Error initializing tokenizer: unknown exception" << std::endl;
+        this->vocSize = 0;
+        this->d = 0;
+    }
 }
 
 
@@ -57,6 +63,12 @@ tokeniser::tokeniser(const std::string& path2data) noexcept : path2data(path2dat
         this->vocSize = 0;
         this->d = 0;
     }
+    catch (...) {
+        // The constructor is noexcept: nothing may escape it.
+        std::cerr << "Error initializing tokenizer: unknown exception" << std::endl;
+        this->vocSize = 0;
+        this->d = 0;
+    }
 }
 
 #endif
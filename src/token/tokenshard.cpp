@@ -0,0 +1,312 @@
+// tokenshard.cpp
+#include "include/tokenise.hpp"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <future>
+#include <semaphore>
+#include <mutex>
+#include <cstring>
+
+
+// A newline-aligned piece of an input file, numbered in input order.
+struct SequencedChunk {
+    uint64_t sequence;
+    CorpusChunk chunk;
+};
+
+// The encoded form of one SequencedChunk: packed ids and the id count of each line.
+struct EncodedChunk {
+    uint64_t sequence;
+    std::string ids;
+    std::vector<uint64_t> lengths;
+};
+
+
+// Packs int32 ids into `id_bytes`-wide unsigned values; UNKNOWN_ID becomes all ones.
+static void packIds(const std::vector<int32_t>& ids, size_t id_bytes, std::string& out) {
+    const size_t first = out.size();
+    out.resize(first + ids.size() * id_bytes);
+    char* dst = out.data() + first;
+    if (id_bytes == sizeof(uint16_t)) {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const uint16_t id = static_cast<uint16_t>(ids[i]);      // -1 -> 0xFFFF
+            std::memcpy(dst + i * sizeof(id), &id, sizeof(id));
+        }
+    }
+    else {
+        std::memcpy(dst, ids.data(), ids.size() * sizeof(int32_t)); // -1 -> 0xFFFFFFFF
+    }
+}
+
+
+static TokenShardHeader makeHeader(const char (&magic)[8], size_t id_bytes, uint64_t tokens, uint64_t documents, uint64_t vocab_size) {
+    TokenShardHeader header{};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = TOKEN_SHARD_VERSION;
+    header.byteOrderMark = TOKEN_SHARD_BYTE_ORDER_MARK;
+    header.idBytes = static_cast<uint32_t>(id_bytes);
+    header.tokenCount = tokens;
+    header.documentCount = documents;
+    header.vocabSize = vocab_size;
+    return header;
+}
+
+
+/**
+ * @brief Tokenizes files in one streaming pass into a binary token-id shard.
+ * Uses the reader / queue design of buildCorpusWordCounts: a producer memory-maps the
+ * files in the given order and queues newline-aligned chunks, consumers encode them in
+ * parallel (every line is one document, encoded as by `encodeToIds`), and the calling
+ * thread writes the encoded chunks back in input order. At most a fixed window of
+ * chunks is in flight; the producer waits for the writer when the window is full, so
+ * memory stays bounded however large the input is.
+ * The layout of `shardPath` and its document index `shardPath + ".idx"` is described in
+ * tokenshard.hpp.
+ * @param file_paths Input files, in the order their lines are written.
+ * @param shardPath Path of the id file; the index is written next to it.
+ * @param idBytes 2 (uint16) or 4 (uint32) bytes per id; 0 picks uint16 when the vocabulary fits.
+ * @return Number of token ids written.
+ * @throws std::runtime_error if no vocabulary is loaded, the width is too small, or the output cannot be written.
+ */
+size_t tokeniser::encodeFilesToShard(const std::vector<std::string>& file_paths, const std::string& shardPath, size_t idBytes) const
+{
+    if (this->tokens.empty()) {
+        throw std::runtime_error("Cannot encode files: no vocabulary is loaded.");
+    }
+    // The all-ones value is reserved for unknown characters.
+    const bool fits_uint16 = this->tokens.size() < UINT16_MAX;
+    const size_t id_bytes = idBytes == 0 ? (fits_uint16 ? sizeof(uint16_t) : sizeof(uint32_t)) : idBytes;
+    if ((id_bytes != sizeof(uint16_t) && id_bytes != sizeof(uint32_t)) || (id_bytes == sizeof(uint16_t) && !fits_uint16)) {
+        throw std::runtime_error("Unsupported token id width of " + std::to_string(id_bytes) + " bytes for "
+                                 + std::to_string(this->tokens.size()) + " tokens.");
+    }
+
+    const size_t CHUNK_BYTES = 4 << 20; // Target bytes per work unit (split on line boundaries)
+    PipelineMetrics& metrics = this->bpe_progress->metrics;
+    PipelineMetrics::Stage stage(metrics, "encode_shard");
+    const std::string index_path = shardPath + TOKEN_INDEX_SUFFIX;
+    std::ofstream ids_file(shardPath, std::ios::binary | std::ios::trunc);
+    std::ofstream index_file(index_path, std::ios::binary | std::ios::trunc);
+    if (!ids_file.is_open() || !index_file.is_open()) {
+        throw std::runtime_error("Failed to open token shard for writing: " + shardPath);
+    }
+    // Placeholder headers; the counts are filled in after the last chunk.
+    TokenShardHeader header = makeHeader(TOKEN_SHARD_MAGIC, id_bytes, 0, 0, this->tokens.size());
+    ids_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    index_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const uint64_t first_offset = 0;
+    index_file.write(reinterpret_cast<const char*>(&first_offset), sizeof(first_offset));
+
+    // One producer keeps the input order trivial; consumers take the remaining threads.
+    ThreadPool& pool = getThreadPool();
+    const int num_consumers = std::max(1, static_cast<int>(pool.size()) - 2);
+    const size_t max_in_flight = 2 * static_cast<size_t>(num_consumers) + 2;
+    ThreadSafeQueue<SequencedChunk> work_queue(max_in_flight);
+    ThreadSafeQueue<EncodedChunk> done_queue;
+    PipelineMetrics::QueueWatch queue_watch(metrics, [&work_queue] { return work_queue.size(); });
+    std::counting_semaphore<> window(static_cast<std::ptrdiff_t>(max_in_flight));
+    std::atomic<bool> cancelled{ false };
+    std::atomic<int> running_consumers{ num_consumers };
+    std::atomic<int> next_consumer{ 0 };
+    std::atomic<uint64_t> bytes_encoded{ 0 };
+    std::mutex error_mutex;
+    std::exception_ptr consumer_error;          // first exception of a consumer (guarded by error_mutex)
+
+    const bool use_pool = pool.size() >= static_cast<size_t>(num_consumers + 1) && !pool.isWorkerThread();
+    auto launch = [&pool, use_pool](auto task) {
+        return use_pool ? pool.submit(std::move(task)) : std::async(std::launch::async, std::move(task));
+    };
+
+    auto consumer_task = [&, id_bytes]() {
+        PipelineMetrics::ThreadTimer timer(metrics, "encode_shard", "consumer", next_consumer++);
+        std::vector<int32_t> line_ids;
+        SequencedChunk item;
+        while (work_queue.wait_and_pop(item)) {
+            timer.idle();
+            if (cancelled.load(std::memory_order_relaxed)) {
+                window.release();       // dropped: the writer never sees this chunk
+                continue;
+            }
+            try {
+                bytes_encoded.fetch_add(item.chunk.bytes.size(), std::memory_order_relaxed);
+                EncodedChunk encoded{ item.sequence, {}, {} };
+                std::string_view remaining = item.chunk.bytes;
+                while (!remaining.empty()) {
+                    const size_t newline = remaining.find('\n');
+                    const std::string_view line = remaining.substr(0, newline);
+                    remaining.remove_prefix(newline == std::string_view::npos ? remaining.size() : newline + 1);
+                    line_ids.clear();
+                    encodeDocument(line, line_ids);
+                    packIds(line_ids, id_bytes, encoded.ids);
+                    encoded.lengths.push_back(line_ids.size());
+                }
+                done_queue.push(std::move(encoded));
+            }
+            catch (...) {
+                // Stop the producer and keep draining, so every thread finishes and the
+                // writer rethrows the error after joining.
+                {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!consumer_error) consumer_error = std::current_exception();
+                }
+                cancelled = true;
+                window.release();
+            }
+            timer.busy("encode_chunk");
+        }
+        // Reached on every path (errors are caught above), so done_queue always closes.
+        if (running_consumers.fetch_sub(1) == 1) done_queue.close();
+    };
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < num_consumers; ++i) {
+        futures.push_back(launch(consumer_task));
+    }
+
+    futures.push_back(launch([&]() {
+        PipelineMetrics::ThreadTimer timer(metrics, "encode_shard", "producer", 0);
+        uint64_t sequence = 0;
+        for (const auto& path : file_paths) {
+            auto file = std::make_shared<MappedFile>();
+            if (!file->open(path)) {
+                std::cerr << "Warning: Producer thread could not open file: " << path << std::endl;
+                continue;
+            }
+            for (std::string_view bytes : splitOnNewlines(file->view(), CHUNK_BYTES)) {
+                timer.busy();
+                window.acquire();       // backpressure: wait until the writer has room
+                if (cancelled.load(std::memory_order_relaxed)) break;
+                work_queue.push(SequencedChunk{ sequence++, CorpusChunk{ file, bytes } });
+                timer.idle();
+            }
+            if (cancelled.load(std::memory_order_relaxed)) break;
+        }
+        work_queue.close();
+    }));
+
+    // WRITER: restore input order, then append ids and document offsets.
+    std::map<uint64_t, EncodedChunk> pending;
+    uint64_t next_sequence = 0, token_count = 0, document_count = 0;
+    std::vector<uint64_t> offsets;
+    std::exception_ptr error;
+    std::vector<EncodedChunk> encoded_batch;     // everything finished since the last wake-up
+    while (done_queue.pop_batch(encoded_batch, max_in_flight)) {
+        for (EncodedChunk& encoded : encoded_batch) pending.emplace(encoded.sequence, std::move(encoded));
+        for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(++next_sequence)) {
+            if (!error) {
+                try {
+                    offsets.clear();
+                    for (const uint64_t length : it->second.lengths) {
+                        token_count += length;
+                        offsets.push_back(token_count);
+                    }
+                    document_count += offsets.size();
+                    ids_file.write(it->second.ids.data(), it->second.ids.size());
+                    index_file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+                    if (!ids_file || !index_file) {
+                        throw std::runtime_error("Failed to write token shard: " + shardPath);
+                    }
+                }
+                catch (...) {
+                    // Keep draining so that the producer and consumers can finish before we rethrow.
+                    error = std::current_exception();
+                    cancelled = true;
+                }
+            }
+            pending.erase(it);
+            window.release();
+        }
+    }
+    for (auto& f : futures) f.get();
+    if (error) std::rethrow_exception(error);
+    if (consumer_error) std::rethrow_exception(consumer_error);
+
+    header = makeHeader(TOKEN_SHARD_MAGIC, id_bytes, token_count, document_count, this->tokens.size());
+    ids_file.seekp(0);
+    ids_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    header = makeHeader(TOKEN_INDEX_MAGIC, id_bytes, token_count, document_count, this->tokens.size());
+    index_file.seekp(0);
+    index_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ids_file.close();
+    index_file.close();
+    if (!ids_file || !index_file) {
+        throw std::runtime_error("Failed to write token shard: " + shardPath);
+    }
+    std::cout << "-> Encoded " << document_count << " documents into " << token_count << " token ids (uint"
+              << 8 * id_bytes << ") at: " << shardPath << std::endl;
+    stage.bytes = bytes_encoded.load();
+    stage.lines = document_count;
+    stage.items = token_count;
+    stage.maxQueueDepth = work_queue.maxSize();
+    return token_count;
+}
+
+
+// Maps one shard file and validates its header against `magic`; returns the data after the header.
+static std::string_view openShardFile(const std::string& path, MappedFile& file, const char (&magic)[8], TokenShardHeader& header) {
+    if (!file.open(path)) {
+        throw std::runtime_error("Could not open token shard: " + path);
+    }
+    const std::string_view data = file.view();
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error("Token shard is truncated: " + path);
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a token shard file: " + path);
+    }
+    if (header.byteOrderMark != TOKEN_SHARD_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Token shard was written with a different byte order: " + path);
+    }
+    if (header.version != TOKEN_SHARD_VERSION) {
+        throw std::runtime_error("Unsupported token shard version " + std::to_string(header.version) + ": " + path);
+    }
+    if (header.idBytes != sizeof(uint16_t) && header.idBytes != sizeof(uint32_t)) {
+        throw std::runtime_error("Token shard has an unsupported id width: " + path);
+    }
+    return data.substr(sizeof(header));
+}
+
+
+/**
+ * @brief Reads a shard written by `encodeFilesToShard` back into an EncodedBatch.
+ * Ids are widened to int32 (unknown characters become EncodedBatch::UNKNOWN_ID).
+ * @param path Path of the id file (the index is read from `path + ".idx"`).
+ * @param batch Output: ids and document offsets (previous contents are replaced).
+ * @throws std::runtime_error if either file is missing, truncated or inconsistent.
+ */
+void readTokenShard(const std::string& path, EncodedBatch& batch) {
+    MappedFile ids_file, index_file;
+    TokenShardHeader header, index_header;
+    const std::string_view ids = openShardFile(path, ids_file, TOKEN_SHARD_MAGIC, header);
+    const std::string index_path = path + TOKEN_INDEX_SUFFIX;
+    const std::string_view index = openShardFile(index_path, index_file, TOKEN_INDEX_MAGIC, index_header);
+
+    if (index_header.idBytes != header.idBytes || index_header.tokenCount != header.tokenCount
+        || index_header.documentCount != header.documentCount || index_header.vocabSize != header.vocabSize
+        || header.tokenCount != ids.size() / header.idBytes || ids.size() % header.idBytes != 0
+        || index.size() < sizeof(uint64_t) || index.size() % sizeof(uint64_t) != 0
+        || header.documentCount != index.size() / sizeof(uint64_t) - 1) {
+        throw std::runtime_error("Token shard and index do not match: " + path);
+    }
+
+    batch.offsets.resize(header.documentCount + 1);
+    std::memcpy(batch.offsets.data(), index.data(), index.size());
+    bool ok = batch.offsets[0] == 0 && batch.offsets.back() == header.tokenCount;
+    for (size_t i = 0; ok && i < header.documentCount; ++i) ok = batch.offsets[i] <= batch.offsets[i + 1];
+    if (!ok) {
+        throw std::runtime_error("Token shard index is corrupt: " + index_path);
+    }
+
+    batch.ids.resize(header.tokenCount);
+    if (header.idBytes == sizeof(uint16_t)) {
+        for (size_t i = 0; i < batch.ids.size(); ++i) {
+            uint16_t id;
+            std::memcpy(&id, ids.data() + i * sizeof(id), sizeof(id));
+            batch.ids[i] = id == UINT16_MAX ? EncodedBatch::UNKNOWN_ID : id;
+        }
+    }
+    else if (!batch.ids.empty()) {
+        std::memcpy(batch.ids.data(), ids.data(), ids.size());
+    }
+}
@@ -19,7 +19,22 @@ void tokeniser::train(const std::string& path2trainData, int num_merges, const s
 
     const std::string unique_tokens_output_path = path2tokenData + "/" + "_unique_initial_tokens.csv";
     const std::string stats_output_path = path2tokenData + "/" + "_final_token_stats.csv";
-    const std::string embeddings_output_path = path2tokenData + "/" + "_final_embeddings.csv";
+    const std::string embeddings_output_path = path2tokenData + "/" + "_embeddings_only.csv";
+    const std::string vocab_output_path = path2tokenData + "/" + "_vocab.csv";
+    const std::string merges_output_path = path2tokenData + "/" + "_merges.csv";
+    const std::string model_output_path = path2tokenData + "/" + "_model.bin";
+    const std::string metrics_output_path = path2tokenData + "/" + "_metrics.json";
+    const std::string trace_output_path = path2tokenData + "/" + "_trace.json";
+
+    // Every run is timed from here; write steps are stages with their rows as items.
+    PipelineMetrics& metrics = this->bpe_progress->metrics;
+    metrics.reset();
+    auto timed_rows = [&metrics](const char* name, auto&& step) -> size_t {
+        PipelineMetrics::Stage stage(metrics, name);
+        const size_t rows = step();
+        stage.items = rows;
+        return rows;
+    };
 
     std::cout << "------------------------ 1. AGGREGATING DATA --------------------------" << std::endl;
     // Step A: Collect all file paths
@@ -32,27 +47,68 @@ void tokeniser::train(const std::string& path2trainData, int num_merges, const s
     std::cout << "-> Found " << all_file_paths.size() << " files for training in: " << path2trainData << std::endl;
     if (all_file_paths.empty()) throw std::runtime_error("No files found in the specified directory.");
     // Step B: Build word counts using the robust producer-consumer model
+    // (or restore them from the word-count checkpoint taken from the same files)
     std::unordered_map<std::string, int> corpus_word_counts;
-    buildCorpusWordCounts(all_file_paths, corpus_word_counts);
+    const std::string counts_checkpoint_path = checkpointDirectory + "/" + WORD_COUNTS_CHECKPOINT;
+    uint64_t input_fingerprint = inputFilesFingerprint(all_file_paths);
+    if (corpusFilter.sketchWidth > 0 && corpusFilter.minCount > 1) {
+        // Sketched counts depend on the sketch, so they only resume a run with the same one.
+        const uint64_t sketch_params[3] = { corpusFilter.sketchWidth, corpusFilter.sketchDepth, static_cast<uint64_t>(corpusFilter.minCount) };
+        input_fingerprint = checkpointFingerprint(input_fingerprint, sketch_params, sizeof(sketch_params));
+    }
+    if (baseAlphabet == BaseAlphabet::Bytes) {
+        // Byte-level counts keep non-ASCII words whole, so they are not interchangeable with ASCII counts.
+        const uint32_t alphabet = MODEL_FLAG_BYTE_ALPHABET;
+        input_fingerprint = checkpointFingerprint(input_fingerprint, &alphabet, sizeof(alphabet));
+    }
+    bool restored_counts = false;
+    if (!checkpointDirectory.empty()) {
+        PipelineMetrics::Stage stage(metrics, "restore_word_counts");
+        restored_counts = loadWordCountsCheckpoint(counts_checkpoint_path, corpus_word_counts, input_fingerprint);
+        stage.items = corpus_word_counts.size();
+    }
+    if (restored_counts) {
+        std::cout << "-> Restored word counts from checkpoint: " << counts_checkpoint_path << std::endl;
+    }
+    else {
+        buildCorpusWordCounts(all_file_paths, corpus_word_counts);
+        if (!checkpointDirectory.empty() && !corpus_word_counts.empty()) {
+            timed_rows("save_word_counts", [&] { saveWordCountsCheckpoint(counts_checkpoint_path, corpus_word_counts, input_fingerprint); return corpus_word_counts.size(); });
+            std::cout << "-> Saved word counts checkpoint: " << counts_checkpoint_path << std::endl;
+        }
+    }
     std::cout << "-> Data aggregation complete. Total unique raw tokens: " << corpus_word_counts.size() << std::endl;
     if (corpus_word_counts.empty()) 
         throw std::runtime_error("No data loaded from files. Check file content.");
     // Step C: Save the gathered unique raw tokens to a CSV file.
-    saveUniqueTokensToCSV(corpus_word_counts, unique_tokens_output_path);
-    std::cout << "-> " << std::filesystem::path(unique_tokens_output_path).filename().string() << " contains " << count_lines(unique_tokens_output_path) << " rows." << std::endl;
+    const size_t unique_rows = timed_rows("save_unique_tokens", [&] { return saveUniqueTokensToCSV(corpus_word_counts, unique_tokens_output_path); });
+    std::cout << "-> " << std::filesystem::path(unique_tokens_output_path).filename().string() << " contains " << unique_rows << " rows." << std::endl;
 
     std::cout << "--------------------------- 2. VOCABULARY LEARNING ---------------------------" << std::endl;
     std::vector<std::string> final_vocabulary;
     // Call the new two-stage learning function.
     learn_vocabulary_from_word_counts(corpus_word_counts, num_merges, final_vocabulary);
     std::cout << "-> Vocabulary Learning complete. Final vocabulary size: " << getVocabularySize() << std::endl;
+    // Save the canonical token ids; readFromFiles restores them from this file
+    timed_rows("save_vocabulary", [&] { return saveVocabulary(vocab_output_path); });
+    // and the ordered merges, which the merge-rank encoder replays
+    timed_rows("save_merges", [&] { return saveMerges(merges_output_path); });
 
     std::cout << "---------------------- 3. STATS & EMBEDDING GEN -----------------------" << std::endl;
     // Step A: Calculate statistics based on the final BPE vocabulary
-    calculateTokenStatsFromCounts(corpus_word_counts, stats_output_path);
-    std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << count_lines(stats_output_path) << " rows." << std::endl;
-    // Step B: Generate embeddings using original formula
-    generateAndSaveEmbeddings(embeddings_output_path, 10.0f);
-    std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << count_lines(stats_output_path) << " rows." << std::endl;
-    std::cout << "-> " << std::filesystem::path(embeddings_output_path).filename().string() << " contains " << count_lines(embeddings_output_path) << " rows." << std::endl;
+    const size_t stats_rows = timed_rows("token_stats", [&] { return calculateTokenStatsFromCounts(corpus_word_counts, stats_output_path); });
+    std::cout << "-> " << std::filesystem::path(stats_output_path).filename().string() << " contains " << stats_rows << " rows." << std::endl;
+    // Step B: Generate embeddings using original formula (saved as _embeddings_only.csv in path2tokenData)
+    const size_t embedding_rows = timed_rows("embeddings", [&] { return generateAndSaveEmbeddings(path2tokenData, 10.0f); });
+    std::cout << "-> " << std::filesystem::path(embeddings_output_path).filename().string() << " contains " << embedding_rows << " rows." << std::endl;
+    // Step C: Save everything as one binary model for fast loading (loadModel)
+    timed_rows("save_model", [&] { saveModel(model_output_path); return this->tokens.size(); });
+
+    // Step D: Per-stage timings, throughput and memory of this run (and a Chrome trace when tracing)
+    if (metrics.writeJson(metrics_output_path)) {
+        std::cout << "-> Saved run metrics to: " << metrics_output_path << std::endl;
+    }
+    if (metrics.tracing() && metrics.writeChromeTrace(trace_output_path)) {
+        std::cout << "-> Saved Chrome trace to: " << trace_output_path << std::endl;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,231 @@
+// trie.cpp
+#include "include/trie.hpp"
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+
+/**
+ * @brief Compiles the prefix index for a vocabulary.
+ * Tokens are first inserted into a temporary adjacency-list trie, which is then
+ * flattened into the CSR arrays used for lookups. Node 0 is the root.
+ * @param vocabulary The tokens to index. A token's position in this vector is the
+ * value returned by the lookup functions.
+ */
+void TokenTrie::build(const std::vector<std::string>& vocabulary) {
+    clear();
+
+    // 1. Build a temporary trie with per-node child lists.
+    std::vector<std::vector<std::pair<unsigned char, uint32_t>>> children(1);
+    std::vector<int32_t> terminal(1, -1);
+
+    for (size_t t = 0; t < vocabulary.size(); ++t) {
+        const std::string& token = vocabulary[t];
+        if (token.empty()) continue;
+
+        uint32_t node = 0;
+        for (char c : token) {
+            const unsigned char label = static_cast<unsigned char>(c);
+            auto& edges = children[node];
+            auto it = std::find_if(edges.begin(), edges.end(), [label](const auto& e) { return e.first == label; });
+            if (it != edges.end()) {
+                node = it->second;
+            } else {
+                const uint32_t next = static_cast<uint32_t>(children.size());
+                edges.emplace_back(label, next);
+                children.emplace_back();
+                terminal.push_back(-1);
+                node = next;
+            }
+        }
+        // Keep the first occurrence if the vocabulary contains duplicates.
+        if (terminal[node] < 0) terminal[node] = static_cast<int32_t>(t);
+    }
+
+    // 2. Flatten into CSR arrays with edges sorted by label.
+    const size_t num_nodes = children.size();
+    firstEdge.resize(num_nodes + 1);
+    tokenIndex = std::move(terminal);
+
+    size_t num_edges = 0;
+    for (size_t n = 0; n < num_nodes; ++n) {
+        firstEdge[n] = static_cast<uint32_t>(num_edges);
+        num_edges += children[n].size();
+    }
+    firstEdge[num_nodes] = static_cast<uint32_t>(num_edges);
+    edgeLabel.resize(num_edges);
+    edgeTarget.resize(num_edges);
+
+    for (size_t n = 0; n < num_nodes; ++n) {
+        auto& edges = children[n];
+        std::sort(edges.begin(), edges.end());
+        size_t e = firstEdge[n];
+        for (const auto& edge : edges) {
+            edgeLabel[e] = edge.first;
+            edgeTarget[e] = edge.second;
+            ++e;
+        }
+    }
+
+    for (const auto& edge : children[0]) {
+        rootChild[edge.first] = edge.second;
+    }
+}
+
+
+/**
+ * @brief Releases the index, leaving an empty trie.
+ */
+void TokenTrie::clear() {
+    rootChild.fill(NO_NODE);
+    firstEdge.clear();
+    edgeLabel.clear();
+    edgeTarget.clear();
+    tokenIndex.clear();
+}
+
+
+// Returns the child of `node` reached by `label`, or NO_NODE.
+uint32_t TokenTrie::child(uint32_t node, unsigned char label) const {
+    if (node == 0) return rootChild[label];
+
+    const unsigned char* begin = edgeLabel.data() + firstEdge[node];
+    const unsigned char* end = edgeLabel.data() + firstEdge[node + 1];
+    // Most inner nodes have only a handful of children; a linear scan beats binary search there.
+    if (end - begin <= 8) {
+        for (const unsigned char* p = begin; p != end; ++p) {
+            if (*p == label) return edgeTarget[p - edgeLabel.data()];
+        }
+        return NO_NODE;
+    }
+    const unsigned char* p = std::lower_bound(begin, end, label);
+    if (p != end && *p == label) return edgeTarget[p - edgeLabel.data()];
+    return NO_NODE;
+}
+
+
+/**
+ * @brief Finds the longest vocabulary token that is a prefix of `head + tail`.
+ * The two-part form lets callers match across a virtual suffix (such as the
+ * end-of-word marker) without building a concatenated string.
+ * @param head First part of the text to match.
+ * @param tail Second part of the text, logically appended to `head`.
+ * @param length Output: number of bytes matched (0 if nothing matched).
+ * @return The vocabulary index of the matched token, or -1 if no token matches.
+ */
+int TokenTrie::longestPrefix(std::string_view head, std::string_view tail, size_t& length) const {
+    length = 0;
+    if (tokenIndex.empty()) return -1;
+
+    int best = -1;
+    uint32_t node = 0;
+    size_t consumed = 0;
+
+    for (std::string_view part : { head, tail }) {
+        for (char c : part) {
+            node = child(node, static_cast<unsigned char>(c));
+            if (node == NO_NODE) return best;
+            ++consumed;
+            if (tokenIndex[node] >= 0) {
+                best = tokenIndex[node];
+                length = consumed;
+            }
+        }
+    }
+    return best;
+}
+
+
+/**
+ * @brief Looks up an exact token.
+ * @param token The token string.
+ * @return The vocabulary index of the token, or -1 if it is not in the vocabulary.
+ */
+int TokenTrie::find(std::string_view token) const {
+    if (tokenIndex.empty() || token.empty()) return -1;
+
+    uint32_t node = 0;
+    for (char c : token) {
+        node = child(node, static_cast<unsigned char>(c));
+        if (node == NO_NODE) return -1;
+    }
+    return tokenIndex[node];
+}
+
+
+// Appends the raw bytes of a trivially copyable array.
+template<typename T>
+static void appendArray(std::string& out, const T* values, size_t count) {
+    out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+// Copies `count` values out of `data` at `pos`, advancing `pos`; false if the data is too short.
+template<typename T>
+static bool readArray(std::string_view data, size_t& pos, std::vector<T>& values, size_t count) {
+    if (count > (data.size() - pos) / sizeof(T)) return false;
+    values.resize(count);
+    if (count > 0) std::memcpy(values.data(), data.data() + pos, count * sizeof(T));
+    pos += count * sizeof(T);
+    return true;
+}
+
+
+/**
+ * @brief Appends the compiled arrays in native byte order.
+ * Layout: node count and edge count (uint32), then firstEdge, edgeTarget and
+ * tokenIndex as 32-bit integers and finally the edge labels as bytes. The root
+ * table is not stored; it is rebuilt from the root's edges.
+ * @param out Output: the serialized index is appended.
+ */
+void TokenTrie::serialize(std::string& out) const {
+    const uint32_t counts[2] = { static_cast<uint32_t>(tokenIndex.size()), static_cast<uint32_t>(edgeLabel.size()) };
+    appendArray(out, counts, 2);
+    appendArray(out, firstEdge.data(), firstEdge.size());
+    appendArray(out, edgeTarget.data(), edgeTarget.size());
+    appendArray(out, tokenIndex.data(), tokenIndex.size());
+    appendArray(out, edgeLabel.data(), edgeLabel.size());
+}
+
+
+/**
+ * @brief Restores an index written by `serialize` without rebuilding it from the tokens.
+ * The arrays are validated so that a corrupt file cannot cause out-of-range lookups.
+ * @param data The serialized index.
+ * @param vocabulary_size Number of tokens the index refers to.
+ * @return `true` on success; on failure the trie is left empty.
+ */
+bool TokenTrie::deserialize(std::string_view data, size_t vocabulary_size) {
+    clear();
+
+    size_t pos = 0;
+    std::vector<uint32_t> counts;
+    bool ok = readArray(data, pos, counts, 2);
+    const size_t num_nodes = ok ? counts[0] : 0;
+    const size_t num_edges = ok ? counts[1] : 0;
+    if (ok && num_nodes == 0) return num_edges == 0 && pos == data.size();   // empty vocabulary
+    ok = ok
+            && readArray(data, pos, firstEdge, num_nodes + 1)
+            && readArray(data, pos, edgeTarget, num_edges)
+            && readArray(data, pos, tokenIndex, num_nodes)
+            && readArray(data, pos, edgeLabel, num_edges)
+            && pos == data.size();
+
+    ok = ok && firstEdge[0] == 0 && firstEdge[num_nodes] == num_edges;
+    for (size_t n = 0; ok && n < num_nodes; ++n) {
+        ok = firstEdge[n] <= firstEdge[n + 1]
+            && tokenIndex[n] >= -1 && tokenIndex[n] < static_cast<int64_t>(vocabulary_size);
+        for (size_t e = firstEdge[n]; ok && e < firstEdge[n + 1]; ++e) {
+            ok = edgeTarget[e] > 0 && edgeTarget[e] < num_nodes
+                && (e == firstEdge[n] || edgeLabel[e - 1] < edgeLabel[e]);
+        }
+    }
+    if (!ok) {
+        clear();
+        return false;
+    }
+
+    for (size_t e = firstEdge[0]; e < firstEdge[1]; ++e) {
+        rootChild[edgeLabel[e]] = edgeTarget[e];
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+// vocab.cpp
+#include "include/tokenise.hpp"
+#include <iostream>
+
+
+/**
+ * @brief Looks up the canonical id of a token through the prefix index.
+ * @param token The token string (e.g. "the</w>", ",").
+ * @return The token's id, or EncodedBatch::UNKNOWN_ID if it is not in the vocabulary.
+ */
+int32_t tokeniser::tokenToId(std::string_view token) const {
+    const int index = this->prefixIndex.find(token);
+    return index >= 0 ? index : EncodedBatch::UNKNOWN_ID;
+}
+
+
+/**
+ * @brief Saves the vocabulary as "id,token" rows in canonical id order.
+ * The ids are the positions in `tokens`: the base vocabulary in lexicographic order
+ * followed by the merged tokens in the order they were learned. Reading this file
+ * back (`readVocabulary`) restores exactly the same ids.
+ * @param outputPath Path of the CSV file to write.
+ * @return Number of vocabulary rows written (the header is not counted).
+ */
+size_t tokeniser::saveVocabulary(const std::string& outputPath) const {
+    if (outputPath.empty()) {
+        std::cout << "-> Output path is empty. Skipping saving vocabulary CSV." << std::endl;
+        return 0;
+    }
+
+    CsvWriter writer(outputPath);
+    if (!writer.isOpen()) {
+        std::cerr << "Error: Could not open file to save vocabulary: " << outputPath << std::endl;
+        throw std::runtime_error("Failed to open file at: " + outputPath);
+    }
+
+    writer.raw("id,token\n");
+    writer.writeRows(this->tokens.size(), nullptr, [this](size_t id, CsvBuffer& out) {
+        out.appendInt(static_cast<long long>(id));
+        out.append(',');
+        out.appendField(this->tokens[id]);
+        out.endRow();
+    });
+
+    const size_t rows = writer.close();
+    if (!writer.good()) {
+        throw std::runtime_error("Failed to write file at: " + outputPath);
+    }
+    std::cout << "-> Saved " << rows << " vocabulary entries to: " << outputPath << std::endl;
+    return rows;
+}
+
+
+/**
+ * @brief Saves the learned merges as "rank,left,right,merged" rows in rank order.
+ * The ids are canonical token ids (see `saveVocabulary`); `readMerges` restores the
+ * list the MergeRank encoder replays.
+ * @param outputPath Path of the CSV file to write.
+ * @return Number of merge rows written (the header is not counted).
+ */
+size_t tokeniser::saveMerges(const std::string& outputPath) const {
+    if (outputPath.empty()) {
+        std::cout << "-> Output path is empty. Skipping saving merges CSV." << std::endl;
+        return 0;
+    }
+
+    CsvWriter writer(outputPath);
+    if (!writer.isOpen()) {
+        std::cerr << "Error: Could not open file to save merges: " << outputPath << std::endl;
+        throw std::runtime_error("Failed to open file at: " + outputPath);
+    }
+
+    writer.raw("rank,left,right,merged\n");
+    writer.writeRows(this->merges.size(), nullptr, [this](size_t rank, CsvBuffer& out) {
+        const TokenMerge& merge = this->merges[rank];
+        out.appendInt(static_cast<long long>(rank));
+        out.append(',');
+        out.appendInt(merge.left);
+        out.append(',');
+        out.appendInt(merge.right);
+        out.append(',');
+        out.appendInt(merge.merged);
+        out.endRow();
+    });
+
+    const size_t rows = writer.close();
+    if (!writer.good()) {
+        throw std::runtime_error("Failed to write file at: " + outputPath);
+    }
+    std::cout << "-> Saved " << rows << " merges to: " << outputPath << std::endl;
+    return rows;
+}
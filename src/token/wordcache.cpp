@@ -0,0 +1,83 @@
+// wordcache.cpp
+#include "include/wordcache.hpp"
+#include <algorithm>
+
+
+/**
+ * @brief Creates an empty cache.
+ * @param capacity_words Number of words per generation, spread evenly over the shards.
+ * @param num_shards Number of independently locked shards.
+ */
+WordIdCache::WordIdCache(size_t capacity_words, size_t num_shards) {
+    if (num_shards == 0) num_shards = 1;
+    shardCapacity = std::max<size_t>(1, capacity_words / num_shards);
+    shards.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+
+WordIdCache::Shard& WordIdCache::shardFor(std::string_view word) const {
+    // The maps hash with the same function, so the shard comes from a multiplicative remix
+    // of the whole hash (high product bits) and shards and buckets stay independent. It
+    // also spreads a 32-bit size_t hash, which has no high bits of its own.
+    const uint64_t hash = static_cast<uint64_t>(StringHash{}(word)) * 0x9E3779B97F4A7C15ULL;
+    return *shards[static_cast<size_t>((hash >> 32) % shards.size())];
+}
+
+
+/**
+ * @brief Appends the cached ids of a word to `ids`.
+ * @param word The (lower-cased) word.
+ * @param ids Output: the word's ids are appended on a hit.
+ * @return `true` on a hit, `false` if the word is not cached.
+ */
+bool WordIdCache::lookup(std::string_view word, std::vector<int32_t>& ids) {
+    if (word.size() > MAX_WORD_BYTES) return false;
+    Shard& shard = shardFor(word);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.current.find(word);
+    if (it == shard.current.end()) {
+        auto old_it = shard.older.find(word);
+        if (old_it == shard.older.end()) return false;
+        // Still in use: promote into the current generation (moves the node, no copy).
+        auto node = shard.older.extract(old_it);
+        if (shard.current.size() >= shardCapacity) {
+            shard.older = std::move(shard.current);
+            shard.current = Map();
+        }
+        it = shard.current.insert(std::move(node)).position;
+    }
+    ids.insert(ids.end(), it->second.begin(), it->second.end());
+    return true;
+}
+
+
+/**
+ * @brief Stores the ids of a word, rotating the shard's generations if it is full.
+ * @param word The (lower-cased) word.
+ * @param ids The word's token ids.
+ * @param count Number of ids.
+ */
+void WordIdCache::insert(std::string_view word, const int32_t* ids, size_t count) {
+    if (word.size() > MAX_WORD_BYTES) return;
+    Shard& shard = shardFor(word);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    if (shard.current.size() >= shardCapacity) {
+        shard.older = std::move(shard.current);
+        shard.current = Map();
+    }
+    shard.current.try_emplace(std::string(word), ids, ids + count);
+}
+
+// Drops every cached word.
+void WordIdCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mtx);
+        shard->current = Map();
+        shard->older = Map();
+    }
+}
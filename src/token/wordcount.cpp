@@ -0,0 +1,177 @@
+// wordcount.cpp
+#include "include/wordcount.hpp"
+#include <cstring>
+#include <functional>
+#include <utility>
+
+// Returned for empty keys so that a stored key is never nullptr.
+static const char EMPTY_KEY[1] = { '\0' };
+
+
+WordCountTable::WordCountTable(WordCountTable&& other) noexcept {
+    *this = std::move(other);
+}
+
+WordCountTable& WordCountTable::operator=(WordCountTable&& other) noexcept {
+    if (this == &other) return *this;
+    slots = std::move(other.slots);
+    used = std::exchange(other.used, 0);
+    mask = std::exchange(other.mask, 0);
+    arenaBlocks = std::move(other.arenaBlocks);
+    arenaCursor = std::exchange(other.arenaCursor, nullptr);
+    arenaRemaining = std::exchange(other.arenaRemaining, 0);
+    arenaBytes = std::exchange(other.arenaBytes, 0);
+    other.slots.clear();
+    other.arenaBlocks.clear();
+    return *this;
+}
+
+
+uint64_t WordCountTable::hashKey(std::string_view key) {
+    return static_cast<uint64_t>(std::hash<std::string_view>{}(key));
+}
+
+
+// Copies a key into the arena and returns its stable address.
+const char* WordCountTable::storeKey(std::string_view key) {
+    if (key.empty()) return EMPTY_KEY;
+    if (key.size() > arenaRemaining) {
+        // Oversized keys get a block of their own so the current block is not wasted.
+        const size_t block_bytes = key.size() > ARENA_BLOCK_BYTES / 4 ? key.size() : ARENA_BLOCK_BYTES;
+        arenaBlocks.push_back(std::make_unique<char[]>(block_bytes));
+        arenaBytes += block_bytes;
+        if (block_bytes != ARENA_BLOCK_BYTES) {
+            std::memcpy(arenaBlocks.back().get(), key.data(), key.size());
+            return arenaBlocks.back().get(); // the cursor keeps filling the previous block
+        }
+        arenaCursor = arenaBlocks.back().get();
+        arenaRemaining = block_bytes;
+    }
+    char* stored = arenaCursor;
+    std::memcpy(stored, key.data(), key.size());
+    arenaCursor += key.size();
+    arenaRemaining -= key.size();
+    return stored;
+}
+
+
+// Returns the slot holding `key`, or the empty slot where it would be inserted.
+WordCountTable::Slot& WordCountTable::findSlot(uint64_t hash, std::string_view key) {
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (true) {
+        Slot& s = slots[i];
+        if (s.key == nullptr) return s;
+        if (s.hash == hash && s.length == key.size() && std::memcmp(s.key, key.data(), key.size()) == 0) return s;
+        i = (i + 1) & mask;
+    }
+}
+
+
+// Rehashes into at least `min_slots` slots (rounded up to a power of two).
+void WordCountTable::grow(size_t min_slots) {
+    size_t capacity = 16;
+    while (capacity < min_slots) capacity <<= 1;
+    if (capacity <= slots.size()) return;
+
+    std::vector<Slot> old = std::move(slots);
+    slots.assign(capacity, Slot{ 0, nullptr, 0, 0 });
+    mask = capacity - 1;
+    for (const Slot& s : old) {
+        if (s.key == nullptr) continue;
+        size_t i = static_cast<size_t>(s.hash) & mask;
+        while (slots[i].key != nullptr) i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+
+void WordCountTable::add(uint64_t hash, std::string_view key, int delta) {
+    // Keep the load factor at or below 0.7.
+    if ((used + 1) * 10 > slots.size() * 7) grow(slots.size() * 2);
+
+    Slot& s = findSlot(hash, key);
+    if (s.key == nullptr) {
+        s.hash = hash;
+        s.key = storeKey(key);
+        s.length = static_cast<uint32_t>(key.size());
+        s.count = 0;
+        ++used;
+    }
+    s.count += delta;
+}
+
+
+/**
+ * @brief Pre-sizes the slot array so that `expected_words` entries fit without rehashing.
+ * @param expected_words Number of distinct words expected.
+ */
+void WordCountTable::reserve(size_t expected_words) {
+    grow(expected_words * 10 / 7 + 1);
+}
+
+// Drops all entries and releases the slot array and the arena.
+void WordCountTable::clear() {
+    std::vector<Slot>().swap(slots);
+    used = 0;
+    mask = 0;
+    arenaBlocks.clear();
+    arenaCursor = nullptr;
+    arenaRemaining = 0;
+    arenaBytes = 0;
+}
+
+
+/**
+ * @brief Looks up the count of a word.
+ * @param word The word.
+ * @return Its count, or 0 if it is not in the table.
+ */
+int WordCountTable::count(std::string_view word) const {
+    if (slots.empty()) return 0;
+    const uint64_t hash = hashKey(word);
+    size_t i = static_cast<size_t>(hash) & mask;
+    while (slots[i].key != nullptr) {
+        const Slot& s = slots[i];
+        if (s.hash == hash && s.length == word.size() && std::memcmp(s.key, word.data(), word.size()) == 0) return s.count;
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Adds every count of `other` to this table and releases `other`.
+ * If this table is empty, `other`'s storage is simply taken over. Otherwise the slot
+ * array is sized once for the worst case and `other`'s entries are inserted with their
+ * stored hashes; only keys that are new to this table are copied, after which `other`'s
+ * arena is freed, so words common to both tables end up stored once.
+ * @param other The table to merge in; it is left empty.
+ */
+void WordCountTable::mergeFrom(WordCountTable&& other) {
+    if (this == &other || other.empty()) {
+        if (this != &other) other.clear();
+        return;
+    }
+    if (empty()) {
+        *this = std::move(other);
+        return;
+    }
+    grow((used + other.used) * 10 / 7 + 1);
+    for (const Slot& s : other.slots) {
+        if (s.key != nullptr) add(s.hash, std::string_view(s.key, s.length), s.count);
+    }
+    other.clear();
+}
+
+
+/**
+ * @brief Moves all entries into an `std::unordered_map`, releasing this table's memory.
+ * @param out Destination map; existing entries are kept and counts are added to them.
+ */
+void WordCountTable::moveInto(std::unordered_map<std::string, int>& out) {
+    out.reserve(out.size() + used);
+    for (const Slot& s : slots) {
+        if (s.key != nullptr) out[std::string(s.key, s.length)] += s.count;
+    }
+    clear();
+}
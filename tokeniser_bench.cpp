@@ -0,0 +1,408 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include "tokenise.h"
+
+// tokeniser_bench: reproducible benchmarks of the tokeniser hot paths, reported as JSON.
+//
+//   tokeniser_bench [--corpus <dir>] [--synthetic-mb N] [--merges N] [--threads N]
+//                   [--dim D] [--repeat R] [--seed S] [--work <dir>] [--json <file>] [--verbose]
+//
+// Without --corpus a synthetic corpus (Zipf-distributed words over a generated lexicon)
+// is written to the work directory; the same seed and size always give the same files.
+// Every benchmark runs --repeat times and reports its fastest run. The library's progress
+// output is suppressed unless --verbose is given, so stdout holds only the JSON
+// (unless --json writes it to a file).
+
+namespace {
+
+struct Options {
+    std::string corpus;
+    std::string work;
+    std::string json;
+    size_t syntheticMb = 64;
+    int merges = 2000;
+    int threads = 0;            // 0 = hardware concurrency
+    int dim = 64;
+    int repeat = 3;
+    uint64_t seed = 42;
+    bool verbose = false;
+};
+
+struct Metric {
+    std::string key;
+    std::string value;          // already formatted as JSON
+};
+
+struct Result {
+    std::string name;
+    std::vector<Metric> metrics = {};
+
+    void add(const std::string& key, double value) {
+        std::ostringstream out;
+        if (value == static_cast<double>(static_cast<long long>(value))) out << static_cast<long long>(value);
+        else { out.precision(6); out << value; }
+        metrics.push_back({ key, out.str() });
+    }
+    void add(const std::string& key, const std::string& value) { metrics.push_back({ key, '"' + value + '"' }); }
+};
+
+// Escapes a string for a JSON string literal.
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (const char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) out += ' ';
+        else out += c;
+    }
+    return out;
+}
+
+// Runs `fn` `repeat` times and returns the fastest wall time in seconds.
+double bestOf(int repeat, const std::function<void()>& fn) {
+    double best = 0.0;
+    for (int r = 0; r < std::max(repeat, 1); ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+double perSecond(double amount, double seconds) { return seconds > 0.0 ? amount / seconds : 0.0; }
+
+// Uniform value in [0, 1) from the counter-based generator.
+double uniform(uint64_t seed, uint64_t& counter) { return embeddingRandom(seed, counter++) * (1.0 / 4294967296.0); }
+
+/**
+ * @brief Writes a synthetic corpus of about `megabytes` MB as four text files.
+ * Words come from a generated lexicon with Zipf(1) frequencies; lines have 4 to 23
+ * words, some capitalised or joined in camelCase, with occasional punctuation.
+ */
+std::vector<std::string> writeSyntheticCorpus(const std::string& dir, size_t megabytes, uint64_t seed) {
+    static constexpr char LETTERS[] = "etaoinshrdlcumwfgypbvkjxqz";
+    static constexpr char PUNCTUATION[] = ",.;:!?()";
+    static constexpr size_t LEXICON_SIZE = 50000;
+    static constexpr size_t NUM_FILES = 4;
+    uint64_t counter = 0;
+
+    std::vector<std::string> lexicon(LEXICON_SIZE);
+    for (std::string& word : lexicon) {
+        const size_t length = 2 + static_cast<size_t>(uniform(seed, counter) * uniform(seed, counter) * 12);
+        for (size_t i = 0; i < length; ++i) {
+            const double u = uniform(seed, counter);
+            word += LETTERS[static_cast<size_t>(u * u * 26)];
+        }
+    }
+    std::vector<double> cumulative(LEXICON_SIZE);
+    double total = 0.0;
+    for (size_t r = 0; r < LEXICON_SIZE; ++r) cumulative[r] = (total += 1.0 / static_cast<double>(r + 1));
+    auto sample_word = [&]() -> const std::string& {
+        const double u = uniform(seed, counter) * total;
+        const size_t r = std::lower_bound(cumulative.begin(), cumulative.end(), u) - cumulative.begin();
+        return lexicon[std::min(r, LEXICON_SIZE - 1)];
+    };
+
+    std::filesystem::create_directories(dir);
+    std::vector<std::string> paths;
+    const size_t bytes_per_file = megabytes * (1 << 20) / NUM_FILES;
+    for (size_t f = 0; f < NUM_FILES; ++f) {
+        paths.push_back(dir + "/synthetic_" + std::to_string(f) + ".txt");
+        std::ofstream out(paths.back(), std::ios::binary);
+        std::string line;
+        size_t written = 0;
+        while (written < bytes_per_file) {
+            line.clear();
+            const size_t words = 4 + static_cast<size_t>(uniform(seed, counter) * 20);
+            for (size_t w = 0; w < words; ++w) {
+                std::string word = sample_word();
+                const double u = uniform(seed, counter);
+                if (u < 0.05) word[0] = static_cast<char>(word[0] - 'a' + 'A');
+                else if (u < 0.07) { std::string next = sample_word(); next[0] = static_cast<char>(next[0] - 'a' + 'A'); word += next; }
+                if (w > 0) line += ' ';
+                line += word;
+                if (uniform(seed, counter) < 0.08) line += PUNCTUATION[static_cast<size_t>(uniform(seed, counter) * 8)];
+            }
+            line += ".\n";
+            out << line;
+            written += line.size();
+        }
+        if (!out) throw std::runtime_error("Could not write synthetic corpus file: " + paths.back());
+    }
+    return paths;
+}
+
+std::vector<std::string> listFiles(const std::string& dir) {
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file()) paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Reads lines (up to `max_bytes` in total) from the corpus files for the encoding benchmarks.
+std::vector<std::string> sampleLines(const std::vector<std::string>& paths, size_t max_bytes) {
+    std::vector<std::string> lines;
+    size_t bytes = 0;
+    for (const auto& path : paths) {
+        std::ifstream in(path, std::ios::binary);
+        std::string line;
+        while (bytes < max_bytes && std::getline(in, line)) {
+            bytes += line.size() + 1;
+            lines.push_back(std::move(line));
+        }
+    }
+    return lines;
+}
+
+const char* backendName() {
+#ifdef USE_CUDA
+    return "cuda";
+#elif USE_OPENCL
+    return "opencl";
+#else
+    return "cpu";
+#endif
+}
+
+int usage() {
+    std::cerr << "Usage: tokeniser_bench [--corpus <dir>] [--synthetic-mb N] [--merges N] [--threads N]\n"
+              << "                       [--dim D] [--repeat R] [--seed S] [--work <dir>] [--json <file>] [--verbose]" << std::endl;
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        const bool has_value = i + 1 < args.size();
+        if (arg == "--verbose") options.verbose = true;
+        else if (!has_value) return usage();
+        else if (arg == "--corpus") options.corpus = args[++i];
+        else if (arg == "--work") options.work = args[++i];
+        else if (arg == "--json") options.json = args[++i];
+        else if (arg == "--synthetic-mb") options.syntheticMb = std::stoull(args[++i]);
+        else if (arg == "--merges") options.merges = std::stoi(args[++i]);
+        else if (arg == "--threads") options.threads = std::stoi(args[++i]);
+        else if (arg == "--dim") options.dim = std::stoi(args[++i]);
+        else if (arg == "--repeat") options.repeat = std::stoi(args[++i]);
+        else if (arg == "--seed") options.seed = std::stoull(args[++i]);
+        else return usage();
+    }
+    if (options.work.empty()) options.work = (std::filesystem::temp_directory_path() / "tokeniser_bench").string();
+
+    // Library progress output goes to a discarded buffer unless --verbose.
+    std::ostringstream discarded;
+    std::streambuf* const console = std::cout.rdbuf();
+    if (!options.verbose) std::cout.rdbuf(discarded.rdbuf());
+
+    std::vector<Result> results;
+    int threads_used = options.threads;
+    try {
+    #ifdef USE_OPENCL
+        OpenCLContext ocl;
+        tokeniser TOKENISER(options.dim, ocl);
+    #elif USE_CUDA || USE_CPU
+        tokeniser TOKENISER(options.dim);
+    #endif
+        if (options.threads > 0) TOKENISER.setNumThreads(options.threads);
+        else TOKENISER.setNumThreads();
+        TOKENISER.setEmbeddingDimension(options.dim);
+        threads_used = TOKENISER.num_threads;
+
+        const std::vector<std::string> files = options.corpus.empty()
+            ? writeSyntheticCorpus(options.work + "/corpus", options.syntheticMb, options.seed)
+            : listFiles(options.corpus);
+        if (files.empty()) throw std::runtime_error("No corpus files found.");
+        uint64_t corpus_bytes = 0;
+        for (const auto& path : files) corpus_bytes += std::filesystem::file_size(path);
+
+        // 1. Corpus word counting
+        std::unordered_map<std::string, int> corpus_word_counts;
+        {
+            Result r{ "build_corpus_word_counts" };
+            const double seconds = bestOf(options.repeat, [&] { TOKENISER.buildCorpusWordCounts(files, corpus_word_counts); });
+            r.add("seconds", seconds);
+            r.add("bytes", static_cast<double>(corpus_bytes));
+            r.add("mb_per_second", perSecond(corpus_bytes / double(1 << 20), seconds));
+            r.add("unique_words", static_cast<double>(corpus_word_counts.size()));
+            results.push_back(r);
+        }
+
+        // 2. BPE training (each run starts again from the same counts)
+        {
+            Result r{ "group_common_tokens" };
+            std::vector<std::string> vocab;
+            const double seconds = bestOf(options.repeat, [&] { TOKENISER.groupCommonTokens(corpus_word_counts, options.merges, vocab); });
+            const double merges = static_cast<double>(TOKENISER.getMerges().size());
+            r.add("seconds", seconds);
+            r.add("merges", merges);
+            r.add("merges_per_second", perSecond(merges, seconds));
+            r.add("vocabulary_size", static_cast<double>(vocab.size()));
+            results.push_back(r);
+        }
+
+        // 3. Splitting and encoding (the first 16 MB of the corpus, word cache on)
+        const std::vector<std::string> lines = sampleLines(files, 16 << 20);
+        size_t line_bytes = 0;
+        for (const auto& line : lines) line_bytes += line.size() + 1;
+        {
+            std::vector<std::string> words, subwords;
+            // Up to a million (lower-cased, letters only) words of the sample lines for splitWord.
+            for (size_t l = 0; l < lines.size() && words.size() < 1000000; ++l) {
+                std::istringstream in(lines[l]);
+                std::string word;
+                while (in >> word) {
+                    word.erase(std::remove_if(word.begin(), word.end(), [](unsigned char c) { return !asciiIsAlpha(c); }), word.end());
+                    std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return static_cast<char>(c | 0x20); });
+                    if (!word.empty()) words.push_back(word);
+                }
+            }
+
+            Result split_word{ "split_word" };
+            size_t tokens = 0;
+            double seconds = bestOf(options.repeat, [&] {
+                tokens = 0;
+                for (const auto& word : words) { TOKENISER.splitWord(word, subwords); tokens += subwords.size(); }
+            });
+            split_word.add("seconds", seconds);
+            split_word.add("words", static_cast<double>(words.size()));
+            split_word.add("tokens_per_second", perSecond(static_cast<double>(tokens), seconds));
+            results.push_back(split_word);
+
+            Result split_sentence{ "split_sentence" };
+            seconds = bestOf(options.repeat, [&] {
+                tokens = 0;
+                for (const auto& line : lines) { TOKENISER.splitSentence(line, subwords); tokens += subwords.size(); }
+            });
+            split_sentence.add("seconds", seconds);
+            split_sentence.add("bytes", static_cast<double>(line_bytes));
+            split_sentence.add("tokens_per_second", perSecond(static_cast<double>(tokens), seconds));
+            results.push_back(split_sentence);
+        }
+        for (const EncoderMode mode : { EncoderMode::Greedy, EncoderMode::MergeRank }) {
+            Result r{ mode == EncoderMode::Greedy ? "encode_greedy" : "encode_merge_rank" };
+            TOKENISER.setEncoderMode(mode);
+            const std::vector<std::string_view> documents(lines.begin(), lines.end());
+            EncodedBatch batch;
+            TOKENISER.encode(documents, batch);          // warm the word cache
+            const double seconds = bestOf(options.repeat, [&] { TOKENISER.encode(documents, batch); });
+            r.add("seconds", seconds);
+            r.add("documents", static_cast<double>(documents.size()));
+            r.add("tokens_per_second", perSecond(static_cast<double>(batch.ids.size()), seconds));
+            r.add("mb_per_second", perSecond(line_bytes / double(1 << 20), seconds));
+            results.push_back(r);
+        }
+        TOKENISER.setEncoderMode(EncoderMode::Greedy);
+
+        // 4. Embedding generation (with inverses) on the compiled backend
+        {
+            Result r{ "embeddings" };
+            int d = options.dim;
+            int rows = static_cast<int>(TOKENISER.getTokens().size());
+            EmbeddingMatrix embeddings, inverses;
+            const double seconds = bestOf(options.repeat, [&] {
+            #ifdef USE_CUDA
+                TOKENISER.cuEmbeddingsWithInverse(embeddings, inverses, d, rows, 10.0f, DEFAULT_EMBEDDING_SEED);
+            #elif USE_OPENCL
+                TOKENISER.clEmbeddingsWithInverse(ocl, embeddings, inverses, d, rows, 10.0f, DEFAULT_EMBEDDING_SEED);
+            #else
+                generateEmbeddingsWithInverse(embeddings, inverses, rows, d, 10.0f, DEFAULT_EMBEDDING_SEED, &TOKENISER.getThreadPool());
+            #endif
+            });
+            r.add("backend", backendName());
+            r.add("seconds", seconds);
+            r.add("rows", static_cast<double>(rows));
+            r.add("dimension", static_cast<double>(d));
+            r.add("rows_per_second", perSecond(rows, seconds));
+            results.push_back(r);
+        }
+
+        // 5. Loading a trained model: CSV files (readFromFiles) and the binary model (loadModel)
+        {
+            const std::string model_dir = options.work + "/model";
+            std::filesystem::create_directories(model_dir);
+            TOKENISER.saveVocabulary(model_dir + "/_vocab.csv");
+            TOKENISER.saveMerges(model_dir + "/_merges.csv");
+            TOKENISER.calculateTokenStatsFromCounts(corpus_word_counts, model_dir + "/_final_token_stats.csv");
+            TOKENISER.generateAndSaveEmbeddings(model_dir, 10.0f);
+            TOKENISER.saveModel(model_dir + "/_model.bin");
+
+            // Every run loads into a new tokeniser with the same number of threads.
+            auto fresh_tokeniser = [&] {
+            #ifdef USE_OPENCL
+                tokeniser loaded(options.dim, ocl);
+            #elif USE_CUDA || USE_CPU
+                tokeniser loaded(options.dim);
+            #endif
+                loaded.setNumThreads(TOKENISER.num_threads);
+                return loaded;
+            };
+
+            Result csv{ "read_from_files" };
+            double seconds = bestOf(options.repeat, [&] {
+                tokeniser loaded = fresh_tokeniser();
+                loaded.readFromFiles(model_dir);
+            });
+            csv.add("seconds", seconds);
+            csv.add("bytes", static_cast<double>(std::filesystem::file_size(model_dir + "/_embeddings_only.csv")
+                                                 + std::filesystem::file_size(model_dir + "/_vocab.csv")));
+            results.push_back(csv);
+
+            Result binary{ "load_model" };
+            seconds = bestOf(options.repeat, [&] {
+                tokeniser loaded = fresh_tokeniser();
+                loaded.loadModel(model_dir + "/_model.bin");
+            });
+            binary.add("seconds", seconds);
+            binary.add("bytes", static_cast<double>(std::filesystem::file_size(model_dir + "/_model.bin")));
+            results.push_back(binary);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout.rdbuf(console);
+        std::cerr << "\nFATAL ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout.rdbuf(console);
+
+    std::ostringstream json;
+    json << "{\n  \"tool\": \"tokeniser_bench\",\n  \"backend\": \"" << backendName() << "\",\n"
+         << "  \"corpus\": \"" << (options.corpus.empty() ? "synthetic" : jsonEscape(options.corpus)) << "\",\n"
+         << "  \"synthetic_mb\": " << (options.corpus.empty() ? options.syntheticMb : 0) << ",\n"
+         << "  \"seed\": " << options.seed << ",\n  \"merges\": " << options.merges << ",\n"
+         << "  \"threads\": " << threads_used << ",\n  \"dimension\": " << options.dim << ",\n"
+         << "  \"repeat\": " << options.repeat << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        json << "    { \"name\": \"" << results[i].name << "\"";
+        for (const Metric& m : results[i].metrics) json << ", \"" << m.key << "\": " << m.value;
+        json << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    if (options.json.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream out(options.json);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Error: Could not write " << options.json << std::endl;
+            return 1;
+        }
+        std::cerr << "-> Wrote benchmark results to: " << options.json << std::endl;
+    }
+    return 0;
+}